@@ -0,0 +1,123 @@
+#ifndef UMAPPP_EMBEDDING_SNAPSHOT_HPP
+#define UMAPPP_EMBEDDING_SNAPSHOT_HPP
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cstddef>
+
+#include "sanisizer/sanisizer.hpp"
+
+/**
+ * @file EmbeddingSnapshot.hpp
+ * @brief Snapshots of the embedding during the optimization.
+ */
+
+namespace umappp {
+
+/**
+ * @brief Snapshots of the embedding that can be read while the optimization runs in another thread.
+ *
+ * @tparam Float_ Floating-point type of the embedding.
+ *
+ * This is intended for monitoring an optimization that runs in the background, e.g., to stream intermediate layouts to a viewer.
+ * `Status::run()` publishes a copy of the embedding at the start of every `interval()`-th epoch and at the end of the run,
+ * and `read()` can be called from another thread at any time to obtain the most recently published snapshot.
+ *
+ * This uses triple buffering, i.e., one buffer for the optimizer to write to, one for the reader to read from, and one holding the latest snapshot that has not yet been read.
+ * The buffers are swapped with a single atomic exchange, so neither the optimizer nor the reader ever waits for the other.
+ * The cost to the reader is a single copy of the embedding, and the cost to the optimizer is a single copy per published epoch, performed between epochs when no other threads are modifying the embedding.
+ * The memory usage is equal to three copies of the embedding.
+ *
+ * Only one thread should call `read()` at any given time, and only one call to `Status::run()` should use this object at any given time.
+ */
+template<typename Float_>
+class EmbeddingSnapshot {
+public:
+    /**
+     * @param num_obs Number of observations.
+     * @param num_dim Number of dimensions of the embedding.
+     * @param interval Interval between epochs at which snapshots are published.
+     * Larger values reduce the cost to the optimizer for large embeddings.
+     */
+    EmbeddingSnapshot(const std::size_t num_obs, const std::size_t num_dim, const int interval = 1) :
+        my_size(sanisizer::product<std::size_t>(num_obs, num_dim)),
+        my_interval(std::max(interval, 1))
+    {
+        for (auto& buffer : my_buffers) {
+            buffer.resize(my_size);
+        }
+    }
+
+private:
+    std::size_t my_size;
+    int my_interval;
+
+    std::vector<Float_> my_buffers[3];
+    int my_epochs[3] = { -1, -1, -1 };
+
+    // Index of the buffer holding the latest snapshot, along with a flag
+    // indicating whether it was published after the last read().
+    static constexpr unsigned char fresh_flag = 4;
+    std::atomic<unsigned char> my_latest = 1;
+
+    // Only accessed by the writer and reader, respectively.
+    unsigned char my_writing = 0;
+    unsigned char my_reading = 2;
+
+public:
+    /**
+     * @return Interval between epochs at which snapshots are published.
+     */
+    int interval() const {
+        return my_interval;
+    }
+
+    /**
+     * @return Whether a snapshot has been published since the last call to `read()`.
+     */
+    bool has_new() const {
+        return my_latest.load(std::memory_order_relaxed) & fresh_flag;
+    }
+
+    /**
+     * Copy the most recently published snapshot.
+     * If no new snapshot has been published since the last call, the same snapshot is copied again.
+     *
+     * @param[out] embedding Pointer to an array of length equal to the product of the number of observations and dimensions,
+     * in the same layout as the embedding in `Status::run()`.
+     * On output, this contains the coordinates of the snapshot.
+     * This is not modified if no snapshot has been published yet.
+     *
+     * @return The epoch of the snapshot, i.e., the number of epochs that had been performed when it was taken.
+     * This is -1 if no snapshot has been published yet.
+     */
+    int read(Float_* const embedding) {
+        if (has_new()) {
+            my_reading = my_latest.exchange(my_reading, std::memory_order_acq_rel) & ~fresh_flag;
+        }
+        const int epoch = my_epochs[my_reading];
+        if (epoch >= 0) {
+            std::copy_n(my_buffers[my_reading].data(), my_size, embedding);
+        }
+        return epoch;
+    }
+
+    /**
+     * @cond
+     */
+    // Called by Status::run() between epochs, see interval().
+    template<typename Coord_>
+    void publish(const Coord_* const embedding, const int epoch) {
+        std::copy_n(embedding, my_size, my_buffers[my_writing].data());
+        my_epochs[my_writing] = epoch;
+        my_writing = my_latest.exchange(my_writing | fresh_flag, std::memory_order_acq_rel) & ~fresh_flag;
+    }
+    /**
+     * @endcond
+     */
+};
+
+}
+
+#endif
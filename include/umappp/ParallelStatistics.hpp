@@ -0,0 +1,65 @@
+#ifndef UMAPPP_PARALLEL_STATISTICS_HPP
+#define UMAPPP_PARALLEL_STATISTICS_HPP
+
+#include <cstddef>
+
+/**
+ * @file ParallelStatistics.hpp
+ * @brief Diagnostics for parallel layout optimization.
+ */
+
+namespace umappp {
+
+/**
+ * @brief Statistics for the parallel layout optimization in `Status::run()`.
+ *
+ * The parallel optimizer processes observations in "rounds".
+ * In each round, observations are dispatched to threads until the next observation conflicts with the in-flight work,
+ * i.e., its neighbors or negative samples overlap with those of an observation that is currently being processed by another thread.
+ * At that point, the main thread waits for all in-flight work to complete before starting the next round.
+ * These statistics can be used to determine whether the requested number of threads is actually being used for a given dataset.
+ */
+struct ParallelStatistics {
+    /**
+     * Number of observations that were dispatched to a thread, summed across all epochs.
+     */
+    std::size_t num_dispatched = 0;
+
+    /**
+     * Number of rounds, summed across all epochs.
+     */
+    std::size_t num_rounds = 0;
+
+    /**
+     * Number of times that an observation was found to conflict with the in-flight work.
+     * An observation may be counted multiple times if it was deferred by `Options::optimize_lookahead` and conflicted again in the next round.
+     */
+    std::size_t num_conflicts = 0;
+
+    /**
+     * Number of times that a conflicting observation was deferred to allow subsequent observations to be dispatched, see `Options::optimize_lookahead`.
+     */
+    std::size_t num_deferred = 0;
+
+    /**
+     * Time spent by the main thread in the serial planning section, in seconds.
+     * This includes sampling of negative observations and conflict detection, but not the time spent waiting for other threads or processing observations on the main thread.
+     * This is only recorded if `Options::optimize_time_planning = true`, otherwise it is always zero.
+     */
+    double planning_time = 0;
+
+    /**
+     * @return Average number of observations processed in parallel in each round.
+     * Values close to `Options::num_threads_optimize` indicate that all threads are being used effectively.
+     */
+    double average_width() const {
+        if (num_rounds == 0) {
+            return 0;
+        }
+        return static_cast<double>(num_dispatched) / static_cast<double>(num_rounds);
+    }
+};
+
+}
+
+#endif
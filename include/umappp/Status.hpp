@@ -2,11 +2,39 @@
 #define UMAPPP_STATUS_HPP
 
 #include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <memory_resource>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <chrono>
+#include <stdexcept>
+#include <future>
+#include <memory>
+#include <exception>
+#include <utility>
 
 #include "sanisizer/sanisizer.hpp"
 
 #include "Options.hpp"
+#include "ParallelStatistics.hpp"
+#include "StopCondition.hpp"
+#include "ThreadSelection.hpp"
 #include "optimize_layout.hpp"
+#include "optimize_layout_batched.hpp"
+#include "optimize_layout_barnes_hut.hpp"
+#include "optimize_layout_minibatch.hpp"
+#include "optimize_layout_accumulated.hpp"
+#include "early_stop.hpp"
+#include "choose_num_threads.hpp"
+#include "thread_affinity.hpp"
+#include "parallelize.hpp"
+#include "update_graph.hpp"
+#include "optimize_layout_subset.hpp"
+#include "float16.hpp"
+#include "rng.hpp"
+#include "EmbeddingSnapshot.hpp"
 
 /**
  * @file Status.hpp
@@ -19,21 +47,32 @@ namespace umappp {
  * @brief Status of the UMAP optimization iterations.
  * @tparam Index_ Integer type of the neighbor indices.
  * @tparam Float_ Floating-point type of the distances.
+ * @tparam Engine_ Random number generator used to sample negative observations during optimization.
+ * This should satisfy the *UniformRandomBitGenerator* requirements and be constructible from `Options::optimize_seed`.
+ * `Xoshiro256StarStar` is a faster alternative to the default `RngEngine`.
  *
  * Instances of this class should not be constructed directly, but instead returned by `initialize()`.
  */
-template<typename Index_, typename Float_>
+template<typename Index_, typename Float_, class Engine_ = RngEngine>
 class Status {
 public:
     /**
      * @cond
      */
-    Status(EpochData<Index_, Float_> epochs, Options options, const std::size_t num_dim) :
+    Status(EpochData<Index_, Float_> epochs, Options options, const std::size_t num_dim, std::optional<UpdatableGraph<Index_, Float_> > updatable = std::nullopt) :
         my_epochs(std::move(epochs)),
         my_options(std::move(options)),
         my_engine(my_options.optimize_seed),
-        my_num_dim(num_dim)
-    {}
+        my_num_dim(num_dim),
+        my_workspace(memory_resource()),
+        my_single_workspace(memory_resource()),
+        my_half_workspace(memory_resource()),
+        my_barnes_hut_workspace(my_num_dim, memory_resource()),
+        my_single_barnes_hut_workspace(my_num_dim, memory_resource()),
+        my_updatable(std::move(updatable))
+    {
+        reset_early_stop();
+    }
     /**
      * @endcond
      */
@@ -41,8 +80,59 @@ public:
 private:
     EpochData<Index_, Float_> my_epochs;
     Options my_options;
-    RngEngine my_engine;
+    Engine_ my_engine;
     std::size_t my_num_dim;
+    ParallelStatistics my_parallel_statistics;
+    ThreadSelection my_thread_selection;
+    std::optional<EarlyStopMonitor<Index_, Float_> > my_early_stop;
+    UninitializedVector<float> my_single_embedding;
+    UninitializedVector<Float16> my_half_embedding;
+    bool my_working_current = false; // whether the working array is more recent than the embedding, see sync_working().
+    OptimizeWorkspace<Index_, Float_, Float_> my_workspace;
+    OptimizeWorkspace<Index_, float, float> my_single_workspace;
+    OptimizeWorkspace<Index_, float, Float16> my_half_workspace;
+    BarnesHutWorkspace<Index_, Float_> my_barnes_hut_workspace;
+    BarnesHutWorkspace<Index_, float> my_single_barnes_hut_workspace; // shared by SINGLE and HALF, as both compute in float.
+    std::optional<UpdatableGraph<Index_, Float_> > my_updatable;
+    std::uint64_t my_num_updates = 0;
+
+    std::pmr::memory_resource* memory_resource() const {
+        return (my_options.optimize_memory_resource == NULL ? std::pmr::get_default_resource() : my_options.optimize_memory_resource);
+    }
+
+    // Choosing the workspace for the precision of the optimization, see run_internal().
+    template<typename Compute_, typename Coord_>
+    OptimizeWorkspace<Index_, Compute_, Coord_>& workspace() {
+        if constexpr(std::is_same<Coord_, Float16>::value) {
+            return my_half_workspace;
+        } else if constexpr(std::is_same<Coord_, Float_>::value) {
+            return my_workspace;
+        } else {
+            return my_single_workspace;
+        }
+    }
+
+    template<typename Compute_>
+    BarnesHutWorkspace<Index_, Compute_>& barnes_hut_workspace() {
+        if constexpr(std::is_same<Compute_, Float_>::value) {
+            return my_barnes_hut_workspace;
+        } else {
+            return my_single_barnes_hut_workspace;
+        }
+    }
+
+    void reset_early_stop() {
+        if (my_options.early_stop_tolerance > 0) {
+            my_early_stop.emplace(
+                num_observations(),
+                my_num_dim,
+                my_options.early_stop_num_samples,
+                my_options.early_stop_tolerance,
+                my_options.early_stop_patience,
+                memory_resource()
+            );
+        }
+    }
 
 public:
     /**
@@ -83,24 +173,214 @@ public:
      * @return The number of observations in the dataset.
      */
     Index_ num_observations() const {
-        return my_epochs.cumulative_num_edges.size() - 1;
+        return my_epochs.graph->cumulative_num_edges.size() - 1;
     }
 
-public:
-    /** 
-     * The status of the algorithm and the coordinates in `embedding()` are updated to the specified number of epochs. 
-     *
-     * @param[in, out] embedding Pointer to an array containing a column-major matrix where rows are dimensions and columns are observations.
-     * On input, this should contain the embeddings at the current epoch (`epoch()`),
-     * and on output, this should contain the embedding at `epoch_limit`.
-     * Typically, this should be the same array that was used in `initialize()`.
-     * @param epoch_limit Number of epochs to run to.
-     * The actual number of epochs performed is equal to the difference between `epoch_limit` and `epoch()`.
-     * `epoch_limit` should be not less than `epoch()` and be no greater than the maximum number of epochs specified in `num_epochs()`.
+    /**
+     * @return Whether the optimization has converged according to the early stopping criteria, see `Options::early_stop_tolerance`.
+     * If true, `epoch()` is the epoch at which convergence was detected, and further calls to `run()` will not perform any more epochs.
      */
-    void run(Float_* const embedding, int epoch_limit) {
-        if (my_options.num_threads_optimize == 1) {
-            optimize_layout<Index_, Float_>(
+    bool converged() const {
+        return my_early_stop.has_value() && my_early_stop->converged();
+    }
+
+    /**
+     * @return Statistics for the parallel optimization in the most recent call to `run()`.
+     * All statistics are zero if `run()` has not yet been called, if `Options::num_threads_optimize = 1` and `Options::optimize_scheduler = OptimizeScheduler::GREEDY`,
+     * or if `Options::optimize_repulsion = OptimizeRepulsion::BARNES_HUT`, or if `Options::optimize_method` is not `OptimizeMethod::SGD`.
+     * For `OptimizeScheduler::COLORING`, each batch is reported as a round and no conflicts are reported.
+     * For `OptimizeScheduler::MINIBATCH`, each minibatch is reported as a round and each edge update is reported as a dispatched observation.
+     */
+    const ParallelStatistics& parallel_statistics() const {
+        return my_parallel_statistics;
+    }
+
+    /**
+     * @return Automatic choice of the number of threads for optimization.
+     * This is only filled if `Options::optimize_choose_threads = true` and `run()` has been called,
+     * after which all calls to `run()` will use the chosen number of threads.
+     */
+    const ThreadSelection& thread_selection() const {
+        return my_thread_selection;
+    }
+
+    /**
+     * @return Memory currently held by this object in bytes,
+     * i.e., the graph and sampling schedule for the optimization epochs along with any scratch buffers, optimizer state and copies of the neighbors for `update()`.
+     * This is computed from the capacity of each allocation and does not include any overhead from the memory allocator.
+     * The epoch graph is counted in full even if it is shared with other `Status` objects.
+     * Scratch buffers are allocated on the first call to `run()`, so the memory usage may increase after that call;
+     * this can be compared to `ResourceEstimate::epoch_data` from `estimate_resources()`.
+     */
+    std::size_t memory_usage() const {
+        std::size_t output = 0;
+
+        if (my_epochs.graph) {
+            const auto& graph = *(my_epochs.graph);
+            output += sizeof(graph);
+            output += umappp::memory_usage(graph.cumulative_num_edges) + umappp::memory_usage(graph.edge_targets) + umappp::memory_usage(graph.epochs_per_sample);
+            output += umappp::memory_usage(graph.batch_pointers) + umappp::memory_usage(graph.batch_observations);
+            output += umappp::memory_usage(graph.edge_alias);
+            for (const auto& table : graph.edge_alias) {
+                output += umappp::memory_usage(table.probability) + umappp::memory_usage(table.alias) + umappp::memory_usage(table.sources) + umappp::memory_usage(table.edges);
+            }
+        }
+        output += umappp::memory_usage(my_epochs.epoch_of_next_sample) + umappp::memory_usage(my_epochs.epoch_of_next_negative_sample) + umappp::memory_usage(my_epochs.optimizer_state);
+
+        output += umappp::memory_usage(my_single_embedding) + umappp::memory_usage(my_half_embedding);
+        output += my_workspace.memory_usage() + my_single_workspace.memory_usage() + my_half_workspace.memory_usage();
+        output += my_barnes_hut_workspace.memory_usage() + my_single_barnes_hut_workspace.memory_usage();
+        if (my_early_stop.has_value()) {
+            output += my_early_stop->memory_usage();
+        }
+
+        if (my_updatable.has_value()) {
+            output += umappp::memory_usage(my_updatable->neighbors) + umappp::memory_usage(my_updatable->similarities) + umappp::memory_usage(my_updatable->reverse);
+        }
+
+        return output;
+    }
+
+private:
+    template<typename Compute_, typename Coord_, class Stop_, class Observe_>
+    void optimize(Coord_* const embedding, const int epoch_limit, Stop_ user_stop, Observe_ observe) {
+        // All optimizers call stop() exactly once at the start of each epoch,
+        // when no other threads are modifying the embedding; so we can use it
+        // to count the epochs and pass the embedding to the observer. The
+        // learning rate is computed in the same manner as the optimizers.
+        int epoch = my_epochs.current_epoch;
+        const Compute_ initial_alpha = my_options.learning_rate;
+
+        // User-specified conditions are checked first so that the early stopping
+        // state is not advanced for an epoch that will be repeated in the next call.
+        const auto stop = [&]() -> bool {
+            const Compute_ current = epoch;
+            const Compute_ alpha = initial_alpha * (1.0 - current / my_epochs.total_epochs);
+            observe(static_cast<const Coord_*>(embedding), epoch, alpha);
+            ++epoch;
+            if (user_stop()) {
+                return true;
+            }
+            if (my_early_stop.has_value()) {
+                return my_early_stop->check(embedding);
+            }
+            return false;
+        };
+
+        if (my_options.optimize_repulsion == OptimizeRepulsion::BARNES_HUT) {
+            optimize_layout_barnes_hut<Index_, Compute_>(
+                my_num_dim,
+                embedding,
+                my_epochs,
+                *(my_options.a),
+                *(my_options.b),
+                my_options.repulsion_strength,
+                my_options.learning_rate,
+                my_options.optimize_barnes_hut_theta,
+                epoch_limit,
+                my_options.num_threads_optimize,
+                stop,
+                my_options.optimize_pin_threads,
+                &(barnes_hut_workspace<Compute_>())
+            );
+        } else if (my_options.optimize_method == OptimizeMethod::MOMENTUM) {
+            optimize_layout_accumulated<Index_, Compute_>(
+                my_num_dim,
+                embedding,
+                my_epochs,
+                *(my_options.a),
+                *(my_options.b),
+                my_options.repulsion_strength,
+                my_options.learning_rate,
+                [&](int) -> MomentumUpdate<Compute_> {
+                    return MomentumUpdate<Compute_>(my_options.optimize_beta1);
+                },
+                my_options.optimize_seed,
+                epoch_limit,
+                my_options.num_threads_optimize,
+                stop,
+                my_options.optimize_pin_threads,
+                &(workspace<Compute_, Coord_>())
+            );
+        } else if (my_options.optimize_method == OptimizeMethod::ADAM) {
+            optimize_layout_accumulated<Index_, Compute_>(
+                my_num_dim,
+                embedding,
+                my_epochs,
+                *(my_options.a),
+                *(my_options.b),
+                my_options.repulsion_strength,
+                my_options.learning_rate,
+                [&](const int epoch) -> AdamUpdate<Compute_> {
+                    return AdamUpdate<Compute_>(my_options.optimize_beta1, my_options.optimize_beta2, my_options.optimize_adam_epsilon, epoch);
+                },
+                my_options.optimize_seed,
+                epoch_limit,
+                my_options.num_threads_optimize,
+                stop,
+                my_options.optimize_pin_threads,
+                &(workspace<Compute_, Coord_>())
+            );
+        } else if (my_options.optimize_scheduler == OptimizeScheduler::MINIBATCH) {
+            const auto total_updates = (
+                my_options.optimize_minibatch_updates.has_value() ?
+                *(my_options.optimize_minibatch_updates) :
+                default_minibatch_updates(*(my_epochs.graph), my_epochs.total_epochs)
+            );
+            optimize_layout_minibatch<Index_, Compute_>(
+                my_num_dim,
+                embedding,
+                my_epochs,
+                *(my_options.a),
+                *(my_options.b),
+                my_options.repulsion_strength,
+                my_options.learning_rate,
+                my_options.optimize_seed,
+                total_updates,
+                my_options.optimize_minibatch_size,
+                epoch_limit,
+                my_options.num_threads_optimize,
+                my_options.optimize_spin_limit,
+                my_parallel_statistics,
+                stop,
+                my_options.optimize_pin_threads,
+                &(workspace<Compute_, Coord_>())
+            );
+        } else if (my_options.optimize_scheduler == OptimizeScheduler::COLORING) {
+            optimize_layout_batched<Index_, Compute_>(
+                my_num_dim,
+                embedding,
+                my_epochs,
+                *(my_options.a),
+                *(my_options.b),
+                my_options.repulsion_strength,
+                my_options.learning_rate,
+                my_options.optimize_seed,
+                epoch_limit,
+                my_options.num_threads_optimize,
+                my_options.optimize_spin_limit,
+                my_parallel_statistics,
+                stop,
+                my_options.optimize_pin_threads,
+                &(workspace<Compute_, Coord_>())
+            );
+        } else if (my_options.num_threads_optimize == 1 && my_options.optimize_buffer_negative_samples) {
+            optimize_layout_buffered<Index_, Compute_>(
+                my_num_dim,
+                embedding,
+                my_epochs,
+                *(my_options.a),
+                *(my_options.b),
+                my_options.repulsion_strength,
+                my_options.learning_rate,
+                my_engine,
+                epoch_limit,
+                my_options.optimize_prefetch_distance,
+                stop,
+                &(workspace<Compute_, Coord_>())
+            );
+        } else if (my_options.num_threads_optimize == 1) {
+            optimize_layout<Index_, Compute_>(
                 my_num_dim,
                 embedding,
                 my_epochs,
@@ -109,10 +389,12 @@ public:
                 my_options.repulsion_strength,
                 my_options.learning_rate,
                 my_engine,
-                epoch_limit
+                epoch_limit,
+                my_options.optimize_prefetch_distance,
+                stop
             );
         } else {
-            optimize_layout_parallel<Index_, Float_>(
+            optimize_layout_parallel<Index_, Compute_>(
                 my_num_dim,
                 embedding,
                 my_epochs,
@@ -122,11 +404,154 @@ public:
                 my_options.learning_rate,
                 my_engine,
                 epoch_limit,
-                my_options.num_threads_optimize
+                my_options.num_threads_optimize,
+                my_options.optimize_lookahead,
+                my_options.optimize_spin_limit,
+                my_parallel_statistics,
+                my_options.optimize_time_planning,
+                stop,
+                my_options.optimize_pin_threads,
+                &(workspace<Compute_, Coord_>())
             );
         }
     }
 
+    void choose_threads(const Float_* const embedding, const int epoch_limit) {
+        int max_threads = std::max(my_options.num_threads_optimize, 1);
+#ifdef UMAPPP_NO_PARALLEL_OPTIMIZATION
+        max_threads = 1;
+#endif
+
+        const auto& graph = *(my_epochs.graph);
+        auto model = default_thread_cost_model(my_options);
+        auto predicted = predict_thread_times(graph, my_epochs.negative_sample_rate, my_options, model, max_threads);
+
+        // Timing a single epoch on copies of the status and embedding, so that the actual optimization is not affected.
+        if (my_options.optimize_calibrate_threads && max_threads > 1 && my_epochs.current_epoch < epoch_limit) {
+            const auto ntotal = sanisizer::product<std::size_t>(num_observations(), my_num_dim);
+            const auto time_epoch = [&](const int nthreads) -> double {
+                Status copy(*this);
+                copy.my_options.optimize_choose_threads = false;
+                copy.my_options.num_threads_optimize = nthreads;
+                copy.my_early_stop.reset();
+                std::vector<Float_> scratch(embedding, embedding + ntotal);
+                const auto start = std::chrono::steady_clock::now();
+                copy.run_internal(scratch.data(), copy.my_epochs.current_epoch + 1, NeverStop());
+                return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            };
+
+            const double single = time_epoch(1);
+            const double multiple = time_epoch(max_threads);
+            if (single > 0) {
+                calibrate_thread_cost_model(model, multiple / single, predicted.back());
+                predicted = predict_thread_times(graph, my_epochs.negative_sample_rate, my_options, model, max_threads);
+                my_thread_selection.calibrated = true;
+            }
+        }
+
+        my_thread_selection.num_threads = choose_from_thread_times(predicted, my_options.optimize_thread_objective, my_options.optimize_thread_efficiency);
+        my_thread_selection.predicted_time = std::move(predicted);
+        my_options.num_threads_optimize = my_thread_selection.num_threads;
+    }
+
+    // If 'defer_copy = true', the working array for reduced precision is not
+    // copied back to 'embedding' and is instead used as the starting point of
+    // the next call, see sync_working(). This is only safe if the embedding
+    // cannot be accessed between calls, e.g., within run_async().
+    template<class Stop_, class Observe_ = NeverObserve>
+    void run_internal(Float_* const embedding, const int epoch_limit, Stop_ user_stop, Observe_ observe = Observe_(), const bool defer_copy = false) {
+        my_parallel_statistics = ParallelStatistics();
+        if (converged()) {
+            return;
+        }
+
+        if (my_options.optimize_choose_threads && my_thread_selection.num_threads == 0) {
+            choose_threads(embedding, epoch_limit);
+        }
+
+        // We refill the working array from the embedding in each call, so that
+        // any user modifications between calls are respected. This does not
+        // affect the result of an uninterrupted run as the round trip from the
+        // working precision to Float_ and back is exact. The exception is when
+        // the working array is more recent than the embedding after a call
+        // with 'defer_copy = true', in which case we continue from the former.
+        const auto run_working = [&](auto& working) -> void {
+            const auto ntotal = sanisizer::product<std::size_t>(num_observations(), my_num_dim);
+            if (!my_working_current) {
+                working.resize(ntotal);
+
+                const int nthreads = my_options.num_threads_optimize;
+                if (my_options.optimize_pin_threads && nthreads > 1) {
+                    // Each pinned thread copies its own subset of observations, so that the
+                    // working array is first touched on the same NUMA node as the optimization.
+                    const auto cpus = available_cpus(true);
+                    parallelize(nthreads, nthreads, [&](const int t, const int start, const int length) -> void {
+                        ThreadPin pin(cpus, t);
+                        for (int p = start, end = start + length; p < end; ++p) {
+                            const auto range = split_range<std::size_t>(0, num_observations(), p, nthreads);
+                            const auto offset = sanisizer::product_unsafe<std::size_t>(range.first, my_num_dim);
+                            std::copy_n(embedding + offset, sanisizer::product_unsafe<std::size_t>(range.second, my_num_dim), working.data() + offset);
+                        }
+                    });
+                } else {
+                    std::copy_n(embedding, ntotal, working.data());
+                }
+            }
+
+            optimize<float>(working.data(), epoch_limit, std::move(user_stop), std::move(observe));
+            my_working_current = defer_copy;
+            if (!defer_copy) {
+                std::copy_n(working.data(), ntotal, embedding);
+            }
+        };
+
+        if (my_options.optimize_precision == OptimizePrecision::HALF) {
+            run_working(my_half_embedding);
+            return;
+        }
+
+        if constexpr(!std::is_same<Float_, float>::value) {
+            if (my_options.optimize_precision == OptimizePrecision::SINGLE) {
+                run_working(my_single_embedding);
+                return;
+            }
+        }
+
+        optimize<Float_>(embedding, epoch_limit, std::move(user_stop), std::move(observe));
+    }
+
+    // Copying the working array back to the embedding after run_internal() with 'defer_copy = true'.
+    void sync_working(Float_* const embedding) {
+        if (!my_working_current) {
+            return;
+        }
+        const auto ntotal = sanisizer::product_unsafe<std::size_t>(num_observations(), my_num_dim);
+        if (my_options.optimize_precision == OptimizePrecision::HALF) {
+            std::copy_n(my_half_embedding.data(), ntotal, embedding);
+        } else {
+            std::copy_n(my_single_embedding.data(), ntotal, embedding);
+        }
+        my_working_current = false;
+    }
+
+public:
+    /** 
+     * The status of the algorithm and the coordinates in `embedding()` are updated to the specified number of epochs. 
+     *
+     * @param[in, out] embedding Pointer to an array containing a column-major matrix where rows are dimensions and columns are observations.
+     * On input, this should contain the embeddings at the current epoch (`epoch()`),
+     * and on output, this should contain the embedding at `epoch_limit`.
+     * Typically, this should be the same array that was used in `initialize()`.
+     * @param epoch_limit Number of epochs to run to.
+     * The actual number of epochs performed is equal to the difference between `epoch_limit` and `epoch()`.
+     * `epoch_limit` should be not less than `epoch()` and be no greater than the maximum number of epochs specified in `num_epochs()`.
+     *
+     * If early stopping is enabled via `Options::early_stop_tolerance`, fewer epochs may be performed, see `converged()`.
+     */
+    void run(Float_* const embedding, int epoch_limit) {
+        run_internal(embedding, epoch_limit, NeverStop());
+    }
+
     /** 
      * The status of the algorithm and the coordinates in `embedding()` are updated after completing `num_epochs()`.
      *
@@ -134,10 +559,386 @@ public:
      * On input, this should contain the embeddings at the current epoch (`epoch()`),
      * and on output, this should contain the embedding at `num_epochs()`.
      * Typically, this should be the same array that was used in `initialize()`.
+     *
+     * If early stopping is enabled via `Options::early_stop_tolerance`, fewer epochs may be performed, see `converged()`.
      */
     void run(Float_* const embedding) {
         run(embedding, my_epochs.total_epochs);
     }
+
+    /** 
+     * The status of the algorithm and the coordinates in `embedding()` are updated to the specified number of epochs,
+     * or until any of the conditions in `stop` are satisfied.
+     *
+     * @param[in, out] embedding Pointer to an array containing a column-major matrix where rows are dimensions and columns are observations.
+     * On input, this should contain the embeddings at the current epoch (`epoch()`),
+     * and on output, this should contain the embedding at the returned epoch.
+     * Typically, this should be the same array that was used in `initialize()`.
+     * @param epoch_limit Number of epochs to run to.
+     * This should be not less than `epoch()` and be no greater than the maximum number of epochs specified in `num_epochs()`.
+     * @param stop Conditions for stopping the optimization early.
+     *
+     * @return The epoch that was reached, i.e., the new value of `epoch()`.
+     * This is less than `epoch_limit` if the optimization was stopped early by `stop`, in which case `run()` can be called again to continue from this epoch;
+     * or if the optimization has `converged()`.
+     */
+    int run(Float_* const embedding, int epoch_limit, const StopCondition& stop) {
+        run_internal(embedding, epoch_limit, [&]() -> bool { return stop(); });
+        return my_epochs.current_epoch;
+    }
+
+    /** 
+     * The status of the algorithm and the coordinates in `embedding()` are updated after completing `num_epochs()`,
+     * or until any of the conditions in `stop` are satisfied.
+     *
+     * @param[in, out] embedding Pointer to an array containing a column-major matrix where rows are dimensions and columns are observations.
+     * On input, this should contain the embeddings at the current epoch (`epoch()`),
+     * and on output, this should contain the embedding at the returned epoch.
+     * Typically, this should be the same array that was used in `initialize()`.
+     * @param stop Conditions for stopping the optimization early.
+     *
+     * @return The epoch that was reached, i.e., the new value of `epoch()`.
+     * This is less than `num_epochs()` if the optimization was stopped early by `stop`, in which case `run()` can be called again to continue from this epoch;
+     * or if the optimization has `converged()`.
+     */
+    int run(Float_* const embedding, const StopCondition& stop) {
+        return run(embedding, my_epochs.total_epochs, stop);
+    }
+
+    /** 
+     * The status of the algorithm and the coordinates in `embedding()` are updated to the specified number of epochs,
+     * or until any of the conditions in `stop` are satisfied,
+     * while publishing snapshots of the embedding that can be read from another thread.
+     *
+     * This is intended to be called in a background thread, e.g., via `std::thread`,
+     * while another thread calls `EmbeddingSnapshot::read()` to obtain intermediate layouts without pausing the optimization.
+     * A snapshot is published at the start of each epoch that is a multiple of `EmbeddingSnapshot::interval()` and at the end of the run, i.e., at the returned epoch.
+     * The optimization can be cancelled from another thread via `StopCondition::cancel`.
+     * The final embedding is the same as that of the other `run()` overloads.
+     *
+     * @param[in, out] embedding Pointer to an array containing a column-major matrix where rows are dimensions and columns are observations.
+     * On input, this should contain the embeddings at the current epoch (`epoch()`),
+     * and on output, this should contain the embedding at the returned epoch.
+     * Typically, this should be the same array that was used in `initialize()`.
+     * This should not be accessed by other threads until this method returns.
+     * @param epoch_limit Number of epochs to run to.
+     * This should be not less than `epoch()` and be no greater than the maximum number of epochs specified in `num_epochs()`.
+     * @param stop Conditions for stopping the optimization early.
+     * @param snapshot Snapshots of the embedding, constructed with the same number of observations and dimensions as `embedding`.
+     *
+     * @return The epoch that was reached, i.e., the new value of `epoch()`.
+     */
+    int run(Float_* const embedding, const int epoch_limit, const StopCondition& stop, EmbeddingSnapshot<Float_>& snapshot) {
+        const int interval = snapshot.interval();
+        const int start = my_epochs.current_epoch;
+        int last_published = -1;
+
+        // Publishing the starting embedding directly, as the working array
+        // for reduced precision is rounded from the embedding at this point.
+        if (start % interval == 0) {
+            snapshot.publish(static_cast<const Float_*>(embedding), start);
+            last_published = start;
+        }
+
+        run_internal(
+            embedding,
+            epoch_limit,
+            [&]() -> bool { return stop(); },
+            [&](const auto* const coords, const int epoch, auto) -> void {
+                if (epoch != start && epoch % interval == 0) {
+                    snapshot.publish(coords, epoch);
+                    last_published = epoch;
+                }
+            }
+        );
+
+        if (last_published != my_epochs.current_epoch) {
+            snapshot.publish(static_cast<const Float_*>(embedding), my_epochs.current_epoch);
+        }
+        return my_epochs.current_epoch;
+    }
+
+    /** 
+     * The status of the algorithm and the coordinates in `embedding()` are updated to the specified number of epochs,
+     * or until any of the conditions in `stop` are satisfied,
+     * while calling `observer` at the start of each epoch and at the end of the run, e.g., to log progress or export animation frames.
+     *
+     * The observer is called with the index of the epoch (i.e., the number of epochs that have been performed), the learning rate for that epoch, and a `const Float_*` pointer to the current embedding.
+     * It is called from a single thread when no other threads are modifying the embedding, so the pointer can be safely used until the observer returns.
+     * For `Options::optimize_precision` other than `OptimizePrecision::NATIVE`, the embedding is converted from the working precision into a temporary array;
+     * at the first epoch of the run, this may differ from `embedding` due to rounding.
+     * No conversion is performed for `OptimizePrecision::SINGLE` if `Float_` is already `float`, as the embedding is then optimized in place.
+     * After the optimization finishes, the observer is called once more with the returned epoch and the final contents of `embedding`,
+     * unless that epoch was already observed (e.g., if the optimization was stopped at the start of an epoch by `stop`).
+     * Thus, when `run()` is called repeatedly, the epoch at the end of one call is observed again at the start of the next call.
+     * Unlike repeated calls to `run()` for one epoch at a time, this avoids the overhead of restarting the optimization (e.g., creating threads) in each epoch. 
+     * The final embedding is the same as that of the other `run()` overloads.
+     *
+     * @tparam Observer_ Function that accepts an `int` epoch, a `Float_` learning rate and a `const Float_*` pointer to the embedding.
+     * Any return value is ignored.
+     *
+     * @param[in, out] embedding Pointer to an array containing a column-major matrix where rows are dimensions and columns are observations.
+     * On input, this should contain the embeddings at the current epoch (`epoch()`),
+     * and on output, this should contain the embedding at the returned epoch.
+     * Typically, this should be the same array that was used in `initialize()`.
+     * @param epoch_limit Number of epochs to run to.
+     * This should be not less than `epoch()` and be no greater than the maximum number of epochs specified in `num_epochs()`.
+     * @param stop Conditions for stopping the optimization early.
+     * @param observer Function to observe the embedding at the start of each epoch and at the end of the run.
+     *
+     * @return The epoch that was reached, i.e., the new value of `epoch()`.
+     */
+    template<class Observer_>
+    int run(Float_* const embedding, const int epoch_limit, const StopCondition& stop, Observer_ observer) {
+        std::vector<Float_> converted;
+        int last_observed = -1;
+        run_internal(
+            embedding,
+            epoch_limit,
+            [&]() -> bool { return stop(); },
+            [&](const auto* const coords, const int epoch, const auto alpha) -> void {
+                last_observed = epoch;
+                if constexpr(std::is_same<I<decltype(*coords)>, Float_>::value) {
+                    observer(epoch, static_cast<Float_>(alpha), coords);
+                } else {
+                    const auto ntotal = sanisizer::product_unsafe<std::size_t>(num_observations(), my_num_dim);
+                    converted.resize(ntotal);
+                    std::copy_n(coords, ntotal, converted.data());
+                    observer(epoch, static_cast<Float_>(alpha), static_cast<const Float_*>(converted.data()));
+                }
+            }
+        );
+
+        // Observing the final embedding, which has already been copied back
+        // from the working array for reduced precision.
+        const int current = my_epochs.current_epoch;
+        if (last_observed != current) {
+            const Float_ alpha = my_options.learning_rate * (1.0 - static_cast<Float_>(current) / my_epochs.total_epochs);
+            observer(current, alpha, static_cast<const Float_*>(embedding));
+        }
+        return current;
+    }
+
+private:
+    // Each epoch visits every edge in the graph to check whether it is due
+    // for an update, so we use the number of edges as the cost of an epoch.
+    int step_limit(const std::size_t max_edges) const {
+        const std::size_t num_edges = std::max<std::size_t>(my_epochs.graph->edge_targets.size(), 1);
+        const std::size_t remaining = std::max(my_epochs.total_epochs - my_epochs.current_epoch, 0);
+        return my_epochs.current_epoch + static_cast<int>(std::min(std::max<std::size_t>(max_edges / num_edges, 1), remaining));
+    }
+
+    template<class Submit_>
+    struct AsyncRun {
+        AsyncRun(Status& status, Float_* const embedding, const std::size_t max_edges, Submit_ submit, StopCondition stop) :
+            status(status),
+            embedding(embedding),
+            max_edges(max_edges),
+            submit(std::move(submit)),
+            stop(std::move(stop))
+        {}
+
+        Status& status;
+        Float_* embedding;
+        std::size_t max_edges;
+        Submit_ submit;
+        StopCondition stop;
+        std::promise<int> promise;
+
+        // Each task performs a single step and then submits the next task, so
+        // only one task is ever in flight and the Status is never accessed
+        // by multiple threads at once.
+        static void resume(const std::shared_ptr<AsyncRun>& self) {
+            auto& status = self->status;
+            try {
+                // The working array for reduced precision is only copied back
+                // to the embedding at the end, as the embedding cannot be
+                // accessed by anyone else until the future is ready.
+                const int limit = status.step_limit(self->max_edges);
+                status.run_internal(self->embedding, limit, [&]() -> bool { return self->stop(); }, NeverObserve(), true);
+                const int reached = status.epoch();
+                if (reached < limit || reached >= status.num_epochs()) {
+                    status.sync_working(self->embedding);
+                    self->promise.set_value(reached);
+                } else {
+                    // 'self' is owned by the current task, so the state (and
+                    // thus 'submit') outlives this call even if the next task
+                    // finishes before it returns.
+                    self->submit([self]() -> void { resume(self); });
+                }
+            } catch (...) {
+                status.sync_working(self->embedding);
+                self->promise.set_exception(std::current_exception());
+            }
+        }
+    };
+
+public:
+    /**
+     * Advance the optimization by a bounded amount of work.
+     * This is intended for applications that multiplex many `Status` objects on a fixed pool of threads,
+     * where each call to `step()` should take roughly the same time regardless of the size of the dataset.
+     *
+     * As every epoch visits each edge of the fuzzy graph, the number of epochs performed is equal to `max_edges` divided by the number of edges, rounded down.
+     * At least one epoch is always performed unless the optimization is already complete.
+     * The optimization can only be interrupted at the start of each epoch, so a call may exceed `max_edges` for large graphs.
+     * The final embedding is the same as that of a single call to `run()`.
+     *
+     * The setup for each call is small compared to an epoch, so the cost of splitting the optimization into many steps is modest:
+     * - For `OptimizeScheduler::MINIBATCH`, the sampling table is computed once in `initialize()` and reused in each step.
+     * - For `OptimizeScheduler::COLORING` and `OptimizeScheduler::MINIBATCH`, the worker threads are created in the first step and retained by the `Status` until it is destroyed.
+     *   Idle workers are blocked and do not consume CPU time between steps.
+     *   For `OptimizeScheduler::GREEDY` with multiple threads, the busy-waiting threads are created in each step, which is another reason to use a single thread.
+     * - For `Options::optimize_precision` other than `OptimizePrecision::NATIVE`, the embedding is copied into the working array and back in each step.
+     *   This is avoided between the tasks of `run_async()`.
+     *   No copy is performed for `OptimizePrecision::SINGLE` if `Float_` is already `float`, as the embedding is then optimized in place.
+     * - All other buffers are retained from the previous step, see `Options::optimize_memory_resource`.
+     *
+     * @param[in, out] embedding Pointer to an array containing a column-major matrix where rows are dimensions and columns are observations.
+     * On input, this should contain the embeddings at the current epoch (`epoch()`),
+     * and on output, this should contain the embedding at the returned epoch.
+     * Typically, this should be the same array that was used in `initialize()`.
+     * @param max_edges Maximum number of edges to visit.
+     * @param stop Conditions for stopping the optimization early.
+     *
+     * @return The epoch that was reached, i.e., the new value of `epoch()`.
+     * The optimization is complete when this is equal to `num_epochs()` or if it has `converged()`.
+     */
+    int step(Float_* const embedding, const std::size_t max_edges, const StopCondition& stop = StopCondition()) {
+        return run(embedding, step_limit(max_edges), stop);
+    }
+
+    /**
+     * Run the optimization asynchronously as a series of `step()` calls, each of which is submitted as a separate task to a user-supplied executor.
+     * Each task submits the next task upon completion, so tasks from many `Status` objects can be interleaved fairly on a fixed pool of threads.
+     * This is useful for serving many concurrent requests without blocking a thread for each call to `run()`.
+     *
+     * The first task is submitted before this method returns, and the returned future is ready once the optimization is complete or is stopped by `stop`.
+     * Any exception thrown by the optimization is stored in the future.
+     * The `Status` and `embedding` should not be accessed until the future is ready, and the `Status` should not be destroyed beforehand.
+     * It is usually desirable to set `Options::num_threads_optimize = 1` in `initialize()` so that each task uses a single thread of the pool.
+     *
+     * @tparam Submit_ Function that accepts a single argument, a copyable function object with no arguments and a `void` return type (e.g., that can be stored in a `std::function<void()>`),
+     * and schedules it for execution, e.g., by posting it to a thread pool or an event loop.
+     * Successive tasks are always submitted after the previous task has finished, possibly from the thread that is running it.
+     * The executor should ensure that the execution of each task happens-after its submission, as is the case for any thread pool that uses a mutex-protected queue.
+     *
+     * @param[in, out] embedding Pointer to an array containing a column-major matrix where rows are dimensions and columns are observations, see `step()` for details.
+     * This should remain alive until the future is ready.
+     * @param max_edges Maximum number of edges to visit in each task, see `step()` for details.
+     * @param submit Function to submit each task.
+     * @param stop Conditions for stopping the optimization early, checked at the start of each epoch.
+     * For example, `StopCondition::cancel` can be used to cancel the optimization from the event loop.
+     *
+     * @return A future containing the epoch that was reached, i.e., the new value of `epoch()`.
+     * This is less than `num_epochs()` if the optimization was stopped early by `stop`, in which case `run_async()` or `run()` can be called again to continue from this epoch;
+     * or if the optimization has `converged()`.
+     */
+    template<class Submit_>
+    std::future<int> run_async(Float_* const embedding, const std::size_t max_edges, Submit_ submit, StopCondition stop = StopCondition()) {
+        auto state = std::make_shared<AsyncRun<Submit_> >(*this, embedding, max_edges, std::move(submit), std::move(stop));
+        auto output = state->promise.get_future();
+        state->submit([state]() -> void { AsyncRun<Submit_>::resume(state); });
+        return output;
+    }
+
+public:
+    /**
+     * Add and/or remove observations, updating the fuzzy graph and refining the embedding around the modified observations.
+     * This requires `Options::update_enabled = true` in `initialize()`.
+     *
+     * After the update, the retained observations are renumbered in their original order, followed by the added observations in the order of `added`.
+     * Only the added observations, the observations that had a removed observation as a neighbor, and their neighbors are affected by the update;
+     * the similarities and edges for all other observations are left unchanged.
+     * Each added observation is placed at the similarity-weighted average of its neighbors' coordinates.
+     * The affected observations are then refined for `Options::update_epochs` with `Options::update_learning_rate`, holding all other observations fixed.
+     * The random numbers for the placement and refinement are generated by `Engine_`,
+     * seeded from `Options::initialize_seed` and `Options::optimize_seed` respectively, combined with the number of previous calls to `update()`;
+     * this ensures that successive updates use different streams while the results remain reproducible.
+     *
+     * The current `epoch()` is unchanged.
+     * If the optimization is not yet complete, `run()` can be called afterwards to continue with the updated graph.
+     *
+     * Note that the nearest neighbors of the existing observations are not updated to include the added observations.
+     * The added observations will still be connected to their neighbors in the fuzzy graph, via the symmetrization of the neighbor lists.
+     *
+     * Each call rebuilds the edges of the entire epoch graph and re-prepares the `Options::optimize_scheduler`,
+     * so its cost is linear in the total number of observations and edges, even if only a few observations are added or removed.
+     * It is more efficient to batch many small modifications into a single call.
+     *
+     * @param[in] embedding Pointer to an array containing a column-major matrix where rows are dimensions and columns are observations.
+     * This should contain the embeddings at the current epoch for all `num_observations()` observations prior to the update.
+     * @param removed Indices of the observations to remove.
+     * Each index should be unique and less than `num_observations()`.
+     * @param added Nearest neighbors for each observation to add, see `initialize()` for details.
+     * Neighbor indices should refer to the renumbered observations after the update.
+     * @param[out] updated_embedding Pointer to an array of length equal to the product of `num_dimensions()` and the number of observations after the update.
+     * On output, this contains the updated embedding, which can be passed to `run()`.
+     * This may be the same as `embedding` if the array is long enough.
+     */
+    void update(const Float_* const embedding, const std::vector<Index_>& removed, NeighborList<Index_, Float_> added, Float_* const updated_embedding) {
+        if (!my_updatable.has_value()) {
+            throw std::runtime_error("updates require 'Options::update_enabled = true' in 'initialize()'");
+        }
+
+        const Index_ old_num_obs = num_observations();
+        const auto result = update_graph(*my_updatable, my_epochs, removed, std::move(added), my_options);
+        const Index_ num_retained = result.retained.size();
+
+        // Retained observations are never moved to a later position, so copying in order is safe when the arrays are the same.
+        for (Index_ n = 0; n < num_retained; ++n) {
+            const auto o = result.retained[n];
+            if (embedding != updated_embedding || o != n) {
+                std::copy_n(
+                    embedding + sanisizer::product_unsafe<std::size_t>(o, my_num_dim),
+                    my_num_dim,
+                    updated_embedding + sanisizer::product_unsafe<std::size_t>(n, my_num_dim)
+                );
+            }
+        }
+        ++my_num_updates;
+        {
+            Engine_ placement_rng(mix_seed(my_options.initialize_seed, my_num_updates));
+            place_added_observations(*my_updatable, my_num_dim, updated_embedding, num_retained, placement_rng);
+        }
+
+        auto& state = my_epochs.optimizer_state;
+        if (!state.empty()) {
+            const std::size_t per_obs = state.size() / old_num_obs;
+            for (Index_ n = 0; n < num_retained; ++n) {
+                const auto o = result.retained[n];
+                if (o != n) {
+                    std::copy_n(state.begin() + sanisizer::product_unsafe<std::size_t>(o, per_obs), per_obs, state.begin() + sanisizer::product_unsafe<std::size_t>(n, per_obs));
+                }
+            }
+            state.resize(sanisizer::product<std::size_t>(num_retained, per_obs));
+            state.resize(sanisizer::product<std::size_t>(num_observations(), per_obs)); // added observations start with zero state.
+        }
+
+        reset_early_stop();
+
+        if (my_options.update_epochs > 0 && !result.touched.empty()) {
+            auto setup = create_epoch_data(my_epochs.graph, my_options.update_epochs, my_epochs.negative_sample_rate);
+            auto is_fixed = sanisizer::create<std::vector<unsigned char> >(num_observations(), 1);
+            for (const auto t : result.touched) {
+                is_fixed[t] = 0;
+            }
+
+            Engine_ rng(mix_seed(my_options.optimize_seed, my_num_updates));
+            optimize_layout_subset<Index_, Float_>(
+                my_num_dim,
+                updated_embedding,
+                setup,
+                result.touched,
+                is_fixed,
+                *(my_options.a),
+                *(my_options.b),
+                my_options.repulsion_strength,
+                my_options.update_learning_rate,
+                rng
+            );
+        }
+    }
 };
 
 }
@@ -0,0 +1,58 @@
+#ifndef UMAPPP_STOP_CONDITION_HPP
+#define UMAPPP_STOP_CONDITION_HPP
+
+#include <chrono>
+#include <atomic>
+#include <optional>
+#include <cstddef>
+
+/**
+ * @file StopCondition.hpp
+ * @brief Conditions for interrupting the UMAP optimization.
+ */
+
+namespace umappp {
+
+/**
+ * @brief Conditions for stopping `Status::run()` before the requested number of epochs.
+ *
+ * These conditions are checked at the start of each epoch.
+ * If any condition is satisfied, `Status::run()` returns without performing the remaining epochs, and the `Status` can be used in a later call to continue the optimization.
+ * The result of an interrupted optimization that is later continued is exactly the same as that of an uninterrupted optimization.
+ * Note that a run may overshoot the deadline by up to the duration of a single epoch.
+ */
+struct StopCondition {
+    /**
+     * Time point at which to stop the optimization.
+     * If unset, no deadline is used.
+     */
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+
+    /**
+     * Pointer to a cancellation flag.
+     * The optimization is stopped once this flag is set to true, e.g., from another thread.
+     * If `NULL`, no cancellation flag is used.
+     * Otherwise, the flag should remain alive for the duration of `Status::run()`.
+     */
+    const std::atomic<bool>* cancel = NULL;
+
+    /**
+     * @cond
+     */
+    bool operator()() const {
+        if (cancel != NULL && cancel->load(std::memory_order_relaxed)) {
+            return true;
+        }
+        if (deadline.has_value() && std::chrono::steady_clock::now() >= *deadline) {
+            return true;
+        }
+        return false;
+    }
+    /**
+     * @endcond
+     */
+};
+
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef UMAPPP_THREAD_SELECTION_HPP
+#define UMAPPP_THREAD_SELECTION_HPP
+
+#include <vector>
+
+/**
+ * @file ThreadSelection.hpp
+ * @brief Automatic choice of the number of threads for layout optimization.
+ */
+
+namespace umappp {
+
+/**
+ * @brief Choice of the number of threads for layout optimization in `Status::run()`.
+ *
+ * If `Options::optimize_choose_threads = true`, the number of threads is chosen from a cost model of the layout optimization.
+ * This model predicts the time per epoch for each number of threads, based on statistics of the fuzzy graph (e.g., the number of edges per observation, its variance, and the expected rate of conflicts between observations)
+ * and the parallelization scheme implied by the other options, e.g., `Options::optimize_scheduler`.
+ * If `Options::optimize_calibrate_threads = true`, the model is refined by timing a single epoch with one thread and with `Options::num_threads_optimize` threads.
+ */
+struct ThreadSelection {
+    /**
+     * Chosen number of threads.
+     * This is zero if no choice has been made, i.e., `Options::optimize_choose_threads = false` or `Status::run()` has not yet been called.
+     */
+    int num_threads = 0;
+
+    /**
+     * Predicted time per epoch for each number of threads, relative to the time with a single thread.
+     * The `i`-th entry contains the prediction for `i + 1` threads, up to `Options::num_threads_optimize`.
+     */
+    std::vector<double> predicted_time;
+
+    /**
+     * Whether the predictions were calibrated by timing epochs, see `Options::optimize_calibrate_threads`.
+     */
+    bool calibrated = false;
+};
+
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef UMAPPP_XOSHIRO256STARSTAR_HPP
+#define UMAPPP_XOSHIRO256STARSTAR_HPP
+
+#include <cstdint>
+#include <limits>
+
+#include "aarand/aarand.hpp"
+
+#include "rng.hpp"
+
+/**
+ * @file Xoshiro256StarStar.hpp
+ * @brief Fast random number generator for layout optimization.
+ */
+
+namespace umappp {
+
+/**
+ * @brief The xoshiro256** random number generator.
+ *
+ * This is a small and fast alternative to the default `RngEngine` for sampling negative observations in `Status::run()`,
+ * see http://xoshiro.di.unimi.it for details.
+ * It uses only 32 bytes of state and a handful of shifts and rotations per draw, compared to the 2.5 KB state and periodic twist of `std::mt19937_64`.
+ * When used as the `Engine_` in `initialize()`, negative observations are also sampled with Lemire's nearly-divisionless method for bounded integers.
+ *
+ * This class satisfies the *UniformRandomBitGenerator* requirements.
+ * Results will differ from those obtained with the default `RngEngine`, but are still reproducible for a given seed.
+ */
+class Xoshiro256StarStar {
+public:
+    /**
+     * Type of the random integers.
+     */
+    typedef std::uint64_t result_type;
+
+    /**
+     * @param seed Seed for the generator.
+     * The state is filled by successive calls to a SplitMix64 generator that is initialized from `seed`, as recommended by the authors.
+     */
+    Xoshiro256StarStar(const std::uint64_t seed) {
+        SplitMix64 init(seed);
+        for (auto& s : my_state) {
+            s = init();
+        }
+    }
+
+    /**
+     * @return Minimum value of the random integers.
+     */
+    static constexpr result_type min() {
+        return 0;
+    }
+
+    /**
+     * @return Maximum value of the random integers.
+     */
+    static constexpr result_type max() {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    /**
+     * @return A random integer in \f$[0, 2^{64})\f$.
+     */
+    result_type operator()() {
+        const std::uint64_t result = rotl(my_state[1] * 5, 7) * 9;
+        const std::uint64_t t = my_state[1] << 17;
+        my_state[2] ^= my_state[0];
+        my_state[3] ^= my_state[1];
+        my_state[1] ^= my_state[2];
+        my_state[0] ^= my_state[3];
+        my_state[2] ^= t;
+        my_state[3] = rotl(my_state[3], 45);
+        return result;
+    }
+
+private:
+    std::uint64_t my_state[4];
+
+    static std::uint64_t rotl(const std::uint64_t x, const int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+};
+
+/**
+ * @cond
+ */
+// Lemire (2019), "Fast random integer generation in an interval". The
+// multiply-shift maps a 64-bit draw onto [0, bound) and the rejection step
+// removes the bias; the modulo is only computed in the rare rejection case.
+template<typename Index_>
+Index_ sample_observation(Xoshiro256StarStar& rng, const Index_ bound) {
+    const std::uint64_t s = bound;
+#ifdef __SIZEOF_INT128__
+    __extension__ typedef unsigned __int128 Wide;
+    Wide m = static_cast<Wide>(rng()) * s;
+    std::uint64_t low = static_cast<std::uint64_t>(m);
+    if (low < s) {
+        const std::uint64_t threshold = (0 - s) % s;
+        while (low < threshold) {
+            m = static_cast<Wide>(rng()) * s;
+            low = static_cast<std::uint64_t>(m);
+        }
+    }
+    return static_cast<Index_>(m >> 64);
+#else
+    return aarand::discrete_uniform(rng, bound);
+#endif
+}
+/**
+ * @endcond
+ */
+
+}
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef UMAPPP_BATCH_HPP
+#define UMAPPP_BATCH_HPP
+
+#include "NeighborList.hpp"
+#include "Options.hpp"
+#include "Status.hpp"
+#include "initialize.hpp"
+#include "parallelize.hpp"
+#include "utils.hpp"
+
+#include <vector>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <algorithm>
+
+/**
+ * @file batch.hpp
+ * @brief Run multiple UMAP embeddings on the same dataset.
+ */
+
+namespace umappp {
+
+/**
+ * Initialize multiple runs of the UMAP algorithm on the same dataset, e.g., with different seeds, `Options::min_dist` or number of dimensions.
+ * All runs share a single read-only copy of the fuzzy graph, so the memory usage of each additional run is limited to its embedding and epoch schedule.
+ * For `Options::optimize_scheduler = OptimizeScheduler::MINIBATCH`, an alias table for sampling the edges is also stored for each distinct `Options::num_epochs`.
+ *
+ * @tparam Index_ Integer type of the neighbor indices.
+ * @tparam Float_ Floating-point type of the distances.
+ * @tparam Engine_ Random number generator for the optimization, see `Status` for details.
+ *
+ * @param x Indices and distances to the nearest neighbors for each observation.
+ * For each observation, neighbors should be unique and sorted in order of increasing distance; see the `NeighborList` description for details.
+ * @param num_dim Vector containing the number of dimensions of the embedding for each run.
+ * @param[out] embeddings Vector of pointers to arrays in which to store the embedding for each run.
+ * Each array is treated as a column-major matrix where rows are dimensions (`num_dim[r]` for run `r`) and columns are observations (`x.size()`).
+ * On output, each array contains the initial coordinates of its embedding, see `initialize()` for details.
+ * @param options Vector of options for each run.
+ * `Options::local_connectivity`, `Options::bandwidth` and `Options::mix_ratio` define the shared graph and must be the same for all runs.
+ * The shared graph is constructed with the `Options::num_threads` of the first run,
+ * while the initialization of each embedding uses the thread options of its own run (e.g., `Options::num_threads_spectral`).
+ * `num_dim`, `embeddings` and `options` should all have the same length.
+ *
+ * @return A vector of `Status` objects containing the initial state of each run.
+ * Each object can be used independently, or all of them can be run together with `run_batch()`.
+ * The result of each run is the same as that of `initialize()` with the same options,
+ * except when `Options::optimize_scheduler = OptimizeScheduler::COLORING` and the runs have different `Options::num_epochs`.
+ */
+template<typename Index_, typename Float_, class Engine_ = RngEngine>
+std::vector<Status<Index_, Float_, Engine_> > initialize_batch(
+    NeighborList<Index_, Float_> x,
+    const std::vector<std::size_t>& num_dim,
+    const std::vector<Float_*>& embeddings,
+    std::vector<Options> options)
+{
+    const auto num_runs = options.size();
+    if (num_dim.size() != num_runs || embeddings.size() != num_runs) {
+        throw std::runtime_error("'num_dim', 'embeddings' and 'options' should have the same length");
+    }
+
+    std::vector<Status<Index_, Float_, Engine_> > output;
+    if (num_runs == 0) {
+        return output;
+    }
+
+    const auto& first = options.front();
+    for (const auto& opt : options) {
+        if (opt.local_connectivity != first.local_connectivity || opt.bandwidth != first.bandwidth || opt.mix_ratio != first.mix_ratio) {
+            throw std::runtime_error("graph-related options should be the same for all runs");
+        }
+    }
+
+    build_fuzzy_graph(x, first);
+
+    // Edges are only pruned if they would never be sampled in the requested
+    // number of epochs, so we can use the largest number of epochs across all
+    // runs. Runs with fewer epochs will just skip the extra edges, except for
+    // the minibatch optimizer, which needs its own alias table that excludes
+    // those edges from the sampling.
+    int max_epochs = 0;
+    for (I<decltype(num_runs)> r = 0; r < num_runs; ++r) {
+        auto& opt = options[r];
+        resolve_options<Index_>(opt, x.size());
+        initialize_embedding(x, num_dim[r], embeddings[r], opt);
+        max_epochs = std::max(max_epochs, *(opt.num_epochs));
+    }
+
+    auto raw_graph = similarities_to_graph<Index_, Float_>(x, max_epochs);
+    for (const auto& opt : options) {
+        if (opt.optimize_scheduler == OptimizeScheduler::MINIBATCH) {
+            fill_edge_alias_table(raw_graph, *(opt.num_epochs), *(opt.num_epochs) < max_epochs);
+        } else if (opt.optimize_scheduler == OptimizeScheduler::COLORING && raw_graph.batch_pointers.empty()) {
+            prepare_scheduler(raw_graph, opt.optimize_scheduler, max_epochs);
+        }
+    }
+    const auto graph = std::make_shared<const EpochGraph<Index_, Float_> >(std::move(raw_graph));
+
+    output.reserve(num_runs);
+    for (I<decltype(num_runs)> r = 0; r < num_runs; ++r) {
+        auto& opt = options[r];
+        auto epochs = create_epoch_data<Index_, Float_>(graph, *(opt.num_epochs), opt.negative_sample_rate);
+        output.emplace_back(std::move(epochs), std::move(opt), num_dim[r]);
+    }
+
+    return output;
+}
+
+/**
+ * Run multiple UMAP embeddings to completion in parallel, where each run is assigned to a single worker.
+ * This is most effective when `Options::num_threads_optimize = 1` for each run,
+ * such that the throughput scales with the number of runs without any of the synchronization overhead of the parallel optimizer.
+ *
+ * @tparam Index_ Integer type of the neighbor indices.
+ * @tparam Float_ Floating-point type of the distances.
+ * @tparam Engine_ Random number generator for the optimization, see `Status` for details.
+ *
+ * @param statuses Vector of `Status` objects, typically created by `initialize_batch()`.
+ * On output, each object is advanced to its `Status::num_epochs()`.
+ * @param embeddings Vector of pointers to the embedding arrays for each run, see `Status::run()` for details.
+ * This should have the same length as `statuses`.
+ * @param num_threads Number of threads to use.
+ * The parallelization scheme is determined by `parallelize()`.
+ * The result for each run is the same regardless of the number of threads.
+ */
+template<typename Index_, typename Float_, class Engine_>
+void run_batch(std::vector<Status<Index_, Float_, Engine_> >& statuses, const std::vector<Float_*>& embeddings, const int num_threads) {
+    const auto num_runs = statuses.size();
+    if (embeddings.size() != num_runs) {
+        throw std::runtime_error("'statuses' and 'embeddings' should have the same length");
+    }
+
+    parallelize(num_threads, num_runs, [&](const int, const std::size_t start, const std::size_t length) -> void {
+        for (std::size_t r = start, end = start + length; r < end; ++r) {
+            statuses[r].run(embeddings[r]);
+        }
+    });
+}
+
+}
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef UMAPPP_CHOOSE_NUM_THREADS_HPP
+#define UMAPPP_CHOOSE_NUM_THREADS_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "Options.hpp"
+#include "optimize_layout.hpp"
+
+namespace umappp {
+
+/*
+ * Cost model for the parallel optimization. For each parallelization scheme,
+ * the time per epoch with 't' threads relative to that with one thread is
+ * modelled as 'serial + (1 - serial) / width(t) + overhead', where 'serial'
+ * is the fraction of the work that is always done on the main thread,
+ * 'width' is the effective number of threads that are used for the rest, and
+ * 'overhead' is the additional cost of coordinating the threads. The width
+ * is derived from the graph while the other values are rough constants,
+ * with the overhead being refined by calibration if requested.
+ */
+struct ThreadCostModel {
+    double serial = 0;
+    double overhead = 0;
+};
+
+inline ThreadCostModel default_thread_cost_model(const Options& options) {
+    ThreadCostModel model;
+    if (options.optimize_repulsion == OptimizeRepulsion::BARNES_HUT) {
+        model.serial = 0.2; // serial pass over the edges after the parallel calculation of the forces.
+        model.overhead = 0.02;
+    } else if (options.optimize_method != OptimizeMethod::SGD) {
+        model.overhead = 0.02;
+    } else if (options.optimize_scheduler == OptimizeScheduler::MINIBATCH) {
+        model.overhead = 0.1; // storing and applying the changes, plus two barriers per minibatch.
+    } else if (options.optimize_scheduler == OptimizeScheduler::COLORING) {
+        model.overhead = 0.05; // copying the snapshot, plus a barrier per batch.
+    } else {
+        // Planning and communication on the main thread. This is consistent
+        // with the observation that at least 4 threads are required for a
+        // noticeable speed-up, see the documentation for num_threads_optimize.
+        model.overhead = 0.75;
+    }
+    return model;
+}
+
+/*
+ * For the greedy scheduler, each observation writes to its own coordinates
+ * and those of its sampled neighbors, and reads the coordinates of its
+ * negative samples. Two observations conflict if one writes to a location
+ * that is read or written by the other. Neighbors are more likely to be
+ * shared if the degree is highly variable, as high-degree observations are
+ * present in many neighbor lists; this is captured by the squared
+ * coefficient of variation of the degree. Negative samples are uniform.
+ */
+template<typename Index_, typename Float_>
+double greedy_conflict_probability(const EpochGraph<Index_, Float_>& graph, const Float_ negative_sample_rate) {
+    const Index_ num_obs = graph.cumulative_num_edges.size() - 1;
+    if (num_obs < 2) {
+        return 0;
+    }
+
+    double sum_sampled = 0;
+    double sum_degree = 0, sum_degree2 = 0;
+    for (Index_ i = 0; i < num_obs; ++i) {
+        const auto start = graph.cumulative_num_edges[i], end = graph.cumulative_num_edges[i + 1];
+        for (auto j = start; j < end; ++j) {
+            sum_sampled += 1 / static_cast<double>(graph.epochs_per_sample[j]);
+        }
+        const double degree = end - start;
+        sum_degree += degree;
+        sum_degree2 += degree * degree;
+    }
+
+    const double dnum_obs = num_obs;
+    const double mean_degree = sum_degree / dnum_obs;
+    const double cv2 = (mean_degree > 0 ? (sum_degree2 / dnum_obs) / (mean_degree * mean_degree) - 1 : 0);
+    const double writes = 1 + sum_sampled / dnum_obs;
+    const double reads = static_cast<double>(negative_sample_rate) * sum_sampled / dnum_obs;
+    const double prob = (writes * writes * (1 + cv2) + 2 * writes * reads) / dnum_obs;
+    return std::min(prob, 1.0);
+}
+
+// Expected number of observations per round for the greedy scheduler, where
+// the k-th observation must not conflict with any of the previous k - 1.
+inline double greedy_expected_width(const double conflict_probability, const int nthreads) {
+    double width = 0, no_conflict = 1;
+    for (int k = 0; k < nthreads; ++k) {
+        width += no_conflict;
+        no_conflict *= std::pow(1 - conflict_probability, k + 1);
+    }
+    return width;
+}
+
+// For the coloring scheduler, each batch is split across threads, so the
+// time is determined by the number of observations per thread in each batch.
+template<typename Index_, typename Float_>
+double coloring_expected_width(const EpochGraph<Index_, Float_>& graph, const int nthreads) {
+    double total = 0, per_thread = 0;
+    const auto num_batches = graph.batch_pointers.size();
+    for (std::size_t b = 1; b < num_batches; ++b) {
+        const auto size = graph.batch_pointers[b] - graph.batch_pointers[b - 1];
+        total += size;
+        per_thread += (size + nthreads - 1) / nthreads;
+    }
+    if (per_thread == 0) {
+        return 1;
+    }
+    return total / per_thread;
+}
+
+template<typename Index_, typename Float_>
+std::vector<double> predict_thread_times(const EpochGraph<Index_, Float_>& graph, const Float_ negative_sample_rate, const Options& options, const ThreadCostModel& model, const int max_threads) {
+    const bool greedy = (
+        options.optimize_repulsion != OptimizeRepulsion::BARNES_HUT &&
+        options.optimize_method == OptimizeMethod::SGD &&
+        options.optimize_scheduler == OptimizeScheduler::GREEDY
+    );
+    const bool coloring = (
+        options.optimize_repulsion != OptimizeRepulsion::BARNES_HUT &&
+        options.optimize_method == OptimizeMethod::SGD &&
+        options.optimize_scheduler == OptimizeScheduler::COLORING
+    );
+    const double conflict = (greedy ? greedy_conflict_probability(graph, negative_sample_rate) : 0);
+
+    std::vector<double> output;
+    output.reserve(std::max(max_threads, 1));
+    output.push_back(1);
+    for (int t = 2; t <= max_threads; ++t) {
+        double width = t;
+        if (greedy) {
+            width = greedy_expected_width(conflict, t);
+        } else if (coloring) {
+            width = coloring_expected_width(graph, t);
+        }
+        output.push_back(model.serial + (1 - model.serial) / width + model.overhead);
+    }
+    return output;
+}
+
+// Refining the overhead from the observed ratio of the time with 't' threads to that with one thread.
+inline void calibrate_thread_cost_model(ThreadCostModel& model, const double observed_ratio, const double predicted_ratio) {
+    model.overhead = std::max(0.0, model.overhead + observed_ratio - predicted_ratio);
+}
+
+// Choosing the smallest number of threads that is within 1% of the best
+// predicted time, to avoid using more threads for a negligible improvement.
+// For CPU_TIME, we only consider numbers of threads where the parallel
+// efficiency, i.e., the speed-up divided by the number of threads, is at
+// least 'min_efficiency'. Directly minimizing the product of the time and
+// the number of threads would always choose one thread, as no speed-up is
+// better than linear.
+inline int choose_from_thread_times(const std::vector<double>& times, const ThreadObjective objective, const double min_efficiency) {
+    const int max_threads = times.size();
+    std::vector<bool> allowed(max_threads, true);
+    if (objective == ThreadObjective::CPU_TIME) {
+        for (int t = 1; t < max_threads; ++t) {
+            allowed[t] = (times[0] >= min_efficiency * (t + 1) * times[t]);
+        }
+    }
+
+    double best = times[0];
+    for (int t = 1; t < max_threads; ++t) {
+        if (allowed[t]) {
+            best = std::min(best, times[t]);
+        }
+    }
+    for (int t = 0; t < max_threads; ++t) {
+        if (allowed[t] && times[t] <= best * 1.01) {
+            return t + 1;
+        }
+    }
+    return 1;
+}
+
+}
+
+#endif
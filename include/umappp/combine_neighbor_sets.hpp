@@ -12,6 +12,25 @@
 
 namespace umappp {
 
+// Same calculation as in combine_neighbor_sets() below, given the directed
+// similarities in each direction (zero if the edge does not exist).
+template<typename Float_>
+Float_ combine_similarities(const Float_ forward, const Float_ backward, const Float_ mix_ratio) {
+    if (forward == 0 || backward == 0) {
+        const Float_ only = forward + backward;
+        return (mix_ratio == 1 ? only : only * mix_ratio);
+    }
+
+    const Float_ product = forward * backward;
+    if (mix_ratio == 1) {
+        return forward + backward - product;
+    } else if (mix_ratio == 0) {
+        return product;
+    } else {
+        return mix_ratio * (forward + backward - product) + (1 - mix_ratio) * product;
+    }
+}
+
 template<typename Index_, typename Float_>
 void combine_neighbor_sets(NeighborList<Index_, Float_>& x, const Float_ mix_ratio) {
     const Index_ num_obs = x.size(); // assume that Index_ is large enough to store the number of observations.
@@ -24,22 +43,48 @@ void combine_neighbor_sets(NeighborList<Index_, Float_>& x, const Float_ mix_rat
         original[i] = x[i].size();
     }
 
+    // Searching for 'i' in the original neighbors of 'target'. As each inner
+    // vector in 'x' is sorted, this should only require a single pass through
+    // the entire set of neighbors as we do not need to search previously
+    // searched hits, provided that 'i' is increasing across calls.
+    const auto find_reverse = [&](const Index_ i, const Index_ target) -> bool {
+        const auto& neighbors = x[target];
+        auto& curlast = last[target];
+        const auto& limits = original[target];
+        while (curlast < limits && neighbors[curlast].first < i) {
+            ++curlast;
+        }
+        return curlast < limits && neighbors[curlast].first == i;
+    };
+
+    // Counting the number of reverse edges that will be added to each
+    // observation, so that each inner vector only needs to be reallocated
+    // once instead of growing (and leaving slack capacity) with each insertion.
+    if (mix_ratio != 0) {
+        auto num_added = sanisizer::create<std::vector<Index_> >(num_obs);
+        for (Index_ i = 0; i < num_obs; ++i) {
+            for (const auto& y : x[i]) {
+                if (!find_reverse(i, y.first)) {
+                    ++(num_added[y.first]);
+                }
+            }
+        }
+        for (Index_ i = 0; i < num_obs; ++i) {
+            if (num_added[i]) {
+                x[i].reserve(sanisizer::sum<I<decltype(x[i].size())> >(original[i], num_added[i]));
+            }
+        }
+        std::fill(last.begin(), last.end(), 0);
+    }
+
     for (Index_ i = 0; i < num_obs; ++i) {
         auto& current = x[i];
 
-        // Looping through the neighbors and searching for self in each
-        // neighbor's neighbors. As each inner vector in 'x' is sorted,
-        // this should only require a single pass through the entire set of
-        // neighbors as we do not need to search previously searched hits.
+        // Looping through the neighbors and searching for self in each neighbor's neighbors.
         for (auto& y : current) {
-            auto& target = x[y.first];
-            auto& curlast = last[y.first];
-            const auto& limits = original[y.first];
-            while (curlast < limits && target[curlast].first < i) {
-                ++curlast;
-            }
-
-            if (curlast < limits && target[curlast].first == i) {
+            if (find_reverse(i, y.first)) {
+                auto& target = x[y.first];
+                const auto curlast = last[y.first];
                 // If i > y.first, then this would have already been done in a
                 // previous iteration of the outermost loop where i and y.first
                 // swap values. So we skip this to avoid adding it twice.
@@ -59,6 +104,7 @@ void combine_neighbor_sets(NeighborList<Index_, Float_>& x, const Float_ mix_rat
                     target[curlast].second = prob_final;
                 }
             } else {
+                auto& target = x[y.first];
                 if (mix_ratio == 1) {
                     target.emplace_back(i, y.second);
                 } else if (mix_ratio == 0) {
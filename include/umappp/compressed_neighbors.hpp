@@ -0,0 +1,175 @@
+#ifndef UMAPPP_COMPRESSED_NEIGHBORS_HPP
+#define UMAPPP_COMPRESSED_NEIGHBORS_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+
+#include "sanisizer/sanisizer.hpp"
+
+#include "NeighborList.hpp"
+#include "combine_neighbor_sets.hpp"
+#include "utils.hpp"
+
+namespace umappp {
+
+/*
+ * Compressed sparse row representation of a NeighborList, where all neighbors
+ * are stored in a single contiguous vector. This avoids the per-observation
+ * allocations (and their slack capacity) of the NeighborList, which matters
+ * when the number of observations is large. Each row can be used in the same
+ * manner as an inner vector of a NeighborList, so functions that only read
+ * the neighbors can be templated on the type of the list.
+ */
+template<typename Index_, typename Float_>
+class NeighborRange {
+public:
+    NeighborRange(const std::pair<Index_, Float_>* const start, const std::pair<Index_, Float_>* const end) : my_start(start), my_end(end) {}
+
+    typedef std::pair<Index_, Float_> value_type;
+
+    const std::pair<Index_, Float_>* begin() const {
+        return my_start;
+    }
+
+    const std::pair<Index_, Float_>* end() const {
+        return my_end;
+    }
+
+    std::size_t size() const {
+        return my_end - my_start;
+    }
+
+    bool empty() const {
+        return my_start == my_end;
+    }
+
+    const std::pair<Index_, Float_>& operator[](const std::size_t i) const {
+        return my_start[i];
+    }
+
+private:
+    const std::pair<Index_, Float_>* my_start;
+    const std::pair<Index_, Float_>* my_end;
+};
+
+template<typename Index_, typename Float_>
+struct CompressedNeighborList {
+    std::vector<std::size_t> pointers = std::vector<std::size_t>(1);
+    std::vector<std::pair<Index_, Float_> > entries;
+
+    typedef NeighborRange<Index_, Float_> value_type;
+
+    std::size_t size() const {
+        return pointers.size() - 1;
+    }
+
+    NeighborRange<Index_, Float_> operator[](const std::size_t i) const {
+        const auto base = entries.data();
+        return NeighborRange<Index_, Float_>(base + pointers[i], base + pointers[i + 1]);
+    }
+};
+
+template<typename Index_, typename Float_>
+NeighborList<Index_, Float_> to_neighbor_list(const CompressedNeighborList<Index_, Float_>& x) {
+    const Index_ num_obs = x.size();
+    NeighborList<Index_, Float_> output(num_obs);
+    for (Index_ i = 0; i < num_obs; ++i) {
+        const auto current = x[i];
+        output[i].insert(output[i].end(), current.begin(), current.end());
+    }
+    return output;
+}
+
+/*
+ * Same result as combine_neighbor_sets(), but from a compressed list of
+ * directed similarities where each row is already sorted by index. We build
+ * the transpose so that each row of the output can be created by merging the
+ * forward and reverse similarities. To save memory, the transpose only holds
+ * the indices, and the reverse similarity is found by a binary search of the
+ * (sorted) row of the source observation. The output is allocated to its
+ * exact size.
+ */
+template<typename Index_, typename Float_>
+CompressedNeighborList<Index_, Float_> combine_compressed_neighbors(const CompressedNeighborList<Index_, Float_>& x, const Float_ mix_ratio) {
+    const Index_ num_obs = x.size();
+
+    auto reverse_pointers = sanisizer::create<std::vector<std::size_t> >(sanisizer::sum<std::size_t>(num_obs, 1));
+    for (const auto& nn : x.entries) {
+        ++(reverse_pointers[nn.first + 1]);
+    }
+    for (Index_ i = 0; i < num_obs; ++i) {
+        reverse_pointers[i + 1] += reverse_pointers[i];
+    }
+
+    auto reverse_sources = sanisizer::create<std::vector<Index_> >(x.entries.size());
+    {
+        auto offsets = reverse_pointers;
+        for (Index_ i = 0; i < num_obs; ++i) {
+            for (const auto& nn : x[i]) {
+                reverse_sources[offsets[nn.first]++] = i;
+            }
+        }
+    }
+
+    const auto reverse_similarity = [&](const Index_ source, const Index_ target) -> Float_ {
+        const auto row = x[source];
+        const auto it = std::lower_bound(row.begin(), row.end(), target, [](const std::pair<Index_, Float_>& left, const Index_ right) -> bool { return left.first < right; });
+        return it->second; // guaranteed to exist, as 'target' is in the transpose of 'source'.
+    };
+
+    // Merging the sorted forward and reverse rows; 'fun' is called with the
+    // index and combined similarity of each neighbor in increasing order.
+    const auto merge = [&](const Index_ i, auto fun) -> void {
+        const auto forward = x[i];
+        auto fIt = forward.begin();
+        const auto fEnd = forward.end();
+        auto rIt = reverse_sources.begin() + reverse_pointers[i];
+        const auto rEnd = reverse_sources.begin() + reverse_pointers[i + 1];
+
+        while (fIt != fEnd || rIt != rEnd) {
+            Float_ prob;
+            Index_ target;
+            if (rIt == rEnd || (fIt != fEnd && fIt->first < *rIt)) {
+                target = fIt->first;
+                prob = combine_similarities(fIt->second, static_cast<Float_>(0), mix_ratio);
+                ++fIt;
+            } else if (fIt == fEnd || *rIt < fIt->first) {
+                target = *rIt;
+                prob = combine_similarities(static_cast<Float_>(0), reverse_similarity(target, i), mix_ratio);
+                ++rIt;
+            } else {
+                target = fIt->first;
+                prob = combine_similarities(fIt->second, reverse_similarity(target, i), mix_ratio);
+                ++fIt;
+                ++rIt;
+            }
+
+            // combine_neighbor_sets() removes all zero probabilities when the mix ratio is zero.
+            if (mix_ratio == 0 && prob == 0) {
+                continue;
+            }
+            fun(target, prob);
+        }
+    };
+
+    CompressedNeighborList<Index_, Float_> output;
+    output.pointers.resize(sanisizer::sum<I<decltype(output.pointers.size())> >(num_obs, 1));
+    for (Index_ i = 0; i < num_obs; ++i) {
+        std::size_t count = 0;
+        merge(i, [&](Index_, Float_) -> void { ++count; });
+        output.pointers[i + 1] = output.pointers[i] + count;
+    }
+
+    output.entries.reserve(output.pointers.back());
+    for (Index_ i = 0; i < num_obs; ++i) {
+        merge(i, [&](const Index_ target, const Float_ prob) -> void { output.entries.emplace_back(target, prob); });
+    }
+
+    return output;
+}
+
+}
+
+#endif
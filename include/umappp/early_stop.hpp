@@ -0,0 +1,130 @@
+#ifndef UMAPPP_EARLY_STOP_HPP
+#define UMAPPP_EARLY_STOP_HPP
+
+#include <vector>
+#include <memory_resource>
+#include <cstddef>
+#include <algorithm>
+
+#include "sanisizer/sanisizer.hpp"
+
+#include "utils.hpp"
+
+namespace umappp {
+
+/*
+ * Tracks the movement of a strided sample of observations between
+ * consecutive checks, which are performed at the start of each epoch,
+ * relative to the spread of the sampled observations in the embedding. We use
+ * a strided sample rather than a random one to avoid interfering with the
+ * RNG used for negative sampling. The state persists across calls to
+ * Status::run() so that the outcome is the same as an uninterrupted run.
+ */
+template<typename Index_, typename Float_>
+class EarlyStopMonitor {
+public:
+    EarlyStopMonitor(
+        const Index_ num_obs,
+        const std::size_t num_dim,
+        const int num_samples,
+        const double tolerance,
+        const int patience,
+        std::pmr::memory_resource* const resource = std::pmr::get_default_resource()
+    ) :
+        my_sampled(resource),
+        my_previous(resource),
+        my_centroid(resource),
+        my_num_dim(num_dim),
+        my_tolerance(tolerance),
+        my_patience(patience)
+    {
+        if (num_obs > 0 && num_samples > 0) {
+            const Index_ stride = std::max<Index_>(1, num_obs / num_samples);
+            Index_ i = 0;
+            while (my_sampled.size() < static_cast<std::size_t>(num_samples)) {
+                my_sampled.push_back(i);
+                if (num_obs - i <= stride) {
+                    break;
+                }
+                i += stride;
+            }
+        }
+        my_previous.resize(sanisizer::product<I<decltype(my_previous.size())> >(my_sampled.size(), my_num_dim));
+        my_centroid.resize(my_num_dim);
+    }
+
+private:
+    std::pmr::vector<Index_> my_sampled;
+    std::pmr::vector<Float_> my_previous;
+    std::pmr::vector<double> my_centroid;
+    std::size_t my_num_dim;
+    double my_tolerance;
+    int my_patience;
+
+    bool my_started = false;
+    int my_num_below = 0;
+    bool my_converged = false;
+
+public:
+    bool converged() const {
+        return my_converged;
+    }
+
+    std::size_t memory_usage() const {
+        return umappp::memory_usage(my_sampled) + umappp::memory_usage(my_previous) + umappp::memory_usage(my_centroid);
+    }
+
+    template<typename Coord_>
+    bool check(const Coord_* const embedding) {
+        if (my_converged) {
+            return true;
+        }
+
+        double moved = 0, spread = 0;
+        std::fill(my_centroid.begin(), my_centroid.end(), 0);
+        auto pIt = my_previous.begin();
+        for (const auto s : my_sampled) {
+            const auto current = embedding + sanisizer::product_unsafe<std::size_t>(s, my_num_dim);
+            for (std::size_t d = 0; d < my_num_dim; ++d, ++pIt) {
+                const double val = current[d];
+                const double delta = val - *pIt;
+                moved += delta * delta;
+                spread += val * val;
+                my_centroid[d] += val;
+                *pIt = val;
+            }
+        }
+
+        if (!my_started) {
+            my_started = true;
+            return false;
+        }
+
+        // Scaling by the spread of the sample, i.e., the mean squared distance
+        // from its centroid, so that the tolerance is independent of the scale
+        // of the embedding. Degenerate samples are never considered converged.
+        const double num_sampled = my_sampled.size();
+        for (const auto c : my_centroid) {
+            spread -= c * c / num_sampled;
+        }
+        if (!(spread > 0)) {
+            my_num_below = 0;
+            return false;
+        }
+
+        if (moved / spread < my_tolerance) {
+            ++my_num_below;
+            if (my_num_below >= my_patience) {
+                my_converged = true;
+            }
+        } else {
+            my_num_below = 0;
+        }
+
+        return my_converged;
+    }
+};
+
+}
+
+#endif
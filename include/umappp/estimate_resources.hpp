@@ -0,0 +1,223 @@
+#ifndef UMAPPP_ESTIMATE_RESOURCES_HPP
+#define UMAPPP_ESTIMATE_RESOURCES_HPP
+
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+#include "Options.hpp"
+#include "NeighborList.hpp"
+#include "initialize.hpp"
+#include "float16.hpp"
+#include "optimize_layout.hpp"
+#include "optimize_layout_barnes_hut.hpp"
+
+/**
+ * @file estimate_resources.hpp
+ * @brief Estimate the resources required by the UMAP algorithm.
+ */
+
+namespace umappp {
+
+/**
+ * @brief Estimated resource usage of the UMAP algorithm.
+ *
+ * Memory usage is reported in bytes for each stage of `initialize()` and `Status::run()`.
+ * This only considers the memory allocated by **umappp**, i.e., it does not include the embedding array supplied by the caller or any overhead from the memory allocator.
+ * The estimates assume that every observation has exactly the requested number of neighbors.
+ * The number of edges in the symmetrized fuzzy graph depends on the dataset,
+ * so the estimates use the maximum possible number of edges (i.e., no neighbor is shared between observations) and should be treated as upper bounds.
+ * The extra memory for `Options::initialize_multilevel` and `Options::initialize_landmark` is not considered.
+ */
+struct ResourceEstimate {
+    /**
+     * Memory used by the `NeighborList` that is passed to `initialize()`.
+     */
+    std::size_t neighbor_list = 0;
+
+    /**
+     * Peak memory used to construct the symmetrized fuzzy graph from the `NeighborList`.
+     * This includes the `NeighborList` itself as it is modified in place.
+     * The fuzzy graph is held until `initialize()` returns.
+     */
+    std::size_t fuzzy_graph = 0;
+
+    /**
+     * Memory used for spectral initialization, i.e., the normalized Laplacian and the workspace for `irlba::compute()`, in addition to the fuzzy graph.
+     * This is an approximation as the size of the IRLBA workspace depends on its implementation.
+     * Zero if `Options::initialize_method` is not `InitializeMethod::SPECTRAL`.
+     */
+    std::size_t spectral_init = 0;
+
+    /**
+     * Memory held by the `Status` after `Status::run()`,
+     * i.e., the graph and sampling schedule for the optimization epochs along with any scratch buffers and optimizer state.
+     * This can be compared to `Status::memory_usage()`.
+     */
+    std::size_t epoch_data = 0;
+
+    /**
+     * Peak memory used by `initialize()` and `Status::run()`, i.e., the maximum of the sum of the memory used by concurrent stages.
+     */
+    std::size_t peak = 0;
+
+    /**
+     * Number of epochs for the optimization, see `Options::num_epochs`.
+     */
+    int num_epochs = 0;
+
+    /**
+     * Number of edge updates (i.e., attractive gradient calculations) across all epochs.
+     * This is estimated from the sum of the membership strengths in the fuzzy graph, which is determined by `Options::bandwidth` and `Options::mix_ratio`;
+     * each edge is updated in proportion to its strength relative to the strongest edge, which is assumed to be 1 (see `Options::local_connectivity`).
+     * The time spent in `Status::run()` is roughly proportional to this number and `num_negative_samples`.
+     */
+    double num_edge_updates = 0;
+
+    /**
+     * Number of negative samples (i.e., repulsive gradient calculations) across all epochs.
+     * Only relevant for exact repulsion, i.e., `Options::optimize_repulsion = OptimizeRepulsion::NEGATIVE_SAMPLING`.
+     */
+    double num_negative_samples = 0;
+};
+
+/**
+ * Estimate the memory usage and amount of work for the UMAP algorithm before calling `initialize()`.
+ * This is intended for planning the resources for a job, e.g., in a cluster scheduler.
+ *
+ * @tparam Index_ Integer type of the neighbor indices.
+ * @tparam Float_ Floating-point type of the distances.
+ *
+ * @param num_obs Number of observations.
+ * @param num_neighbors Number of neighbors for each observation.
+ * @param num_dim Number of dimensions of the embedding.
+ * @param options Further options that would be passed to `initialize()`.
+ *
+ * @return Estimated resource usage.
+ */
+template<typename Index_, typename Float_>
+ResourceEstimate estimate_resources(const Index_ num_obs, const int num_neighbors, const std::size_t num_dim, const Options& options) {
+    typedef std::pair<Index_, Float_> Neighbor;
+    const double dnum_obs = num_obs;
+    const double dnum_neighbors = std::max(num_neighbors, 0);
+    const double num_directed = dnum_obs * dnum_neighbors;
+    const double num_symmetrized = (options.mix_ratio > 0 ? 2 : 1) * num_directed;
+    const double outer = dnum_obs * sizeof(std::vector<Neighbor>);
+
+    ResourceEstimate output;
+    output.neighbor_list = outer + num_directed * sizeof(Neighbor);
+
+    // Copies of the neighbors and their similarities for Status::update(),
+    // where the reverse neighbors are added one at a time so they may use
+    // up to twice their size due to the growth of each vector.
+    double updatable = 0;
+    if (options.update_enabled) {
+        updatable += output.neighbor_list;
+        updatable += dnum_obs * sizeof(std::vector<Float_>) + num_directed * sizeof(Float_);
+        updatable += dnum_obs * sizeof(std::vector<Index_>) + 2 * num_directed * sizeof(Index_);
+    }
+
+    // Symmetrized in place, with three per-observation counters in combine_neighbor_sets().
+    const double symmetrized = outer + num_symmetrized * sizeof(Neighbor);
+    output.fuzzy_graph = symmetrized + 3 * dnum_obs * sizeof(Index_) + updatable;
+
+    if (options.initialize_method == InitializeMethod::SPECTRAL) {
+        // Values and indices of the Laplacian, including the diagonal, plus its pointers and the degree of each observation.
+        const double num_nonzero = num_symmetrized + dnum_obs;
+        double spectral = num_nonzero * (sizeof(double) + sizeof(Index_)) + 2 * dnum_obs * sizeof(double);
+
+        // Left and right Lanczos vectors in IRLBA, plus a few more vectors of length equal to the number of observations.
+        const double work = static_cast<double>(num_dim) + 1 + options.initialize_spectral_irlba_options.extra_work;
+        spectral += (2 * work + 4) * dnum_obs * sizeof(double);
+        output.spectral_init = spectral;
+    }
+
+    // Graph and schedule for the epochs.
+    double epochs = (dnum_obs + 1) * sizeof(std::size_t) + num_symmetrized * (sizeof(Index_) + 3 * sizeof(Float_));
+    if (options.optimize_scheduler == OptimizeScheduler::COLORING) {
+        epochs += dnum_obs * (sizeof(Index_) + sizeof(std::size_t));
+    } else if (options.optimize_scheduler == OptimizeScheduler::MINIBATCH) {
+        epochs += sizeof(EdgeAliasTable<Index_, Float_>) + num_symmetrized * (sizeof(Float_) + sizeof(std::size_t) + sizeof(Index_)); // alias table, see fill_edge_alias_table().
+    }
+
+    // Scratch buffers that are held in the Status across calls to run(), in the
+    // working precision, see OptimizeWorkspace and BarnesHutWorkspace. These
+    // follow the choice of optimizer in Status::optimize().
+    const bool native = (options.optimize_precision == OptimizePrecision::NATIVE || std::is_same<Float_, float>::value);
+    const double compute_size = (native ? sizeof(Float_) : sizeof(float));
+    const double coord_size = (options.optimize_precision == OptimizePrecision::HALF ? sizeof(Float16) : compute_size);
+    const double ntotal = dnum_obs * static_cast<double>(num_dim);
+    const double dnum_threads = std::max(options.num_threads_optimize, 1);
+
+    if (options.optimize_repulsion == OptimizeRepulsion::BARNES_HUT) {
+        if (native) {
+            epochs += BarnesHutTree<Index_, Float_>::memory_bound(dnum_obs, num_dim);
+        } else {
+            epochs += BarnesHutTree<Index_, float>::memory_bound(dnum_obs, num_dim);
+        }
+        epochs += ntotal * compute_size; // field, see optimize_layout_barnes_hut().
+    } else if (options.optimize_method != OptimizeMethod::SGD) {
+        epochs += ntotal * compute_size; // gradients, see optimize_layout_accumulated().
+    } else if (options.optimize_scheduler == OptimizeScheduler::MINIBATCH) {
+        // Changes for each update in a minibatch and a per-thread buffer padded to a cache line, see optimize_layout_minibatch().
+        const double num_rows = 2 * static_cast<double>(std::max<std::size_t>(options.optimize_minibatch_size, 1));
+        epochs += num_rows * (sizeof(Index_) + static_cast<double>(num_dim) * compute_size);
+        epochs += dnum_threads * (static_cast<double>(num_dim) + std::floor(64 / compute_size) + 1) * compute_size;
+    } else if (options.optimize_scheduler == OptimizeScheduler::COLORING) {
+        epochs += ntotal * coord_size; // snapshot, see optimize_layout_batched().
+    }
+
+    if (options.optimize_method == OptimizeMethod::MOMENTUM) {
+        epochs += ntotal * sizeof(Float_);
+    } else if (options.optimize_method == OptimizeMethod::ADAM) {
+        epochs += 2 * ntotal * sizeof(Float_);
+    }
+
+    if (options.optimize_precision == OptimizePrecision::HALF) {
+        epochs += ntotal * sizeof(Float16);
+    } else if (options.optimize_precision == OptimizePrecision::SINGLE && !std::is_same<Float_, float>::value) {
+        epochs += ntotal * sizeof(float);
+    }
+
+    if (
+        options.num_threads_optimize > 1 &&
+        options.optimize_repulsion == OptimizeRepulsion::NEGATIVE_SAMPLING &&
+        options.optimize_method == OptimizeMethod::SGD &&
+        options.optimize_scheduler == OptimizeScheduler::GREEDY
+    ) {
+        epochs += dnum_obs * (sizeof(std::size_t) + sizeof(unsigned char)); // conflict tracking, see optimize_layout_parallel().
+    }
+
+    if (options.early_stop_tolerance > 0) {
+        const double num_sampled = std::min(dnum_obs, static_cast<double>(std::max(options.early_stop_num_samples, 0)));
+        epochs += num_sampled * (sizeof(Index_) + static_cast<double>(num_dim) * sizeof(Float_)) + static_cast<double>(num_dim) * sizeof(double);
+    }
+
+    output.epoch_data = epochs + updatable;
+
+    // The fuzzy graph is held throughout initialize(), while the spectral
+    // initialization and the epoch data are never held at the same time.
+    output.peak = output.fuzzy_graph + std::max(output.spectral_init, static_cast<std::size_t>(epochs));
+
+    output.num_epochs = choose_num_epochs<Index_>(options.num_epochs, num_obs);
+
+    // Each observation's similarities sum to log2(k + 1) * bandwidth, see
+    // neighbor_similarities(), so the directed similarities sum to S across
+    // all observations. For a mix ratio of r, the symmetrized strengths sum to
+    // r * (2 * S - X) + (1 - r) * X, where X is the sum of the products of
+    // reciprocal similarities and lies in [0, S]. This is at most
+    // max(2 * r, 1) * S.
+    const double directed_sum = dnum_obs * std::log2(dnum_neighbors + 1) * options.bandwidth;
+    const double strength_sum = std::max(2 * options.mix_ratio, 1.0) * directed_sum;
+    output.num_edge_updates = std::min(strength_sum, num_symmetrized) * output.num_epochs;
+    output.num_negative_samples = output.num_edge_updates * options.negative_sample_rate;
+
+    return output;
+}
+
+}
+
+#endif
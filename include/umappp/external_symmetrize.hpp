@@ -0,0 +1,428 @@
+#ifndef UMAPPP_EXTERNAL_SYMMETRIZE_HPP
+#define UMAPPP_EXTERNAL_SYMMETRIZE_HPP
+
+#include <vector>
+#include <algorithm>
+#include <queue>
+#include <memory>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <stdexcept>
+#include <filesystem>
+#include <random>
+#include <system_error>
+#include <type_traits>
+
+#include "sanisizer/sanisizer.hpp"
+
+#include "combine_neighbor_sets.hpp"
+#include "compressed_neighbors.hpp"
+#include "utils.hpp"
+
+namespace umappp {
+
+/*
+ * Binary file that is deleted upon destruction. If no directory is supplied,
+ * we use std::tmpfile(), which is removed automatically when closed.
+ */
+class TemporaryFile {
+public:
+    TemporaryFile(const std::string& directory) {
+        if (directory.empty()) {
+            my_handle = std::tmpfile();
+        } else {
+            std::random_device rd;
+            for (int attempt = 0; attempt < 100 && my_handle == NULL; ++attempt) {
+                auto candidate = std::filesystem::path(directory) / ("umappp-" + std::to_string(rd()) + "-" + std::to_string(rd()) + ".tmp");
+                std::error_code ec;
+                if (std::filesystem::exists(candidate, ec) || ec) {
+                    continue;
+                }
+                my_handle = std::fopen(candidate.string().c_str(), "w+b");
+                if (my_handle) {
+                    my_path = candidate;
+                }
+            }
+        }
+
+        if (my_handle == NULL) {
+            throw std::runtime_error("failed to create a temporary file for symmetrization");
+        }
+    }
+
+    ~TemporaryFile() {
+        std::fclose(my_handle);
+        if (!my_path.empty()) {
+            std::error_code ec;
+            std::filesystem::remove(my_path, ec);
+        }
+    }
+
+    TemporaryFile(const TemporaryFile&) = delete;
+    TemporaryFile& operator=(const TemporaryFile&) = delete;
+    TemporaryFile(TemporaryFile&&) = delete;
+    TemporaryFile& operator=(TemporaryFile&&) = delete;
+
+    template<typename Record_>
+    void write(const Record_* const data, const std::size_t n) {
+        static_assert(std::is_trivially_copyable<Record_>::value);
+        if (std::fwrite(data, sizeof(Record_), n, my_handle) != n) {
+            throw std::runtime_error("failed to write to a temporary file for symmetrization");
+        }
+    }
+
+    void rewind() {
+        if (std::fflush(my_handle) != 0 || std::fseek(my_handle, 0, SEEK_SET) != 0) {
+            throw std::runtime_error("failed to rewind a temporary file for symmetrization");
+        }
+    }
+
+    template<typename Record_>
+    std::size_t read(Record_* const data, const std::size_t n) {
+        const auto nread = std::fread(data, sizeof(Record_), n, my_handle);
+        if (nread < n && std::ferror(my_handle)) {
+            throw std::runtime_error("failed to read from a temporary file for symmetrization");
+        }
+        return nread;
+    }
+
+private:
+    std::FILE* my_handle = NULL;
+    std::filesystem::path my_path;
+};
+
+/*
+ * External-memory equivalent of combine_neighbor_sets(). Each directed edge
+ * is stored as a record of the smaller and larger index, along with the
+ * similarity and its direction. Records are buffered in memory up to the
+ * budget and then written to a temporary file as a sorted run. The runs are
+ * merged so that the (at most two) records for each pair of observations are
+ * adjacent, allowing us to compute the combined similarity in a single
+ * sequential pass. As the records are sorted by the smaller index and then
+ * the larger index, the neighbors of each observation are filled in
+ * increasing order of index.
+ *
+ * Each merge reads from at most 'max_fan_in' runs, so that the number of open
+ * files and the size of each read are bounded. Whenever that many runs of the
+ * same level are present, they are merged into a single run of the next
+ * level; any excess runs at the end are merged in the same manner before the
+ * final merge. The memory for the merges is taken from the record buffer,
+ * which is divided into one chunk for each input run plus one for the output.
+ *
+ * The final merge only happens once. The combined similarities are written
+ * to a spill file while counting the number of neighbors for each
+ * observation, after which the CSR can be allocated to its exact size and
+ * filled from the spill file.
+ *
+ * If all records fit in the budget, no files are created.
+ */
+template<typename Index_, typename Float_>
+class ExternalSymmetrizer {
+private:
+    struct Record {
+        Index_ lower;
+        Index_ upper;
+        Float_ similarity;
+        unsigned char reverse; // whether this is the similarity from 'upper' to 'lower'.
+    };
+
+    static bool record_less(const Record& left, const Record& right) {
+        if (left.lower != right.lower) {
+            return left.lower < right.lower;
+        } else if (left.upper != right.upper) {
+            return left.upper < right.upper;
+        } else {
+            return left.reverse < right.reverse;
+        }
+    }
+
+    static void fill_record(Record& rec, const Index_ lower, const Index_ upper, const Float_ similarity, const bool reverse) {
+        // Setting every byte, as initializing the members does not guarantee
+        // that the padding is zeroed, and we don't want to write uninitialized
+        // bytes to the temporary files.
+        std::memset(static_cast<void*>(&rec), 0, sizeof(Record));
+        rec.lower = lower;
+        rec.upper = upper;
+        rec.similarity = similarity;
+        rec.reverse = reverse;
+    }
+
+public:
+    ExternalSymmetrizer(const Index_ num_obs, const std::size_t memory_budget, std::string directory, const std::size_t max_fan_in = 64) :
+        my_num_obs(num_obs),
+        my_capacity(std::max<std::size_t>(memory_budget / sizeof(Record), 1)),
+        my_directory(std::move(directory))
+    {
+        // Choosing the fan-in so that each chunk has at least 1024 records, to
+        // avoid excessive numbers of small reads.
+        const std::size_t max_chunks = my_capacity / 1024;
+        my_fan_in = std::max<std::size_t>(std::min(max_chunks > 1 ? max_chunks - 1 : 0, max_fan_in), 2);
+        my_chunk_size = std::max<std::size_t>(my_capacity / (my_fan_in + 1), 1);
+
+        // Allocating the buffer once, so that it never grows beyond the budget
+        // (or the minimum of one record per chunk for tiny budgets) and we
+        // never hold the old and new allocations during a reallocation.
+        my_buffer_size = std::max(my_capacity, my_chunk_size * (my_fan_in + 1));
+        reset_buffer();
+    }
+
+    void add(const Index_ from, const Index_ to, const Float_ similarity) {
+        my_buffer.emplace_back();
+        const bool reverse = (from > to);
+        fill_record(my_buffer.back(), (reverse ? to : from), (reverse ? from : to), similarity, reverse);
+        if (my_buffer.size() >= my_capacity) {
+            flush();
+        }
+    }
+
+    // Number of sorted runs that were written to file, before any merging.
+    std::size_t num_runs() const {
+        return my_num_runs;
+    }
+
+    // Number of temporary files that are currently open.
+    std::size_t num_files() const {
+        return my_runs.size();
+    }
+
+    std::size_t fan_in() const {
+        return my_fan_in;
+    }
+
+private:
+    Index_ my_num_obs;
+    std::size_t my_capacity;
+    std::string my_directory;
+    std::size_t my_fan_in;
+    std::size_t my_chunk_size;
+    std::size_t my_buffer_size;
+    std::vector<Record> my_buffer;
+
+    // Emptying the buffer while keeping its allocation for the next run.
+    void reset_buffer() {
+        my_buffer.clear();
+        my_buffer.reserve(my_buffer_size); // no-op if the capacity was retained by clear().
+    }
+
+    struct Run {
+        std::unique_ptr<TemporaryFile> file;
+        int level;
+    };
+    std::vector<Run> my_runs; // levels are non-increasing.
+    std::size_t my_num_runs = 0;
+
+    void flush() {
+        std::sort(my_buffer.begin(), my_buffer.end(), record_less);
+        my_runs.push_back(Run{ std::unique_ptr<TemporaryFile>(new TemporaryFile(my_directory)), 0 });
+        my_runs.back().file->write(my_buffer.data(), my_buffer.size());
+        reset_buffer();
+        ++my_num_runs;
+
+        while (my_runs.size() >= my_fan_in) {
+            const auto first = my_runs.size() - my_fan_in;
+            if (my_runs[first].level != my_runs.back().level) {
+                break;
+            }
+            consolidate(first);
+        }
+    }
+
+    // Writes records to 'file' through the output chunk, i.e., the last chunk of the buffer.
+    class ChunkWriter {
+    public:
+        ChunkWriter(Record* chunk, std::size_t size, TemporaryFile& file) : my_chunk(chunk), my_size(size), my_file(file) {}
+
+        Record& next() {
+            if (my_used == my_size) {
+                flush();
+            }
+            return my_chunk[my_used++];
+        }
+
+        void flush() {
+            my_file.write(my_chunk, my_used);
+            my_used = 0;
+        }
+
+    private:
+        Record* my_chunk;
+        std::size_t my_size;
+        TemporaryFile& my_file;
+        std::size_t my_used = 0;
+    };
+
+    Record* output_chunk() {
+        return my_buffer.data() + my_fan_in * my_chunk_size;
+    }
+
+    // Calls 'fun' with each record of the runs in '[first, my_runs.size())' in sorted order.
+    // The first 'my_fan_in' chunks of the buffer are used to read from the runs.
+    template<class Function_>
+    void merge(const std::size_t first, Function_ fun) {
+        const auto num_merged = my_runs.size() - first;
+        std::vector<std::size_t> positions(num_merged), lengths(num_merged);
+
+        const auto refill = [&](const std::size_t r) -> bool {
+            lengths[r] = my_runs[first + r].file->read(my_buffer.data() + r * my_chunk_size, my_chunk_size);
+            positions[r] = 0;
+            return lengths[r] > 0;
+        };
+
+        const auto current = [&](const std::size_t r) -> const Record& {
+            return my_buffer[r * my_chunk_size + positions[r]];
+        };
+        const auto compare = [&](const std::size_t left, const std::size_t right) -> bool {
+            return record_less(current(right), current(left)); // reversed for a min-heap.
+        };
+        std::priority_queue<std::size_t, std::vector<std::size_t>, I<decltype(compare)> > heap(compare);
+
+        for (std::size_t r = 0; r < num_merged; ++r) {
+            my_runs[first + r].file->rewind();
+            if (refill(r)) {
+                heap.push(r);
+            }
+        }
+
+        while (!heap.empty()) {
+            const auto r = heap.top();
+            heap.pop();
+            fun(current(r));
+            ++positions[r];
+            if (positions[r] < lengths[r] || refill(r)) {
+                heap.push(r);
+            }
+        }
+    }
+
+    // Merges the runs in '[first, my_runs.size())' into a single run of the next level.
+    void consolidate(const std::size_t first) {
+        const int level = my_runs[first].level + 1;
+        std::unique_ptr<TemporaryFile> output(new TemporaryFile(my_directory));
+
+        my_buffer.resize(my_chunk_size * (my_fan_in + 1));
+        ChunkWriter writer(output_chunk(), my_chunk_size, *output);
+        merge(first, [&](const Record& rec) -> void {
+            writer.next() = rec;
+        });
+        writer.flush();
+        reset_buffer();
+
+        my_runs.resize(first);
+        my_runs.push_back(Run{ std::move(output), level });
+    }
+
+    // Calls 'fun' with the smaller index, larger index and combined similarity
+    // for each pair, given a 'source' that calls its argument with each record
+    // in sorted order.
+    template<class Source_, class Function_>
+    static void combine(Source_ source, const Float_ mix_ratio, Function_ fun) {
+        bool has_last = false;
+        Index_ last_lower = 0, last_upper = 0;
+        Float_ forward = 0, backward = 0;
+
+        const auto emit = [&]() -> void {
+            if (!has_last) {
+                return;
+            }
+            const Float_ prob = combine_similarities(forward, backward, mix_ratio);
+            if (mix_ratio == 0 && prob == 0) { // combine_neighbor_sets() removes all zero probabilities when the mix ratio is zero.
+                return;
+            }
+            fun(last_lower, last_upper, prob);
+        };
+
+        source([&](const Record& rec) -> void {
+            if (!has_last || rec.lower != last_lower || rec.upper != last_upper) {
+                emit();
+                has_last = true;
+                last_lower = rec.lower;
+                last_upper = rec.upper;
+                forward = 0;
+                backward = 0;
+            }
+            (rec.reverse ? backward : forward) = rec.similarity;
+        });
+        emit();
+    }
+
+public:
+    CompressedNeighborList<Index_, Float_> finish(const Float_ mix_ratio) {
+        CompressedNeighborList<Index_, Float_> output;
+        output.pointers.resize(sanisizer::sum<I<decltype(output.pointers.size())> >(my_num_obs, 1));
+        const auto count = [&](const Index_ lower, const Index_ upper, const Float_) -> void {
+            ++(output.pointers[lower + 1]);
+            ++(output.pointers[upper + 1]);
+        };
+
+        I<decltype(output.pointers)> offsets;
+        const auto allocate = [&]() -> void {
+            for (Index_ i = 0; i < my_num_obs; ++i) {
+                output.pointers[i + 1] += output.pointers[i];
+            }
+            output.entries.resize(output.pointers.back());
+            offsets = output.pointers;
+        };
+        const auto fill = [&](const Index_ lower, const Index_ upper, const Float_ prob) -> void {
+            output.entries[offsets[lower]++] = std::make_pair(upper, prob);
+            output.entries[offsets[upper]++] = std::make_pair(lower, prob);
+        };
+
+        if (my_runs.empty()) {
+            // Everything is in memory, so we just iterate over the buffer twice.
+            std::sort(my_buffer.begin(), my_buffer.end(), record_less);
+            const auto source = [&](auto fun) -> void {
+                for (const auto& rec : my_buffer) {
+                    fun(rec);
+                }
+            };
+            combine(source, mix_ratio, count);
+            allocate();
+            combine(source, mix_ratio, fill);
+
+        } else {
+            if (!my_buffer.empty()) {
+                flush();
+            }
+            while (my_runs.size() > my_fan_in) {
+                consolidate(my_runs.size() - my_fan_in);
+            }
+
+            // Storing each combined similarity in a record, where the direction is irrelevant.
+            TemporaryFile spill(my_directory);
+            my_buffer.resize(my_chunk_size * (my_fan_in + 1));
+            ChunkWriter writer(output_chunk(), my_chunk_size, spill);
+            const auto source = [&](auto fun) -> void {
+                merge(0, fun);
+            };
+            combine(source, mix_ratio, [&](const Index_ lower, const Index_ upper, const Float_ prob) -> void {
+                count(lower, upper, prob);
+                fill_record(writer.next(), lower, upper, prob, false);
+            });
+            writer.flush();
+            my_runs.clear();
+
+            allocate();
+            spill.rewind();
+            while (true) {
+                const auto nread = spill.read(my_buffer.data(), my_buffer.size());
+                if (nread == 0) {
+                    break;
+                }
+                for (std::size_t i = 0; i < nread; ++i) {
+                    const auto& rec = my_buffer[i];
+                    fill(rec.lower, rec.upper, rec.similarity);
+                }
+            }
+        }
+
+        my_buffer.clear();
+        my_buffer.shrink_to_fit();
+        return output;
+    }
+};
+
+}
+
+#endif
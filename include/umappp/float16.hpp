@@ -0,0 +1,125 @@
+#ifndef UMAPPP_FLOAT16_HPP
+#define UMAPPP_FLOAT16_HPP
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+namespace umappp {
+
+/*
+ * Storage-only IEEE 754 binary16 type for the embedding coordinates, see
+ * OptimizePrecision::HALF. All arithmetic is performed in single precision
+ * after widening, and the result is narrowed with round-to-nearest-even on
+ * store. We use the F16C instructions if available, otherwise we fall back
+ * to the bit manipulations from Fabian Giesen's public domain
+ * float_to_half_fast3_rtne() and half_to_float_fast5().
+ */
+class Float16 {
+public:
+    Float16() = default;
+
+    Float16(const float x) : my_bits(narrow(x)) {}
+
+    operator float() const {
+        return widen(my_bits);
+    }
+
+    Float16& operator+=(const float x) {
+        my_bits = narrow(widen(my_bits) + x);
+        return *this;
+    }
+
+    Float16& operator-=(const float x) {
+        my_bits = narrow(widen(my_bits) - x);
+        return *this;
+    }
+
+    std::uint16_t bits() const {
+        return my_bits;
+    }
+
+    static Float16 from_bits(const std::uint16_t bits) {
+        Float16 output;
+        output.my_bits = bits;
+        return output;
+    }
+
+private:
+    std::uint16_t my_bits;
+
+    static std::uint32_t float_bits(const float x) {
+        std::uint32_t u;
+        std::memcpy(&u, &x, sizeof(u));
+        return u;
+    }
+
+    static float bits_float(const std::uint32_t u) {
+        float x;
+        std::memcpy(&x, &u, sizeof(x));
+        return x;
+    }
+
+    static std::uint16_t narrow(const float x) {
+#ifdef __F16C__
+        return _cvtss_sh(x, _MM_FROUND_TO_NEAREST_INT);
+#else
+        std::uint32_t u = float_bits(x);
+        const std::uint32_t sign = u & 0x80000000u;
+        u ^= sign;
+
+        std::uint32_t output;
+        if (u >= (static_cast<std::uint32_t>(127 + 16) << 23)) {
+            // Overflows to infinity, or is already infinite or NaN.
+            output = (u > (static_cast<std::uint32_t>(255) << 23) ? 0x7e00 : 0x7c00);
+        } else if (u < (static_cast<std::uint32_t>(113) << 23)) {
+            // Subnormal or zero in half precision. Adding a magic number
+            // aligns the 10 mantissa bits at the bottom of the float, and the
+            // float addition takes care of the rounding.
+            const std::uint32_t magic = static_cast<std::uint32_t>((127 - 15) + (23 - 10) + 1) << 23;
+            output = float_bits(bits_float(u) + bits_float(magic)) - magic;
+        } else {
+            // Rebiasing the exponent and rounding to the nearest even mantissa.
+            const std::uint32_t mantissa_odd = (u >> 13) & 1;
+            u -= static_cast<std::uint32_t>(127 - 15) << 23;
+            u += 0xfff + mantissa_odd;
+            output = u >> 13;
+        }
+
+        return static_cast<std::uint16_t>(output | (sign >> 16));
+#endif
+    }
+
+    static float widen(const std::uint16_t h) {
+#ifdef __F16C__
+        return _cvtsh_ss(h);
+#else
+        const std::uint32_t shifted_exp = static_cast<std::uint32_t>(0x7c00) << 13;
+        std::uint32_t u = static_cast<std::uint32_t>(h & 0x7fff) << 13;
+        const std::uint32_t exp = shifted_exp & u;
+        u += static_cast<std::uint32_t>(127 - 15) << 23;
+
+        float output;
+        if (exp == shifted_exp) {
+            // Infinity or NaN.
+            u += static_cast<std::uint32_t>(128 - 16) << 23;
+            output = bits_float(u);
+        } else if (exp == 0) {
+            // Zero or subnormal, renormalized via float subtraction.
+            u += static_cast<std::uint32_t>(1) << 23;
+            output = bits_float(u) - bits_float(static_cast<std::uint32_t>(113) << 23);
+        } else {
+            output = bits_float(u);
+        }
+
+        return (h & 0x8000) ? -output : output;
+#endif
+    }
+};
+
+}
+
+#endif
@@ -6,6 +6,9 @@
 #include "find_ab.hpp"
 #include "neighbor_similarities.hpp"
 #include "spectral_init.hpp"
+#include "multilevel.hpp"
+#include "landmark.hpp"
+#include "update_graph.hpp"
 #include "Status.hpp"
 
 #include "knncolle/knncolle.hpp"
@@ -13,6 +16,8 @@
 #include <random>
 #include <cstddef>
 #include <optional>
+#include <memory>
+#include <algorithm>
 
 /**
  * @file initialize.hpp
@@ -45,37 +50,41 @@ int choose_num_epochs(const std::optional<int> num_epochs, const Index_ size) {
         return minimal + static_cast<int>(std::ceil(maximal * static_cast<double>(limit) / static_cast<double>(size)));
     }
 }
-/**
- * @endcond
- */
 
-/** 
- * @tparam Index_ Integer type of the neighbor indices.
- * @tparam Float_ Floating-point type of the distances.
- *
- * @param x Indices and distances to the nearest neighbors for each observation.
- * For each observation, neighbors should be unique and sorted in order of increasing distance; see the `NeighborList` description for details.
- * @param num_dim Number of dimensions of the embedding.
- * @param[out] embedding Pointer to an array in which to store the embedding.
- * This is treated as a column-major matrix where rows are dimensions (`num_dim`) and columns are observations (`x.size()`).
- * On output, this contains the initial coordinates of the embedding.
- * Existing values in this array will not be modified if `Options::initialize_method = InitializeMethod::NONE`, 
- * or if `Options::initialize_method = InitializeMethod::SPECTRAL` and spectral initialization fails and `Options::initialize_random_on_spectral_fail = false`.
- * @param options Further options.
- * Note that `Options::num_neighbors` is ignored here.
- *
- * @return A `Status` object containing the initial state of the UMAP algorithm.
- */
+// If 'updatable' is supplied, it is filled with the neighbor lists and the
+// directed similarities, for use in Status::update().
 template<typename Index_, typename Float_>
-Status<Index_, Float_> initialize(NeighborList<Index_, Float_> x, const std::size_t num_dim, Float_* const embedding, Options options) {
+void build_fuzzy_graph(NeighborList<Index_, Float_>& x, const Options& options, UpdatableGraph<Index_, Float_>* const updatable = NULL) {
+    if (updatable) {
+        updatable->neighbors = x;
+    }
+
     NeighborSimilaritiesOptions<Float_> nsopt;
     nsopt.local_connectivity = options.local_connectivity;
     nsopt.bandwidth = options.bandwidth;
     nsopt.num_threads = options.num_threads;
     neighbor_similarities(x, nsopt);
 
+    if (updatable) {
+        auto& sims = updatable->similarities;
+        sims.reserve(x.size());
+        for (const auto& current : x) {
+            sims.emplace_back();
+            sims.back().reserve(current.size());
+            for (const auto& nn : current) {
+                sims.back().push_back(nn.second);
+            }
+        }
+        fill_reverse_neighbors(*updatable);
+    }
+
     combine_neighbor_sets(x, static_cast<Float_>(options.mix_ratio));
+}
 
+// 'Edges_' may be a NeighborList or a CompressedNeighborList.
+template<class Edges_, typename Float_>
+void initialize_embedding_direct(const Edges_& x, const std::size_t num_dim, Float_* const embedding, const Options& options) {
+    typedef I<decltype(x[0][0].first)> Index_;
     bool use_random = (options.initialize_method == InitializeMethod::RANDOM);
     if (options.initialize_method == InitializeMethod::SPECTRAL) {
         const bool spectral_okay = spectral_init(
@@ -101,7 +110,31 @@ Status<Index_, Float_> initialize(NeighborList<Index_, Float_> x, const std::siz
             options.initialize_random_scale
         );
     }
+}
+
+// This should only be called after resolve_options(), as the multilevel and
+// landmark initializations need to know the values of 'a' and 'b'.
+template<typename Index_, typename Float_>
+void initialize_embedding(const NeighborList<Index_, Float_>& x, const std::size_t num_dim, Float_* const embedding, const Options& options) {
+    const auto initialize_graph = [&](const NeighborList<Index_, Float_>& graph, Float_* const graph_embedding) -> void {
+        if (options.initialize_multilevel && options.initialize_method != InitializeMethod::NONE) {
+            multilevel_initialize(graph, num_dim, graph_embedding, options, [&](const NeighborList<Index_, Float_>& coarsest, Float_* const coarsest_embedding) -> void {
+                initialize_embedding_direct(coarsest, num_dim, coarsest_embedding, options);
+            });
+        } else {
+            initialize_embedding_direct(graph, num_dim, graph_embedding, options);
+        }
+    };
+
+    if (options.initialize_landmark && options.initialize_method != InitializeMethod::NONE) {
+        landmark_initialize(x, num_dim, embedding, options, initialize_graph);
+    } else {
+        initialize_graph(x, embedding);
+    }
+}
 
+template<typename Index_>
+void resolve_options(Options& options, const Index_ num_obs) {
     // Finding a good a/b pair.
     if (!options.a.has_value() || !options.b.has_value()) {
         const auto found = find_ab(options.spread, options.min_dist);
@@ -109,12 +142,63 @@ Status<Index_, Float_> initialize(NeighborList<Index_, Float_> x, const std::siz
         options.b = found.second;
     }
 
-    options.num_epochs = choose_num_epochs<Index_>(options.num_epochs, x.size());
+    options.num_epochs = choose_num_epochs<Index_>(options.num_epochs, num_obs);
+}
+/**
+ * @endcond
+ */
+
+/** 
+ * @tparam Index_ Integer type of the neighbor indices.
+ * @tparam Float_ Floating-point type of the distances.
+ * @tparam Engine_ Random number generator for the optimization, see `Status` for details.
+ *
+ * @param x Indices and distances to the nearest neighbors for each observation.
+ * For each observation, neighbors should be unique and sorted in order of increasing distance; see the `NeighborList` description for details.
+ * @param num_dim Number of dimensions of the embedding.
+ * @param[out] embedding Pointer to an array in which to store the embedding.
+ * This is treated as a column-major matrix where rows are dimensions (`num_dim`) and columns are observations (`x.size()`).
+ * On output, this contains the initial coordinates of the embedding.
+ * Existing values in this array will not be modified if `Options::initialize_method = InitializeMethod::NONE`, 
+ * or if `Options::initialize_method = InitializeMethod::SPECTRAL` and spectral initialization fails and `Options::initialize_random_on_spectral_fail = false`.
+ * @param options Further options.
+ * Note that `Options::num_neighbors` is ignored here.
+ *
+ * @return A `Status` object containing the initial state of the UMAP algorithm.
+ */
+template<typename Index_, typename Float_, class Engine_ = RngEngine>
+Status<Index_, Float_, Engine_> initialize(NeighborList<Index_, Float_> x, const std::size_t num_dim, Float_* const embedding, Options options) {
+    std::optional<UpdatableGraph<Index_, Float_> > updatable;
+    if (options.update_enabled) {
+        updatable.emplace();
+    }
+    build_fuzzy_graph(x, options, (updatable.has_value() ? &(*updatable) : NULL));
+    resolve_options<Index_>(options, x.size());
+    initialize_embedding(x, num_dim, embedding, options);
+
+    if (updatable.has_value()) {
+        // Same constants as in similarities_to_graph().
+        for (const auto& current : x) {
+            for (const auto& nn : current) {
+                updatable->max_weight = std::max(updatable->max_weight, nn.second);
+            }
+        }
+        updatable->num_epochs = *(options.num_epochs);
+    }
+
+    auto graph = similarities_to_graph<Index_, Float_>(x, *(options.num_epochs));
+    prepare_scheduler(graph, options.optimize_scheduler, *(options.num_epochs));
+    auto epochs = create_epoch_data<Index_, Float_>(
+        std::make_shared<const EpochGraph<Index_, Float_> >(std::move(graph)),
+        *(options.num_epochs),
+        options.negative_sample_rate
+    );
 
-    return Status<Index_, Float_>(
-        similarities_to_epochs<Index_, Float_>(x, *(options.num_epochs), options.negative_sample_rate),
+    return Status<Index_, Float_, Engine_>(
+        std::move(epochs),
         std::move(options),
-        num_dim
+        num_dim,
+        std::move(updatable)
     );
 }
 
@@ -123,6 +207,7 @@ Status<Index_, Float_> initialize(NeighborList<Index_, Float_> x, const std::siz
  * @tparam Input_ Floating-point type of the input data for the neighbor search.
  * This only used to define the `knncolle::Prebuilt` type and is otherwise ignored.
  * @tparam Float_ Floating-point type of the input data, neighbor distances and output embedding.
+ * @tparam Engine_ Random number generator for the optimization, see `Status` for details.
  *
  * @param prebuilt A neighbor search index built on the dataset of interest.
  * @param num_dim Number of dimensions of the UMAP embedding.
@@ -135,10 +220,10 @@ Status<Index_, Float_> initialize(NeighborList<Index_, Float_> x, const std::siz
  *
  * @return A `Status` object containing the initial state of the UMAP algorithm.
  */
-template<typename Index_, typename Input_, typename Float_>
-Status<Index_, Float_> initialize(const knncolle::Prebuilt<Index_, Input_, Float_>& prebuilt, const std::size_t num_dim, Float_* const embedding, Options options) { 
+template<typename Index_, typename Input_, typename Float_, class Engine_ = RngEngine>
+Status<Index_, Float_, Engine_> initialize(const knncolle::Prebuilt<Index_, Input_, Float_>& prebuilt, const std::size_t num_dim, Float_* const embedding, Options options) { 
     auto output = knncolle::find_nearest_neighbors(prebuilt, options.num_neighbors, options.num_threads);
-    return initialize(std::move(output), num_dim, embedding, std::move(options));
+    return initialize<Index_, Float_, Engine_>(std::move(output), num_dim, embedding, std::move(options));
 }
 
 /**
@@ -146,6 +231,7 @@ Status<Index_, Float_> initialize(const knncolle::Prebuilt<Index_, Input_, Float
  * @tparam Float_ Floating-point type of the input data, neighbor distances and output embedding.
  * @tparam Matrix_ Class of the input matrix for the neighbor search.
  * This should be a `knncolle::SimpleMatrix` or `knncolle::Matrix`.
+ * @tparam Engine_ Random number generator for the optimization, see `Status` for details.
  * 
  * @param data_dim Number of dimensions of the input dataset.
  * @param num_obs Number of observations in the input dataset.
@@ -162,8 +248,8 @@ Status<Index_, Float_> initialize(const knncolle::Prebuilt<Index_, Input_, Float
  *
  * @return A `Status` object containing the initial state of the UMAP algorithm.
  */
-template<typename Index_, typename Float_, class Matrix_ = knncolle::Matrix<Index_, Float_> >
-Status<Index_, Float_> initialize(
+template<typename Index_, typename Float_, class Matrix_ = knncolle::Matrix<Index_, Float_>, class Engine_ = RngEngine>
+Status<Index_, Float_, Engine_> initialize(
     const std::size_t data_dim,
     const Index_ num_obs,
     const Float_* const data,
@@ -173,7 +259,7 @@ Status<Index_, Float_> initialize(
     Options options)
 { 
     const auto prebuilt = builder.build_unique(knncolle::SimpleMatrix<Index_, Float_>(data_dim, num_obs, data));
-    return initialize(*prebuilt, num_dim, embedding, std::move(options));
+    return initialize<Index_, Float_, Float_, Engine_>(*prebuilt, num_dim, embedding, std::move(options));
 }
 
 }
@@ -0,0 +1,220 @@
+#ifndef UMAPPP_LANDMARK_HPP
+#define UMAPPP_LANDMARK_HPP
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cstddef>
+#include <cmath>
+
+#include "aarand/aarand.hpp"
+#include "sanisizer/sanisizer.hpp"
+
+#include "NeighborList.hpp"
+#include "Options.hpp"
+#include "optimize_layout.hpp"
+#include "optimize_layout_subset.hpp"
+#include "multilevel.hpp"
+#include "rng.hpp"
+#include "utils.hpp"
+
+namespace umappp {
+
+/*
+ * Landmarks are either chosen at random or as the observations with the
+ * largest weighted degree in the fuzzy graph, i.e., those in dense regions.
+ * The output is sorted in increasing order of index.
+ */
+template<typename Index_, typename Float_>
+std::vector<Index_> select_landmarks(const NeighborList<Index_, Float_>& x, const Index_ num_landmarks, const LandmarkMethod method, const typename RngEngine::result_type seed) {
+    const Index_ num_obs = x.size();
+    auto landmarks = sanisizer::create<std::vector<Index_> >(num_landmarks);
+
+    if (method == LandmarkMethod::UNIFORM) {
+        RngEngine rng(seed);
+        aarand::sample(num_obs, num_landmarks, landmarks.begin(), rng);
+        return landmarks;
+    }
+
+    auto degree = sanisizer::create<std::vector<Float_> >(num_obs);
+    for (Index_ i = 0; i < num_obs; ++i) {
+        for (const auto& edge : x[i]) {
+            degree[i] += edge.second;
+        }
+    }
+
+    auto order = sanisizer::create<std::vector<Index_> >(num_obs);
+    std::iota(order.begin(), order.end(), static_cast<Index_>(0));
+    std::partial_sort(order.begin(), order.begin() + num_landmarks, order.end(), [&](const Index_ left, const Index_ right) -> bool {
+        if (degree[left] == degree[right]) {
+            return left < right; // breaking ties by index for reproducibility.
+        }
+        return degree[left] > degree[right];
+    });
+    std::copy_n(order.begin(), num_landmarks, landmarks.begin());
+    std::sort(landmarks.begin(), landmarks.end());
+    return landmarks;
+}
+
+/*
+ * Each observation is assigned to its closest landmark (by the number of hops
+ * in the fuzzy graph) with a multi-source breadth-first search. Observations
+ * in components without any landmarks are promoted to landmarks themselves,
+ * so every observation ends up with a position after interpolation.
+ */
+template<typename Index_, typename Float_>
+std::vector<Index_> assign_to_landmarks(const NeighborList<Index_, Float_>& x, std::vector<Index_>& landmarks) {
+    const Index_ num_obs = x.size();
+    std::vector<Index_> assignment(num_obs, num_obs); // using 'num_obs' as a placeholder for unassigned observations.
+    std::vector<Index_> queue;
+    queue.reserve(num_obs);
+
+    const auto search = [&]() -> void {
+        for (std::size_t q = 0; q < queue.size(); ++q) {
+            const auto current = queue[q];
+            for (const auto& edge : x[current]) {
+                auto& target = assignment[edge.first];
+                if (target == num_obs) {
+                    target = assignment[current];
+                    queue.push_back(edge.first);
+                }
+            }
+        }
+        queue.clear();
+    };
+
+    const Index_ num_landmarks = landmarks.size();
+    for (Index_ l = 0; l < num_landmarks; ++l) {
+        assignment[landmarks[l]] = l;
+        queue.push_back(landmarks[l]);
+    }
+    search();
+
+    for (Index_ i = 0; i < num_obs; ++i) {
+        if (assignment[i] == num_obs) {
+            assignment[i] = landmarks.size();
+            landmarks.push_back(i);
+            queue.push_back(i);
+            search();
+        }
+    }
+
+    return assignment;
+}
+
+/*
+ * Refinement of the non-landmark observations, holding the landmarks fixed.
+ */
+template<typename Index_, typename Float_>
+void refine_with_frozen_landmarks(
+    const NeighborList<Index_, Float_>& x,
+    const std::size_t num_dim,
+    Float_* const embedding,
+    const std::vector<unsigned char>& is_landmark,
+    const Options& options,
+    const int num_epochs)
+{
+    if (num_epochs <= 0) {
+        return;
+    }
+
+    auto setup = similarities_to_epochs<Index_, Float_>(x, num_epochs, options.negative_sample_rate);
+    const Index_ num_obs = x.size();
+    std::vector<Index_> active;
+    active.reserve(num_obs);
+    for (Index_ i = 0; i < num_obs; ++i) {
+        if (!is_landmark[i]) {
+            active.push_back(i);
+        }
+    }
+
+    RngEngine rng(options.optimize_seed);
+    optimize_layout_subset<Index_, Float_>(
+        num_dim,
+        embedding,
+        setup,
+        active,
+        is_landmark,
+        *(options.a),
+        *(options.b),
+        options.repulsion_strength,
+        options.learning_rate,
+        rng
+    );
+}
+
+/*
+ * Landmark initialization. We select a subset of landmark observations,
+ * assign every other observation to its closest landmark, and contract the
+ * fuzzy graph accordingly to obtain a graph over the landmarks only. This
+ * graph is initialized with 'init' and optimized, after which each
+ * non-landmark observation is placed at the weighted average of its landmark
+ * neighbors, or at its assigned landmark if it has no landmark neighbors.
+ * A small jitter is added to avoid stacking observations at the same
+ * position, followed by an optional refinement with frozen landmarks.
+ */
+template<typename Index_, typename Float_, class Init_>
+void landmark_initialize(const NeighborList<Index_, Float_>& x, const std::size_t num_dim, Float_* const embedding, const Options& options, Init_ init) {
+    const Index_ num_obs = x.size();
+    if (options.initialize_landmark_number <= 0 || static_cast<std::size_t>(options.initialize_landmark_number) >= static_cast<std::size_t>(num_obs)) {
+        init(x, embedding);
+        return;
+    }
+
+    auto landmarks = select_landmarks(x, static_cast<Index_>(options.initialize_landmark_number), options.initialize_landmark_method, options.initialize_seed);
+    const auto assignment = assign_to_landmarks(x, landmarks);
+    const Index_ num_landmarks = landmarks.size();
+    const auto landmark_graph = contract_graph(x, assignment, num_landmarks, max_num_edges(x));
+
+    auto landmark_embedding = sanisizer::create<std::vector<Float_> >(sanisizer::product<std::size_t>(num_landmarks, num_dim));
+    init(landmark_graph, landmark_embedding.data());
+    optimize_intermediate_layout(landmark_graph, num_dim, landmark_embedding.data(), options, options.initialize_landmark_epochs);
+
+    auto is_landmark = sanisizer::create<std::vector<unsigned char> >(num_obs);
+    for (Index_ l = 0; l < num_landmarks; ++l) {
+        is_landmark[landmarks[l]] = true;
+        std::copy_n(
+            landmark_embedding.data() + sanisizer::product_unsafe<std::size_t>(l, num_dim),
+            num_dim,
+            embedding + sanisizer::product_unsafe<std::size_t>(landmarks[l], num_dim)
+        );
+    }
+
+    RngEngine rng(options.initialize_seed);
+    const Float_ jitter_sd = 0.01;
+    for (Index_ i = 0; i < num_obs; ++i) {
+        if (is_landmark[i]) {
+            continue;
+        }
+
+        const auto output = embedding + sanisizer::product_unsafe<std::size_t>(i, num_dim);
+        std::fill_n(output, num_dim, 0);
+        Float_ total = 0;
+        for (const auto& edge : x[i]) {
+            if (is_landmark[edge.first]) {
+                const auto source = landmark_embedding.data() + sanisizer::product_unsafe<std::size_t>(assignment[edge.first], num_dim);
+                for (std::size_t d = 0; d < num_dim; ++d) {
+                    output[d] += edge.second * source[d];
+                }
+                total += edge.second;
+            }
+        }
+
+        if (total > 0) {
+            for (std::size_t d = 0; d < num_dim; ++d) {
+                output[d] /= total;
+            }
+        } else {
+            const auto source = landmark_embedding.data() + sanisizer::product_unsafe<std::size_t>(assignment[i], num_dim);
+            std::copy_n(source, num_dim, output);
+        }
+
+        jitter_layout(num_dim, output, jitter_sd, rng);
+    }
+
+    refine_with_frozen_landmarks(x, num_dim, embedding, is_landmark, options, options.initialize_landmark_refine_epochs);
+}
+
+}
+
+#endif
@@ -0,0 +1,261 @@
+#ifndef UMAPPP_MULTILEVEL_HPP
+#define UMAPPP_MULTILEVEL_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+
+#include "aarand/aarand.hpp"
+#include "sanisizer/sanisizer.hpp"
+
+#include "NeighborList.hpp"
+#include "Options.hpp"
+#include "optimize_layout.hpp"
+#include "utils.hpp"
+
+namespace umappp {
+
+/*
+ * Contraction of the fuzzy graph, given an assignment of each observation to
+ * a group. Each group becomes a single observation in the contracted graph,
+ * where the edge weights between groups are summed across their constituents
+ * and edges within each group are ignored. We cap the number of edges for
+ * each group to avoid a blow-up in the degree of the contracted graph,
+ * keeping the edges with the largest weights. An edge is only retained if it
+ * is kept by both of its endpoints, so that the contracted graph remains
+ * symmetric like the fuzzy graph.
+ */
+template<typename Index_, typename Float_>
+NeighborList<Index_, Float_> contract_graph(const NeighborList<Index_, Float_>& x, const std::vector<Index_>& assignment, const Index_ num_groups, const std::size_t max_edges) {
+    const Index_ num_obs = x.size();
+    auto member_pointers = sanisizer::create<std::vector<std::size_t> >(sanisizer::sum<std::size_t>(num_groups, 1));
+    for (Index_ i = 0; i < num_obs; ++i) {
+        ++member_pointers[assignment[i] + 1];
+    }
+    for (Index_ g = 0; g < num_groups; ++g) {
+        member_pointers[g + 1] += member_pointers[g];
+    }
+    auto members = sanisizer::create<std::vector<Index_> >(num_obs);
+    {
+        auto fill = member_pointers;
+        for (Index_ i = 0; i < num_obs; ++i) {
+            members[fill[assignment[i]]++] = i;
+        }
+    }
+
+    NeighborList<Index_, Float_> output(num_groups);
+    auto truncated = sanisizer::create<std::vector<unsigned char> >(num_groups);
+    bool any_truncated = false;
+    auto position = sanisizer::create<std::vector<std::size_t> >(num_groups);
+    constexpr std::size_t unset = static_cast<std::size_t>(-1);
+    std::fill(position.begin(), position.end(), unset);
+
+    for (Index_ g = 0; g < num_groups; ++g) {
+        auto& current = output[g];
+        for (auto m = member_pointers[g], end = member_pointers[g + 1]; m < end; ++m) {
+            for (const auto& edge : x[members[m]]) {
+                const auto target = assignment[edge.first];
+                if (target == g) {
+                    continue;
+                }
+                auto& pos = position[target];
+                if (pos == unset) {
+                    pos = current.size();
+                    current.emplace_back(target, edge.second);
+                } else {
+                    current[pos].second += edge.second;
+                }
+            }
+        }
+        for (const auto& edge : current) {
+            position[edge.first] = unset;
+        }
+
+        if (current.size() > max_edges) {
+            std::partial_sort(current.begin(), current.begin() + max_edges, current.end(), [](const auto& left, const auto& right) -> bool {
+                return left.second > right.second;
+            });
+            current.resize(max_edges);
+
+            // Sorting by index for the binary searches below.
+            std::sort(current.begin(), current.end());
+            truncated[g] = 1;
+            any_truncated = true;
+        }
+    }
+
+    // Removing edges that were dropped from the other endpoint's truncated row.
+    // Edges are only ever removed if the reverse edge is already absent, so the
+    // rows that are being searched do not lose any entries that are needed.
+    if (any_truncated) {
+        for (Index_ g = 0; g < num_groups; ++g) {
+            auto& current = output[g];
+            auto last = std::remove_if(current.begin(), current.end(), [&](const std::pair<Index_, Float_>& edge) -> bool {
+                if (!truncated[edge.first]) {
+                    return false;
+                }
+                const auto& other = output[edge.first];
+                const auto found = std::lower_bound(other.begin(), other.end(), g, [](const std::pair<Index_, Float_>& left, const Index_ right) -> bool {
+                    return left.first < right;
+                });
+                return found == other.end() || found->first != g;
+            });
+            current.erase(last, current.end());
+        }
+    }
+
+    return output;
+}
+
+/*
+ * Coarsening of the fuzzy graph by heavy-edge matching. Each unmatched
+ * observation is matched with its unmatched neighbor that has the largest
+ * edge weight, and each matched pair (or unmatched singleton) becomes a
+ * single observation in the coarser graph.
+ */
+template<typename Index_, typename Float_>
+NeighborList<Index_, Float_> coarsen_graph(const NeighborList<Index_, Float_>& x, std::vector<Index_>& assignment, const std::size_t max_edges) {
+    const Index_ num_obs = x.size();
+    assignment.clear();
+    assignment.resize(num_obs, num_obs); // using 'num_obs' as a placeholder for unassigned observations.
+    Index_ num_coarse = 0;
+
+    for (Index_ i = 0; i < num_obs; ++i) {
+        if (assignment[i] != num_obs) {
+            continue;
+        }
+
+        Index_ best = num_obs;
+        Float_ best_weight = 0;
+        for (const auto& edge : x[i]) {
+            if (edge.first != i && assignment[edge.first] == num_obs && (best == num_obs || edge.second > best_weight)) {
+                best = edge.first;
+                best_weight = edge.second;
+            }
+        }
+
+        assignment[i] = num_coarse;
+        if (best != num_obs) {
+            assignment[best] = num_coarse;
+        }
+        ++num_coarse;
+    }
+
+    return contract_graph(x, assignment, num_coarse, max_edges);
+}
+
+template<typename Index_, typename Float_>
+std::size_t max_num_edges(const NeighborList<Index_, Float_>& x) {
+    std::size_t max_edges = 0;
+    for (const auto& current : x) {
+        max_edges = std::max(max_edges, current.size());
+    }
+    return max_edges;
+}
+
+// Short optimization of an intermediate layout, e.g., for a coarsened graph.
+template<typename Index_, typename Float_>
+void optimize_intermediate_layout(const NeighborList<Index_, Float_>& graph, const std::size_t num_dim, Float_* const embedding, const Options& options, const int num_epochs) {
+    if (num_epochs <= 0) {
+        return;
+    }
+    auto epochs = similarities_to_epochs<Index_, Float_>(graph, num_epochs, options.negative_sample_rate);
+    RngEngine engine(options.optimize_seed);
+    optimize_layout<Index_, Float_>(
+        num_dim,
+        embedding,
+        epochs,
+        *(options.a),
+        *(options.b),
+        options.repulsion_strength,
+        options.learning_rate,
+        engine,
+        num_epochs
+    );
+}
+
+template<typename Float_, class Rng_>
+void jitter_layout(const std::size_t ntotal, Float_* const embedding, const Float_ sd, Rng_& rng) {
+    const auto half_ntotal = ntotal / 2;
+    for (std::size_t i = 0; i < half_ntotal; ++i) {
+        const auto sampled = aarand::standard_normal(rng);
+        embedding[2 * i] += sampled.first * sd;
+        embedding[2 * i + 1] += sampled.second * sd;
+    }
+    if (ntotal % 2 == 1) {
+        embedding[ntotal - 1] += aarand::standard_normal(rng).first * sd;
+    }
+}
+
+/*
+ * Multilevel initialization. We repeatedly coarsen the graph until it is
+ * small enough; initialize the coarsest graph with 'init', e.g., spectral
+ * initialization; optimize its layout; and then prolong the coordinates to
+ * each finer level, with a short optimization at each intermediate level.
+ * The finest level is left for the usual optimization in Status::run().
+ * The coordinates of each coarse observation are copied to its constituents
+ * and jittered so that matched pairs do not start at the same position.
+ */
+template<typename Index_, typename Float_, class Init_>
+void multilevel_initialize(const NeighborList<Index_, Float_>& x, const std::size_t num_dim, Float_* const embedding, const Options& options, Init_ init) {
+    const auto max_edges = max_num_edges(x);
+    std::vector<NeighborList<Index_, Float_> > levels;
+    std::vector<std::vector<Index_> > assignments;
+    while (true) {
+        const auto& finer = (levels.empty() ? x : levels.back());
+        if (finer.size() <= static_cast<std::size_t>(std::max(options.initialize_multilevel_size, 1))) {
+            break;
+        }
+
+        std::vector<Index_> assignment;
+        auto coarser = coarsen_graph(finer, assignment, max_edges);
+
+        // Giving up if the graph is not getting much smaller, e.g., if most observations are isolated.
+        if (static_cast<double>(coarser.size()) > 0.9 * static_cast<double>(finer.size())) {
+            break;
+        }
+        levels.push_back(std::move(coarser));
+        assignments.push_back(std::move(assignment));
+    }
+
+    if (levels.empty()) {
+        init(x, embedding);
+        return;
+    }
+
+    auto coarse_embedding = sanisizer::create<std::vector<Float_> >(sanisizer::product<std::size_t>(levels.back().size(), num_dim));
+    init(levels.back(), coarse_embedding.data());
+    optimize_intermediate_layout(levels.back(), num_dim, coarse_embedding.data(), options, options.initialize_multilevel_epochs);
+
+    RngEngine rng(options.initialize_seed);
+    const Float_ jitter_sd = 0.01;
+    std::vector<Float_> fine_embedding;
+    for (auto l = levels.size(); l > 0; --l) {
+        const auto& assignment = assignments[l - 1];
+        const std::size_t num_fine = assignment.size();
+        Float_* fine;
+        if (l == 1) {
+            fine = embedding;
+        } else {
+            fine_embedding.resize(sanisizer::product<std::size_t>(num_fine, num_dim));
+            fine = fine_embedding.data();
+        }
+
+        for (std::size_t i = 0; i < num_fine; ++i) {
+            const auto source = coarse_embedding.data() + sanisizer::product_unsafe<std::size_t>(assignment[i], num_dim);
+            std::copy_n(source, num_dim, fine + sanisizer::product_unsafe<std::size_t>(i, num_dim));
+        }
+
+        jitter_layout(sanisizer::product_unsafe<std::size_t>(num_fine, num_dim), fine, jitter_sd, rng);
+
+        if (l > 1) {
+            optimize_intermediate_layout(levels[l - 2], num_dim, fine, options, options.initialize_multilevel_refine_epochs);
+            coarse_embedding.swap(fine_embedding);
+        }
+    }
+}
+
+}
+
+#endif
@@ -6,58 +6,113 @@
 #include <algorithm>
 #include <cmath>
 #include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <utility>
 
 #ifndef UMAPPP_NO_PARALLEL_OPTIMIZATION
 #include <thread>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #else
 #include <stdexcept>
 #endif
 
-#include "aarand/aarand.hpp"
 #include "sanisizer/sanisizer.hpp"
 
 #include "NeighborList.hpp"
+#include "compressed_neighbors.hpp"
+#include "ParallelStatistics.hpp"
+#include "Xoshiro256StarStar.hpp"
+#include "rng.hpp"
+#include "thread_affinity.hpp"
+#include "worker_pool.hpp"
 #include "utils.hpp"
 
 namespace umappp {
 
+/*
+ * Alias table for sampling edges in proportion to their weights, i.e., the
+ * inverse of 'epochs_per_sample', in constant time (Vose's method). We also
+ * store the source observation of each edge, as the compressed sparse
+ * format only allows us to go from observations to edges.
+ *
+ * A graph that is shared between runs with different numbers of epochs is
+ * pruned for the largest number, see initialize_batch(). The table for a run
+ * with fewer epochs only contains the edges that would have been retained by
+ * pruning for its own number of epochs, so that the same edges are sampled as
+ * in initialize(). In that case, 'edges' contains the index of each sampled
+ * edge in the graph; otherwise it is empty and all edges are sampled.
+ */
 template<typename Index_, typename Float_>
-struct EpochData {
-    EpochData(const Index_ nobs) : cumulative_num_edges(sanisizer::sum<I<decltype(cumulative_num_edges.size())> >(nobs, 1)) {}
+struct EdgeAliasTable {
+    int num_epochs = 0;
+    std::vector<Float_> probability;
+    std::vector<std::size_t> alias;
+    std::vector<Index_> sources;
+    std::vector<std::size_t> edges;
+};
 
-    int total_epochs;
-    int current_epoch = 0;
+template<typename Index_, typename Float_>
+struct EpochGraph {
+    EpochGraph(const Index_ nobs) : cumulative_num_edges(sanisizer::sum<I<decltype(cumulative_num_edges.size())> >(nobs, 1)) {}
 
     // Store the graph as a (symmetric) compressed sparse matrix.
     // Cumulative_num_edges is the equivalent to indptrs while edge_targets are the indices.
-    // The various 'epochs_per_*' and 'epoch_of_*' vectors are the values/edge weights.
+    // The 'epochs_per_sample' vector contains the values/edge weights.
     std::vector<std::size_t> cumulative_num_edges;
     std::vector<Index_> edge_targets;
-
     std::vector<Float_> epochs_per_sample;
-    std::vector<Float_> epoch_of_next_sample;
 
+    // Partition of observations into conflict-free batches, only filled for OptimizeScheduler::COLORING.
+    // Batch_pointers is the equivalent to indptrs while batch_observations contains the observations in each batch.
+    std::vector<std::size_t> batch_pointers;
+    std::vector<Index_> batch_observations;
+
+    // Alias tables for sampling edges, one for each number of epochs of the runs
+    // that share this graph. Only filled for OptimizeScheduler::MINIBATCH.
+    std::vector<EdgeAliasTable<Index_, Float_> > edge_alias;
+};
+
+template<typename Index_, typename Float_>
+struct EpochData {
+    // The graph is never modified after construction,
+    // so it can be shared between multiple runs on the same dataset.
+    std::shared_ptr<const EpochGraph<Index_, Float_> > graph;
+
+    int total_epochs;
+    int current_epoch = 0;
+
+    // Per-run schedule, parallel to the edges in 'graph'. The optimizers may
+    // use a different (lower) precision for the embedding coordinates, but the
+    // schedule is always computed in this precision so that the same edges and
+    // negative samples are used, see OptimizePrecision::SINGLE.
+    std::vector<Float_> epoch_of_next_sample;
     std::vector<Float_> epoch_of_next_negative_sample;
     Float_ negative_sample_rate;
+
+    // Per-observation state for the momentum and Adam updates, see OptimizeMethod.
+    // This is filled on first use so that it persists across restarts.
+    std::vector<Float_> optimizer_state;
 };
 
-template<typename Index_, typename Float_>
-EpochData<Index_, Float_> similarities_to_epochs(const NeighborList<Index_, Float_>& p, const int num_epochs, const Float_ negative_sample_rate) {
+// 'Edges_' may be a NeighborList or a CompressedNeighborList.
+template<typename Index_, typename Float_, class Edges_>
+EpochGraph<Index_, Float_> edges_to_graph(const Edges_& p, const int num_epochs) {
+    const Index_ num_obs = p.size(); // Index_ should be able to hold the number of observations.
     Float_ maxed = 0;
     std::size_t count = 0;
-    for (const auto& x : p) {
+    for (Index_ i = 0; i < num_obs; ++i) {
+        const auto& x = p[i];
         count = sanisizer::sum<std::size_t>(count, x.size());
         for (const auto& y : x) {
             maxed = std::max(maxed, y.second);
         }
     }
 
-    const Index_ num_obs = p.size(); // Index_ should be able to hold the number of observations.
-    EpochData<Index_, Float_> output(num_obs);
-    output.total_epochs = num_epochs;
+    EpochGraph<Index_, Float_> output(num_obs);
     output.edge_targets.reserve(count);
     output.epochs_per_sample.reserve(count);
     const Float_ limit = maxed / num_epochs;
@@ -73,29 +128,56 @@ EpochData<Index_, Float_> similarities_to_epochs(const NeighborList<Index_, Floa
         output.cumulative_num_edges[i + 1] = output.edge_targets.size();
     }
 
+    return output;
+}
+
+template<typename Index_, typename Float_>
+EpochGraph<Index_, Float_> similarities_to_graph(const NeighborList<Index_, Float_>& p, const int num_epochs) {
+    return edges_to_graph<Index_, Float_>(p, num_epochs);
+}
+
+template<typename Index_, typename Float_>
+EpochGraph<Index_, Float_> similarities_to_graph(const CompressedNeighborList<Index_, Float_>& p, const int num_epochs) {
+    return edges_to_graph<Index_, Float_>(p, num_epochs);
+}
+
+template<typename Index_, typename Float_>
+EpochData<Index_, Float_> create_epoch_data(std::shared_ptr<const EpochGraph<Index_, Float_> > graph, const int num_epochs, const Float_ negative_sample_rate) {
+    EpochData<Index_, Float_> output;
+    output.total_epochs = num_epochs;
+
     // Filling in some epoch-related running statistics.
-    output.epoch_of_next_sample = output.epochs_per_sample;
-    output.epoch_of_next_negative_sample = output.epochs_per_sample;
+    output.epoch_of_next_sample = graph->epochs_per_sample;
+    output.epoch_of_next_negative_sample = graph->epochs_per_sample;
     for (auto& e : output.epoch_of_next_negative_sample) {
         e /= negative_sample_rate;
     }
     output.negative_sample_rate = negative_sample_rate;
+    output.graph = std::move(graph);
 
     // Maximum value of 'num_neg_samples' should be 'num_epochs * negative_sample_rate', because:
     // - '(epoch - setup.epoch_of_next_negative_sample[j])' has a maximum value of 'num_epochs'.
     // - 'epochs_per_negative_sample' has a minimum value of '1/negative_sample_rate', because:
-    // - 'setup.epochs_per_sample[j]' has a minimum value of 1, when 'y.second == maxed'.
+    // - 'graph.epochs_per_sample[j]' has a minimum value of 1, when 'y.second == maxed'.
     // So we just have to check that the cast is safe once, for the maximum value.
     sanisizer::from_float<int>(static_cast<Float_>(num_epochs) * negative_sample_rate);
 
-    return output;       
+    return output;
 }
 
-template<typename Float_>
-Float_ quick_squared_distance(const Float_* const left, const Float_* const right, const std::size_t num_dim) {
+template<typename Index_, typename Float_>
+EpochData<Index_, Float_> similarities_to_epochs(const NeighborList<Index_, Float_>& p, const int num_epochs, const Float_ negative_sample_rate) {
+    auto graph = std::make_shared<const EpochGraph<Index_, Float_> >(similarities_to_graph(p, num_epochs));
+    return create_epoch_data(std::move(graph), num_epochs, negative_sample_rate);
+}
+
+// The coordinates may be stored in a different type from that used for the
+// gradient calculations, see OptimizePrecision::HALF.
+template<typename Float_, typename Coord_>
+Float_ quick_squared_distance(const Coord_* const left, const Coord_* const right, const std::size_t num_dim) {
     Float_ dist2 = 0;
     for (std::size_t d = 0; d < num_dim; ++d) {
-        Float_ delta = (left[d] - right[d]);
+        Float_ delta = (static_cast<Float_>(left[d]) - static_cast<Float_>(right[d]));
         dist2 += delta * delta;
     }
     constexpr Float_ dist_eps = std::numeric_limits<Float_>::epsilon();
@@ -109,73 +191,145 @@ Float_ clamp(const Float_ input) {
     return std::min(std::max(input, min_gradient), max_gradient);
 }
 
+// Coefficients of the gradients for the attraction along an edge and the
+// repulsion from a negative sample, given the squared distance between the
+// two observations. All optimizers should use these (or the wrappers below)
+// so that they compute exactly the same updates.
+template<typename Float_>
+Float_ attractive_coefficient(const Float_ dist2, const Float_ a, const Float_ b) {
+    const Float_ pd2b = std::pow(dist2, b);
+    return (-2 * a * b * pd2b) / (dist2 * (a * pd2b + 1.0));
+}
+
+template<typename Float_>
+Float_ repulsive_coefficient(const Float_ dist2, const Float_ a, const Float_ b, const Float_ gamma) {
+    return 2 * gamma * b / ((0.001 + dist2) * (a * std::pow(dist2, b) + 1.0));
+}
+
+// Moving the two ends of an edge towards each other. 'right' is left
+// untouched if 'move_right = false', e.g., if its coordinates are fixed.
+template<typename Float_, typename Coord_>
+void attract_pair(Coord_* const left, Coord_* const right, const std::size_t num_dim, const Float_ a, const Float_ b, const Float_ alpha, const bool move_right = true) {
+    const Float_ dist2 = quick_squared_distance<Float_>(left, right, num_dim);
+    const Float_ grad_coef = attractive_coefficient(dist2, a, b);
+    for (std::size_t d = 0; d < num_dim; ++d) {
+        auto& l = left[d];
+        auto& r = right[d];
+        const Float_ gradient = alpha * clamp(grad_coef * (l - r));
+        l += gradient;
+        if (move_right) {
+            r -= gradient;
+        }
+    }
+}
+
+// Moving an observation away from a negative sample.
+template<typename Float_, typename Coord_>
+void repel_from(Coord_* const left, const Coord_* const right, const std::size_t num_dim, const Float_ a, const Float_ b, const Float_ gamma, const Float_ alpha) {
+    const Float_ dist2 = quick_squared_distance<Float_>(left, right, num_dim);
+    const Float_ grad_coef = repulsive_coefficient(dist2, a, b, gamma);
+    for (std::size_t d = 0; d < num_dim; ++d) {
+        left[d] += alpha * clamp(grad_coef * (left[d] - right[d]));
+    }
+}
+
+template<typename Coord_>
+void prefetch_row(const Coord_* const row) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(row);
+#else
+    (void)row;
+#endif
+}
+
+// Prefetching the embedding rows for the neighbors of the observation that is
+// 'prefetch_distance' observations ahead of the current one. This gives each
+// prefetch the time taken to process all of the intervening observations.
+template<typename Index_, typename EpochFloat_, typename Coord_>
+void prefetch_neighbors(const EpochGraph<Index_, EpochFloat_>& graph, const Coord_* const embedding, const std::size_t num_dim, const Index_ observation, const int prefetch_distance) {
+    const auto ahead = sanisizer::sum_unsafe<std::size_t>(observation, prefetch_distance);
+    if (ahead + 1 < graph.cumulative_num_edges.size()) {
+        for (auto j = graph.cumulative_num_edges[ahead], end = graph.cumulative_num_edges[ahead + 1]; j < end; ++j) {
+            prefetch_row(embedding + sanisizer::product_unsafe<std::size_t>(graph.edge_targets[j], num_dim));
+        }
+    }
+}
+
+// Default for the stopping condition that is checked at the start of each
+// epoch; this allows callers to cooperatively interrupt the optimization
+// while leaving 'setup' in a consistent state for a later restart.
+struct NeverStop {
+    bool operator()() const {
+        return false;
+    }
+};
+
+// Default for the observer that is called by Status::run() at the start of
+// each epoch, which should be optimized away entirely.
+struct NeverObserve {
+    template<typename Coord_, typename Alpha_>
+    void operator()(const Coord_*, int, Alpha_) const {}
+};
+
 /*****************************************************
  ***************** Serial code ***********************
  *****************************************************/
 
-template<typename Index_, typename Float_, class Rng_>
+template<typename Index_, typename Float_, typename Coord_, typename EpochFloat_, class Rng_, class Stop_ = NeverStop>
 void optimize_layout(
     std::size_t num_dim,
-    Float_* embedding, 
-    EpochData<Index_, Float_>& setup,
+    Coord_* embedding, 
+    EpochData<Index_, EpochFloat_>& setup,
     Float_ a, 
     Float_ b, 
     Float_ gamma,
     Float_ initial_alpha,
     Rng_& rng,
-    int epoch_limit
+    int epoch_limit,
+    int prefetch_distance = 0,
+    Stop_ stop = Stop_()
 ) {
     auto& n = setup.current_epoch;
     const auto num_epochs = setup.total_epochs;
+    const auto& graph = *(setup.graph);
 
     for (; n < epoch_limit; ++n) {
+        if (stop()) {
+            break;
+        }
+
         const Float_ epoch = n;
         const Float_ alpha = initial_alpha * (1.0 - epoch / num_epochs);
 
-        const Index_ num_obs = setup.cumulative_num_edges.size() - 1; 
+        const Index_ num_obs = graph.cumulative_num_edges.size() - 1; 
         for (Index_ i = 0; i < num_obs; ++i) {
-            const auto start = setup.cumulative_num_edges[i], end = setup.cumulative_num_edges[i + 1];
+            const auto start = graph.cumulative_num_edges[i], end = graph.cumulative_num_edges[i + 1];
             const auto left = embedding + sanisizer::product_unsafe<std::size_t>(i, num_dim);
+            if (prefetch_distance > 0) {
+                prefetch_neighbors(graph, embedding, num_dim, i, prefetch_distance);
+            }
 
             for (auto j = start; j < end; ++j) {
                 if (setup.epoch_of_next_sample[j] > epoch) {
                     continue;
                 }
 
-                {
-                    const auto right = embedding + sanisizer::product_unsafe<std::size_t>(setup.edge_targets[j], num_dim);
-                    const Float_ dist2 = quick_squared_distance(left, right, num_dim);
-                    const Float_ pd2b = std::pow(dist2, b);
-                    const Float_ grad_coef = (-2 * a * b * pd2b) / (dist2 * (a * pd2b + 1.0));
-
-                    for (std::size_t d = 0; d < num_dim; ++d) {
-                        auto& l = left[d];
-                        auto& r = right[d];
-                        const Float_ gradient = alpha * clamp(grad_coef * (l - r));
-                        l += gradient;
-                        r -= gradient;
-                    }
-                }
+                const auto right = embedding + sanisizer::product_unsafe<std::size_t>(graph.edge_targets[j], num_dim);
+                attract_pair(left, right, num_dim, a, b, alpha);
 
-                const Float_ epochs_per_negative_sample = setup.epochs_per_sample[j] / setup.negative_sample_rate;
+                const EpochFloat_ epochs_per_negative_sample = graph.epochs_per_sample[j] / setup.negative_sample_rate;
                 const int num_neg_samples = (epoch - setup.epoch_of_next_negative_sample[j]) / epochs_per_negative_sample; // cast is known to be safe, see initialize().
 
                 for (int p = 0; p < num_neg_samples; ++p) {
-                    const auto sampled = aarand::discrete_uniform(rng, num_obs);
+                    const auto sampled = sample_observation(rng, num_obs);
                     if (sampled == i) {
                         continue;
                     }
 
-                    const auto right = embedding + sanisizer::product_unsafe<std::size_t>(sampled, num_dim);
-                    const Float_ dist2 = quick_squared_distance(left, right, num_dim);
-                    const Float_ grad_coef = 2 * gamma * b / ((0.001 + dist2) * (a * std::pow(dist2, b) + 1.0));
-
-                    for (std::size_t d = 0; d < num_dim; ++d) {
-                        left[d] += alpha * clamp(grad_coef * (left[d] - right[d]));
-                    }
+                    repel_from(left, embedding + sanisizer::product_unsafe<std::size_t>(sampled, num_dim), num_dim, a, b, gamma, alpha);
                 }
 
-                setup.epoch_of_next_sample[j] += setup.epochs_per_sample[j];
+                setup.epoch_of_next_sample[j] += graph.epochs_per_sample[j];
                 setup.epoch_of_next_negative_sample[j] += num_neg_samples * epochs_per_negative_sample;
             }
         }
@@ -185,36 +339,164 @@ void optimize_layout(
 }
 
 /*****************************************************
- **************** Parallel code **********************
+ **************** Planned code ***********************
  *****************************************************/
 
-#ifndef UMAPPP_NO_PARALLEL_OPTIMIZATION
+/*
+ * Here, the negative samples for each observation are drawn in a separate
+ * 'planning' step before the gradient calculations. This is used by the
+ * parallel code so that the RNG is only ever used on the main thread, and by
+ * the buffered serial code so that the embedding rows for the negative
+ * samples can be prefetched. In both cases, the RNG is called in the same
+ * order as in the serial code, so the results are exactly the same.
+ */
+
 constexpr int skip_ns_sentinel = -1;
 
 template<typename Index_, typename Float_>
 struct BusyWaiterInput {
-    std::vector<Index_> negative_sample_selections;
-    std::vector<int> negative_sample_count;
+    BusyWaiterInput(std::pmr::memory_resource* const resource = std::pmr::get_default_resource()) :
+        negative_sample_selections(resource),
+        negative_sample_count(resource)
+    {}
+
+    std::pmr::vector<Index_> negative_sample_selections;
+    std::pmr::vector<int> negative_sample_count;
     Index_ observation;
     std::size_t edge_target_index_start;
     Float_ alpha;
 };
 
-template<typename Index_, typename Float_>
+template<typename Index_, typename Float_, typename Coord_>
 struct BusyWaiterState {
+    BusyWaiterState(std::pmr::memory_resource* const resource = std::pmr::get_default_resource()) : self_modified(resource) {}
+
     std::size_t num_dim;
-    Float_* embedding;
-    const EpochData<Index_, Float_>* setup;
+    Coord_* embedding;
+    const Index_* edge_targets;
     Float_ a;
     Float_ b;
     Float_ gamma;
-    std::vector<Float_> self_modified;
+    std::pmr::vector<Coord_> self_modified;
+    int spin_limit;
 };
 
-template<typename Index_, typename Float_>
-void optimize_single_observation(const BusyWaiterInput<Index_, Float_>& input, BusyWaiterState<Index_, Float_>& state) {
+/*
+ * Scratch buffers for the planned and parallel code, as well as the per-run
+ * buffers of the batched, minibatch and accumulated optimizers. These are
+ * held by the Status so that repeated calls to run() can reuse the
+ * allocations from previous calls, such that the optimization does not
+ * allocate in steady state (other than to create the worker threads in the
+ * parallel code). All buffers are allocated from the supplied memory resource.
+ * The worker threads for the batched and minibatch optimizers are also
+ * retained, but not those of the planned code, as its busy-waiting threads
+ * would otherwise consume CPU time between runs.
+ */
+template<typename Index_, typename Float_, typename Coord_>
+struct OptimizeWorkspace {
+    OptimizeWorkspace(std::pmr::memory_resource* const resource = std::pmr::get_default_resource()) :
+        resource(resource),
+        state(resource),
+        inputs(resource),
+        available_inputs(resource),
+        pool_inputs(resource),
+        deferred_inputs(resource),
+        last_touched(resource),
+        touch_type(resource),
+        snapshot(resource),
+        values(resource),
+        thread_values(resource),
+        rows(resource)
+    {}
+
+    std::pmr::memory_resource* resource;
+    BusyWaiterState<Index_, Float_, Coord_> state;
+    std::pmr::vector<BusyWaiterInput<Index_, Float_> > inputs;
+    std::pmr::vector<BusyWaiterInput<Index_, Float_>*> available_inputs;
+    std::pmr::vector<BusyWaiterInput<Index_, Float_>*> pool_inputs;
+    std::pmr::vector<BusyWaiterInput<Index_, Float_>*> deferred_inputs;
+    std::pmr::vector<std::size_t> last_touched;
+    std::pmr::vector<unsigned char> touch_type;
+
+    // Uninitialized so that each page is first touched by the thread that uses it.
+    UninitializedPmrVector<Coord_> snapshot; // see optimize_layout_batched().
+    UninitializedPmrVector<Float_> values; // see optimize_layout_minibatch() and optimize_layout_accumulated().
+    UninitializedPmrVector<Float_> thread_values; // see optimize_layout_minibatch().
+    std::pmr::vector<Index_> rows; // see optimize_layout_minibatch().
+
+    WorkerPool pool; // see optimize_layout_batched() and optimize_layout_minibatch().
+
+    void reserve_inputs(const std::size_t number) {
+        inputs.reserve(number);
+        while (inputs.size() < number) {
+            inputs.emplace_back(resource);
+        }
+    }
+
+    std::size_t memory_usage() const {
+        std::size_t output = umappp::memory_usage(state.self_modified) + umappp::memory_usage(inputs);
+        for (const auto& in : inputs) {
+            output += umappp::memory_usage(in.negative_sample_selections) + umappp::memory_usage(in.negative_sample_count);
+        }
+        output += umappp::memory_usage(available_inputs) + umappp::memory_usage(pool_inputs) + umappp::memory_usage(deferred_inputs);
+        output += umappp::memory_usage(last_touched) + umappp::memory_usage(touch_type);
+        output += umappp::memory_usage(snapshot) + umappp::memory_usage(values) + umappp::memory_usage(thread_values) + umappp::memory_usage(rows);
+        output += pool.memory_usage();
+        return output;
+    }
+};
+
+template<typename Index_, typename Float_, typename EpochFloat_, class Rng_>
+void plan_single_observation(
+    const Index_ observation,
+    EpochData<Index_, EpochFloat_>& setup,
+    const Float_ epoch,
+    const Float_ alpha,
+    Rng_& rng,
+    BusyWaiterInput<Index_, Float_>& input
+) {
+    input.alpha = alpha;
+    input.observation = observation;
+
+    // Tapping the RNG here in the serial section.
+    auto& ns_selections = input.negative_sample_selections;
+    ns_selections.clear();
+    auto& ns_count = input.negative_sample_count;
+    ns_count.clear();
+
+    const auto& graph = *(setup.graph);
+    const Index_ num_obs = graph.cumulative_num_edges.size() - 1;
+    const auto start = graph.cumulative_num_edges[observation], end = graph.cumulative_num_edges[observation + 1];
+    input.edge_target_index_start = start;
+
+    for (auto j = start; j < end; ++j) {
+        if (setup.epoch_of_next_sample[j] > epoch) {
+            ns_count.push_back(skip_ns_sentinel);
+            continue;
+        }
+
+        const auto prior_size = ns_selections.size();
+        const EpochFloat_ epochs_per_negative_sample = graph.epochs_per_sample[j] / setup.negative_sample_rate;
+        const int num_neg_samples = (epoch - setup.epoch_of_next_negative_sample[j]) / epochs_per_negative_sample; // cast is known to be safe, see initialize().
+
+        for (int p = 0; p < num_neg_samples; ++p) {
+            const Index_ sampled = sample_observation(rng, num_obs);
+            if (sampled == observation) {
+                continue;
+            }
+            ns_selections.push_back(sampled);
+        }
+
+        ns_count.push_back(ns_selections.size() - prior_size);
+        setup.epoch_of_next_sample[j] += graph.epochs_per_sample[j];
+        setup.epoch_of_next_negative_sample[j] += num_neg_samples * epochs_per_negative_sample;
+    }
+}
+
+template<typename Index_, typename Float_, typename Coord_>
+void optimize_single_observation(const BusyWaiterInput<Index_, Float_>& input, BusyWaiterState<Index_, Float_, Coord_>& state) {
     // Copying it over into a thread-local buffer to avoid false sharing.
-    // We don't bother doing this for the neighbors, though, as it's 
+    // We don't bother doing this for the neighbors, though, as it's
     // tedious to make sure that the modified values are available during negative sampling.
     // (This isn't a problem for the self, as the self cannot be its own negative sample.)
     const auto source = state.embedding + sanisizer::product_unsafe<std::size_t>(input.observation, state.num_dim);
@@ -228,44 +510,134 @@ void optimize_single_observation(const BusyWaiterInput<Index_, Float_>& input, B
             continue;
         }
 
-        {
-            const auto left = state.self_modified.data();
-            const auto j = sanisizer::sum_unsafe<std::size_t>(n, input.edge_target_index_start);
-            const auto right = state.embedding + sanisizer::product_unsafe<std::size_t>(state.setup->edge_targets[j], state.num_dim);
-
-            const Float_ dist2 = quick_squared_distance(left, right, state.num_dim);
-            const Float_ pd2b = std::pow(dist2, state.b);
-            const Float_ grad_coef = (-2 * state.a * state.b * pd2b) / (dist2 * (state.a * pd2b + 1.0));
-
-            for (std::size_t d = 0; d < state.num_dim; ++d) {
-                auto& l = left[d];
-                auto& r = right[d];
-                const Float_ gradient = input.alpha * clamp(grad_coef * (l - r));
-                l += gradient;
-                r -= gradient;
-            }
-        }
+        const auto left = state.self_modified.data();
+        const auto j = sanisizer::sum_unsafe<std::size_t>(n, input.edge_target_index_start);
+        const auto right = state.embedding + sanisizer::product_unsafe<std::size_t>(state.edge_targets[j], state.num_dim);
+        attract_pair(left, right, state.num_dim, state.a, state.b, input.alpha);
 
         auto s = position;
         position += number;
         for (; s < position; ++s) {
-            const auto left = state.self_modified.data();
-            const auto right = state.embedding + sanisizer::product_unsafe<std::size_t>(input.negative_sample_selections[s], state.num_dim);
+            const auto other = state.embedding + sanisizer::product_unsafe<std::size_t>(input.negative_sample_selections[s], state.num_dim);
+            repel_from(left, other, state.num_dim, state.a, state.b, state.gamma, input.alpha);
+        }
+    }
+
+    // Copying it back to the embedding once we're done.
+    std::copy(state.self_modified.begin(), state.self_modified.end(), source);
+}
+
+template<typename Index_, typename Float_, typename Coord_, typename EpochFloat_, class Rng_, class Stop_ = NeverStop>
+void optimize_layout_buffered(
+    const std::size_t num_dim,
+    Coord_* const embedding,
+    EpochData<Index_, EpochFloat_>& setup,
+    const Float_ a,
+    const Float_ b,
+    const Float_ gamma,
+    const Float_ initial_alpha,
+    Rng_& rng,
+    const int epoch_limit,
+    const int prefetch_distance = 0,
+    Stop_ stop = Stop_(),
+    OptimizeWorkspace<Index_, Float_, Coord_>* const workspace = NULL
+) {
+    auto& n = setup.current_epoch;
+    const auto num_epochs = setup.total_epochs;
+    const auto& graph = *(setup.graph);
+    const Index_ num_obs = graph.cumulative_num_edges.size() - 1;
 
-            const Float_ dist2 = quick_squared_distance(left, right, state.num_dim);
-            const Float_ grad_coef = 2 * state.gamma * state.b / ((0.001 + dist2) * (state.a * std::pow(dist2, state.b) + 1.0));
+    OptimizeWorkspace<Index_, Float_, Coord_> local_workspace;
+    auto& work = (workspace == NULL ? local_workspace : *workspace);
+    auto& state = work.state;
+    state.num_dim = num_dim;
+    state.embedding = embedding;
+    state.edge_targets = graph.edge_targets.data();
+    state.a = a;
+    state.b = b;
+    state.gamma = gamma;
+    state.self_modified.resize(num_dim);
+    state.spin_limit = 0;
+
+    work.reserve_inputs(2);
+    auto current = work.inputs.data(), next = current + 1;
+
+    for (; n < epoch_limit; ++n) {
+        if (stop()) {
+            break;
+        }
 
-            for (std::size_t d = 0; d < state.num_dim; ++d) {
-                left[d] += input.alpha * clamp(grad_coef * (left[d] - right[d]));
+        const Float_ epoch = n;
+        const Float_ alpha = initial_alpha * (1.0 - epoch / num_epochs);
+        if (num_obs == 0) {
+            continue;
+        }
+
+        plan_single_observation(static_cast<Index_>(0), setup, epoch, alpha, rng, *current);
+        for (Index_ i = 0; i < num_obs; ++i) {
+            // Planning the next observation before processing the current one,
+            // so that the rows of its negative samples are (hopefully) in
+            // cache by the time that we get to them.
+            const Index_ following = i + 1;
+            if (following < num_obs) {
+                plan_single_observation(following, setup, epoch, alpha, rng, *next);
+                for (const auto s : next->negative_sample_selections) {
+                    prefetch_row(embedding + sanisizer::product_unsafe<std::size_t>(s, num_dim));
+                }
             }
+
+            if (prefetch_distance > 0) {
+                prefetch_neighbors(graph, embedding, num_dim, i, prefetch_distance);
+            }
+
+            optimize_single_observation(*current, state);
+            std::swap(current, next);
         }
     }
+}
 
-    // Copying it back to the embedding once we're done.
-    std::copy(state.self_modified.begin(), state.self_modified.end(), source);
+/*****************************************************
+ **************** Parallel code **********************
+ *****************************************************/
+
+#ifndef UMAPPP_NO_PARALLEL_OPTIMIZATION
+template<class Ready_>
+void spin_until(Ready_ ready, const int spin_limit) {
+    int spins = 0;
+    while (!ready()) {
+        ++spins;
+        if (spins == spin_limit) {
+            // Giving up the CPU so that we don't starve the other threads
+            // when there are fewer available CPUs than requested threads.
+            std::this_thread::yield();
+            spins = 0;
+        }
+    }
 }
 
-template<typename Index_, typename Float_>
+class SpinBarrier {
+public:
+    SpinBarrier(const int num_threads, const int spin_limit) : my_num_threads(num_threads), my_spin_limit(spin_limit) {}
+
+    void arrive_and_wait() {
+        const auto generation = my_generation.load(std::memory_order_acquire);
+        if (my_count.fetch_add(1, std::memory_order_acq_rel) + 1 == my_num_threads) {
+            // Resetting the count before releasing the other threads, so that it's ready for the next use of the barrier.
+            my_count.store(0, std::memory_order_relaxed);
+            my_generation.fetch_add(1, std::memory_order_release);
+        } else {
+            spin_until([&]() -> bool { return my_generation.load(std::memory_order_acquire) != generation; }, my_spin_limit);
+        }
+    }
+
+private:
+    std::atomic<int> my_count = 0;
+    std::atomic<unsigned int> my_generation = 0;
+    int my_num_threads;
+    int my_spin_limit;
+};
+
+template<typename Index_, typename Float_, typename Coord_>
 class BusyWaiterThread {
 private:
     struct SyncData {
@@ -277,6 +649,7 @@ private:
     SyncData* my_sync;
     std::thread my_worker;
     BusyWaiterInput<Index_, Float_>* my_input;
+    int my_spin_limit;
 
 public:
     void run(BusyWaiterInput<Index_, Float_>& input) {
@@ -285,20 +658,19 @@ public:
     }
 
     void wait() {
-        while (my_sync->ready.load(std::memory_order_acquire)) {
-            ;
-        }
+        spin_until([&]() -> bool { return !my_sync->ready.load(std::memory_order_acquire); }, my_spin_limit);
     }
 
 public:
-    BusyWaiterThread(const BusyWaiterState<Index_, Float_>& x) {
+    BusyWaiterThread(const BusyWaiterState<Index_, Float_, Coord_>& x, const std::vector<int>& cpus, const int thread) : my_spin_limit(x.spin_limit) {
         std::mutex init_mut;
         std::condition_variable init_cv;
         bool initialized = false;
 
         my_worker = std::thread([&]() -> void {
+            ThreadPin pin(cpus, thread); // Pinning before allocating, so that the per-thread data is placed on the local node.
             SyncData sync; // Allocating within each thread to reduce false sharing.
-            BusyWaiterState<Index_, Float_> state(x); // Make a copy to reduce false sharing.
+            BusyWaiterState<Index_, Float_, Coord_> state(x); // Make a copy to reduce false sharing.
 
             {
                 std::lock_guard ilck(init_mut);
@@ -308,9 +680,7 @@ public:
             }
 
             while (true) {
-                while (!sync.ready.load(std::memory_order_acquire)) {
-                    ;
-                }
+                spin_until([&]() -> bool { return sync.ready.load(std::memory_order_acquire); }, state.spin_limit);
                 if (sync.finished) {
                     break;
                 }
@@ -322,7 +692,7 @@ public:
         std::unique_lock ilck(init_mut);
         init_cv.wait(ilck, [&]() -> bool { return initialized; });
     }
- 
+
 public:
     ~BusyWaiterThread() {
         if (my_sync != NULL) {
@@ -338,218 +708,264 @@ public:
     BusyWaiterThread& operator=(const BusyWaiterThread&) = delete;
     BusyWaiterThread(const BusyWaiterThread&) = delete;
 };
-#endif
 
-//#define PRINT false
+/*
+ * Each observation that is considered in a round is assigned a unique,
+ * increasing 'stamp'. We record the stamp of the last observation that
+ * touched each location, along with the type of touch. Any stamp that is no
+ * less than the 'base' of the current round indicates that the location
+ * was touched by an observation in this round, in which case we check for
+ * conflicts: an observation cannot write to a location that was read or
+ * written by another observation in the same round, nor can it read from a
+ * location that was written by another observation. This ensures that all
+ * observations in a round can be safely processed in any order.
+ *
+ * Note that observations that are deferred due to conflicts still retain
+ * their marks for the rest of the round. This ensures that any subsequent
+ * observation that touches the same locations will also be deferred,
+ * thus preserving the serial order of all conflicting updates.
+ */
+constexpr unsigned char touch_readonly = 0;
+constexpr unsigned char touch_write = 1;
+
+template<typename Index_, typename Float_, typename EpochFloat_>
+bool mark_single_observation(
+    const BusyWaiterInput<Index_, Float_>& input,
+    const EpochData<Index_, EpochFloat_>& setup,
+    std::pmr::vector<std::size_t>& last_touched,
+    std::pmr::vector<unsigned char>& touch_type,
+    const std::size_t base,
+    const std::size_t stamp
+) {
+    const auto& graph = *(setup.graph);
+    bool is_clear = true;
+
+    {
+        auto& touched = last_touched[input.observation];
+        if (touched >= base) {
+            is_clear = false;
+        }
+        touched = stamp;
+        touch_type[input.observation] = touch_write;
+    }
+
+    I<decltype(input.negative_sample_selections.size())> position = 0;
+    const auto num_neighbors = input.negative_sample_count.size();
+    for (I<decltype(num_neighbors)> n = 0; n < num_neighbors; ++n) {
+        const auto number = input.negative_sample_count[n];
+        if (number == skip_ns_sentinel) {
+            continue;
+        }
+
+        {
+            const auto neighbor = graph.edge_targets[sanisizer::sum_unsafe<std::size_t>(n, input.edge_target_index_start)];
+            auto& touched = last_touched[neighbor];
+            if (touched >= base && touched != stamp) {
+                is_clear = false;
+            }
+            touched = stamp;
+            touch_type[neighbor] = touch_write;
+        }
+
+        auto s = position;
+        position += number;
+        for (; s < position; ++s) {
+            const auto sampled = input.negative_sample_selections[s];
+            auto& touched = last_touched[sampled];
+            if (touched >= base) {
+                if (touched != stamp && touch_type[sampled] == touch_write) {
+                    is_clear = false;
+                }
+            } else {
+                // Only updating if it wasn't touched by a previous observation in this round.
+                touched = stamp;
+                touch_type[sampled] = touch_readonly;
+            }
+        }
+    }
 
-template<typename Index_, typename Float_, class Rng_>
+    return is_clear;
+}
+#endif
+
+template<typename Index_, typename Float_, typename Coord_, typename EpochFloat_, class Rng_, class Stop_ = NeverStop>
 void optimize_layout_parallel(
     const std::size_t num_dim,
-    Float_* const embedding, 
-    EpochData<Index_, Float_>& setup,
-    const Float_ a, 
-    const Float_ b, 
+    Coord_* const embedding,
+    EpochData<Index_, EpochFloat_>& setup,
+    const Float_ a,
+    const Float_ b,
     const Float_ gamma,
     const Float_ initial_alpha,
     Rng_& rng,
     const int epoch_limit,
-    const int nthreads
+    const int nthreads,
+    const int lookahead,
+    const int spin_limit,
+    ParallelStatistics& statistics,
+    const bool time_planning,
+    Stop_ stop = Stop_(),
+    const bool pin_threads = false,
+    OptimizeWorkspace<Index_, Float_, Coord_>* const workspace = NULL
 ) {
 #ifndef UMAPPP_NO_PARALLEL_OPTIMIZATION
     auto& n = setup.current_epoch;
     const auto num_epochs = setup.total_epochs;
 
-    BusyWaiterState<Index_, Float_> state;
+    OptimizeWorkspace<Index_, Float_, Coord_> local_workspace;
+    auto& work = (workspace == NULL ? local_workspace : *workspace);
+    auto& state = work.state;
     state.num_dim = num_dim;
     state.embedding = embedding;
-    state.setup = &setup;
+    const auto& graph = *(setup.graph);
+    state.edge_targets = graph.edge_targets.data();
     state.a = a;
     state.b = b;
     state.gamma = gamma;
     state.self_modified.resize(state.num_dim);
+    state.spin_limit = spin_limit;
 
     // We use 'nthreads - 1' busy waiters so that some work runs on the main
     // thread. This ensures that we don't spin off 'nthreads' and then have the
     // main thread running the spin lock to compete for CPU usage. Instead, if
     // all threads are in use, the main thread is also doing useful work.
-    std::vector<BusyWaiterThread<Index_, Float_> > pool;
+    const auto cpus = available_cpus(pin_threads);
+    std::vector<BusyWaiterThread<Index_, Float_, Coord_> > pool;
     pool.reserve(nthreads - 1);
     for (int t = 0; t < nthreads - 1; ++t) {
-        pool.emplace_back(state);
+        pool.emplace_back(state, cpus, t + 1);
     }
-
-    auto raw_inputs = sanisizer::create<std::vector<BusyWaiterInput<Index_, Float_> > >(nthreads);
-    BusyWaiterInput<Index_, Float_>* main_input = &(raw_inputs.back());
-    std::vector<BusyWaiterInput<Index_, Float_>*> pool_inputs;
-    pool_inputs.reserve(nthreads - 1);
-    for (int t = 0; t < nthreads - 1; ++t) {
-        pool_inputs.push_back(&(raw_inputs[t]));
+    ThreadPin main_pin(cpus, 0);
+
+    // At any given time, we need one input for each of the in-flight
+    // observations on the pool threads, one for each deferred observation
+    // (including the one that stalls the round), and one for planning.
+    const auto max_deferred = sanisizer::sum<std::size_t>(lookahead, 1);
+    work.reserve_inputs(sanisizer::sum<std::size_t>(nthreads, max_deferred));
+    auto& available_inputs = work.available_inputs;
+    available_inputs.clear();
+    available_inputs.reserve(work.inputs.size());
+    for (auto& input : work.inputs) {
+        available_inputs.push_back(&input);
     }
+    auto& pool_inputs = work.pool_inputs;
+    sanisizer::resize(pool_inputs, nthreads - 1);
+    auto& deferred_inputs = work.deferred_inputs;
+    deferred_inputs.clear();
+    deferred_inputs.reserve(max_deferred);
+
+    const Index_ num_obs = graph.cumulative_num_edges.size() - 1;
+    auto& last_touched = work.last_touched;
+    sanisizer::resize(last_touched, num_obs);
+    auto& touch_type = work.touch_type;
+    sanisizer::resize(touch_type, num_obs);
 
-    const Index_ num_obs = setup.cumulative_num_edges.size() - 1; 
-    std::vector<Index_> last_touched_iteration(num_obs);
-    std::vector<unsigned char> touch_type(num_obs);
+    typedef std::chrono::steady_clock Clock;
 
     for (; n < epoch_limit; ++n) {
+        // All work is complete at the end of each epoch, so the pool threads
+        // are idle and can be safely shut down by the destructors if we stop.
+        if (stop()) {
+            break;
+        }
+
         const Float_ epoch = n;
         const Float_ alpha = initial_alpha * (1.0 - epoch / num_epochs);
 
-        // Iteration is 1-based so as to allow last_touched_iteration[i] = 0 to
-        // mean that it has never been touched. A touch after the first
-        // iteration is instead last_touched_iteration[i] = 1. (We can't use
-        // last_touched_iteration[i] = -1 because Index_ might be unsigned.)
-        Index_ base_iteration = 1;
-        std::fill(last_touched_iteration.begin(), last_touched_iteration.end(), 0);
+        // Stamps are 1-based so as to allow last_touched[i] = 0 to mean that
+        // it has never been touched in this epoch.
+        std::size_t stamp = 0;
+        std::fill(last_touched.begin(), last_touched.end(), 0);
 
-        int used_threads = 0;
         Index_ i = 0;
-        while (i < num_obs) {
-            bool is_clear = true;
-//            if (PRINT) { std::cout << "size is " << threads_in_progress.size() << std::endl; }
-
-            for (int t = used_threads; t < nthreads; ++t) {
-                auto& input = *main_input;
-                input.alpha = alpha;
-                input.observation = i;
-
-                // Tapping the RNG here in the serial section.
-                auto& ns_selections = input.negative_sample_selections;
-                ns_selections.clear();
-                auto& ns_count = input.negative_sample_count;
-                ns_count.clear();
-
-                const Index_ self_iteration = i + 1; // remember, iterations are 1-based.
-                constexpr unsigned char READONLY = 0;
-                constexpr unsigned char WRITE = 1;
-
-                {
-                    auto& touched = last_touched_iteration[i];
-                    auto& ttype = touch_type[i];
-//                    if (PRINT) { std::cout << "SELF: " << i << ": " << touched << " (" << ttype << ")" << std::endl; }
-                    if (touched >= base_iteration) {
-                        is_clear = false;
-//                        if (PRINT) { std::cout << "=== FAILED! ===" << std::endl; }
-                    }
-                    touched = self_iteration;
-                    ttype = WRITE;
-                }
-
-                const auto start = setup.cumulative_num_edges[i], end = setup.cumulative_num_edges[i + 1];
-                input.edge_target_index_start = start;
-                for (auto j = start; j < end; ++j) {
-                    if (setup.epoch_of_next_sample[j] > epoch) {
-                        ns_count.push_back(skip_ns_sentinel);
-                        continue;
-                    }
-
-                    {
-                        const auto neighbor = setup.edge_targets[j];
-                        auto& touched = last_touched_iteration[neighbor];
-                        auto& ttype = touch_type[neighbor];
-//                        if (PRINT) { std::cout << "\tNEIGHBOR: " << neighbor << ": " << touched << " (" << ttype << ")" << std::endl; }
-                        if (touched >= base_iteration) {
-                            if (touched != self_iteration) {
-                                is_clear = false;
-//                                if (PRINT) { std::cout << "=== FAILED! ===" << std::endl; }
-                            }
-                        }
-                        touched = self_iteration;
-                        ttype = WRITE;
-                    }
-
-                    const auto prior_size = ns_selections.size();
-                    const Float_ epochs_per_negative_sample = setup.epochs_per_sample[j] / setup.negative_sample_rate;
-                    const int num_neg_samples = (epoch - setup.epoch_of_next_negative_sample[j]) / epochs_per_negative_sample; // cast is known to be safe, see initialize().
-
-                    for (int p = 0; p < num_neg_samples; ++p) {
-                        const Index_ sampled = aarand::discrete_uniform(rng, num_obs);
-                        if (sampled == i) {
-                            continue;
-                        }
-                        ns_selections.push_back(sampled);
-
-                        auto& touched = last_touched_iteration[sampled];
-                        auto& ttype = touch_type[sampled];
-//                        if (PRINT) { std::cout << "\t\tSAMPLED: " << sampled << ": " << touched << " (" << ttype << ")" << std::endl; }
-                        if (touched >= base_iteration) { 
-                            if (touched != self_iteration) {
-                                if (ttype == WRITE) {
-                                    is_clear = false;
-//                                    if (PRINT) { std::cout << "=== FAILED! ===" << std::endl; }
-                                }
-                            }
-                        } else {
-                            // Only updating if it wasn't touched by a previous thread in this
-                            // round of thread iterations.
-                            ttype = READONLY;
-                            touched = self_iteration;
-                        }
-                    }
-
-                    ns_count.push_back(ns_selections.size() - prior_size);
-                    setup.epoch_of_next_sample[j] += setup.epochs_per_sample[j];
-                    setup.epoch_of_next_negative_sample[j] += num_neg_samples * epochs_per_negative_sample;
-                }
+        while (i < num_obs || !deferred_inputs.empty()) {
+            // Timing is optional as the clock calls are not free relative to
+            // the planning of a single observation.
+            Clock::time_point round_start;
+            Clock::duration main_time(0);
+            if (time_planning) {
+                round_start = Clock::now();
+            }
 
-                if (!is_clear) {
-                    // As we only updated the access for 'sampled' to READONLY
-                    // if they weren't touched by another thread, we need to go
-                    // through and manually update them now that the next round
-                    // of thread_iterations will use 'self_iteration' as the
-                    // 'base_iteration'. This ensures that the flags are properly
-                    // set for the next round, under the expectation that the
-                    // pending thread becomes the first thread.
-                    for (auto s : ns_selections) {
-                        auto& touched = last_touched_iteration[s];
-                        if (touched != self_iteration) {
-                            touched = self_iteration;
-                            touch_type[s] = READONLY;
-                        }
-                    }
-                    break;
-                } 
+            const std::size_t base = stamp + 1;
+            int used_threads = 0;
+            bool round_finished = false;
 
-                if (t + 1 == nthreads) {
+            auto dispatch = [&](BusyWaiterInput<Index_, Float_>* input) -> void {
+                ++statistics.num_dispatched;
+                if (used_threads + 1 == nthreads) {
                     // If we saturate the number of threads, we run the last task
                     // on the main thread to ensure that the main thread's spinlock
                     // won't compete other threads for with CPU time.
-                    optimize_single_observation(*main_input, state);
+                    if (time_planning) {
+                        const auto main_start = Clock::now();
+                        optimize_single_observation(*input, state);
+                        main_time += Clock::now() - main_start;
+                    } else {
+                        optimize_single_observation(*input, state);
+                    }
+                    available_inputs.push_back(input);
+                    round_finished = true;
                 } else {
-                    std::swap(pool_inputs[t], main_input);
-                    pool[t].run(*(pool_inputs[t]));
+                    pool_inputs[used_threads] = input;
+                    pool[used_threads].run(*input);
                     ++used_threads;
                 }
-
+            };
+
+            // First, we re-examine the observations that were deferred in the
+            // previous round, in their original order. The first deferred
+            // observation is always clear as nothing else has been touched in
+            // this round, so we are guaranteed to make progress.
+            I<decltype(deferred_inputs.size())> num_kept = 0;
+            for (auto input : deferred_inputs) {
+                if (!round_finished) {
+                    ++stamp;
+                    if (mark_single_observation(*input, setup, last_touched, touch_type, base, stamp)) {
+                        dispatch(input);
+                        continue;
+                    }
+                    ++statistics.num_conflicts;
+                }
+                deferred_inputs[num_kept] = input;
+                ++num_kept;
+            }
+            deferred_inputs.resize(num_kept);
+
+            // Then we plan the subsequent observations. If an observation
+            // conflicts with the in-flight work, we defer it and continue
+            // looking for independent work, as long as we haven't already
+            // deferred too many observations.
+            while (!round_finished && i < num_obs) {
+                auto input = available_inputs.back();
+                available_inputs.pop_back();
+                plan_single_observation(i, setup, epoch, alpha, rng, *input);
                 ++i;
-                if (i == num_obs) {
-                    break;
+
+                ++stamp;
+                if (mark_single_observation(*input, setup, last_touched, touch_type, base, stamp)) {
+                    dispatch(input);
+                } else {
+                    ++statistics.num_conflicts;
+                    deferred_inputs.push_back(input);
+                    if (deferred_inputs.size() == max_deferred) {
+                        round_finished = true;
+                    } else {
+                        ++statistics.num_deferred;
+                    }
                 }
             }
 
+            if (time_planning) {
+                statistics.planning_time += std::chrono::duration<double>(Clock::now() - round_start - main_time).count();
+            }
+            ++statistics.num_rounds;
+
             // Waiting for all the jobs that were submitted.
             for (int t = 0; t < used_threads; ++t) {
                 pool[t].wait();
+                available_inputs.push_back(pool_inputs[t]);
             }
-
-//            if (PRINT) { std::cout << "###################### OK ##########################" << std::endl; }
-
-            base_iteration = i + 1; // remember, iterations are 1-based.
-
-            // If an observation has a conflict that causes us to break out
-            // early, we launch its job on the first thread once all the
-            // previous conflicting jobs have finished.
-            if (!is_clear) {
-                std::swap(pool_inputs[0], main_input);
-                pool[0].run(*(pool_inputs[0]));
-                used_threads = 1;
-                ++i;
-            } else {
-                used_threads = 0;
-            }
-        }
-
-        for (int t = 0; t < used_threads; ++t) {
-            pool[t].wait();
         }
     }
 
@@ -0,0 +1,192 @@
+#ifndef UMAPPP_OPTIMIZE_LAYOUT_ACCUMULATED_HPP
+#define UMAPPP_OPTIMIZE_LAYOUT_ACCUMULATED_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#ifdef UMAPPP_NO_PARALLEL_OPTIMIZATION
+#include <stdexcept>
+#endif
+
+#include "aarand/aarand.hpp"
+#include "sanisizer/sanisizer.hpp"
+
+#include "optimize_layout.hpp"
+#include "parallelize.hpp"
+#include "rng.hpp"
+#include "thread_affinity.hpp"
+#include "utils.hpp"
+
+namespace umappp {
+
+/*
+ * Update policies for the accumulated gradients. Each policy specifies the
+ * number of state values per coordinate and how to update each coordinate
+ * given its accumulated gradient (more precisely, the descent direction, as
+ * the clamped gradients are already negated in the UMAP updates).
+ */
+template<typename Float_>
+struct MomentumUpdate {
+    static constexpr std::size_t num_states = 1;
+
+    MomentumUpdate(const Float_ beta) : my_beta(beta) {}
+
+    Float_ operator()(const Float_ gradient, Float_* const state, const Float_ alpha) const {
+        auto& velocity = state[0];
+        velocity = my_beta * velocity + gradient;
+        return alpha * velocity;
+    }
+
+private:
+    Float_ my_beta;
+};
+
+template<typename Float_>
+struct AdamUpdate {
+    static constexpr std::size_t num_states = 2;
+
+    AdamUpdate(const Float_ beta1, const Float_ beta2, const Float_ epsilon, const int epoch) :
+        my_beta1(beta1),
+        my_beta2(beta2),
+        my_epsilon(epsilon),
+        my_correction1(1 - std::pow(beta1, epoch + 1)),
+        my_correction2(1 - std::pow(beta2, epoch + 1))
+    {}
+
+    Float_ operator()(const Float_ gradient, Float_* const state, const Float_ alpha) const {
+        auto& first = state[0];
+        auto& second = state[1];
+        first = my_beta1 * first + (1 - my_beta1) * gradient;
+        second = my_beta2 * second + (1 - my_beta2) * gradient * gradient;
+        const Float_ first_hat = first / my_correction1;
+        const Float_ second_hat = second / my_correction2;
+        return alpha * first_hat / (std::sqrt(second_hat) + my_epsilon);
+    }
+
+private:
+    Float_ my_beta1, my_beta2, my_epsilon;
+    Float_ my_correction1, my_correction2;
+};
+
+/*
+ * Here, the gradients for each observation are accumulated over the epoch
+ * from the coordinates at the start of the epoch, and then used to update
+ * each observation's coordinates with a policy from above. As the graph is
+ * symmetric, each observation only needs to accumulate the attractive forces
+ * from its own edges. Negative samples are drawn from a separate random
+ * number stream for each observation in each epoch, so the result is the
+ * same for any number of threads.
+ */
+template<typename Index_, typename Float_, typename Coord_, typename EpochFloat_, class CreateUpdate_, class Stop_ = NeverStop>
+void optimize_layout_accumulated(
+    const std::size_t num_dim,
+    Coord_* const embedding,
+    EpochData<Index_, EpochFloat_>& setup,
+    const Float_ a,
+    const Float_ b,
+    const Float_ gamma,
+    const Float_ initial_alpha,
+    CreateUpdate_ create_update,
+    const std::uint64_t seed,
+    const int epoch_limit,
+    const int nthreads,
+    Stop_ stop = Stop_(),
+    const bool pin_threads = false,
+    OptimizeWorkspace<Index_, Float_, Coord_>* const workspace = NULL
+) {
+#ifdef UMAPPP_NO_PARALLEL_OPTIMIZATION
+    if (nthreads > 1) {
+        throw std::runtime_error("umappp was not compiled with support for parallel optimization");
+    }
+#endif
+
+    auto& n = setup.current_epoch;
+    const auto num_epochs = setup.total_epochs;
+    const auto& graph = *(setup.graph);
+    const Index_ num_obs = graph.cumulative_num_edges.size() - 1;
+
+    typedef decltype(create_update(0)) Update;
+    constexpr std::size_t num_states = Update::num_states;
+    const auto ntotal = sanisizer::product<std::size_t>(num_obs, num_dim);
+    if (setup.optimizer_state.empty()) {
+        setup.optimizer_state.resize(sanisizer::product<std::size_t>(ntotal, num_states));
+    }
+    OptimizeWorkspace<Index_, Float_, Coord_> local_workspace;
+    auto& gradients = (workspace == NULL ? local_workspace : *workspace).values;
+    gradients.resize(ntotal); // first touched by the thread accumulating each observation's gradient.
+    const auto cpus = available_cpus(pin_threads && nthreads > 1);
+
+    for (; n < epoch_limit; ++n) {
+        if (stop()) {
+            break;
+        }
+
+        const Float_ epoch = n;
+        const Float_ alpha = initial_alpha * (1.0 - epoch / num_epochs);
+        const int epoch_index = n;
+
+        parallelize(nthreads, num_obs, [&](const int t, const Index_ start, const Index_ length) -> void {
+            ThreadPin pin(cpus, t);
+            for (Index_ i = start, end = start + length; i < end; ++i) {
+                auto rng = create_observation_rng(seed, epoch_index, i);
+                const auto left = embedding + sanisizer::product_unsafe<std::size_t>(i, num_dim);
+                const auto grad = gradients.data() + sanisizer::product_unsafe<std::size_t>(i, num_dim);
+                std::fill_n(grad, num_dim, 0);
+
+                for (auto j = graph.cumulative_num_edges[i], jend = graph.cumulative_num_edges[i + 1]; j < jend; ++j) {
+                    if (setup.epoch_of_next_sample[j] > epoch) {
+                        continue;
+                    }
+
+                    {
+                        const auto right = embedding + sanisizer::product_unsafe<std::size_t>(graph.edge_targets[j], num_dim);
+                        const Float_ dist2 = quick_squared_distance<Float_>(left, right, num_dim);
+                        const Float_ grad_coef = attractive_coefficient(dist2, a, b);
+                        for (std::size_t d = 0; d < num_dim; ++d) {
+                            grad[d] += clamp(grad_coef * (static_cast<Float_>(left[d]) - static_cast<Float_>(right[d])));
+                        }
+                    }
+
+                    const EpochFloat_ epochs_per_negative_sample = graph.epochs_per_sample[j] / setup.negative_sample_rate;
+                    const int num_neg_samples = (epoch - setup.epoch_of_next_negative_sample[j]) / epochs_per_negative_sample; // cast is known to be safe, see initialize().
+
+                    for (int p = 0; p < num_neg_samples; ++p) {
+                        const auto sampled = aarand::discrete_uniform(rng, num_obs);
+                        if (sampled == i) {
+                            continue;
+                        }
+
+                        const auto right = embedding + sanisizer::product_unsafe<std::size_t>(sampled, num_dim);
+                        const Float_ dist2 = quick_squared_distance<Float_>(left, right, num_dim);
+                        const Float_ grad_coef = repulsive_coefficient(dist2, a, b, gamma);
+                        for (std::size_t d = 0; d < num_dim; ++d) {
+                            grad[d] += clamp(grad_coef * (static_cast<Float_>(left[d]) - static_cast<Float_>(right[d])));
+                        }
+                    }
+
+                    setup.epoch_of_next_sample[j] += graph.epochs_per_sample[j];
+                    setup.epoch_of_next_negative_sample[j] += num_neg_samples * epochs_per_negative_sample;
+                }
+            }
+        });
+
+        const auto update = create_update(epoch_index);
+        parallelize(nthreads, ntotal, [&](const int t, const std::size_t start, const std::size_t length) -> void {
+            ThreadPin pin(cpus, t);
+            for (std::size_t x = start, end = start + length; x < end; ++x) {
+                Float_ state[num_states];
+                const auto saved = setup.optimizer_state.data() + x * num_states;
+                std::copy_n(saved, num_states, state);
+                embedding[x] += update(gradients[x], state, alpha);
+                std::copy_n(state, num_states, saved);
+            }
+        });
+    }
+}
+
+}
+
+#endif
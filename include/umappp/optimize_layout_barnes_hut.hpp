@@ -0,0 +1,373 @@
+#ifndef UMAPPP_OPTIMIZE_LAYOUT_BARNES_HUT_HPP
+#define UMAPPP_OPTIMIZE_LAYOUT_BARNES_HUT_HPP
+
+#include <vector>
+#include <memory_resource>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cmath>
+#include <cstddef>
+#include <optional>
+
+#ifdef UMAPPP_NO_PARALLEL_OPTIMIZATION
+#include <stdexcept>
+#endif
+
+#include "sanisizer/sanisizer.hpp"
+
+#include "optimize_layout.hpp"
+#include "parallelize.hpp"
+#include "thread_affinity.hpp"
+#include "utils.hpp"
+
+namespace umappp {
+
+/*
+ * Barnes-Hut approximation of the repulsive forces between all pairs of
+ * observations. We build a k-d tree on the embedding by splitting each node
+ * at the midpoint of its widest dimension, which works for any number of
+ * dimensions. Nodes are stored in pre-order, so the left child of each
+ * internal node immediately follows it; and each node records the index of
+ * the node after its subtree, so the tree can be traversed without a stack.
+ * The coordinates are copied into the tree in the same order as the nodes,
+ * such that each traversal mostly accesses memory sequentially.
+ */
+template<typename Index_, typename Float_>
+class BarnesHutTree {
+public:
+    BarnesHutTree(const std::size_t num_dim, std::pmr::memory_resource* const resource = std::pmr::get_default_resource()) :
+        my_num_dim(num_dim),
+        my_nodes(resource),
+        my_centers(resource),
+        my_order(resource),
+        my_position(resource),
+        my_points(resource),
+        my_tasks(resource),
+        my_lower(resource),
+        my_upper(resource)
+    {}
+
+private:
+    struct Node {
+        std::size_t start, end; // range of observations in 'my_order'.
+        std::size_t skip; // index of the next node after this subtree.
+        Float_ width2; // squared width along the widest dimension.
+        bool leaf;
+    };
+
+    std::size_t my_num_dim;
+    std::pmr::vector<Node> my_nodes;
+    std::pmr::vector<Float_> my_centers;
+    std::pmr::vector<Index_> my_order;
+    std::pmr::vector<std::size_t> my_position;
+    std::pmr::vector<Float_> my_points;
+
+    struct Task {
+        std::size_t start, end;
+    };
+    std::pmr::vector<Task> my_tasks;
+    std::pmr::vector<Float_> my_lower, my_upper;
+
+    static constexpr std::size_t leaf_size = 8;
+
+public:
+    std::size_t num_dimensions() const {
+        return my_num_dim;
+    }
+
+    std::size_t memory_usage() const {
+        std::size_t output = umappp::memory_usage(my_nodes) + umappp::memory_usage(my_centers) + umappp::memory_usage(my_order) + umappp::memory_usage(my_position);
+        output += umappp::memory_usage(my_points) + umappp::memory_usage(my_tasks) + umappp::memory_usage(my_lower) + umappp::memory_usage(my_upper);
+        return output;
+    }
+
+    // Memory used after build(), see estimate_resources(). Every internal node
+    // has two non-empty children, so there are at most 'num_obs' leaves and
+    // '2 * num_obs - 1' nodes; and the pending tasks always refer to disjoint
+    // ranges of observations, so there are at most 'num_obs' of them.
+    static double memory_bound(const double num_obs, const double num_dim) {
+        const double max_nodes = 2 * num_obs;
+        return max_nodes * (sizeof(Node) + num_dim * sizeof(Float_)) +
+            num_obs * (sizeof(Index_) + sizeof(std::size_t) + num_dim * sizeof(Float_) + sizeof(Task)) +
+            2 * num_dim * sizeof(Float_);
+    }
+
+    template<typename Coord_>
+    void build(const Index_ num_obs, const Coord_* const embedding) {
+        my_lower.resize(my_num_dim);
+        my_upper.resize(my_num_dim);
+
+        // Reserving the maximum sizes so that the tree does not reallocate, see memory_bound().
+        if (num_obs) {
+            const auto max_nodes = sanisizer::product<std::size_t>(num_obs, 2) - 1;
+            my_nodes.reserve(max_nodes);
+            my_centers.reserve(sanisizer::product<std::size_t>(max_nodes, my_num_dim));
+            my_tasks.reserve(num_obs);
+        }
+
+        my_order.resize(num_obs);
+        std::iota(my_order.begin(), my_order.end(), static_cast<Index_>(0));
+        const auto ntotal = sanisizer::product<std::size_t>(num_obs, my_num_dim);
+        my_points.resize(ntotal);
+        std::copy_n(embedding, ntotal, my_points.data());
+
+        my_nodes.clear();
+        my_centers.clear();
+        my_tasks.clear();
+        if (num_obs) {
+            my_tasks.push_back(Task{ 0, static_cast<std::size_t>(num_obs) });
+        }
+
+        while (!my_tasks.empty()) {
+            const auto task = my_tasks.back();
+            my_tasks.pop_back();
+
+            std::fill(my_lower.begin(), my_lower.end(), std::numeric_limits<Float_>::infinity());
+            std::fill(my_upper.begin(), my_upper.end(), -std::numeric_limits<Float_>::infinity());
+            const auto center_offset = my_centers.size();
+            my_centers.resize(center_offset + my_num_dim);
+            const auto center = my_centers.data() + center_offset;
+
+            for (auto p = task.start; p < task.end; ++p) {
+                const auto point = my_points.data() + p * my_num_dim;
+                for (std::size_t d = 0; d < my_num_dim; ++d) {
+                    my_lower[d] = std::min(my_lower[d], point[d]);
+                    my_upper[d] = std::max(my_upper[d], point[d]);
+                    center[d] += point[d];
+                }
+            }
+            const Float_ count = task.end - task.start;
+            for (std::size_t d = 0; d < my_num_dim; ++d) {
+                center[d] /= count;
+            }
+
+            std::size_t split_dim = 0;
+            Float_ width = 0;
+            for (std::size_t d = 0; d < my_num_dim; ++d) {
+                const Float_ current = my_upper[d] - my_lower[d];
+                if (current > width) {
+                    width = current;
+                    split_dim = d;
+                }
+            }
+
+            Node node;
+            node.start = task.start;
+            node.end = task.end;
+            node.width2 = width * width;
+            node.leaf = true;
+
+            if (task.end - task.start > leaf_size && width > 0) {
+                // Partitioning the observations (and their coordinates) by the midpoint.
+                const Float_ mid = my_lower[split_dim] + width / 2;
+                auto left = task.start, right = task.end;
+                while (left < right) {
+                    if (my_points[left * my_num_dim + split_dim] < mid) {
+                        ++left;
+                    } else {
+                        --right;
+                        std::swap(my_order[left], my_order[right]);
+                        std::swap_ranges(
+                            my_points.data() + left * my_num_dim,
+                            my_points.data() + (left + 1) * my_num_dim,
+                            my_points.data() + right * my_num_dim
+                        );
+                    }
+                }
+
+                // Guarding against round-off when the width is tiny.
+                if (left != task.start && left != task.end) {
+                    node.leaf = false;
+                    my_tasks.push_back(Task{ left, task.end });
+                    my_tasks.push_back(Task{ task.start, left });
+                }
+            }
+
+            my_nodes.push_back(node);
+        }
+
+        // Filling in the skips in reverse, as children always come after their parents.
+        // For an internal node, the right child is the node after the left subtree.
+        const auto num_nodes = my_nodes.size();
+        for (std::size_t n = num_nodes; n > 0; --n) {
+            auto& node = my_nodes[n - 1];
+            if (node.leaf) {
+                node.skip = n;
+            } else {
+                const auto right = my_nodes[n].skip;
+                node.skip = my_nodes[right].skip;
+            }
+        }
+
+        my_position.resize(num_obs);
+        for (Index_ i = 0; i < num_obs; ++i) {
+            my_position[my_order[i]] = i;
+        }
+    }
+
+private:
+    void add_repulsion(const Float_* const self, const Float_* const other, const Float_ multiplier, const Float_ a, const Float_ b, const Float_ gamma, Float_* const output) const {
+        const Float_ dist2 = quick_squared_distance<Float_>(self, other, my_num_dim);
+        const Float_ grad_coef = repulsive_coefficient(dist2, a, b, gamma);
+        for (std::size_t d = 0; d < my_num_dim; ++d) {
+            output[d] += multiplier * clamp(grad_coef * (self[d] - other[d]));
+        }
+    }
+
+public:
+    // Sum of the clamped repulsive gradients on 'observation' from all other observations,
+    // using the coordinates at the time of the last build().
+    void compute_repulsion(const Index_ observation, const Float_ a, const Float_ b, const Float_ gamma, const Float_ theta2, Float_* const output) const {
+        std::fill_n(output, my_num_dim, 0);
+        const auto position = my_position[observation];
+        const auto self = my_points.data() + position * my_num_dim;
+
+        const auto num_nodes = my_nodes.size();
+        std::size_t n = 0;
+        while (n < num_nodes) {
+            const auto& node = my_nodes[n];
+            const auto center = my_centers.data() + n * my_num_dim;
+
+            // Treating the node as a single point if it is sufficiently far away.
+            // Nodes containing the observation itself are never approximated, as the
+            // center of mass can be far from the observation in elongated or
+            // high-dimensional nodes, such that the observation would repel itself.
+            const bool contains_self = (position >= node.start && position < node.end);
+            if (!contains_self && node.width2 < theta2 * quick_squared_distance<Float_>(self, center, my_num_dim)) {
+                add_repulsion(self, center, node.end - node.start, a, b, gamma, output);
+                n = node.skip;
+                continue;
+            }
+
+            if (node.leaf) {
+                for (auto p = node.start; p < node.end; ++p) {
+                    if (my_order[p] != observation) {
+                        add_repulsion(self, my_points.data() + p * my_num_dim, 1, a, b, gamma, output);
+                    }
+                }
+                n = node.skip;
+            } else {
+                ++n;
+            }
+        }
+    }
+};
+
+/*
+ * Buffers for optimize_layout_barnes_hut(), which are held by the Status so
+ * that repeated calls to run() can reuse the allocations from previous calls.
+ */
+template<typename Index_, typename Float_>
+struct BarnesHutWorkspace {
+    BarnesHutWorkspace(const std::size_t num_dim, std::pmr::memory_resource* const resource = std::pmr::get_default_resource()) :
+        tree(num_dim, resource),
+        field(resource)
+    {}
+
+    BarnesHutTree<Index_, Float_> tree;
+    UninitializedPmrVector<Float_> field;
+
+    std::size_t memory_usage() const {
+        return tree.memory_usage() + umappp::memory_usage(field);
+    }
+};
+
+/*
+ * In each epoch, we compute the expected repulsive gradient for each
+ * observation from a single negative sample, i.e., the average over all
+ * observations. This is done in parallel from a snapshot of the embedding at
+ * the start of the epoch. The optimization then proceeds as in the serial
+ * code, except that each set of negative samples for an edge is replaced by
+ * the same number of copies of the expected gradient. No random numbers are
+ * involved, so the result is the same for any number of threads.
+ */
+template<typename Index_, typename Float_, typename Coord_, typename EpochFloat_, class Stop_ = NeverStop>
+void optimize_layout_barnes_hut(
+    const std::size_t num_dim,
+    Coord_* const embedding,
+    EpochData<Index_, EpochFloat_>& setup,
+    const Float_ a,
+    const Float_ b,
+    const Float_ gamma,
+    const Float_ initial_alpha,
+    const Float_ theta,
+    const int epoch_limit,
+    const int nthreads,
+    Stop_ stop = Stop_(),
+    const bool pin_threads = false,
+    BarnesHutWorkspace<Index_, Float_>* const workspace = NULL
+) {
+#ifdef UMAPPP_NO_PARALLEL_OPTIMIZATION
+    if (nthreads > 1) {
+        throw std::runtime_error("umappp was not compiled with support for parallel optimization");
+    }
+#endif
+
+    auto& n = setup.current_epoch;
+    const auto num_epochs = setup.total_epochs;
+    const auto& graph = *(setup.graph);
+    const Index_ num_obs = graph.cumulative_num_edges.size() - 1;
+
+    std::optional<BarnesHutWorkspace<Index_, Float_> > local_workspace;
+    if (workspace == NULL || workspace->tree.num_dimensions() != num_dim) {
+        local_workspace.emplace(num_dim);
+    }
+    auto& work = (local_workspace.has_value() ? *local_workspace : *workspace);
+    auto& tree = work.tree;
+    auto& field = work.field;
+    field.resize(sanisizer::product<std::size_t>(num_obs, num_dim)); // first touched by the thread computing each observation's force.
+    const auto cpus = available_cpus(pin_threads && nthreads > 1);
+    const Float_ theta2 = theta * theta;
+
+    for (; n < epoch_limit; ++n) {
+        if (stop()) {
+            break;
+        }
+
+        const Float_ epoch = n;
+        const Float_ alpha = initial_alpha * (1.0 - epoch / num_epochs);
+
+        tree.build(num_obs, embedding);
+        parallelize(nthreads, num_obs, [&](const int t, const Index_ start, const Index_ length) -> void {
+            ThreadPin pin(cpus, t);
+            for (Index_ i = start, end = start + length; i < end; ++i) {
+                tree.compute_repulsion(i, a, b, gamma, theta2, field.data() + sanisizer::product_unsafe<std::size_t>(i, num_dim));
+            }
+        });
+
+        for (Index_ i = 0; i < num_obs; ++i) {
+            const auto start = graph.cumulative_num_edges[i], end = graph.cumulative_num_edges[i + 1];
+            const auto left = embedding + sanisizer::product_unsafe<std::size_t>(i, num_dim);
+            const auto repulsion = field.data() + sanisizer::product_unsafe<std::size_t>(i, num_dim);
+
+            for (auto j = start; j < end; ++j) {
+                if (setup.epoch_of_next_sample[j] > epoch) {
+                    continue;
+                }
+
+                const auto right = embedding + sanisizer::product_unsafe<std::size_t>(graph.edge_targets[j], num_dim);
+                attract_pair(left, right, num_dim, a, b, alpha);
+
+                const EpochFloat_ epochs_per_negative_sample = graph.epochs_per_sample[j] / setup.negative_sample_rate;
+                const int num_neg_samples = (epoch - setup.epoch_of_next_negative_sample[j]) / epochs_per_negative_sample; // cast is known to be safe, see initialize().
+
+                if (num_neg_samples > 0) {
+                    // Negative samples are drawn uniformly from all observations (and skipped if equal to 'i'),
+                    // so the expected gradient of each sample is the sum divided by the number of observations.
+                    const Float_ multiplier = alpha * num_neg_samples / static_cast<Float_>(num_obs);
+                    for (std::size_t d = 0; d < num_dim; ++d) {
+                        left[d] += multiplier * repulsion[d];
+                    }
+                }
+
+                setup.epoch_of_next_sample[j] += graph.epochs_per_sample[j];
+                setup.epoch_of_next_negative_sample[j] += num_neg_samples * epochs_per_negative_sample;
+            }
+        }
+    }
+}
+
+}
+
+#endif
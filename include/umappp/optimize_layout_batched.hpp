@@ -0,0 +1,256 @@
+#ifndef UMAPPP_OPTIMIZE_LAYOUT_BATCHED_HPP
+#define UMAPPP_OPTIMIZE_LAYOUT_BATCHED_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <utility>
+
+#ifdef UMAPPP_NO_PARALLEL_OPTIMIZATION
+#include <stdexcept>
+#endif
+
+#include "aarand/aarand.hpp"
+#include "sanisizer/sanisizer.hpp"
+
+#include "optimize_layout.hpp"
+#include "ParallelStatistics.hpp"
+#include "rng.hpp"
+#include "thread_affinity.hpp"
+#include "utils.hpp"
+
+namespace umappp {
+
+/*
+ * Processing an observation involves writing to its own coordinates and
+ * those of its neighbors. Two observations can be safely processed in
+ * parallel if they are not neighbors and do not share any neighbors, i.e.,
+ * they are separated by a distance of at least 3 in the (symmetric) graph.
+ * So, we perform a greedy distance-2 coloring of the graph, where each
+ * color defines a batch of observations that can be processed in parallel.
+ */
+template<typename Index_, typename Float_>
+void color_observations(EpochGraph<Index_, Float_>& graph) {
+    const Index_ num_obs = graph.cumulative_num_edges.size() - 1;
+    auto colors = sanisizer::create<std::vector<std::size_t> >(num_obs);
+
+    // For each color, we store 1 + the last observation for which it was forbidden.
+    std::vector<std::size_t> last_forbidden;
+
+    for (Index_ i = 0; i < num_obs; ++i) {
+        const std::size_t flag = static_cast<std::size_t>(i) + 1;
+        const auto forbid = [&](const Index_ other) -> void {
+            if (other < i) { // only the preceding observations have been colored.
+                last_forbidden[colors[other]] = flag;
+            }
+        };
+
+        const auto start = graph.cumulative_num_edges[i], end = graph.cumulative_num_edges[i + 1];
+        for (auto j = start; j < end; ++j) {
+            const auto neighbor = graph.edge_targets[j];
+            forbid(neighbor);
+            const auto nstart = graph.cumulative_num_edges[neighbor], nend = graph.cumulative_num_edges[neighbor + 1];
+            for (auto k = nstart; k < nend; ++k) {
+                forbid(graph.edge_targets[k]);
+            }
+        }
+
+        std::size_t chosen = 0;
+        const auto num_colors = last_forbidden.size();
+        while (chosen < num_colors && last_forbidden[chosen] == flag) {
+            ++chosen;
+        }
+        if (chosen == num_colors) {
+            last_forbidden.push_back(0);
+        }
+        colors[i] = chosen;
+    }
+
+    // Counting sort of observations by their colors.
+    const auto num_colors = last_forbidden.size();
+    graph.batch_pointers.clear();
+    graph.batch_pointers.resize(sanisizer::sum<I<decltype(graph.batch_pointers.size())> >(num_colors, 1));
+    for (const auto c : colors) {
+        ++(graph.batch_pointers[c + 1]);
+    }
+    for (I<decltype(num_colors)> c = 0; c < num_colors; ++c) {
+        graph.batch_pointers[c + 1] += graph.batch_pointers[c];
+    }
+
+    graph.batch_observations.resize(num_obs);
+    auto offsets = graph.batch_pointers;
+    for (Index_ i = 0; i < num_obs; ++i) {
+        auto& pos = offsets[colors[i]];
+        graph.batch_observations[pos] = i;
+        ++pos;
+    }
+}
+
+template<typename Index_, typename Float_, typename Coord_, typename EpochFloat_>
+void optimize_batched_observation(
+    const Index_ i,
+    const std::size_t num_dim,
+    Coord_* const embedding,
+    const Coord_* const snapshot,
+    EpochData<Index_, EpochFloat_>& setup,
+    const Float_ a,
+    const Float_ b,
+    const Float_ gamma,
+    const Float_ alpha,
+    const int epoch_index,
+    const std::uint64_t seed
+) {
+    const auto& graph = *(setup.graph);
+    const Float_ epoch = epoch_index;
+    const Index_ num_obs = graph.cumulative_num_edges.size() - 1;
+    auto rng = create_observation_rng(seed, epoch_index, i);
+
+    const auto start = graph.cumulative_num_edges[i], end = graph.cumulative_num_edges[i + 1];
+    const auto left = embedding + sanisizer::product_unsafe<std::size_t>(i, num_dim);
+
+    for (auto j = start; j < end; ++j) {
+        if (setup.epoch_of_next_sample[j] > epoch) {
+            continue;
+        }
+
+        const auto right = embedding + sanisizer::product_unsafe<std::size_t>(graph.edge_targets[j], num_dim);
+        attract_pair(left, right, num_dim, a, b, alpha);
+
+        const EpochFloat_ epochs_per_negative_sample = graph.epochs_per_sample[j] / setup.negative_sample_rate;
+        const int num_neg_samples = (epoch - setup.epoch_of_next_negative_sample[j]) / epochs_per_negative_sample; // cast is known to be safe, see initialize().
+
+        for (int p = 0; p < num_neg_samples; ++p) {
+            const auto sampled = aarand::discrete_uniform(rng, num_obs);
+            if (sampled == i) {
+                continue;
+            }
+
+            // Negative samples are read from the snapshot, as their current
+            // coordinates may be modified by other observations in this batch.
+            repel_from(left, snapshot + sanisizer::product_unsafe<std::size_t>(sampled, num_dim), num_dim, a, b, gamma, alpha);
+        }
+
+        setup.epoch_of_next_sample[j] += graph.epochs_per_sample[j];
+        setup.epoch_of_next_negative_sample[j] += num_neg_samples * epochs_per_negative_sample;
+    }
+}
+
+template<typename Task_>
+std::pair<Task_, Task_> split_range(const Task_ start, const Task_ length, const int thread, const int nthreads) {
+    const Task_ per_thread = length / nthreads;
+    const Task_ remainder = length % nthreads;
+    const Task_ offset = per_thread * thread + std::min(static_cast<Task_>(thread), remainder);
+    return std::make_pair(start + offset, per_thread + (static_cast<Task_>(thread) < remainder));
+}
+
+template<typename Index_, typename Float_, typename Coord_, typename EpochFloat_, class Stop_ = NeverStop>
+void optimize_layout_batched(
+    const std::size_t num_dim,
+    Coord_* const embedding,
+    EpochData<Index_, EpochFloat_>& setup,
+    const Float_ a,
+    const Float_ b,
+    const Float_ gamma,
+    const Float_ initial_alpha,
+    const std::uint64_t seed,
+    const int epoch_limit,
+    const int nthreads,
+    const int spin_limit,
+    ParallelStatistics& statistics,
+    Stop_ stop = Stop_(),
+    const bool pin_threads = false,
+    OptimizeWorkspace<Index_, Float_, Coord_>* const workspace = NULL
+) {
+    const int start_epoch = setup.current_epoch;
+    if (start_epoch >= epoch_limit) {
+        return;
+    }
+
+    // The graph should have already been colored by color_observations().
+    const auto& graph = *(setup.graph);
+    const auto num_epochs = setup.total_epochs;
+    const Index_ num_obs = graph.cumulative_num_edges.size() - 1;
+    const auto num_batches = graph.batch_pointers.size() - 1;
+    const auto ntotal = sanisizer::product<std::size_t>(num_obs, num_dim);
+    OptimizeWorkspace<Index_, Float_, Coord_> local_workspace;
+    auto& work = (workspace == NULL ? local_workspace : *workspace);
+    auto& snapshot = work.snapshot;
+    snapshot.resize(ntotal); // first touched by each thread's copy below.
+    const auto cpus = available_cpus(pin_threads && nthreads > 1);
+
+    // All threads run through the same sequence of epochs and batches,
+    // synchronizing at the end of each step via the barrier.
+    int end_epoch = epoch_limit;
+    bool stopped = false;
+    std::exception_ptr error;
+    const auto run_epochs = [&](const int t, auto&& sync) -> void {
+        ThreadPin pin(cpus, t);
+        for (int n = start_epoch; n < epoch_limit; ++n) {
+            // Only the main thread checks the stopping condition, and the
+            // other threads see its decision after the next barrier.
+            if (t == 0) {
+                // Any exception from the stopping condition (e.g., an observer)
+                // is rethrown after all threads have left the parallel section.
+                try {
+                    stopped = stop();
+                } catch (...) {
+                    error = std::current_exception();
+                    stopped = true;
+                }
+                if (stopped) {
+                    end_epoch = n;
+                }
+            }
+
+            const Float_ epoch = n;
+            const Float_ alpha = initial_alpha * (1.0 - epoch / num_epochs);
+
+            const auto snap_range = split_range<std::size_t>(0, ntotal, t, nthreads);
+            std::copy_n(embedding + snap_range.first, snap_range.second, snapshot.data() + snap_range.first);
+            sync();
+            if (stopped) {
+                break;
+            }
+
+            for (I<decltype(num_batches)> batch = 0; batch < num_batches; ++batch) {
+                const auto batch_start = graph.batch_pointers[batch];
+                const auto batch_range = split_range<std::size_t>(batch_start, graph.batch_pointers[batch + 1] - batch_start, t, nthreads);
+                for (std::size_t o = batch_range.first, oend = batch_range.first + batch_range.second; o < oend; ++o) {
+                    optimize_batched_observation(graph.batch_observations[o], num_dim, embedding, snapshot.data(), setup, a, b, gamma, alpha, n, seed);
+                }
+                sync();
+            }
+        }
+    };
+
+    if (nthreads == 1) {
+        run_epochs(0, []() -> void {});
+    } else {
+#ifndef UMAPPP_NO_PARALLEL_OPTIMIZATION
+        SpinBarrier barrier(nthreads, spin_limit);
+        const auto sync = [&]() -> void {
+            barrier.arrive_and_wait();
+        };
+        work.pool.run(nthreads, [&](const int t) -> void {
+            run_epochs(t, sync);
+        });
+#else
+        throw std::runtime_error("umappp was not compiled with support for parallel optimization");
+#endif
+    }
+
+    const auto num_run = end_epoch - start_epoch;
+    statistics.num_dispatched += sanisizer::product<std::size_t>(num_obs, num_run);
+    statistics.num_rounds += sanisizer::product<std::size_t>(num_batches, num_run);
+    setup.current_epoch = end_epoch;
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,345 @@
+#ifndef UMAPPP_OPTIMIZE_LAYOUT_MINIBATCH_HPP
+#define UMAPPP_OPTIMIZE_LAYOUT_MINIBATCH_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <limits>
+
+#ifdef UMAPPP_NO_PARALLEL_OPTIMIZATION
+#include <stdexcept>
+#endif
+
+#include "aarand/aarand.hpp"
+#include "sanisizer/sanisizer.hpp"
+
+#include "optimize_layout.hpp"
+#include "optimize_layout_batched.hpp"
+#include "ParallelStatistics.hpp"
+#include "rng.hpp"
+#include "thread_affinity.hpp"
+#include "utils.hpp"
+
+namespace umappp {
+
+// See EdgeAliasTable in optimize_layout.hpp. If 'prune_epochs' is positive,
+// only edges that are sampled at least once in 'prune_epochs' are included.
+template<typename Index_, typename Float_>
+EdgeAliasTable<Index_, Float_> build_edge_alias_table(const EpochGraph<Index_, Float_>& graph, const int prune_epochs = 0) {
+    EdgeAliasTable<Index_, Float_> output;
+    const Index_ num_obs = graph.cumulative_num_edges.size() - 1;
+    const auto num_graph_edges = graph.edge_targets.size();
+
+    if (prune_epochs > 0) {
+        for (Index_ i = 0; i < num_obs; ++i) {
+            for (auto j = graph.cumulative_num_edges[i], end = graph.cumulative_num_edges[i + 1]; j < end; ++j) {
+                if (graph.epochs_per_sample[j] <= prune_epochs) {
+                    output.edges.push_back(j);
+                    output.sources.push_back(i);
+                }
+            }
+        }
+        if (output.edges.size() == num_graph_edges) {
+            output.edges.clear(); // no need to store the indices if nothing was pruned.
+            output.edges.shrink_to_fit();
+        }
+    } else {
+        output.sources.resize(num_graph_edges);
+        for (Index_ i = 0; i < num_obs; ++i) {
+            std::fill(output.sources.begin() + graph.cumulative_num_edges[i], output.sources.begin() + graph.cumulative_num_edges[i + 1], i);
+        }
+    }
+
+    const auto num_edges = output.sources.size();
+    const auto get_epochs_per_sample = [&](const std::size_t j) -> Float_ {
+        return graph.epochs_per_sample[output.edges.empty() ? j : output.edges[j]];
+    };
+
+    output.probability.resize(num_edges);
+    output.alias.resize(num_edges);
+    Float_ total = 0;
+    for (std::size_t j = 0; j < num_edges; ++j) {
+        total += 1 / get_epochs_per_sample(j);
+    }
+
+    std::vector<std::size_t> small, large;
+    for (std::size_t j = 0; j < num_edges; ++j) {
+        auto& p = output.probability[j];
+        p = static_cast<Float_>(num_edges) / (get_epochs_per_sample(j) * total);
+        output.alias[j] = j;
+        if (p < 1) {
+            small.push_back(j);
+        } else {
+            large.push_back(j);
+        }
+    }
+
+    while (!small.empty() && !large.empty()) {
+        const auto s = small.back();
+        small.pop_back();
+        const auto l = large.back();
+        output.alias[s] = l;
+
+        auto& lprob = output.probability[l];
+        lprob -= 1 - output.probability[s];
+        if (lprob < 1) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+
+    // Any leftovers should be 1, up to round-off error.
+    for (const auto l : large) {
+        output.probability[l] = 1;
+    }
+    for (const auto s : small) {
+        output.probability[s] = 1;
+    }
+
+    return output;
+}
+
+// The table only depends on the graph and the number of epochs, so it is
+// computed once when the graph is created, like the batches for
+// OptimizeScheduler::COLORING. If 'prune = true', the graph was pruned for a
+// larger number of epochs than 'num_epochs', see initialize_batch().
+template<typename Index_, typename Float_>
+void fill_edge_alias_table(EpochGraph<Index_, Float_>& graph, const int num_epochs, const bool prune = false) {
+    for (const auto& existing : graph.edge_alias) {
+        if (existing.num_epochs == num_epochs) {
+            return;
+        }
+    }
+    graph.edge_alias.push_back(build_edge_alias_table(graph, prune ? num_epochs : 0));
+    graph.edge_alias.back().num_epochs = num_epochs;
+}
+
+// Total number of edge updates in the usual epoch-based optimization,
+// which is used as the default budget for the minibatch optimization.
+template<typename Index_, typename Float_>
+std::size_t default_minibatch_updates(const EpochGraph<Index_, Float_>& graph, const int num_epochs) {
+    double total = 0;
+    for (const auto e : graph.epochs_per_sample) {
+        total += std::floor(static_cast<double>(num_epochs) / static_cast<double>(e));
+    }
+    return sanisizer::from_float<std::size_t>(total);
+}
+
+/*
+ * In each epoch, the update budget is split into minibatches of edges that
+ * are sampled from the alias table. All updates in a minibatch are computed
+ * from the embedding at the start of the minibatch, with the random numbers
+ * for each update drawn from its own stream. The changes to the coordinates
+ * are stored for each update and then applied in the order of the updates,
+ * so the result is the same for any number of threads. Threads split the
+ * updates of each minibatch during the computation and split the
+ * observations when applying the changes.
+ */
+template<typename Index_, typename Float_, typename Coord_, typename EpochFloat_, class Stop_ = NeverStop>
+void optimize_layout_minibatch(
+    const std::size_t num_dim,
+    Coord_* const embedding,
+    EpochData<Index_, EpochFloat_>& setup,
+    const Float_ a,
+    const Float_ b,
+    const Float_ gamma,
+    const Float_ initial_alpha,
+    const std::uint64_t seed,
+    const std::size_t total_updates,
+    const std::size_t batch_size,
+    const int epoch_limit,
+    const int nthreads,
+    const int spin_limit,
+    ParallelStatistics& statistics,
+    Stop_ stop = Stop_(),
+    const bool pin_threads = false,
+    OptimizeWorkspace<Index_, Float_, Coord_>* const workspace = NULL
+) {
+    const int start_epoch = setup.current_epoch;
+    if (start_epoch >= epoch_limit) {
+        return;
+    }
+
+    const auto& graph = *(setup.graph);
+    const auto num_epochs = setup.total_epochs;
+    const Index_ num_obs = graph.cumulative_num_edges.size() - 1;
+
+    // Falling back to a temporary table if the graph was not created for this
+    // scheduler, in which case we assume that it was pruned for 'num_epochs'.
+    const EdgeAliasTable<Index_, EpochFloat_>* cached = NULL;
+    for (const auto& existing : graph.edge_alias) {
+        if (existing.num_epochs == num_epochs) {
+            cached = &existing;
+            break;
+        }
+    }
+    EdgeAliasTable<Index_, EpochFloat_> local_table;
+    if (cached == NULL) {
+        local_table = build_edge_alias_table(graph);
+    }
+    const auto& table = (cached == NULL ? local_table : *cached);
+    const auto num_edges = table.sources.size();
+    sanisizer::product<std::size_t>(total_updates, num_epochs); // checking that the per-epoch calculation below does not overflow.
+
+    const std::size_t safe_batch_size = std::max(batch_size, static_cast<std::size_t>(1));
+    OptimizeWorkspace<Index_, Float_, Coord_> local_workspace;
+    auto& work = (workspace == NULL ? local_workspace : *workspace);
+    auto& changed_rows = work.rows;
+    changed_rows.resize(sanisizer::product<std::size_t>(safe_batch_size, 2));
+    auto& changes = work.values;
+    changes.resize(sanisizer::product<std::size_t>(changed_rows.size(), num_dim)); // first touched by the thread computing each update.
+
+    // Each thread's buffer is padded by a cache line to avoid false sharing.
+    const auto buffer_stride = sanisizer::sum<std::size_t>(num_dim, 64 / sizeof(Float_) + 1);
+    work.thread_values.resize(sanisizer::product<std::size_t>(buffer_stride, std::max(nthreads, 1)));
+    const auto cpus = available_cpus(pin_threads && nthreads > 1);
+
+    const auto base_negatives = static_cast<int>(setup.negative_sample_rate); // cast is known to be safe, see create_epoch_data().
+    const Float_ extra_negative = setup.negative_sample_rate - base_negatives;
+
+    int end_epoch = epoch_limit;
+    bool stopped = false;
+    std::exception_ptr error;
+    std::size_t num_batches_run = 0, num_updates_run = 0;
+
+    const auto run_epochs = [&](const int t, auto&& sync) -> void {
+        ThreadPin pin(cpus, t);
+        const auto buffer = work.thread_values.data() + sanisizer::product_unsafe<std::size_t>(buffer_stride, t);
+
+        for (int n = start_epoch; n < epoch_limit; ++n) {
+            if (t == 0) {
+                // Any exception from the stopping condition (e.g., an observer)
+                // is rethrown after all threads have left the parallel section.
+                try {
+                    stopped = stop();
+                } catch (...) {
+                    error = std::current_exception();
+                    stopped = true;
+                }
+                if (stopped) {
+                    end_epoch = n;
+                }
+            }
+            sync();
+            if (stopped || num_edges == 0) {
+                break;
+            }
+
+            const Float_ epoch = n;
+            const Float_ alpha = initial_alpha * (1.0 - epoch / num_epochs);
+            const auto epoch_start = total_updates * static_cast<std::size_t>(n) / static_cast<std::size_t>(num_epochs);
+            const auto epoch_end = total_updates * static_cast<std::size_t>(n + 1) / static_cast<std::size_t>(num_epochs);
+
+            for (auto batch_start = epoch_start; batch_start < epoch_end; batch_start += safe_batch_size) {
+                const auto batch_length = std::min(safe_batch_size, epoch_end - batch_start);
+
+                const auto update_range = split_range<std::size_t>(0, batch_length, t, nthreads);
+                for (std::size_t u = update_range.first, uend = update_range.first + update_range.second; u < uend; ++u) {
+                    auto rng = create_observation_rng(seed, n, batch_start + u);
+                    auto edge = aarand::discrete_uniform(rng, num_edges);
+                    if (aarand::standard_uniform<Float_>(rng) >= table.probability[edge]) {
+                        edge = table.alias[edge];
+                    }
+
+                    const auto i = table.sources[edge], target = graph.edge_targets[table.edges.empty() ? edge : table.edges[edge]];
+                    const auto left = embedding + sanisizer::product_unsafe<std::size_t>(i, num_dim);
+                    const auto right = embedding + sanisizer::product_unsafe<std::size_t>(target, num_dim);
+                    auto left_change = changes.data() + sanisizer::product_unsafe<std::size_t>(2 * u, num_dim);
+                    auto right_change = left_change + num_dim;
+                    changed_rows[2 * u] = i;
+                    changed_rows[2 * u + 1] = target;
+
+                    {
+                        const Float_ dist2 = quick_squared_distance<Float_>(left, right, num_dim);
+                        const Float_ grad_coef = attractive_coefficient(dist2, a, b);
+                        for (std::size_t d = 0; d < num_dim; ++d) {
+                            const Float_ l = left[d], r = right[d];
+                            const Float_ gradient = alpha * clamp(grad_coef * (l - r));
+                            buffer[d] = l + gradient;
+                            left_change[d] = gradient;
+                            right_change[d] = -gradient;
+                        }
+                    }
+
+                    int num_neg_samples = base_negatives;
+                    if (extra_negative > 0 && aarand::standard_uniform<Float_>(rng) < extra_negative) {
+                        ++num_neg_samples;
+                    }
+
+                    for (int p = 0; p < num_neg_samples; ++p) {
+                        const auto sampled = aarand::discrete_uniform(rng, num_obs);
+                        if (sampled == i) {
+                            continue;
+                        }
+
+                        const auto other = embedding + sanisizer::product_unsafe<std::size_t>(sampled, num_dim);
+                        Float_ dist2 = 0; // can't use quick_squared_distance() as the buffer may have a different type from the embedding.
+                        for (std::size_t d = 0; d < num_dim; ++d) {
+                            const Float_ delta = buffer[d] - static_cast<Float_>(other[d]);
+                            dist2 += delta * delta;
+                        }
+                        dist2 = std::max(dist2, std::numeric_limits<Float_>::epsilon());
+                        const Float_ grad_coef = repulsive_coefficient(dist2, a, b, gamma);
+                        for (std::size_t d = 0; d < num_dim; ++d) {
+                            const Float_ gradient = alpha * clamp(grad_coef * (buffer[d] - static_cast<Float_>(other[d])));
+                            buffer[d] += gradient;
+                            left_change[d] += gradient;
+                        }
+                    }
+                }
+                sync();
+
+                // Each thread applies the changes to its own subset of observations, in the order of the updates.
+                const auto obs_range = split_range<Index_>(0, num_obs, t, nthreads);
+                const Index_ obs_start = obs_range.first, obs_end = obs_range.first + obs_range.second;
+                for (std::size_t c = 0, cend = 2 * batch_length; c < cend; ++c) {
+                    const auto row = changed_rows[c];
+                    if (row < obs_start || row >= obs_end) {
+                        continue;
+                    }
+                    const auto output = embedding + sanisizer::product_unsafe<std::size_t>(row, num_dim);
+                    const auto change = changes.data() + sanisizer::product_unsafe<std::size_t>(c, num_dim);
+                    for (std::size_t d = 0; d < num_dim; ++d) {
+                        output[d] += change[d];
+                    }
+                }
+                sync();
+
+                if (t == 0) {
+                    ++num_batches_run;
+                    num_updates_run += batch_length;
+                }
+            }
+        }
+    };
+
+    if (nthreads == 1) {
+        run_epochs(0, []() -> void {});
+    } else {
+#ifndef UMAPPP_NO_PARALLEL_OPTIMIZATION
+        SpinBarrier barrier(nthreads, spin_limit);
+        const auto sync = [&]() -> void {
+            barrier.arrive_and_wait();
+        };
+        work.pool.run(nthreads, [&](const int t) -> void {
+            run_epochs(t, sync);
+        });
+#else
+        throw std::runtime_error("umappp was not compiled with support for parallel optimization");
+#endif
+    }
+
+    statistics.num_dispatched += num_updates_run;
+    statistics.num_rounds += num_batches_run;
+    setup.current_epoch = end_epoch;
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef UMAPPP_OPTIMIZE_LAYOUT_SUBSET_HPP
+#define UMAPPP_OPTIMIZE_LAYOUT_SUBSET_HPP
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+
+#include "sanisizer/sanisizer.hpp"
+
+#include "optimize_layout.hpp"
+#include "rng.hpp"
+
+namespace umappp {
+
+/*
+ * Optimization of a subset of observations, holding all other observations
+ * fixed. This is the same as the serial optimization except that edges are
+ * only processed for the 'active' observations (in the supplied order), and
+ * the targets of those edges are only moved if they are not fixed. Negative
+ * samples are still drawn from all observations. The cost of each epoch is
+ * proportional to the number of edges of the active observations.
+ */
+template<typename Index_, typename Float_, class Rng_>
+void optimize_layout_subset(
+    const std::size_t num_dim,
+    Float_* const embedding,
+    EpochData<Index_, Float_>& setup,
+    const std::vector<Index_>& active,
+    const std::vector<unsigned char>& is_fixed,
+    const Float_ a,
+    const Float_ b,
+    const Float_ gamma,
+    const Float_ initial_alpha,
+    Rng_& rng)
+{
+    const auto& graph = *(setup.graph);
+    const auto num_epochs = setup.total_epochs;
+    const Index_ num_obs = graph.cumulative_num_edges.size() - 1;
+
+    for (auto& n = setup.current_epoch; n < num_epochs; ++n) {
+        const Float_ epoch = n;
+        const Float_ alpha = initial_alpha * (1.0 - epoch / num_epochs);
+
+        for (const auto i : active) {
+            const auto start = graph.cumulative_num_edges[i], end = graph.cumulative_num_edges[i + 1];
+            const auto left = embedding + sanisizer::product_unsafe<std::size_t>(i, num_dim);
+
+            for (auto j = start; j < end; ++j) {
+                if (setup.epoch_of_next_sample[j] > epoch) {
+                    continue;
+                }
+
+                const auto target = graph.edge_targets[j];
+                const auto right = embedding + sanisizer::product_unsafe<std::size_t>(target, num_dim);
+                attract_pair(left, right, num_dim, a, b, alpha, !is_fixed[target]);
+
+                const Float_ epochs_per_negative_sample = graph.epochs_per_sample[j] / setup.negative_sample_rate;
+                const int num_neg_samples = (epoch - setup.epoch_of_next_negative_sample[j]) / epochs_per_negative_sample; // cast is known to be safe, see create_epoch_data().
+
+                for (int p = 0; p < num_neg_samples; ++p) {
+                    const auto sampled = sample_observation(rng, num_obs);
+                    if (sampled == i) {
+                        continue;
+                    }
+
+                    repel_from(left, embedding + sanisizer::product_unsafe<std::size_t>(sampled, num_dim), num_dim, a, b, gamma, alpha);
+                }
+
+                setup.epoch_of_next_sample[j] += graph.epochs_per_sample[j];
+                setup.epoch_of_next_negative_sample[j] += num_neg_samples * epochs_per_negative_sample;
+            }
+        }
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef UMAPPP_RNG_HPP
+#define UMAPPP_RNG_HPP
+
+#include <cstdint>
+#include <limits>
+
+#include "aarand/aarand.hpp"
+
+namespace umappp {
+
+/*
+ * SplitMix64 generator, see http://xoshiro.di.unimi.it/splitmix64.c.
+ * This is very cheap to construct so we use it to create independent streams
+ * for each observation in each epoch, such that the random numbers used for
+ * an observation do not depend on the order in which observations are processed.
+ */
+inline std::uint64_t splitmix64_mix(std::uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9u;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebu;
+    return z ^ (z >> 31);
+}
+
+class SplitMix64 {
+public:
+    typedef std::uint64_t result_type;
+
+    SplitMix64(const std::uint64_t seed) : my_state(seed) {}
+
+    static constexpr result_type min() {
+        return 0;
+    }
+
+    static constexpr result_type max() {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    result_type operator()() {
+        my_state += 0x9e3779b97f4a7c15u;
+        return splitmix64_mix(my_state);
+    }
+
+private:
+    std::uint64_t my_state;
+};
+
+// Deriving a new seed from a user-supplied seed and a counter, e.g., the epoch
+// or the number of updates, so that each value of the counter gets its own stream.
+inline std::uint64_t mix_seed(const std::uint64_t seed, const std::uint64_t counter) {
+    return splitmix64_mix(seed ^ splitmix64_mix(counter));
+}
+
+template<typename Index_>
+SplitMix64 create_observation_rng(const std::uint64_t seed, const int epoch, const Index_ observation) {
+    const auto epoch_seed = mix_seed(seed, static_cast<std::uint64_t>(epoch));
+    return SplitMix64(splitmix64_mix(epoch_seed ^ static_cast<std::uint64_t>(observation)));
+}
+
+// Sampling a random observation for the negative samples. This can be
+// overloaded for specific engines with a faster bounded integer method.
+template<class Engine_, typename Index_>
+Index_ sample_observation(Engine_& rng, const Index_ bound) {
+    return aarand::discrete_uniform(rng, bound);
+}
+
+}
+
+#endif
@@ -19,17 +19,19 @@ namespace umappp {
 /* Peeled from the function of the same name in the uwot package,
  * see https://github.com/jlmelville/uwot/blob/master/R/init.R for details.
  *
- * It is assumed that 'edges' has already been symmetrized.
+ * It is assumed that 'edges' has already been symmetrized. This can be a
+ * NeighborList or a CompressedNeighborList, as we only read from it.
  */
-template<typename Index_, typename Float_>
+template<class Edges_, typename Float_>
 bool normalized_laplacian(
-    const NeighborList<Index_, Float_>& edges,
+    const Edges_& edges,
     const std::size_t num_dim,
     Float_* const Y,
     const irlba::Options<Eigen::VectorXd>& irlba_opt,
     const int nthreads,
     double scale
 ) {
+    typedef I<decltype(edges[0][0].first)> Index_;
     const Index_ nobs = edges.size();
     auto sums = sanisizer::create<std::vector<double> >(nobs); // we deliberately use double-precision to avoid difficult problems from overflow/underflow inside IRLBA.
     std::vector<std::size_t> pointers(sanisizer::sum<typename std::vector<std::size_t>::size_type>(nobs, 1));
@@ -139,8 +141,9 @@ bool normalized_laplacian(
     return true;
 }
 
-template<typename Index_, typename Float_>
-bool has_multiple_components(const NeighborList<Index_, Float_>& edges) {
+template<class Edges_>
+bool has_multiple_components(const Edges_& edges) {
+    typedef I<decltype(edges[0][0].first)> Index_;
     if (!edges.size()) {
         return false;
     }
@@ -167,9 +170,9 @@ bool has_multiple_components(const NeighborList<Index_, Float_>& edges) {
     return in_component != edges.size();
 }
 
-template<typename Index_, typename Float_>
+template<class Edges_, typename Float_>
 bool spectral_init(
-    const NeighborList<Index_, Float_>& edges,
+    const Edges_& edges,
     const std::size_t num_dim,
     Float_* const vals,
     const irlba::Options<Eigen::VectorXd>& irlba_opt,
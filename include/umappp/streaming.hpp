@@ -0,0 +1,231 @@
+#ifndef UMAPPP_STREAMING_HPP
+#define UMAPPP_STREAMING_HPP
+
+#include "NeighborList.hpp"
+#include "Options.hpp"
+#include "Status.hpp"
+#include "initialize.hpp"
+#include "compressed_neighbors.hpp"
+#include "external_symmetrize.hpp"
+#include "neighbor_similarities.hpp"
+#include "parallelize.hpp"
+#include "utils.hpp"
+
+#include "knncolle/knncolle.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/**
+ * @file streaming.hpp
+ * @brief Initialize the UMAP algorithm from streamed neighbors.
+ */
+
+namespace umappp {
+
+/**
+ * @cond
+ */
+// Number of observations for which the neighbors are held at any given time.
+// This should be large enough to parallelize the similarity calculations but
+// small enough for its memory usage to be negligible.
+constexpr std::size_t stream_block_size = 1024;
+
+/*
+ * 'fill' should accept the index of the first observation in the block, the
+ * number of observations in the block, and a NeighborList of that length,
+ * and replace each inner vector with the neighbors of the corresponding
+ * observation. The directed similarities are computed for each block and
+ * passed to 'store' for each observation, so the full NeighborList is never
+ * created.
+ */
+template<typename Index_, typename Float_, class Fill_, class Store_>
+void stream_directed_similarities(const Index_ num_obs, Fill_ fill, const Options& options, Store_ store) {
+    NeighborSimilaritiesOptions<Float_> nsopt;
+    nsopt.local_connectivity = options.local_connectivity;
+    nsopt.bandwidth = options.bandwidth;
+    nsopt.num_threads = options.num_threads;
+
+    NeighborList<Index_, Float_> block;
+    for (Index_ start = 0; start < num_obs; ) {
+        const Index_ length = std::min(static_cast<std::size_t>(num_obs - start), stream_block_size);
+        block.resize(length);
+        fill(start, length, block);
+        neighbor_similarities(block, nsopt);
+        for (Index_ b = 0; b < length; ++b) {
+            store(start + b, block[b]);
+        }
+        start += length;
+    }
+}
+
+template<typename Index_, typename Float_, class Fill_>
+CompressedNeighborList<Index_, Float_> stream_fuzzy_graph(const Index_ num_obs, Fill_ fill, const Options& options) {
+    const Float_ mix_ratio = options.mix_ratio;
+
+    if (options.symmetrize_memory_budget > 0) {
+        ExternalSymmetrizer<Index_, Float_> symmetrizer(num_obs, options.symmetrize_memory_budget, options.symmetrize_temp_directory);
+        stream_directed_similarities<Index_, Float_>(num_obs, std::move(fill), options, [&](const Index_ i, const std::vector<std::pair<Index_, Float_> >& current) -> void {
+            for (const auto& nn : current) {
+                symmetrizer.add(i, nn.first, nn.second);
+            }
+        });
+        return symmetrizer.finish(mix_ratio);
+    }
+
+    CompressedNeighborList<Index_, Float_> directed;
+    directed.pointers.reserve(sanisizer::sum<I<decltype(directed.pointers.size())> >(num_obs, 1));
+    const Index_ first_block = std::min(static_cast<std::size_t>(num_obs), stream_block_size);
+
+    stream_directed_similarities<Index_, Float_>(num_obs, std::move(fill), options, [&](const Index_ i, std::vector<std::pair<Index_, Float_> >& current) -> void {
+        std::sort(current.begin(), current.end()); // sorting by index, as in combine_neighbor_sets().
+        directed.entries.insert(directed.entries.end(), current.begin(), current.end());
+        directed.pointers.push_back(directed.entries.size());
+
+        // Guessing the total size from the first block, assuming that all
+        // observations have similar numbers of neighbors. This avoids the
+        // slack capacity and copies from repeated reallocations.
+        if (i + 1 == first_block && first_block < num_obs) {
+            const auto per_obs = (directed.entries.size() + first_block - 1) / first_block;
+            directed.entries.reserve(sanisizer::product<std::size_t>(per_obs, num_obs));
+        }
+    });
+
+    return combine_compressed_neighbors(directed, mix_ratio);
+}
+
+template<typename Index_, typename Float_, class Engine_, class Fill_>
+Status<Index_, Float_, Engine_> initialize_streaming_internal(const Index_ num_obs, Fill_ fill, const std::size_t num_dim, Float_* const embedding, Options options) {
+    auto x = stream_fuzzy_graph<Index_, Float_>(num_obs, std::move(fill), options);
+
+    resolve_options<Index_>(options, num_obs);
+    if (options.initialize_method != InitializeMethod::NONE && (options.initialize_multilevel || options.initialize_landmark)) {
+        // These initializations need to create modified graphs, so we fall back to a temporary NeighborList.
+        initialize_embedding(to_neighbor_list(x), num_dim, embedding, options);
+    } else {
+        initialize_embedding_direct(x, num_dim, embedding, options);
+    }
+
+    auto graph = similarities_to_graph<Index_, Float_>(x, *(options.num_epochs));
+    x = CompressedNeighborList<Index_, Float_>(); // releasing memory before allocating the epoch data.
+    prepare_scheduler(graph, options.optimize_scheduler, *(options.num_epochs));
+    auto epochs = create_epoch_data<Index_, Float_>(
+        std::make_shared<const EpochGraph<Index_, Float_> >(std::move(graph)),
+        *(options.num_epochs),
+        options.negative_sample_rate
+    );
+
+    return Status<Index_, Float_, Engine_>(
+        std::move(epochs),
+        std::move(options),
+        num_dim
+    );
+}
+/**
+ * @endcond
+ */
+
+/**
+ * Initialize the UMAP algorithm with neighbors that are supplied one observation at a time.
+ * The similarities are computed as the neighbors are received and stored in a compact form,
+ * so the full `NeighborList` required by `initialize()` is never created.
+ * This reduces the peak memory usage for large datasets.
+ *
+ * The result is the same as that of `initialize()` with a `NeighborList` containing the same neighbors.
+ * If `Options::initialize_multilevel` or `Options::initialize_landmark` is true, a temporary `NeighborList` of the fuzzy graph is still created for the initialization.
+ * `Options::update_enabled` is not supported and is ignored.
+ *
+ * @tparam Index_ Integer type of the neighbor indices.
+ * @tparam Float_ Floating-point type of the distances.
+ * @tparam Engine_ Random number generator for the optimization, see `Status` for details.
+ * @tparam Producer_ Function that accepts an observation index `i`, a `std::vector<Index_>&` and a `std::vector<Float_>&`,
+ * and fills the vectors with the indices of and distances to the nearest neighbors of `i`, respectively.
+ * Neighbors should be unique and sorted in order of increasing distance, and should not include `i` itself; see the `NeighborList` description for details.
+ *
+ * @param num_obs Number of observations.
+ * @param producer Function to obtain the neighbors for each observation.
+ * This is called exactly once for each observation in increasing order of index, from a single thread.
+ * The vectors may contain the neighbors of a previous observation on input.
+ * @param num_dim Number of dimensions of the embedding.
+ * @param[out] embedding Pointer to an array in which to store the embedding, see `initialize()` for details.
+ * @param options Further options.
+ * Note that `Options::num_neighbors` is ignored here.
+ *
+ * @return A `Status` object containing the initial state of the UMAP algorithm.
+ */
+template<typename Index_, typename Float_, class Engine_ = RngEngine, class Producer_>
+Status<Index_, Float_, Engine_> initialize_streaming(const Index_ num_obs, Producer_ producer, const std::size_t num_dim, Float_* const embedding, Options options) {
+    std::vector<Index_> indices;
+    std::vector<Float_> distances;
+    return initialize_streaming_internal<Index_, Float_, Engine_>(
+        num_obs,
+        [&](const Index_ start, const Index_ length, NeighborList<Index_, Float_>& block) -> void {
+            for (Index_ b = 0; b < length; ++b) {
+                producer(start + b, indices, distances);
+                auto& current = block[b];
+                current.clear();
+                const auto num_neighbors = indices.size();
+                for (I<decltype(num_neighbors)> k = 0; k < num_neighbors; ++k) {
+                    current.emplace_back(indices[k], distances[k]);
+                }
+            }
+        },
+        num_dim,
+        embedding,
+        std::move(options)
+    );
+}
+
+/**
+ * Initialize the UMAP algorithm by streaming the results of a nearest neighbor search, see the other `initialize_streaming()` overload for details.
+ * Neighbors are searched in blocks of observations, each of which is parallelized according to `Options::num_threads`.
+ *
+ * @tparam Index_ Integer type of the observation indices.
+ * @tparam Input_ Floating-point type of the input data for the neighbor search.
+ * This only used to define the `knncolle::Prebuilt` type and is otherwise ignored.
+ * @tparam Float_ Floating-point type of the input data, neighbor distances and output embedding.
+ * @tparam Engine_ Random number generator for the optimization, see `Status` for details.
+ *
+ * @param prebuilt A neighbor search index built on the dataset of interest.
+ * @param num_dim Number of dimensions of the UMAP embedding.
+ * @param[out] embedding Pointer to an array in which to store the embedding, see `initialize()` for details.
+ * @param options Further options.
+ *
+ * @return A `Status` object containing the initial state of the UMAP algorithm.
+ * This is the same as that of `initialize()` with the same `prebuilt`.
+ */
+template<typename Index_, typename Input_, typename Float_, class Engine_ = RngEngine>
+Status<Index_, Float_, Engine_> initialize_streaming(const knncolle::Prebuilt<Index_, Input_, Float_>& prebuilt, const std::size_t num_dim, Float_* const embedding, Options options) {
+    const Index_ num_obs = prebuilt.num_observations();
+    const int num_neighbors = options.num_neighbors;
+    const int num_threads = options.num_threads;
+    return initialize_streaming_internal<Index_, Float_, Engine_>(
+        num_obs,
+        [&](const Index_ start, const Index_ length, NeighborList<Index_, Float_>& block) -> void {
+            parallelize(num_threads, length, [&](const int, const Index_ sub_start, const Index_ sub_length) -> void {
+                auto searcher = prebuilt.initialize();
+                std::vector<Index_> indices;
+                std::vector<Float_> distances;
+                for (Index_ b = sub_start, end = sub_start + sub_length; b < end; ++b) {
+                    searcher->search(start + b, num_neighbors, &indices, &distances);
+                    auto& current = block[b];
+                    current.clear();
+                    const auto found = indices.size();
+                    for (I<decltype(found)> k = 0; k < found; ++k) {
+                        current.emplace_back(indices[k], distances[k]);
+                    }
+                }
+            });
+        },
+        num_dim,
+        embedding,
+        std::move(options)
+    );
+}
+
+}
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef UMAPPP_THREAD_AFFINITY_HPP
+#define UMAPPP_THREAD_AFFINITY_HPP
+
+#include <vector>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+
+#if defined(__linux__) && !defined(UMAPPP_NO_PARALLEL_OPTIMIZATION)
+#include <pthread.h>
+#include <sched.h>
+#define UMAPPP_THREAD_AFFINITY_SUPPORTED 1
+#endif
+
+namespace umappp {
+
+/*
+ * CPUs that are available to the calling thread, e.g., after restriction by
+ * 'taskset' or a cgroup. This should be called on the main thread before any
+ * threads are pinned, as new threads inherit the affinity of their creator.
+ * An empty vector is returned if pinning is not requested or not supported.
+ */
+inline std::vector<int> available_cpus(const bool pin_threads) {
+    std::vector<int> output;
+#ifdef UMAPPP_THREAD_AFFINITY_SUPPORTED
+    if (pin_threads) {
+        cpu_set_t current;
+        if (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &current) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &current)) {
+                    output.push_back(cpu);
+                }
+            }
+        }
+    }
+#else
+    (void)pin_threads;
+#endif
+    return output;
+}
+
+/*
+ * Pins the calling thread to one of the available CPUs, based on its thread
+ * index, for the lifetime of this object. The previous affinity is restored
+ * upon destruction, which is necessary when the main thread participates in
+ * the parallel section. This is a no-op if 'cpus' is empty.
+ */
+class ThreadPin {
+public:
+    ThreadPin(const std::vector<int>& cpus, const int thread) {
+#ifdef UMAPPP_THREAD_AFFINITY_SUPPORTED
+        if (cpus.empty() || pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &my_previous) != 0) {
+            return;
+        }
+        cpu_set_t pinned;
+        CPU_ZERO(&pinned);
+        CPU_SET(cpus[thread % cpus.size()], &pinned);
+        my_pinned = (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &pinned) == 0);
+#else
+        (void)cpus;
+        (void)thread;
+#endif
+    }
+
+    ~ThreadPin() {
+#ifdef UMAPPP_THREAD_AFFINITY_SUPPORTED
+        if (my_pinned) {
+            pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &my_previous);
+        }
+#endif
+    }
+
+    ThreadPin(const ThreadPin&) = delete;
+    ThreadPin& operator=(const ThreadPin&) = delete;
+    ThreadPin(ThreadPin&&) = delete;
+    ThreadPin& operator=(ThreadPin&&) = delete;
+
+    bool pinned() const {
+        return my_pinned;
+    }
+
+private:
+    bool my_pinned = false;
+#ifdef UMAPPP_THREAD_AFFINITY_SUPPORTED
+    cpu_set_t my_previous;
+#endif
+};
+
+/*
+ * Allocator that default-initializes its elements, so that the memory for
+ * trivial types is not touched upon allocation. On NUMA systems, each page
+ * is then placed on the node of the thread that first writes to it, so we
+ * can partition the initial writes to match the assignment of observations
+ * to threads in the optimization.
+ */
+template<typename Type_>
+class UninitializedAllocator : public std::allocator<Type_> {
+public:
+    template<typename Other_>
+    struct rebind {
+        typedef UninitializedAllocator<Other_> other;
+    };
+
+    UninitializedAllocator() = default;
+
+    template<typename Other_>
+    UninitializedAllocator(const UninitializedAllocator<Other_>&) noexcept {}
+
+    template<typename Other_>
+    void construct(Other_* const ptr) {
+        ::new(static_cast<void*>(ptr)) Other_;
+    }
+
+    template<typename Other_, typename ... Args_>
+    void construct(Other_* const ptr, Args_&& ... args) {
+        ::new(static_cast<void*>(ptr)) Other_(std::forward<Args_>(args)...);
+    }
+};
+
+template<typename Type_>
+using UninitializedVector = std::vector<Type_, UninitializedAllocator<Type_> >;
+
+// Same as UninitializedAllocator, but allocating from a std::pmr::memory_resource.
+template<typename Type_>
+class UninitializedPmrAllocator : public std::pmr::polymorphic_allocator<Type_> {
+public:
+    UninitializedPmrAllocator(std::pmr::memory_resource* const resource = std::pmr::get_default_resource()) noexcept :
+        std::pmr::polymorphic_allocator<Type_>(resource) {}
+
+    // Also used to convert the result of select_on_container_copy_construction().
+    template<typename Other_>
+    UninitializedPmrAllocator(const std::pmr::polymorphic_allocator<Other_>& other) noexcept :
+        std::pmr::polymorphic_allocator<Type_>(other.resource()) {}
+
+    template<typename Other_>
+    void construct(Other_* const ptr) {
+        ::new(static_cast<void*>(ptr)) Other_;
+    }
+
+    template<typename Other_, typename ... Args_>
+    void construct(Other_* const ptr, Args_&& ... args) {
+        ::new(static_cast<void*>(ptr)) Other_(std::forward<Args_>(args)...);
+    }
+};
+
+template<typename Type_>
+using UninitializedPmrVector = std::vector<Type_, UninitializedPmrAllocator<Type_> >;
+
+}
+
+#endif
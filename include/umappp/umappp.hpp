@@ -6,9 +6,17 @@
  * @brief Umbrella header for the **umappp** library.
  */
 
+#include "EmbeddingSnapshot.hpp"
 #include "Options.hpp"
+#include "ParallelStatistics.hpp"
 #include "Status.hpp"
+#include "StopCondition.hpp"
+#include "ThreadSelection.hpp"
+#include "Xoshiro256StarStar.hpp"
 #include "initialize.hpp"
+#include "batch.hpp"
+#include "streaming.hpp"
+#include "estimate_resources.hpp"
 
 /**
  * @namespace umappp
@@ -0,0 +1,415 @@
+#ifndef UMAPPP_UPDATE_GRAPH_HPP
+#define UMAPPP_UPDATE_GRAPH_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include "sanisizer/sanisizer.hpp"
+
+#include "NeighborList.hpp"
+#include "Options.hpp"
+#include "neighbor_similarities.hpp"
+#include "combine_neighbor_sets.hpp"
+#include "optimize_layout.hpp"
+#include "optimize_layout_batched.hpp"
+#include "optimize_layout_minibatch.hpp"
+#include "multilevel.hpp"
+#include "utils.hpp"
+
+namespace umappp {
+
+// Precomputing the parts of the graph that are specific to a scheduler, which
+// only depend on the graph and can be shared by all runs that use it.
+template<typename Index_, typename Float_>
+void prepare_scheduler(EpochGraph<Index_, Float_>& graph, const OptimizeScheduler scheduler, const int num_epochs) {
+    if (scheduler == OptimizeScheduler::COLORING) {
+        color_observations(graph);
+    } else if (scheduler == OptimizeScheduler::MINIBATCH) {
+        fill_edge_alias_table(graph, num_epochs);
+    }
+}
+
+/*
+ * Information required to update the fuzzy graph after adding or removing
+ * observations, without recomputing it from scratch. We store the original
+ * neighbor lists and their directed similarities (i.e., before the lists are
+ * combined), along with the reverse lists so that we can find all
+ * observations that have a particular observation as a neighbor. We also
+ * keep the constants that were used to convert the combined similarities to
+ * the sampling rates in similarities_to_graph(), so that all unchanged edges
+ * retain exactly the same rate after the update.
+ */
+template<typename Index_, typename Float_>
+struct UpdatableGraph {
+    NeighborList<Index_, Float_> neighbors;
+    std::vector<std::vector<Float_> > similarities;
+    std::vector<std::vector<Index_> > reverse;
+    Float_ max_weight = 0;
+    int num_epochs = 0;
+};
+
+template<typename Index_, typename Float_>
+void fill_reverse_neighbors(UpdatableGraph<Index_, Float_>& store) {
+    const Index_ num_obs = store.neighbors.size();
+    store.reverse.clear();
+    store.reverse.resize(num_obs);
+    for (Index_ i = 0; i < num_obs; ++i) {
+        for (const auto& nn : store.neighbors[i]) {
+            store.reverse[nn.first].push_back(i);
+        }
+    }
+}
+
+template<typename Index_, typename Float_>
+void fill_directed_similarities(
+    UpdatableGraph<Index_, Float_>& store,
+    const std::vector<Index_>& rows,
+    const NeighborSimilaritiesOptions<Float_>& options)
+{
+    NeighborList<Index_, Float_> subset;
+    subset.reserve(rows.size());
+    for (const auto r : rows) {
+        subset.push_back(store.neighbors[r]);
+    }
+    neighbor_similarities(subset, options);
+
+    const auto num_rows = rows.size();
+    for (I<decltype(num_rows)> r = 0; r < num_rows; ++r) {
+        auto& sims = store.similarities[rows[r]];
+        sims.clear();
+        sims.reserve(subset[r].size());
+        for (const auto& nn : subset[r]) {
+            sims.push_back(nn.second);
+        }
+    }
+}
+
+template<typename Index_, typename Float_>
+std::size_t find_neighbor(const UpdatableGraph<Index_, Float_>& store, const Index_ from, const Index_ to) {
+    const auto& current = store.neighbors[from];
+    const auto num_neighbors = current.size();
+    for (I<decltype(num_neighbors)> k = 0; k < num_neighbors; ++k) {
+        if (current[k].first == to) {
+            return k;
+        }
+    }
+    return num_neighbors;
+}
+
+template<typename Index_, typename Float_>
+Float_ directed_similarity(const UpdatableGraph<Index_, Float_>& store, const Index_ from, const Index_ to) {
+    const auto k = find_neighbor(store, from, to);
+    return (k < store.neighbors[from].size() ? store.similarities[from][k] : static_cast<Float_>(0));
+}
+
+/*
+ * Edges that are new or have a new sampling rate are scheduled as if they had
+ * been present from the start of the optimization, so that they are sampled
+ * at the same rate as all other edges in the remaining epochs.
+ */
+template<typename Float_>
+std::pair<Float_, Float_> schedule_new_edge(const Float_ epochs_per_sample, const int current_epoch, const Float_ negative_sample_rate) {
+    const Float_ num_samples = std::max(static_cast<Float_>(1), std::ceil(static_cast<Float_>(current_epoch) / epochs_per_sample));
+    const Float_ next_sample = num_samples * epochs_per_sample;
+    const Float_ next_negative = (num_samples > 1 ? next_sample - epochs_per_sample : epochs_per_sample / negative_sample_rate);
+    return std::make_pair(next_sample, next_negative);
+}
+
+template<typename Index_>
+struct GraphUpdateResult {
+    // Observations whose edges were modified by the update, in the new indexing.
+    std::vector<Index_> touched;
+
+    // Original index of each retained observation in the new indexing.
+    std::vector<Index_> retained;
+};
+
+/*
+ * Removed observations are dropped and the remaining observations are
+ * renumbered in their original order, followed by the added observations.
+ * Only the observations that lose a neighbor and the added observations need
+ * their directed similarities to be recomputed. The combined edges then only
+ * need to be recomputed for those observations and their neighbors, as well
+ * as the neighbors of the removed observations; all other edges are copied
+ * with their schedules from the existing graph. The cost is proportional to
+ * the number of modified observations, apart from the linear copy of the
+ * compressed graph (and the renumbering of all neighbor indices if any
+ * observations are removed, which is unavoidable).
+ */
+template<typename Index_, typename Float_>
+GraphUpdateResult<Index_> update_graph(
+    UpdatableGraph<Index_, Float_>& store,
+    EpochData<Index_, Float_>& epochs,
+    const std::vector<Index_>& removed,
+    NeighborList<Index_, Float_> added,
+    const Options& options)
+{
+    const Index_ old_num_obs = store.neighbors.size();
+    auto is_removed = sanisizer::create<std::vector<unsigned char> >(old_num_obs);
+    for (const auto r : removed) {
+        if (static_cast<std::size_t>(r) >= static_cast<std::size_t>(old_num_obs)) { // also catches negative indices for signed types.
+            throw std::runtime_error("indices of removed observations should be less than the number of observations");
+        }
+        if (is_removed[r]) {
+            throw std::runtime_error("indices of removed observations should be unique");
+        }
+        is_removed[r] = true;
+    }
+
+    const Index_ num_retained = old_num_obs - static_cast<Index_>(removed.size());
+    const Index_ new_num_obs = sanisizer::sum<Index_>(num_retained, added.size());
+    for (const auto& current : added) {
+        for (const auto& nn : current) {
+            if (static_cast<std::size_t>(nn.first) >= static_cast<std::size_t>(new_num_obs)) {
+                throw std::runtime_error("neighbor indices of added observations should be less than the updated number of observations");
+            }
+        }
+    }
+
+    GraphUpdateResult<Index_> output;
+    output.retained.reserve(num_retained);
+    auto new_index = sanisizer::create<std::vector<Index_> >(old_num_obs);
+    for (Index_ i = 0; i < old_num_obs; ++i) {
+        if (!is_removed[i]) {
+            new_index[i] = output.retained.size();
+            output.retained.push_back(i);
+        }
+    }
+
+    // Marking observations that lose a neighbor (and thus need new
+    // similarities) and those that have a removed observation as a neighbor
+    // in the combined graph. This must be done with the old indices.
+    auto changed = sanisizer::create<std::vector<unsigned char> >(new_num_obs);
+    auto touched = sanisizer::create<std::vector<unsigned char> >(new_num_obs);
+    for (const auto r : removed) {
+        for (const auto s : store.reverse[r]) {
+            if (!is_removed[s]) {
+                changed[new_index[s]] = true;
+            }
+        }
+        for (const auto& nn : store.neighbors[r]) {
+            if (!is_removed[nn.first]) {
+                touched[new_index[nn.first]] = true;
+            }
+        }
+    }
+
+    if (!removed.empty()) {
+        for (Index_ n = 0; n < num_retained; ++n) {
+            const auto o = output.retained[n];
+            auto& neighbors = store.neighbors[n];
+            auto& sims = store.similarities[n];
+            auto& reverse = store.reverse[n];
+            if (n != o) {
+                neighbors.swap(store.neighbors[o]);
+                sims.swap(store.similarities[o]);
+                reverse.swap(store.reverse[o]);
+            }
+
+            I<decltype(neighbors.size())> kept = 0;
+            for (I<decltype(neighbors.size())> k = 0, end = neighbors.size(); k < end; ++k) {
+                if (!is_removed[neighbors[k].first]) {
+                    neighbors[kept] = std::make_pair(new_index[neighbors[k].first], neighbors[k].second);
+                    sims[kept] = sims[k];
+                    ++kept;
+                }
+            }
+            neighbors.resize(kept);
+            sims.resize(kept);
+
+            kept = 0;
+            for (I<decltype(reverse.size())> k = 0, end = reverse.size(); k < end; ++k) {
+                if (!is_removed[reverse[k]]) {
+                    reverse[kept] = new_index[reverse[k]];
+                    ++kept;
+                }
+            }
+            reverse.resize(kept);
+        }
+    }
+
+    store.neighbors.resize(num_retained);
+    store.similarities.resize(num_retained);
+    store.reverse.resize(new_num_obs);
+    for (auto& current : added) {
+        const Index_ a = store.neighbors.size();
+        for (const auto& nn : current) {
+            store.reverse[nn.first].push_back(a);
+        }
+        store.neighbors.push_back(std::move(current));
+        store.similarities.emplace_back();
+        changed[a] = true;
+    }
+
+    std::vector<Index_> changed_rows;
+    for (Index_ i = 0; i < new_num_obs; ++i) {
+        if (changed[i]) {
+            changed_rows.push_back(i);
+        }
+    }
+    NeighborSimilaritiesOptions<Float_> nsopt;
+    nsopt.local_connectivity = options.local_connectivity;
+    nsopt.bandwidth = options.bandwidth;
+    nsopt.num_threads = options.num_threads;
+    fill_directed_similarities(store, changed_rows, nsopt);
+
+    for (const auto c : changed_rows) {
+        touched[c] = true;
+        for (const auto& nn : store.neighbors[c]) {
+            touched[nn.first] = true;
+        }
+    }
+
+    // Rebuilding the graph, copying all edges from untouched observations.
+    const auto& old_graph = *(epochs.graph);
+    const Float_ mix_ratio = options.mix_ratio;
+    const Float_ limit = store.max_weight / store.num_epochs;
+    const Float_ negative_sample_rate = epochs.negative_sample_rate;
+    const int current_epoch = epochs.current_epoch;
+
+    EpochGraph<Index_, Float_> graph(new_num_obs);
+    graph.edge_targets.reserve(old_graph.edge_targets.size());
+    graph.epochs_per_sample.reserve(old_graph.epochs_per_sample.size());
+    std::vector<Float_> next_sample, next_negative;
+    next_sample.reserve(old_graph.edge_targets.size());
+    next_negative.reserve(old_graph.edge_targets.size());
+    std::vector<std::pair<Index_, Float_> > combined;
+
+    for (Index_ i = 0; i < new_num_obs; ++i) {
+        const bool is_retained = i < num_retained;
+        const std::size_t old_start = (is_retained ? old_graph.cumulative_num_edges[output.retained[i]] : 0);
+        const std::size_t old_end = (is_retained ? old_graph.cumulative_num_edges[output.retained[i] + 1] : 0);
+
+        if (!touched[i]) {
+            for (auto j = old_start; j < old_end; ++j) {
+                graph.edge_targets.push_back(new_index[old_graph.edge_targets[j]]);
+                graph.epochs_per_sample.push_back(old_graph.epochs_per_sample[j]);
+                next_sample.push_back(epochs.epoch_of_next_sample[j]);
+                next_negative.push_back(epochs.epoch_of_next_negative_sample[j]);
+            }
+            graph.cumulative_num_edges[i + 1] = graph.edge_targets.size();
+            continue;
+        }
+        output.touched.push_back(i);
+
+        combined.clear();
+        const auto& neighbors = store.neighbors[i];
+        const auto num_neighbors = neighbors.size();
+        for (I<decltype(num_neighbors)> k = 0; k < num_neighbors; ++k) {
+            const auto target = neighbors[k].first;
+            combined.emplace_back(target, combine_similarities(store.similarities[i][k], directed_similarity(store, target, i), mix_ratio));
+        }
+        for (const auto s : store.reverse[i]) {
+            if (find_neighbor(store, i, s) == num_neighbors) { // otherwise, already added above.
+                combined.emplace_back(s, combine_similarities(static_cast<Float_>(0), directed_similarity(store, s, i), mix_ratio));
+            }
+        }
+        std::sort(combined.begin(), combined.end());
+
+        // Edges are matched to the old graph by target, as both are sorted by index and the renumbering preserves the order.
+        auto old_j = old_start;
+        for (const auto& edge : combined) {
+            if (edge.second == 0 || edge.second < limit) {
+                continue;
+            }
+            const Float_ eps = std::max(static_cast<Float_>(1), store.max_weight / edge.second);
+            graph.edge_targets.push_back(edge.first);
+            graph.epochs_per_sample.push_back(eps);
+
+            while (old_j < old_end && (is_removed[old_graph.edge_targets[old_j]] || new_index[old_graph.edge_targets[old_j]] < edge.first)) {
+                ++old_j;
+            }
+            if (old_j < old_end && new_index[old_graph.edge_targets[old_j]] == edge.first && old_graph.epochs_per_sample[old_j] == eps) {
+                next_sample.push_back(epochs.epoch_of_next_sample[old_j]);
+                next_negative.push_back(epochs.epoch_of_next_negative_sample[old_j]);
+            } else {
+                const auto schedule = schedule_new_edge(eps, current_epoch, negative_sample_rate);
+                next_sample.push_back(schedule.first);
+                next_negative.push_back(schedule.second);
+            }
+        }
+        graph.cumulative_num_edges[i + 1] = graph.edge_targets.size();
+    }
+
+    prepare_scheduler(graph, options.optimize_scheduler, store.num_epochs);
+
+    epochs.graph = std::make_shared<const EpochGraph<Index_, Float_> >(std::move(graph));
+    epochs.epoch_of_next_sample.swap(next_sample);
+    epochs.epoch_of_next_negative_sample.swap(next_negative);
+    return output;
+}
+
+/*
+ * Each added observation is placed at the weighted average of its neighbors
+ * that already have a position, i.e., retained observations or previously
+ * placed additions. If there are no such neighbors, the observation is placed
+ * at the centroid of the retained observations. A small jitter is added to
+ * avoid stacking observations at the same position, as in the landmark
+ * initialization. The caller is responsible for seeding 'rng' differently for
+ * each update, otherwise repeated updates would reuse the same jitter.
+ */
+template<typename Index_, typename Float_, class Engine_>
+void place_added_observations(
+    const UpdatableGraph<Index_, Float_>& store,
+    const std::size_t num_dim,
+    Float_* const embedding,
+    const Index_ num_retained,
+    Engine_& rng)
+{
+    const Index_ num_obs = store.neighbors.size();
+    const Float_ jitter_sd = 0.01;
+    std::vector<Float_> centroid;
+
+    for (Index_ i = num_retained; i < num_obs; ++i) {
+        const auto output = embedding + sanisizer::product_unsafe<std::size_t>(i, num_dim);
+        std::fill_n(output, num_dim, 0);
+        Float_ total = 0;
+
+        const auto& neighbors = store.neighbors[i];
+        const auto num_neighbors = neighbors.size();
+        for (I<decltype(num_neighbors)> k = 0; k < num_neighbors; ++k) {
+            const auto target = neighbors[k].first;
+            if (target < i) {
+                const auto weight = store.similarities[i][k];
+                const auto source = embedding + sanisizer::product_unsafe<std::size_t>(target, num_dim);
+                for (std::size_t d = 0; d < num_dim; ++d) {
+                    output[d] += weight * source[d];
+                }
+                total += weight;
+            }
+        }
+
+        if (total > 0) {
+            for (std::size_t d = 0; d < num_dim; ++d) {
+                output[d] /= total;
+            }
+        } else {
+            if (centroid.empty()) {
+                centroid.resize(num_dim);
+                for (Index_ r = 0; r < num_retained; ++r) {
+                    const auto source = embedding + sanisizer::product_unsafe<std::size_t>(r, num_dim);
+                    for (std::size_t d = 0; d < num_dim; ++d) {
+                        centroid[d] += source[d];
+                    }
+                }
+                if (num_retained > 0) {
+                    for (auto& c : centroid) {
+                        c /= num_retained;
+                    }
+                }
+            }
+            std::copy(centroid.begin(), centroid.end(), output);
+        }
+
+        jitter_layout(num_dim, output, jitter_sd, rng);
+    }
+}
+
+}
+
+#endif
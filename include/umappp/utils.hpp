@@ -2,12 +2,30 @@
 #define UMAPPP_UTILS_HPP
 
 #include <type_traits>
+#include <vector>
+#include <cstddef>
 
 namespace umappp {
 
 template<typename Input_>
 using I = typename std::remove_cv<typename std::remove_reference<Input_>::type>::type;
 
+// Bytes allocated by a vector, i.e., its capacity rather than its size.
+template<typename Type_, class Allocator_>
+std::size_t memory_usage(const std::vector<Type_, Allocator_>& x) {
+    return x.capacity() * sizeof(Type_);
+}
+
+// Including the allocations of the inner vectors, e.g., in a NeighborList.
+template<typename Type_, class Inner_, class Allocator_>
+std::size_t memory_usage(const std::vector<std::vector<Type_, Inner_>, Allocator_>& x) {
+    std::size_t output = x.capacity() * sizeof(std::vector<Type_, Inner_>);
+    for (const auto& y : x) {
+        output += memory_usage(y);
+    }
+    return output;
+}
+
 }
 
 #endif
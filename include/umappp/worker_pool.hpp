@@ -0,0 +1,132 @@
+#ifndef UMAPPP_WORKER_POOL_HPP
+#define UMAPPP_WORKER_POOL_HPP
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+namespace umappp {
+
+/*
+ * Worker threads that are retained across calls to Status::run(), so that
+ * repeated short runs (e.g., from step() or run_async()) do not pay for the
+ * creation of threads in each call. Idle workers block on a condition
+ * variable rather than spinning, so a retained pool does not consume any CPU
+ * time between runs. Workers are only created when they are first needed.
+ *
+ * Copies of a pool are empty, as the threads cannot be shared; this allows
+ * the pool to be held by copyable objects like the Status.
+ */
+class WorkerPool {
+private:
+    struct Worker {
+        std::mutex mut;
+        std::condition_variable cv;
+        void (*job)(void*, int) = NULL;
+        void* context = NULL;
+        bool shutdown = false;
+        std::thread thread;
+
+        ~Worker() {
+            {
+                std::unique_lock lck(mut);
+                cv.wait(lck, [&]() -> bool { return job == NULL; });
+                shutdown = true;
+            }
+            cv.notify_all();
+            thread.join();
+        }
+    };
+
+    std::vector<std::unique_ptr<Worker> > my_workers;
+
+    static void loop(Worker& worker, const int thread) {
+        std::unique_lock lck(worker.mut);
+        while (true) {
+            worker.cv.wait(lck, [&]() -> bool { return worker.job != NULL || worker.shutdown; });
+            if (worker.job == NULL) {
+                break;
+            }
+            const auto job = worker.job;
+            const auto context = worker.context;
+            lck.unlock();
+            job(context, thread);
+            lck.lock();
+            worker.job = NULL;
+            worker.cv.notify_all();
+        }
+    }
+
+public:
+    WorkerPool() = default;
+    WorkerPool(const WorkerPool&) {}
+    WorkerPool& operator=(const WorkerPool&) {
+        return *this;
+    }
+    WorkerPool(WorkerPool&&) = default;
+    WorkerPool& operator=(WorkerPool&&) = default;
+
+    std::size_t num_workers() const {
+        return my_workers.size();
+    }
+
+    // Not including the stacks of the threads, which are not allocated from
+    // the heap. The standard library also holds the thread's function and its
+    // arguments for as long as the thread runs, which we approximate.
+    std::size_t memory_usage() const {
+        constexpr std::size_t launch_state = sizeof(void*) + sizeof(&loop) + sizeof(Worker*) + sizeof(int);
+        return my_workers.capacity() * sizeof(std::unique_ptr<Worker>) + my_workers.size() * (sizeof(Worker) + launch_state);
+    }
+
+    /*
+     * Calls 'fun(t)' for each 't' in [1, nthreads) on the workers and 'fun(0)'
+     * on the calling thread, and waits for all calls to finish. Additional
+     * workers are created if necessary.
+     */
+    template<class Function_>
+    void run(const int nthreads, Function_ fun) {
+        for (int t = 1; t < nthreads; ++t) {
+            const auto w = static_cast<std::size_t>(t - 1);
+            if (w == my_workers.size()) {
+                my_workers.emplace_back(new Worker);
+                auto& worker = *(my_workers.back());
+                worker.thread = std::thread(loop, std::ref(worker), t);
+            }
+
+            auto& worker = *(my_workers[w]);
+            {
+                std::lock_guard lck(worker.mut);
+                worker.job = [](void* context, const int thread) -> void {
+                    (*static_cast<Function_*>(context))(thread);
+                };
+                worker.context = &fun;
+            }
+            worker.cv.notify_all();
+        }
+
+        // Waiting even if the calling thread throws, as the workers still refer to 'fun'.
+        try {
+            fun(0);
+        } catch (...) {
+            wait(nthreads);
+            throw;
+        }
+        wait(nthreads);
+    }
+
+private:
+    void wait(const int nthreads) {
+        for (int t = 1; t < nthreads; ++t) {
+            auto& worker = *(my_workers[t - 1]);
+            std::unique_lock lck(worker.mut);
+            worker.cv.wait(lck, [&]() -> bool { return worker.job == NULL; });
+        }
+    }
+};
+
+}
+
+#endif
@@ -66,7 +66,7 @@ Rcpp::List initialize_umap(Rcpp::IntegerMatrix indices, Rcpp::NumericMatrix dist
     Rcpp::NumericMatrix output(ndim, nc);
     auto status = umappp::initialize(std::move(x), ndim, static_cast<double*>(output.begin()), umappp::Options());
 
-    const auto& edata = status.get_epoch_data();
+    const auto& edata = *(status.get_epoch_data().graph);
     return Rcpp::List::create(
         Rcpp::transpose(output),
         Rcpp::List::create(
@@ -0,0 +1,43 @@
+#include "common.h"
+
+// Compares Barnes-Hut repulsion to the default negative sampling, in terms of
+// the time for a full optimization and the preservation of the neighbors of
+// each observation in the embedding. Observations are simulated in clusters
+// so that there is some structure to preserve.
+//
+// Usage: benchmark_barnes_hut [NUM_OBS] [NUM_EPOCHS] [NUM_THREADS]
+
+int main(int argc, char** argv) {
+    const int nobs = get_argument(argc, argv, 1, 20000);
+    const int nepochs = get_argument(argc, argv, 2, 500);
+    const int nthreads = get_argument(argc, argv, 3, 1);
+    const int ndim = 10, k = 15;
+    const auto data = simulate_clusters(nobs, ndim, 20);
+    const auto neighbors = find_neighbors(data, ndim, k);
+
+    // Printing after the label for each configuration.
+    const auto report = [&](const umappp::Options& opt) -> void {
+        std::vector<double> embedding(static_cast<std::size_t>(nobs) * 2);
+        const double elapsed = time_best(
+            3,
+            [&]() { return umappp::initialize(neighbors, 2, embedding.data(), opt); },
+            [&](auto& status) -> void { status.run(embedding.data()); }
+        );
+        std::cout << ": " << elapsed << " s, preservation " << neighborhood_preservation(neighbors, embedding, 2) << std::endl;
+    };
+
+    umappp::Options opt;
+    opt.num_epochs = nepochs;
+    opt.num_threads_optimize = nthreads;
+    std::cout << "negative sampling";
+    report(opt);
+
+    opt.optimize_repulsion = umappp::OptimizeRepulsion::BARNES_HUT;
+    for (double theta : { 0.5, 0.8, 1.2 }) {
+        opt.optimize_barnes_hut_theta = theta;
+        std::cout << "Barnes-Hut, theta = " << theta;
+        report(opt);
+    }
+
+    return 0;
+}
@@ -0,0 +1,131 @@
+#ifndef BENCHMARK_COMMON_H
+#define BENCHMARK_COMMON_H
+
+#include "umappp/umappp.hpp"
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+// Random neighbors with sorted distances, which is enough to exercise the
+// optimizers without the cost of a real neighbor search. The targets are
+// scattered across the embedding, so this is a worst case for the cache.
+inline umappp::NeighborList<int, double> simulate_neighbors(const int nobs, const int k, const unsigned long long seed = 42) {
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<int> pick(0, nobs - 1);
+    std::uniform_real_distribution<double> dist(0.1, 1);
+
+    umappp::NeighborList<int, double> output(nobs);
+    std::vector<double> distances(k);
+    for (int i = 0; i < nobs; ++i) {
+        for (auto& d : distances) {
+            d = dist(rng);
+        }
+        std::sort(distances.begin(), distances.end());
+        for (int j = 0; j < k; ++j) {
+            int target;
+            do {
+                target = pick(rng);
+            } while (target == i);
+            output[i].emplace_back(target, distances[j]);
+        }
+    }
+    return output;
+}
+
+// Minimum time across replicates, which is the least noisy summary on a
+// shared machine.
+template<class Function_>
+double time_best(const int reps, Function_ fun) {
+    double best = -1;
+    for (int r = 0; r < reps; ++r) {
+        const auto start = std::chrono::steady_clock::now();
+        fun();
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (best < 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+// As above, but with an untimed 'setup' that is called before each replicate
+// to create the object that is passed to 'fun'.
+template<class Setup_, class Function_>
+double time_best(const int reps, Setup_ setup, Function_ fun) {
+    double best = -1;
+    for (int r = 0; r < reps; ++r) {
+        auto object = setup();
+        const auto start = std::chrono::steady_clock::now();
+        fun(object);
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (best < 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+// Observations in Gaussian clusters with unit variance, where the cluster
+// centers are drawn with a larger variance so that the clusters are mostly
+// separated. Observations are stored in columns.
+inline std::vector<double> simulate_clusters(const int nobs, const int ndim, const int nclusters, const unsigned long long seed = 42) {
+    std::mt19937_64 rng(seed);
+    std::normal_distribution<double> dist;
+    std::vector<double> centers(static_cast<std::size_t>(nclusters) * ndim);
+    for (auto& c : centers) {
+        c = dist(rng) * 5;
+    }
+
+    std::vector<double> output(static_cast<std::size_t>(nobs) * ndim);
+    for (int i = 0; i < nobs; ++i) {
+        const auto center = centers.data() + static_cast<std::size_t>(i % nclusters) * ndim;
+        for (int d = 0; d < ndim; ++d) {
+            output[static_cast<std::size_t>(i) * ndim + d] = center[d] + dist(rng);
+        }
+    }
+    return output;
+}
+
+inline umappp::NeighborList<int, double> find_neighbors(const std::vector<double>& data, const int ndim, const int k) {
+    const int nobs = data.size() / ndim;
+    knncolle::VptreeBuilder<int, double, double> builder(std::make_shared<knncolle::EuclideanDistance<double, double> >());
+    auto index = builder.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+    return knncolle::find_nearest_neighbors(*index, k);
+}
+
+// Fraction of the original neighbors of each observation that are also among
+// its nearest neighbors in the embedding, for the same number of neighbors.
+inline double neighborhood_preservation(const umappp::NeighborList<int, double>& original, const std::vector<double>& embedding, const int num_dim) {
+    const int k = (original.empty() ? 0 : original.front().size());
+    const auto embedded = find_neighbors(embedding, num_dim, k);
+
+    std::size_t found = 0, total = 0;
+    std::vector<int> expected;
+    for (std::size_t i = 0; i < original.size(); ++i) {
+        expected.clear();
+        for (const auto& nn : original[i]) {
+            expected.push_back(nn.first);
+        }
+        std::sort(expected.begin(), expected.end());
+        for (const auto& nn : embedded[i]) {
+            found += std::binary_search(expected.begin(), expected.end(), nn.first);
+        }
+        total += expected.size();
+    }
+    return static_cast<double>(found) / static_cast<double>(total);
+}
+
+inline int get_argument(const int argc, char** const argv, const int position, const int fallback) {
+    if (position < argc) {
+        return std::atoi(argv[position]);
+    }
+    return fallback;
+}
+
+#endif
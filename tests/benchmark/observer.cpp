@@ -0,0 +1,71 @@
+#include "common.h"
+
+#include <algorithm>
+
+// Times the optimization with and without an observer in run(), compared to
+// calling run() once per epoch to inspect the embedding. This is repeated
+// for the serial and parallel optimizers, as the latter have more setup costs
+// (e.g., creating threads) that are avoided by the observer.
+//
+// The spin limit of the parallel optimizers can be reduced when there are
+// fewer cores than threads, otherwise the waiting threads dominate the timings.
+//
+// Usage: benchmark_observer [NUM_OBS] [NUM_EPOCHS] [NUM_THREADS] [SPIN_LIMIT]
+
+int main(int argc, char** argv) {
+    const int nobs = get_argument(argc, argv, 1, 20000);
+    const int nepochs = get_argument(argc, argv, 2, 100);
+    const int nthreads = get_argument(argc, argv, 3, 4);
+    const int spin_limit = get_argument(argc, argv, 4, umappp::Options().optimize_spin_limit);
+    const auto neighbors = simulate_neighbors(nobs, 15);
+    const std::size_t ntotal = static_cast<std::size_t>(nobs) * 2;
+
+    const auto report = [&](const umappp::Options& opt) -> void {
+        std::vector<double> embedding(ntotal);
+        const auto setup = [&]() { return umappp::initialize(neighbors, 2, embedding.data(), opt); };
+
+        const double plain = time_best(3, setup, [&](auto& status) -> void {
+            status.run(embedding.data());
+        });
+        std::cout << "  plain: " << plain << std::endl;
+
+        const double noop = time_best(3, setup, [&](auto& status) -> void {
+            status.run(embedding.data(), status.num_epochs(), umappp::StopCondition(), [](int, double, const double*) -> void {});
+        });
+        std::cout << "  no-op observer: " << noop << std::endl;
+
+        // Copying each frame, as would be done to export an animation.
+        std::vector<double> frame(ntotal);
+        const double copying = time_best(3, setup, [&](auto& status) -> void {
+            status.run(embedding.data(), status.num_epochs(), umappp::StopCondition(), [&](int, double, const double* current) -> void {
+                std::copy_n(current, ntotal, frame.data());
+            });
+        });
+        std::cout << "  copying observer: " << copying << std::endl;
+
+        const double stepwise = time_best(3, setup, [&](auto& status) -> void {
+            for (int e = 1; e <= status.num_epochs(); ++e) {
+                status.run(embedding.data(), e);
+                std::copy_n(embedding.data(), ntotal, frame.data());
+            }
+        });
+        std::cout << "  run() per epoch: " << stepwise << std::endl;
+    };
+
+    umappp::Options opt;
+    opt.initialize_method = umappp::InitializeMethod::RANDOM;
+    opt.num_epochs = nepochs;
+
+    std::cout << "1 thread (s)" << std::endl;
+    report(opt);
+
+    opt.num_threads_optimize = nthreads;
+    opt.optimize_spin_limit = spin_limit;
+    for (auto scheduler : { umappp::OptimizeScheduler::GREEDY, umappp::OptimizeScheduler::COLORING }) {
+        opt.optimize_scheduler = scheduler;
+        std::cout << nthreads << " threads, " << (scheduler == umappp::OptimizeScheduler::GREEDY ? "greedy" : "coloring") << " (s)" << std::endl;
+        report(opt);
+    }
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include "common.h"
+
+// Reports the neighborhood preservation and the time for each
+// Options::optimize_method after a complete run with a given number of epochs,
+// to compare the number of epochs (and thus the time) needed to reach a target
+// preservation. Each number of epochs is a separate run so that the learning
+// rate decays to zero at the end of each run, as it would in practice.
+//
+// Usage: benchmark_optimize_method [NUM_OBS] [MAX_EPOCHS]
+
+int main(int argc, char** argv) {
+    const int nobs = get_argument(argc, argv, 1, 20000);
+    const int max_epochs = get_argument(argc, argv, 2, 200);
+    const int ndim = 10, k = 15;
+    const auto data = simulate_clusters(nobs, ndim, 20);
+    const auto neighbors = find_neighbors(data, ndim, k);
+
+    std::vector<int> num_epochs;
+    for (int e = max_epochs; e >= 25; e /= 2) {
+        num_epochs.insert(num_epochs.begin(), e);
+    }
+
+    const auto report = [&](const std::string& name, umappp::Options opt) -> void {
+        std::cout << name << std::endl;
+        for (auto e : num_epochs) {
+            opt.num_epochs = e;
+            std::vector<double> embedding(static_cast<std::size_t>(nobs) * 2);
+            const double elapsed = time_best(
+                1,
+                [&]() { return umappp::initialize(neighbors, 2, embedding.data(), opt); },
+                [&](auto& status) -> void { status.run(embedding.data()); }
+            );
+            std::cout << "  " << e << " epochs: preservation " << neighborhood_preservation(neighbors, embedding, 2) << " (" << elapsed << " s)" << std::endl;
+        }
+    };
+
+    umappp::Options opt;
+    report("SGD", opt);
+
+    opt.optimize_method = umappp::OptimizeMethod::ADAM;
+    report("ADAM", opt);
+
+    opt.optimize_method = umappp::OptimizeMethod::MOMENTUM;
+    report("MOMENTUM", opt);
+    opt.learning_rate = 0.25;
+    report("MOMENTUM, learning rate 0.25", opt);
+
+    return 0;
+}
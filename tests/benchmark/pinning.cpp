@@ -0,0 +1,53 @@
+#include "common.h"
+
+#include <utility>
+
+// Times the parallel optimizers with and without Options::optimize_pin_threads,
+// which is intended for machines with multiple NUMA nodes (e.g., multiple
+// sockets). The working array for OptimizePrecision::SINGLE is first touched
+// by the pinned threads, so this is also reported. The default number of
+// observations is chosen so that the embedding and the graph do not fit in
+// the last-level cache; the number of threads should usually span all sockets.
+//
+// Usage: benchmark_pinning [NUM_OBS] [NUM_EPOCHS] [NUM_THREADS] [SPIN_LIMIT]
+
+int main(int argc, char** argv) {
+    const int nobs = get_argument(argc, argv, 1, 1000000);
+    const int nepochs = get_argument(argc, argv, 2, 10);
+    const int nthreads = get_argument(argc, argv, 3, 8);
+    const int spin_limit = get_argument(argc, argv, 4, umappp::Options().optimize_spin_limit);
+    const auto neighbors = simulate_neighbors(nobs, 15);
+    std::cout << "CPUs available for pinning: " << umappp::available_cpus(true).size() << std::endl;
+
+    const std::vector<std::pair<std::string, umappp::OptimizeScheduler> > schedulers {
+        { "greedy", umappp::OptimizeScheduler::GREEDY },
+        { "coloring", umappp::OptimizeScheduler::COLORING },
+        { "minibatch", umappp::OptimizeScheduler::MINIBATCH }
+    };
+
+    for (const auto& sched : schedulers) {
+        for (auto precision : { umappp::OptimizePrecision::NATIVE, umappp::OptimizePrecision::SINGLE }) {
+            std::cout << sched.first << (precision == umappp::OptimizePrecision::SINGLE ? ", single" : ", native") << " (s)" << std::endl;
+            for (int pinned = 0; pinned < 2; ++pinned) {
+                umappp::Options opt;
+                opt.initialize_method = umappp::InitializeMethod::RANDOM;
+                opt.num_epochs = nepochs;
+                opt.num_threads_optimize = nthreads;
+                opt.optimize_spin_limit = spin_limit;
+                opt.optimize_scheduler = sched.second;
+                opt.optimize_precision = precision;
+                opt.optimize_pin_threads = pinned;
+
+                std::vector<double> embedding(static_cast<std::size_t>(nobs) * 2);
+                const double elapsed = time_best(
+                    3,
+                    [&]() { return umappp::initialize(neighbors, 2, embedding.data(), opt); },
+                    [&](auto& status) -> void { status.run(embedding.data()); }
+                );
+                std::cout << "  " << (pinned ? "pinned" : "unpinned") << ": " << elapsed << std::endl;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,36 @@
+#include "common.h"
+
+#include <utility>
+
+// Times the serial optimizers for a range of Options::optimize_prefetch_distance,
+// with and without Options::optimize_buffer_negative_samples. The default
+// number of observations is chosen so that the embedding and the graph do not
+// fit in the last-level cache.
+//
+// Usage: benchmark_prefetch [NUM_OBS] [NUM_EPOCHS]
+
+int main(int argc, char** argv) {
+    const int nobs = get_argument(argc, argv, 1, 1000000);
+    const int nepochs = get_argument(argc, argv, 2, 3);
+    const auto neighbors = simulate_neighbors(nobs, 15);
+
+    for (int buffered = 0; buffered < 2; ++buffered) {
+        std::cout << (buffered ? "buffered" : "plain") << " (s)" << std::endl;
+        for (int distance : { 0, 1, 2, 4, 8, 16 }) {
+            umappp::Options opt;
+            opt.initialize_method = umappp::InitializeMethod::RANDOM;
+            opt.num_epochs = nepochs;
+            opt.optimize_buffer_negative_samples = buffered;
+            opt.optimize_prefetch_distance = distance;
+
+            std::vector<double> embedding(static_cast<std::size_t>(nobs) * 2);
+            const double elapsed = time_best(
+                3,
+                [&]() { return umappp::initialize(neighbors, 2, embedding.data(), opt); },
+                [&](auto& status) -> void { status.run(embedding.data()); }
+            );
+            std::cout << "  distance " << distance << ": " << elapsed << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include "common.h"
+
+// Compares the default engine with Xoshiro256StarStar, first for the bounded
+// draws of the negative samples and then for a full serial optimization.
+//
+// Usage: benchmark_rng [NUM_OBS] [NUM_EPOCHS]
+
+volatile std::size_t consumed = 0;
+
+template<class Engine_>
+double time_draws(const int nobs, const std::size_t ndraws) {
+    Engine_ engine(1234567890);
+    std::size_t sink = 0;
+    const double elapsed = time_best(3, [&]() -> void {
+        for (std::size_t d = 0; d < ndraws; ++d) {
+            sink += umappp::sample_observation(engine, nobs);
+        }
+    });
+    consumed = sink; // so that the draws are not optimized away.
+    return static_cast<double>(ndraws) / elapsed / 1e6;
+}
+
+template<class Engine_>
+double time_run(const umappp::NeighborList<int, double>& neighbors, const umappp::Options& opt) {
+    const std::size_t nobs = neighbors.size();
+    return time_best(3, [&]() -> void {
+        std::vector<double> embedding(nobs * 2);
+        auto status = umappp::initialize<int, double, Engine_>(neighbors, 2, embedding.data(), opt);
+        status.run(embedding.data());
+    });
+}
+
+int main(int argc, char** argv) {
+    const int nobs = get_argument(argc, argv, 1, 20000);
+    const int nepochs = get_argument(argc, argv, 2, 200);
+
+    const std::size_t ndraws = 100000000;
+    std::cout << "bounded draws (millions/s)" << std::endl;
+    std::cout << "  mt19937_64:          " << time_draws<umappp::RngEngine>(nobs, ndraws) << std::endl;
+    std::cout << "  Xoshiro256StarStar:  " << time_draws<umappp::Xoshiro256StarStar>(nobs, ndraws) << std::endl;
+
+    const auto neighbors = simulate_neighbors(nobs, 15);
+    umappp::Options opt;
+    opt.initialize_method = umappp::InitializeMethod::RANDOM;
+    opt.num_epochs = nepochs;
+    std::cout << "serial run (s)" << std::endl;
+    std::cout << "  mt19937_64:          " << time_run<umappp::RngEngine>(neighbors, opt) << std::endl;
+    std::cout << "  Xoshiro256StarStar:  " << time_run<umappp::Xoshiro256StarStar>(neighbors, opt) << std::endl;
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include "umappp/EmbeddingSnapshot.hpp"
+#include "umappp/float16.hpp"
+
+#include <vector>
+#include <thread>
+#include <atomic>
+
+TEST(EmbeddingSnapshot, Basic) {
+    umappp::EmbeddingSnapshot<double> snapshot(5, 2);
+    EXPECT_EQ(snapshot.interval(), 1);
+    EXPECT_FALSE(snapshot.has_new());
+
+    std::vector<double> buffer(10, -1);
+    EXPECT_EQ(snapshot.read(buffer.data()), -1);
+    EXPECT_EQ(buffer, std::vector<double>(10, -1));
+
+    std::vector<double> first(10, 1);
+    snapshot.publish(first.data(), 0);
+    EXPECT_TRUE(snapshot.has_new());
+    EXPECT_EQ(snapshot.read(buffer.data()), 0);
+    EXPECT_EQ(buffer, first);
+    EXPECT_FALSE(snapshot.has_new());
+
+    // Repeated reads give the same snapshot.
+    EXPECT_EQ(snapshot.read(buffer.data()), 0);
+    EXPECT_EQ(buffer, first);
+
+    // Only the latest of multiple publications is read.
+    std::vector<double> second(10, 2), third(10, 3);
+    snapshot.publish(second.data(), 1);
+    snapshot.publish(third.data(), 2);
+    EXPECT_EQ(snapshot.read(buffer.data()), 2);
+    EXPECT_EQ(buffer, third);
+
+    for (int e = 3; e < 10; ++e) {
+        std::vector<double> current(10, e);
+        snapshot.publish(current.data(), e);
+        EXPECT_EQ(snapshot.read(buffer.data()), e);
+        EXPECT_EQ(buffer, current);
+    }
+}
+
+TEST(EmbeddingSnapshot, Conversion) {
+    umappp::EmbeddingSnapshot<double> snapshot(3, 2, 0);
+    EXPECT_EQ(snapshot.interval(), 1);
+
+    std::vector<float> single { 0.5, -1, 2, 3.5, 4, -5.25 };
+    snapshot.publish(single.data(), 10);
+    std::vector<double> buffer(6);
+    EXPECT_EQ(snapshot.read(buffer.data()), 10);
+    EXPECT_EQ(buffer, std::vector<double>(single.begin(), single.end()));
+
+    std::vector<umappp::Float16> half(single.begin(), single.end());
+    snapshot.publish(half.data(), 20);
+    EXPECT_EQ(snapshot.read(buffer.data()), 20);
+    EXPECT_EQ(buffer, std::vector<double>(single.begin(), single.end())); // all exactly representable.
+}
+
+TEST(EmbeddingSnapshot, Concurrent) {
+    const std::size_t num_obs = 1000, num_dim = 3;
+    const int num_epochs = 2000;
+    umappp::EmbeddingSnapshot<double> snapshot(num_obs, num_dim);
+
+    // Each snapshot is filled with its epoch, so a torn read would show up
+    // as a mixture of values.
+    std::atomic<bool> finished(false);
+    std::thread writer([&]() -> void {
+        std::vector<double> current(num_obs * num_dim);
+        for (int e = 0; e < num_epochs; ++e) {
+            std::fill(current.begin(), current.end(), e);
+            snapshot.publish(current.data(), e);
+        }
+        finished = true;
+    });
+
+    std::vector<double> buffer(num_obs * num_dim);
+    int last = -1;
+    bool consistent = true;
+    while (!finished) {
+        const int epoch = snapshot.read(buffer.data());
+        if (epoch >= 0) {
+            consistent = consistent && epoch >= last && buffer == std::vector<double>(buffer.size(), epoch);
+            last = epoch;
+        }
+    }
+    writer.join();
+
+    EXPECT_TRUE(consistent);
+    EXPECT_EQ(snapshot.read(buffer.data()), num_epochs - 1);
+    EXPECT_EQ(buffer, std::vector<double>(buffer.size(), num_epochs - 1));
+}
@@ -0,0 +1,48 @@
+#include <gtest/gtest.h>
+
+#include "umappp/Xoshiro256StarStar.hpp"
+
+#include <vector>
+#include <cstdint>
+
+TEST(Xoshiro256StarStar, Reference) {
+    // Expected values from the reference implementation, seeded via SplitMix64.
+    umappp::Xoshiro256StarStar rng(42);
+    EXPECT_EQ(rng(), 1546998764402558742u);
+    EXPECT_EQ(rng(), 6990951692964543102u);
+    EXPECT_EQ(rng(), 12544586762248559009u);
+    EXPECT_EQ(rng(), 17057574109182124193u);
+
+    umappp::Xoshiro256StarStar rng2(42), rng3(43);
+    EXPECT_EQ(rng2(), 1546998764402558742u);
+    EXPECT_NE(rng3(), 1546998764402558742u);
+}
+
+TEST(Xoshiro256StarStar, SampleObservation) {
+    umappp::Xoshiro256StarStar rng(100);
+
+    for (int bound : { 1, 2, 7, 100, 12345 }) {
+        for (int i = 0; i < 1000; ++i) {
+            const int sampled = umappp::sample_observation(rng, bound);
+            EXPECT_GE(sampled, 0);
+            EXPECT_LT(sampled, bound);
+        }
+    }
+
+    // Roughly uniform.
+    const int bound = 10, ntotal = 100000;
+    std::vector<int> counts(bound);
+    for (int i = 0; i < ntotal; ++i) {
+        ++counts[umappp::sample_observation(rng, bound)];
+    }
+    for (auto c : counts) {
+        EXPECT_GT(c, ntotal / bound * 0.95);
+        EXPECT_LT(c, ntotal / bound * 1.05);
+    }
+
+    // Works with the largest bounds.
+    const std::uint64_t big = static_cast<std::uint64_t>(-1);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_LT(umappp::sample_observation(rng, big), big);
+    }
+}
@@ -0,0 +1,427 @@
+#include <gtest/gtest.h>
+
+#include "umappp/initialize.hpp"
+#include "umappp/estimate_resources.hpp"
+#include "umappp/external_symmetrize.hpp"
+#include "knncolle/knncolle.hpp"
+
+#include <vector>
+#include <random>
+#include <memory>
+#include <memory_resource>
+#include <atomic>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+#include <new>
+#include <tuple>
+
+// Replacing the global allocation functions so that we can count the
+// allocations within a block of code. This applies to the entire test
+// executable but is otherwise a transparent wrapper around malloc/free,
+// with a header to store the size of each allocation so that we can also
+// track the number of bytes that are currently allocated.
+static std::atomic<bool> count_allocations = false;
+static std::atomic<std::size_t> num_allocations = 0;
+static std::atomic<std::size_t> live_bytes = 0;
+static std::atomic<std::size_t> peak_bytes = 0;
+static constexpr std::size_t header_size = alignof(std::max_align_t);
+
+static void track_allocation(const std::size_t size) {
+    if (count_allocations.load(std::memory_order_relaxed)) {
+        num_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    const auto current = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    auto peak = peak_bytes.load(std::memory_order_relaxed);
+    while (current > peak && !peak_bytes.compare_exchange_weak(peak, current, std::memory_order_relaxed)) {}
+}
+
+void* operator new(std::size_t size) {
+    if (void* ptr = std::malloc(size + header_size)) {
+        track_allocation(size);
+        *static_cast<std::size_t*>(ptr) = size;
+        return static_cast<unsigned char*>(ptr) + header_size;
+    }
+    throw std::bad_alloc();
+}
+
+// Also replacing the over-aligned versions, which are used by the default
+// std::pmr::memory_resource. Here, the header holds the size and the pointer
+// returned by malloc().
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    const auto align = std::max(static_cast<std::size_t>(alignment), 2 * sizeof(std::size_t));
+    if (void* ptr = std::malloc(size + 2 * align)) {
+        track_allocation(size);
+        const auto address = reinterpret_cast<std::uintptr_t>(ptr) + align;
+        auto aligned = reinterpret_cast<std::size_t*>((address + align - 1) / align * align);
+        aligned[-2] = size;
+        aligned[-1] = reinterpret_cast<std::uintptr_t>(ptr);
+        return aligned;
+    }
+    throw std::bad_alloc();
+}
+
+// GCC complains about free() on memory from operator new after inlining,
+// which is expected as we have replaced operator new with malloc(). It also
+// complains about the access to the header before the start of the object.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#pragma GCC diagnostic ignored "-Warray-bounds"
+#endif
+
+void operator delete(void* ptr) noexcept {
+    if (ptr == NULL) {
+        return;
+    }
+    void* original = static_cast<unsigned char*>(ptr) - header_size;
+    live_bytes.fetch_sub(*static_cast<std::size_t*>(original), std::memory_order_relaxed);
+    std::free(original);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    if (ptr == NULL) {
+        return;
+    }
+    auto header = static_cast<std::size_t*>(ptr) - 2;
+    live_bytes.fetch_sub(header[0], std::memory_order_relaxed);
+    std::free(reinterpret_cast<void*>(header[1]));
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t alignment) noexcept {
+    operator delete(ptr, alignment);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+template<class Function_>
+static std::size_t allocations_in(Function_ fun) {
+    num_allocations.store(0);
+    count_allocations.store(true);
+    fun();
+    count_allocations.store(false);
+    return num_allocations.load();
+}
+
+class AllocationsTest : public ::testing::Test {
+protected:
+    void SetUp() {
+        std::mt19937_64 rng(42);
+        std::normal_distribution<> dist(0, 1);
+        std::vector<double> data(nobs * ndim);
+        for (auto& d : data) {
+            d = dist(rng);
+        }
+
+        auto builder = knncolle::VptreeBuilder<int, double, double>(std::make_shared<knncolle::EuclideanDistance<double, double> >());
+        auto index = builder.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+        neighbors = knncolle::find_nearest_neighbors(*index, 10);
+    }
+
+    int nobs = 200, ndim = 5;
+    umappp::NeighborList<int, double> neighbors;
+};
+
+TEST_F(AllocationsTest, SteadyState) {
+    const auto check = [&](const umappp::Options& opt) -> void {
+        std::vector<double> output(nobs * 2);
+        auto status = umappp::initialize(neighbors, 2, output.data(), opt);
+
+        // The first call is allowed to allocate the scratch buffers.
+        status.run(output.data(), 100);
+        EXPECT_EQ(allocations_in([&]() -> void { status.run(output.data(), 300); }), 0);
+        EXPECT_EQ(allocations_in([&]() -> void { status.run(output.data()); }), 0);
+        EXPECT_EQ(status.epoch(), 500);
+    };
+
+    umappp::Options opt;
+    check(opt);
+
+    {
+        auto opt2 = opt;
+        opt2.optimize_buffer_negative_samples = true;
+        check(opt2);
+    }
+
+    {
+        auto opt2 = opt;
+        opt2.optimize_precision = umappp::OptimizePrecision::SINGLE;
+        check(opt2);
+        opt2.optimize_precision = umappp::OptimizePrecision::HALF;
+        check(opt2);
+    }
+
+    // Same for the other optimizers, whose buffers are also held in the workspace.
+    for (auto scheduler : { umappp::OptimizeScheduler::COLORING, umappp::OptimizeScheduler::MINIBATCH }) {
+        auto opt2 = opt;
+        opt2.optimize_scheduler = scheduler;
+        check(opt2);
+        opt2.optimize_precision = umappp::OptimizePrecision::SINGLE;
+        check(opt2);
+    }
+
+    {
+        auto opt2 = opt;
+        opt2.optimize_repulsion = umappp::OptimizeRepulsion::BARNES_HUT;
+        check(opt2);
+        opt2.optimize_precision = umappp::OptimizePrecision::HALF;
+        check(opt2);
+    }
+
+    for (auto method : { umappp::OptimizeMethod::MOMENTUM, umappp::OptimizeMethod::ADAM }) {
+        auto opt2 = opt;
+        opt2.optimize_method = method;
+        check(opt2);
+    }
+
+    {
+        auto opt2 = opt;
+        opt2.early_stop_tolerance = 1e-20; // never actually converges.
+        check(opt2);
+    }
+}
+
+class CountingResource : public std::pmr::memory_resource {
+public:
+    std::size_t num_allocations = 0;
+
+private:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) {
+        ++num_allocations;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) {
+        std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+        return this == &other;
+    }
+};
+
+TEST_F(AllocationsTest, MemoryResource) {
+    const auto check = [&](umappp::Options opt) -> void {
+        std::vector<double> ref(nobs * 2);
+        auto ref_status = umappp::initialize(neighbors, 2, ref.data(), opt);
+        ref_status.run(ref.data());
+
+        CountingResource resource;
+        opt.optimize_memory_resource = &resource;
+        std::vector<double> output(nobs * 2);
+        {
+            auto status = umappp::initialize(neighbors, 2, output.data(), opt);
+            status.run(output.data());
+        }
+        EXPECT_GT(resource.num_allocations, 0);
+        EXPECT_EQ(output, ref);
+    };
+
+    umappp::Options opt;
+    opt.optimize_buffer_negative_samples = true;
+    check(opt);
+
+    {
+        auto opt2 = opt;
+        opt2.optimize_scheduler = umappp::OptimizeScheduler::MINIBATCH;
+        check(opt2);
+        opt2.optimize_repulsion = umappp::OptimizeRepulsion::BARNES_HUT;
+        check(opt2);
+        opt2.optimize_repulsion = umappp::OptimizeRepulsion::NEGATIVE_SAMPLING;
+        opt2.optimize_method = umappp::OptimizeMethod::ADAM;
+        opt2.early_stop_tolerance = 1e-20;
+        check(opt2);
+    }
+
+#ifndef UMAPPP_NO_PARALLEL_OPTIMIZATION
+    opt.optimize_buffer_negative_samples = false;
+    opt.num_threads_optimize = 3;
+    opt.optimize_spin_limit = 100;
+    check(opt);
+#endif
+}
+
+TEST_F(AllocationsTest, SymmetrizeBudget) {
+    std::mt19937_64 rng(69);
+    std::uniform_int_distribution<int> pick(0, nobs - 1);
+    std::uniform_real_distribution<double> sim(0.1, 1);
+    std::vector<std::tuple<int, int, double> > edges;
+    for (int i = 0; i < 20000; ++i) {
+        edges.emplace_back(pick(rng), pick(rng), sim(rng));
+    }
+
+    // The buffer is allocated in the constructor and does not grow, regardless
+    // of the number of runs or merges. A little extra memory is allowed for the
+    // list of runs and the state of each merge.
+    for (std::size_t budget : { 50000, 100000 }) {
+        const auto start = live_bytes.load();
+        peak_bytes.store(start);
+
+        umappp::ExternalSymmetrizer<int, double> sym(nobs, budget, "");
+        EXPECT_LE(live_bytes.load() - start, budget);
+        for (const auto& e : edges) {
+            sym.add(std::get<0>(e), std::get<1>(e), std::get<2>(e));
+        }
+        EXPECT_GT(sym.num_runs(), sym.fan_in()); // runs are consolidated.
+        EXPECT_LE(peak_bytes.load() - start, budget + 4096);
+
+        auto output = sym.finish(1);
+        const auto held = live_bytes.load() - start;
+        const auto output_bytes = umappp::memory_usage(output.pointers) + umappp::memory_usage(output.entries);
+        EXPECT_GE(held, output_bytes);
+        EXPECT_LE(held, output_bytes + 1024); // the buffer is released, only the empty list of runs is left.
+
+        // The output and the offsets for filling it are allocated while the buffer is still held.
+        EXPECT_LE(peak_bytes.load() - start, budget + held + umappp::memory_usage(output.pointers) + 4096);
+    }
+}
+
+TEST_F(AllocationsTest, Estimates) {
+    const auto check = [&](umappp::Options opt) -> void {
+        opt.initialize_method = umappp::InitializeMethod::RANDOM; // the memory usage of IRLBA depends on its implementation.
+        const auto est = umappp::estimate_resources<int, double>(nobs, 10, 2, opt);
+
+        std::vector<double> output(nobs * 2);
+        auto copy = neighbors;
+        std::size_t neighbor_bytes = 0;
+        {
+            const auto before = live_bytes.load();
+            auto tmp = copy;
+            neighbor_bytes = live_bytes.load() - before;
+        }
+        EXPECT_EQ(neighbor_bytes, est.neighbor_list);
+
+        // Measuring memory relative to the start, before the neighbors were copied.
+        const auto start = live_bytes.load() - neighbor_bytes;
+        peak_bytes.store(live_bytes.load());
+        auto status = umappp::initialize(std::move(copy), 2, output.data(), opt);
+        const auto held_init = live_bytes.load() - start;
+        EXPECT_LE(status.memory_usage(), held_init);
+        EXPECT_GE(status.memory_usage() + 64, held_init); // some slack for the shared pointer's control block.
+
+        status.run(output.data());
+        const auto measured_peak = peak_bytes.load() - start;
+        EXPECT_LE(measured_peak, est.peak);
+        EXPECT_GE(measured_peak * 2, est.peak);
+
+        const auto held_run = live_bytes.load() - start;
+        EXPECT_LE(status.memory_usage(), held_run);
+        EXPECT_GE(status.memory_usage() + 64, held_run);
+        EXPECT_LE(status.memory_usage(), est.epoch_data);
+        EXPECT_GE(status.memory_usage() * 2, est.epoch_data);
+
+        // Comparing to the actual number of edge updates in the schedule.
+        const auto& epochs = status.get_epoch_data();
+        EXPECT_EQ(epochs.total_epochs, est.num_epochs);
+        double num_updates = 0;
+        for (auto eps : epochs.graph->epochs_per_sample) {
+            num_updates += std::floor((est.num_epochs - 1) / eps);
+        }
+        EXPECT_LE(num_updates, est.num_edge_updates);
+        if (opt.mix_ratio > 0) { // otherwise the sum of the strengths depends on the number of reciprocal neighbors.
+            EXPECT_GE(num_updates * 2, est.num_edge_updates);
+        }
+        EXPECT_EQ(est.num_negative_samples, est.num_edge_updates * opt.negative_sample_rate);
+    };
+
+    umappp::Options opt;
+    check(opt);
+
+    {
+        auto opt2 = opt;
+        opt2.mix_ratio = 0.5;
+        check(opt2);
+        opt2.mix_ratio = 0;
+        check(opt2);
+    }
+
+    {
+        auto opt2 = opt;
+        opt2.update_enabled = true;
+        check(opt2);
+    }
+
+    {
+        auto opt2 = opt;
+        opt2.optimize_method = umappp::OptimizeMethod::MOMENTUM;
+        check(opt2);
+        opt2.optimize_method = umappp::OptimizeMethod::ADAM;
+        check(opt2);
+    }
+
+    {
+        auto opt2 = opt;
+        opt2.optimize_precision = umappp::OptimizePrecision::SINGLE;
+        check(opt2);
+        opt2.optimize_precision = umappp::OptimizePrecision::HALF;
+        check(opt2);
+    }
+
+    {
+        auto opt2 = opt;
+        opt2.early_stop_tolerance = 0.001;
+        check(opt2);
+    }
+
+    {
+        auto opt2 = opt;
+        opt2.optimize_scheduler = umappp::OptimizeScheduler::COLORING;
+        check(opt2);
+        opt2.optimize_precision = umappp::OptimizePrecision::HALF;
+        check(opt2);
+    }
+
+    {
+        auto opt2 = opt;
+        opt2.optimize_scheduler = umappp::OptimizeScheduler::MINIBATCH;
+        check(opt2);
+        opt2.optimize_minibatch_size = 100;
+        opt2.optimize_precision = umappp::OptimizePrecision::SINGLE;
+        check(opt2);
+#ifndef UMAPPP_NO_PARALLEL_OPTIMIZATION
+        opt2.num_threads_optimize = 3;
+        opt2.optimize_spin_limit = 100;
+        check(opt2);
+#endif
+    }
+
+    {
+        auto opt2 = opt;
+        opt2.optimize_repulsion = umappp::OptimizeRepulsion::BARNES_HUT;
+        check(opt2);
+        opt2.optimize_precision = umappp::OptimizePrecision::SINGLE;
+        check(opt2);
+        opt2.optimize_method = umappp::OptimizeMethod::ADAM;
+        check(opt2);
+    }
+
+    // Spectral initialization is only checked for consistency.
+    {
+        const auto est = umappp::estimate_resources<int, double>(nobs, 10, 2, opt);
+        EXPECT_GT(est.spectral_init, 0);
+        EXPECT_EQ(est.peak, est.fuzzy_graph + std::max(est.spectral_init, est.epoch_data));
+        auto opt2 = opt;
+        opt2.initialize_method = umappp::InitializeMethod::RANDOM;
+        const auto est2 = umappp::estimate_resources<int, double>(nobs, 10, 2, opt2);
+        EXPECT_EQ(est2.spectral_init, 0);
+    }
+
+#ifndef UMAPPP_NO_PARALLEL_OPTIMIZATION
+    {
+        auto opt2 = opt;
+        opt2.num_threads_optimize = 3;
+        opt2.optimize_spin_limit = 100;
+        check(opt2);
+        opt2.optimize_scheduler = umappp::OptimizeScheduler::COLORING;
+        check(opt2);
+    }
+#endif
+}
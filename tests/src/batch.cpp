@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+
+#include "umappp/batch.hpp"
+#include "knncolle/knncolle.hpp"
+
+#include <random>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+class BatchTest : public ::testing::Test {
+protected:
+    void SetUp() {
+        std::mt19937_64 rng(4242);
+        std::normal_distribution<> dist(0, 1);
+
+        data.resize(nobs * ndim);
+        for (auto& d : data) {
+            d = dist(rng);
+        }
+
+        auto builder = knncolle::VptreeBuilder<int, double, double>(std::make_shared<knncolle::EuclideanDistance<double, double> >());
+        auto index = builder.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+        neighbors = knncolle::find_nearest_neighbors(*index, 10);
+    }
+
+    int nobs = 150;
+    int ndim = 5;
+    std::vector<double> data;
+    umappp::NeighborList<int, double> neighbors;
+
+    // Reference result from a standalone run.
+    std::vector<double> reference(const std::size_t outdim, const umappp::Options& opt) const {
+        std::vector<double> output(nobs * outdim);
+        auto status = umappp::initialize(neighbors, outdim, output.data(), opt);
+        status.run(output.data());
+        return output;
+    }
+};
+
+TEST_F(BatchTest, Basic) {
+    std::vector<umappp::Options> options(3);
+    options[1].initialize_seed = 10;
+    options[1].optimize_seed = 20;
+    options[2].min_dist = 0.5;
+    std::vector<std::size_t> num_dim { 2, 2, 3 };
+
+    std::vector<std::vector<double> > outputs;
+    std::vector<double*> embeddings;
+    for (auto nd : num_dim) {
+        outputs.emplace_back(nd * nobs);
+        embeddings.push_back(outputs.back().data());
+    }
+
+    auto statuses = umappp::initialize_batch(neighbors, num_dim, embeddings, options);
+    ASSERT_EQ(statuses.size(), 3);
+    EXPECT_EQ(statuses[0].get_epoch_data().graph, statuses[1].get_epoch_data().graph);
+    EXPECT_EQ(statuses[0].get_epoch_data().graph, statuses[2].get_epoch_data().graph);
+    EXPECT_EQ(statuses[2].num_dimensions(), 3);
+
+    umappp::run_batch(statuses, embeddings, 2);
+    for (int r = 0; r < 3; ++r) {
+        EXPECT_EQ(statuses[r].epoch(), statuses[r].num_epochs());
+        EXPECT_EQ(outputs[r], reference(num_dim[r], options[r]));
+    }
+    EXPECT_NE(outputs[0], outputs[1]);
+}
+
+TEST_F(BatchTest, DifferentEpochs) {
+    std::vector<umappp::Options> options(2);
+    options[0].num_epochs = 100;
+    options[1].num_epochs = 300;
+    std::vector<std::size_t> num_dim { 2, 2 };
+
+    std::vector<double> out1(nobs * 2), out2(nobs * 2);
+    std::vector<double*> embeddings { out1.data(), out2.data() };
+    auto statuses = umappp::initialize_batch(neighbors, num_dim, embeddings, options);
+    EXPECT_EQ(statuses[0].num_epochs(), 100);
+    EXPECT_EQ(statuses[1].num_epochs(), 300);
+
+    // Extra edges from the larger number of epochs do not affect the shorter run.
+    umappp::run_batch(statuses, embeddings, 1);
+    EXPECT_EQ(out1, reference(2, options[0]));
+    EXPECT_EQ(out2, reference(2, options[1]));
+}
+
+TEST_F(BatchTest, Coloring) {
+    std::vector<umappp::Options> options(2);
+    options[0].optimize_scheduler = umappp::OptimizeScheduler::COLORING;
+    options[1].optimize_scheduler = umappp::OptimizeScheduler::COLORING;
+    options[1].optimize_seed = 99;
+    std::vector<std::size_t> num_dim { 2, 2 };
+
+    std::vector<double> out1(nobs * 2), out2(nobs * 2);
+    std::vector<double*> embeddings { out1.data(), out2.data() };
+    auto statuses = umappp::initialize_batch(neighbors, num_dim, embeddings, options);
+    EXPECT_FALSE(statuses[0].get_epoch_data().graph->batch_pointers.empty());
+
+    umappp::run_batch(statuses, embeddings, 2);
+    EXPECT_EQ(out1, reference(2, options[0]));
+    EXPECT_EQ(out2, reference(2, options[1]));
+}
+
+TEST_F(BatchTest, Minibatch) {
+    std::vector<umappp::Options> options(2);
+    options[0].optimize_scheduler = umappp::OptimizeScheduler::MINIBATCH;
+    options[1].optimize_scheduler = umappp::OptimizeScheduler::COLORING;
+    std::vector<std::size_t> num_dim { 2, 2 };
+
+    std::vector<double> out1(nobs * 2), out2(nobs * 2);
+    std::vector<double*> embeddings { out1.data(), out2.data() };
+    auto statuses = umappp::initialize_batch(neighbors, num_dim, embeddings, options);
+    const auto& graph = *(statuses[0].get_epoch_data().graph);
+    ASSERT_EQ(graph.edge_alias.size(), 1);
+    EXPECT_EQ(graph.edge_alias.front().sources.size(), graph.edge_targets.size());
+    EXPECT_FALSE(graph.batch_pointers.empty());
+
+    umappp::run_batch(statuses, embeddings, 2);
+    EXPECT_EQ(out1, reference(2, options[0]));
+    EXPECT_EQ(out2, reference(2, options[1]));
+}
+
+TEST_F(BatchTest, MinibatchDifferentEpochs) {
+    std::vector<umappp::Options> options(3);
+    options[0].num_epochs = 20;
+    options[1].num_epochs = 500;
+    options[2].num_epochs = 100;
+    for (auto& opt : options) {
+        opt.optimize_scheduler = umappp::OptimizeScheduler::MINIBATCH;
+    }
+    std::vector<std::size_t> num_dim { 2, 2, 2 };
+
+    std::vector<double> out1(nobs * 2), out2(nobs * 2), out3(nobs * 2);
+    std::vector<double*> embeddings { out1.data(), out2.data(), out3.data() };
+    auto statuses = umappp::initialize_batch(neighbors, num_dim, embeddings, options);
+
+    // Each run with fewer epochs has its own table over the unpruned edges.
+    const auto& graph = *(statuses[0].get_epoch_data().graph);
+    ASSERT_EQ(graph.edge_alias.size(), 3);
+    std::vector<double> short_out(nobs * 2);
+    const auto short_graph = umappp::initialize(neighbors, 2, short_out.data(), options[0]).get_epoch_data().graph;
+    EXPECT_LT(short_graph->edge_targets.size(), graph.edge_targets.size());
+    EXPECT_EQ(graph.edge_alias[0].edges.size(), short_graph->edge_targets.size());
+    EXPECT_TRUE(graph.edge_alias[1].edges.empty());
+
+    umappp::run_batch(statuses, embeddings, 2);
+    EXPECT_EQ(out1, reference(2, options[0]));
+    EXPECT_EQ(out2, reference(2, options[1]));
+    EXPECT_EQ(out3, reference(2, options[2]));
+}
+
+TEST_F(BatchTest, Errors) {
+    std::vector<double> out1(nobs * 2), out2(nobs * 2);
+    std::vector<double*> embeddings { out1.data(), out2.data() };
+
+    std::string msg;
+    try {
+        umappp::initialize_batch(neighbors, std::vector<std::size_t>{ 2 }, embeddings, std::vector<umappp::Options>(2));
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("same length") != std::string::npos);
+
+    std::vector<umappp::Options> options(2);
+    options[1].mix_ratio = 0.5;
+    msg.clear();
+    try {
+        umappp::initialize_batch(neighbors, std::vector<std::size_t>{ 2, 2 }, embeddings, options);
+    } catch (std::exception& e) {
+        msg = e.what();
+    }
+    EXPECT_TRUE(msg.find("graph-related") != std::string::npos);
+
+    auto empty = umappp::initialize_batch(neighbors, std::vector<std::size_t>{}, std::vector<double*>{}, std::vector<umappp::Options>{});
+    EXPECT_TRUE(empty.empty());
+}
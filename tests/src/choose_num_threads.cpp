@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+
+#include "umappp/choose_num_threads.hpp"
+
+#include <vector>
+
+TEST(ChooseNumThreads, GreedyWidth) {
+    EXPECT_DOUBLE_EQ(umappp::greedy_expected_width(0, 1), 1);
+    EXPECT_DOUBLE_EQ(umappp::greedy_expected_width(0, 5), 5);
+    EXPECT_DOUBLE_EQ(umappp::greedy_expected_width(1, 5), 1);
+
+    // Second observation must not conflict with the first, third must not conflict with the first two.
+    EXPECT_DOUBLE_EQ(umappp::greedy_expected_width(0.1, 3), 1 + 0.9 + 0.9 * 0.81);
+
+    double last = 0;
+    for (int t = 1; t <= 10; ++t) {
+        const double current = umappp::greedy_expected_width(0.05, t);
+        EXPECT_GT(current, last);
+        EXPECT_LE(current, t);
+        last = current;
+    }
+}
+
+static umappp::EpochGraph<int, double> mock_graph(const std::vector<int>& degrees) {
+    const int nobs = degrees.size();
+    umappp::EpochGraph<int, double> graph(nobs);
+    for (int i = 0; i < nobs; ++i) {
+        graph.cumulative_num_edges[i + 1] = graph.cumulative_num_edges[i] + degrees[i];
+        for (int j = 0; j < degrees[i]; ++j) {
+            graph.edge_targets.push_back((i + j + 1) % nobs);
+            graph.epochs_per_sample.push_back(1);
+        }
+    }
+    return graph;
+}
+
+TEST(ChooseNumThreads, GreedyConflict) {
+    auto graph = mock_graph(std::vector<int>(1000, 4));
+    const double prob = umappp::greedy_conflict_probability(graph, 5.0);
+    EXPECT_DOUBLE_EQ(prob, (25.0 + 2 * 5 * 20) / 1000);
+
+    // Fewer conflicts with fewer negative samples and more observations.
+    EXPECT_LT(umappp::greedy_conflict_probability(graph, 1.0), prob);
+    EXPECT_LT(umappp::greedy_conflict_probability(mock_graph(std::vector<int>(10000, 4)), 5.0), prob);
+
+    // More conflicts with variable degrees, for the same total number of edges.
+    std::vector<int> degrees(1000, 2);
+    for (int i = 0; i < 500; ++i) {
+        degrees[i] = 6;
+    }
+    EXPECT_GT(umappp::greedy_conflict_probability(mock_graph(degrees), 0.0), umappp::greedy_conflict_probability(graph, 0.0));
+
+    // Capped at 1.
+    EXPECT_EQ(umappp::greedy_conflict_probability(mock_graph(std::vector<int>(10, 4)), 5.0), 1);
+    EXPECT_EQ(umappp::greedy_conflict_probability(mock_graph(std::vector<int>(1, 0)), 5.0), 0);
+}
+
+TEST(ChooseNumThreads, ColoringWidth) {
+    auto graph = mock_graph(std::vector<int>(20, 1));
+    graph.batch_pointers = std::vector<std::size_t>{ 0, 12, 17, 20 };
+    EXPECT_DOUBLE_EQ(umappp::coloring_expected_width(graph, 1), 1);
+    EXPECT_DOUBLE_EQ(umappp::coloring_expected_width(graph, 4), 20.0 / (3 + 2 + 1));
+    EXPECT_DOUBLE_EQ(umappp::coloring_expected_width(graph, 100), 20.0 / 3);
+}
+
+TEST(ChooseNumThreads, Predict) {
+    auto graph = mock_graph(std::vector<int>(100000, 4));
+    umappp::Options opt;
+
+    // Greedy scheduler has a high overhead, so more threads are needed to see any improvement.
+    {
+        auto model = umappp::default_thread_cost_model(opt);
+        auto times = umappp::predict_thread_times(graph, 5.0, opt, model, 8);
+        EXPECT_EQ(times.size(), 8u);
+        EXPECT_EQ(times[0], 1);
+        EXPECT_GT(times[1], 1);
+        EXPECT_LT(times[7], 1);
+        EXPECT_EQ(umappp::choose_from_thread_times(times, umappp::ThreadObjective::WALL_TIME, 0.8), 8);
+        EXPECT_EQ(umappp::choose_from_thread_times(times, umappp::ThreadObjective::CPU_TIME, 0.8), 1);
+    }
+
+    // Other schemes scale almost linearly.
+    {
+        auto opt2 = opt;
+        opt2.optimize_method = umappp::OptimizeMethod::ADAM;
+        auto model = umappp::default_thread_cost_model(opt2);
+        auto times = umappp::predict_thread_times(graph, 5.0, opt2, model, 4);
+        EXPECT_DOUBLE_EQ(times[3], 0.25 + model.overhead);
+        EXPECT_EQ(umappp::choose_from_thread_times(times, umappp::ThreadObjective::WALL_TIME, 0.8), 4);
+        EXPECT_EQ(umappp::choose_from_thread_times(times, umappp::ThreadObjective::CPU_TIME, 0.8), 4);
+
+        // Efficiency eventually drops below the threshold with more threads.
+        auto times16 = umappp::predict_thread_times(graph, 5.0, opt2, model, 16);
+        EXPECT_EQ(umappp::choose_from_thread_times(times16, umappp::ThreadObjective::WALL_TIME, 0.8), 16);
+        const auto chosen = umappp::choose_from_thread_times(times16, umappp::ThreadObjective::CPU_TIME, 0.8);
+        EXPECT_GT(chosen, 4);
+        EXPECT_LT(chosen, 16);
+        EXPECT_GE(times16[0] / (chosen * times16[chosen - 1]), 0.8);
+        EXPECT_LT(times16[0] / ((chosen + 1) * times16[chosen]), 0.8);
+    }
+
+    // Barnes-Hut has a serial component.
+    {
+        auto opt2 = opt;
+        opt2.optimize_repulsion = umappp::OptimizeRepulsion::BARNES_HUT;
+        auto model = umappp::default_thread_cost_model(opt2);
+        auto times = umappp::predict_thread_times(graph, 5.0, opt2, model, 4);
+        EXPECT_DOUBLE_EQ(times[3], model.serial + (1 - model.serial) / 4 + model.overhead);
+    }
+
+    // Only one thread.
+    {
+        auto model = umappp::default_thread_cost_model(opt);
+        auto times = umappp::predict_thread_times(graph, 5.0, opt, model, 1);
+        EXPECT_EQ(times.size(), 1u);
+        EXPECT_EQ(umappp::choose_from_thread_times(times, umappp::ThreadObjective::WALL_TIME, 0.8), 1);
+    }
+}
+
+TEST(ChooseNumThreads, Calibrate) {
+    umappp::ThreadCostModel model;
+    model.overhead = 0.5;
+    umappp::calibrate_thread_cost_model(model, 0.8, 0.6);
+    EXPECT_DOUBLE_EQ(model.overhead, 0.7);
+    umappp::calibrate_thread_cost_model(model, 0.1, 1);
+    EXPECT_EQ(model.overhead, 0);
+}
+
+TEST(ChooseNumThreads, Choose) {
+    // Prefers fewer threads if the improvement is negligible.
+    EXPECT_EQ(umappp::choose_from_thread_times(std::vector<double>{ 1, 0.6, 0.5, 0.499 }, umappp::ThreadObjective::WALL_TIME, 0.8), 3);
+    EXPECT_EQ(umappp::choose_from_thread_times(std::vector<double>{ 1, 0.6, 0.5, 0.4 }, umappp::ThreadObjective::WALL_TIME, 0.8), 4);
+    EXPECT_EQ(umappp::choose_from_thread_times(std::vector<double>{ 1, 0.45, 0.5, 0.4 }, umappp::ThreadObjective::CPU_TIME, 0.8), 2);
+
+    // CPU time objective uses the fastest option with sufficient efficiency.
+    const std::vector<double> linear { 1, 0.5, 0.34, 0.27, 0.25 };
+    EXPECT_EQ(umappp::choose_from_thread_times(linear, umappp::ThreadObjective::CPU_TIME, 0.9), 4);
+    EXPECT_EQ(umappp::choose_from_thread_times(linear, umappp::ThreadObjective::CPU_TIME, 0.95), 3);
+    EXPECT_EQ(umappp::choose_from_thread_times(linear, umappp::ThreadObjective::CPU_TIME, 0.99), 2);
+    EXPECT_EQ(umappp::choose_from_thread_times(linear, umappp::ThreadObjective::CPU_TIME, 0), 5);
+}
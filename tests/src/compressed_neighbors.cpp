@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include "umappp/compressed_neighbors.hpp"
+#include "umappp/combine_neighbor_sets.hpp"
+#include "umappp/spectral_init.hpp"
+#include "umappp/optimize_layout.hpp"
+#include "knncolle/knncolle.hpp"
+
+#include <vector>
+#include <random>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+
+class CompressedNeighborsTest : public ::testing::TestWithParam<std::tuple<int, int, double> > {
+protected:
+    void SetUp() {
+        auto p = GetParam();
+        nobs = std::get<0>(p);
+        k = std::get<1>(p);
+        mix_ratio = std::get<2>(p);
+
+        std::mt19937_64 rng(nobs * k); // for some variety
+        std::normal_distribution<> dist(0, 1);
+
+        std::vector<double> data(nobs * ndim);
+        for (size_t r = 0; r < data.size(); ++r) {
+            data[r] = dist(rng);
+        }
+
+        auto builder = knncolle::VptreeBuilder<int, double, double>(std::make_shared<knncolle::EuclideanDistance<double, double> >());
+        auto index = builder.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+        neighbors = knncolle::find_nearest_neighbors(*index, k);
+        for (auto& current : neighbors) {
+            for (auto& nn : current) {
+                nn.second = std::exp(-nn.second);
+            }
+        }
+    }
+
+    int nobs, k;
+    double mix_ratio;
+    int ndim = 5;
+    umappp::NeighborList<int, double> neighbors;
+
+    static umappp::CompressedNeighborList<int, double> compress(umappp::NeighborList<int, double> x) {
+        umappp::CompressedNeighborList<int, double> output;
+        for (auto& current : x) {
+            std::sort(current.begin(), current.end());
+            output.entries.insert(output.entries.end(), current.begin(), current.end());
+            output.pointers.push_back(output.entries.size());
+        }
+        return output;
+    }
+};
+
+TEST_P(CompressedNeighborsTest, Access) {
+    auto compressed = compress(neighbors);
+    ASSERT_EQ(compressed.size(), neighbors.size());
+
+    auto copy = neighbors;
+    for (auto& current : copy) {
+        std::sort(current.begin(), current.end());
+    }
+    EXPECT_EQ(umappp::to_neighbor_list(compressed), copy);
+
+    for (int i = 0; i < nobs; ++i) {
+        const auto row = compressed[i];
+        ASSERT_EQ(row.size(), copy[i].size());
+        EXPECT_EQ(row.empty(), copy[i].empty());
+        for (size_t j = 0; j < row.size(); ++j) {
+            EXPECT_EQ(row[j], copy[i][j]);
+        }
+    }
+}
+
+TEST_P(CompressedNeighborsTest, Combine) {
+    auto ref = neighbors;
+    umappp::combine_neighbor_sets(ref, mix_ratio);
+
+    auto compressed = umappp::combine_compressed_neighbors(compress(neighbors), mix_ratio);
+    EXPECT_EQ(umappp::to_neighbor_list(compressed), ref);
+    EXPECT_EQ(compressed.entries.capacity(), compressed.entries.size());
+
+    // Same graph.
+    auto ref_graph = umappp::similarities_to_graph(ref, 500);
+    auto graph = umappp::similarities_to_graph(compressed, 500);
+    EXPECT_EQ(graph.cumulative_num_edges, ref_graph.cumulative_num_edges);
+    EXPECT_EQ(graph.edge_targets, ref_graph.edge_targets);
+    EXPECT_EQ(graph.epochs_per_sample, ref_graph.epochs_per_sample);
+
+    // Same spectral initialization.
+    EXPECT_EQ(umappp::has_multiple_components(compressed), umappp::has_multiple_components(ref));
+    std::vector<double> ref_init(nobs * 2), init(nobs * 2);
+    irlba::Options iopt;
+    const bool ref_ok = umappp::spectral_init(ref, 2, ref_init.data(), iopt, 1, 10.0, false, 0.0001, 42);
+    const bool ok = umappp::spectral_init(compressed, 2, init.data(), iopt, 1, 10.0, false, 0.0001, 42);
+    EXPECT_EQ(ok, ref_ok);
+    EXPECT_EQ(init, ref_init);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    CompressedNeighbors,
+    CompressedNeighborsTest,
+    ::testing::Combine(
+        ::testing::Values(50, 100, 200), // number of observations
+        ::testing::Values(5, 10, 15), // number of neighbors
+        ::testing::Values(0.0, 0.5, 1.0) // mix ratio
+    )
+);
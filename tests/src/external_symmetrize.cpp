@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include "umappp/external_symmetrize.hpp"
+#include "umappp/combine_neighbor_sets.hpp"
+#include "knncolle/knncolle.hpp"
+
+#include <vector>
+#include <random>
+#include <memory>
+#include <cmath>
+#include <filesystem>
+#include <string>
+#include <algorithm>
+
+class ExternalSymmetrizeTest : public ::testing::TestWithParam<std::tuple<int, double, size_t> > {
+protected:
+    void SetUp() {
+        auto p = GetParam();
+        nobs = std::get<0>(p);
+        mix_ratio = std::get<1>(p);
+        budget = std::get<2>(p);
+
+        std::mt19937_64 rng(nobs + budget); // for some variety
+        std::normal_distribution<> dist(0, 1);
+
+        std::vector<double> data(nobs * ndim);
+        for (size_t r = 0; r < data.size(); ++r) {
+            data[r] = dist(rng);
+        }
+
+        auto builder = knncolle::VptreeBuilder<int, double, double>(std::make_shared<knncolle::EuclideanDistance<double, double> >());
+        auto index = builder.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+        neighbors = knncolle::find_nearest_neighbors(*index, k);
+        for (auto& current : neighbors) {
+            for (auto& nn : current) {
+                nn.second = std::exp(-nn.second);
+            }
+        }
+    }
+
+    int nobs;
+    double mix_ratio;
+    size_t budget;
+    int ndim = 5, k = 10;
+    umappp::NeighborList<int, double> neighbors;
+
+    umappp::CompressedNeighborList<int, double> symmetrize(const std::string& directory, size_t& num_runs, size_t max_fan_in = 64, size_t* max_files = NULL) const {
+        umappp::ExternalSymmetrizer<int, double> sym(nobs, budget, directory, max_fan_in);
+        for (int i = 0; i < nobs; ++i) {
+            for (const auto& nn : neighbors[i]) {
+                sym.add(i, nn.first, nn.second);
+                if (max_files) {
+                    *max_files = std::max(*max_files, sym.num_files());
+                }
+            }
+        }
+        num_runs = sym.num_runs();
+        return sym.finish(mix_ratio);
+    }
+};
+
+TEST_P(ExternalSymmetrizeTest, Basic) {
+    auto ref = neighbors;
+    umappp::combine_neighbor_sets(ref, mix_ratio);
+
+    size_t num_runs;
+    auto output = symmetrize("", num_runs);
+    EXPECT_EQ(umappp::to_neighbor_list(output), ref);
+    EXPECT_EQ(output.entries.size(), output.entries.capacity());
+
+    const size_t total = static_cast<size_t>(nobs) * k;
+    if (budget >= total * 100) {
+        EXPECT_EQ(num_runs, 0);
+    } else {
+        EXPECT_GT(num_runs, 1);
+    }
+}
+
+TEST_P(ExternalSymmetrizeTest, Directory) {
+    auto ref = neighbors;
+    umappp::combine_neighbor_sets(ref, mix_ratio);
+
+    auto dir = std::filesystem::temp_directory_path() / "umappp-external-symmetrize-test";
+    std::filesystem::create_directories(dir);
+
+    size_t num_runs;
+    auto output = symmetrize(dir.string(), num_runs);
+    EXPECT_EQ(umappp::to_neighbor_list(output), ref);
+
+    // All temporary files are removed afterwards.
+    EXPECT_TRUE(std::filesystem::is_empty(dir));
+    std::filesystem::remove_all(dir);
+}
+
+TEST_P(ExternalSymmetrizeTest, FanIn) {
+    auto ref = neighbors;
+    umappp::combine_neighbor_sets(ref, mix_ratio);
+
+    for (size_t fan_in : { 2, 3, 5 }) {
+        size_t num_runs, max_files = 0;
+        auto output = symmetrize("", num_runs, fan_in, &max_files);
+        EXPECT_EQ(umappp::to_neighbor_list(output), ref);
+
+        // Runs are merged as they are created, so the number of open files
+        // only grows logarithmically with the number of runs.
+        size_t num_levels = 1;
+        for (size_t capacity = fan_in; capacity < num_runs; capacity *= fan_in) {
+            ++num_levels;
+        }
+        EXPECT_LE(max_files, (fan_in - 1) * num_levels);
+        if (num_runs > fan_in) {
+            EXPECT_LT(max_files, num_runs);
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    ExternalSymmetrize,
+    ExternalSymmetrizeTest,
+    ::testing::Combine(
+        ::testing::Values(50, 200), // number of observations
+        ::testing::Values(0.0, 0.5, 1.0), // mix ratio
+        ::testing::Values(100, 5000, 10000000) // memory budget
+    )
+);
+
+TEST(ExternalSymmetrize, Empty) {
+    umappp::ExternalSymmetrizer<int, double> sym(10, 100, "");
+    auto output = sym.finish(1);
+    EXPECT_EQ(output.size(), 10);
+    EXPECT_TRUE(output.entries.empty());
+}
+
+TEST(ExternalSymmetrize, DefaultFanIn) {
+    // Small budgets use the minimum fan-in.
+    EXPECT_EQ((umappp::ExternalSymmetrizer<int, double>(10, 100, "").fan_in()), 2);
+    // Each chunk should have at least 1024 records.
+    umappp::ExternalSymmetrizer<int, double> medium(10, 24 * 1024 * 10, "");
+    EXPECT_EQ(medium.fan_in(), 9);
+    // Fan-in is capped for large budgets.
+    EXPECT_EQ((umappp::ExternalSymmetrizer<int, double>(10, 1000000000, "").fan_in()), 64);
+    EXPECT_EQ((umappp::ExternalSymmetrizer<int, double>(10, 1000000000, "", 16).fan_in()), 16);
+}
+
+TEST(ExternalSymmetrize, BadDirectory) {
+    umappp::ExternalSymmetrizer<int, double> sym(10, 1, "/this/does/not/exist");
+    EXPECT_ANY_THROW(sym.add(0, 1, 0.5));
+}
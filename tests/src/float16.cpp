@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+
+#include "umappp/float16.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+TEST(Float16, RoundTrip) {
+    // Every half-precision value is exactly representable in single precision.
+    for (std::uint32_t b = 0; b < 65536; ++b) {
+        const auto h = umappp::Float16::from_bits(b);
+        const float f = h;
+        if (std::isnan(f)) {
+            EXPECT_EQ(b & 0x7c00, 0x7c00);
+            EXPECT_NE(b & 0x3ff, 0);
+            EXPECT_TRUE(std::isnan(static_cast<float>(umappp::Float16(f))));
+        } else {
+            EXPECT_EQ(umappp::Float16(f).bits(), b);
+        }
+    }
+}
+
+TEST(Float16, Values) {
+    EXPECT_EQ(umappp::Float16(0.f).bits(), 0);
+    EXPECT_EQ(umappp::Float16(-0.f).bits(), 0x8000);
+    EXPECT_EQ(umappp::Float16(1.f).bits(), 0x3c00);
+    EXPECT_EQ(umappp::Float16(-2.f).bits(), 0xc000);
+    EXPECT_EQ(umappp::Float16(65504.f).bits(), 0x7bff);
+    EXPECT_EQ(static_cast<float>(umappp::Float16::from_bits(0x0001)), std::ldexp(1.f, -24)); // smallest subnormal.
+    EXPECT_EQ(static_cast<float>(umappp::Float16::from_bits(0x0400)), std::ldexp(1.f, -14)); // smallest normal.
+
+    // Overflow and infinities.
+    EXPECT_EQ(umappp::Float16(65520.f).bits(), 0x7c00);
+    EXPECT_EQ(umappp::Float16(1e10f).bits(), 0x7c00);
+    EXPECT_EQ(umappp::Float16(-std::numeric_limits<float>::infinity()).bits(), 0xfc00);
+    EXPECT_EQ(static_cast<float>(umappp::Float16::from_bits(0x7c00)), std::numeric_limits<float>::infinity());
+
+    // Underflow.
+    EXPECT_EQ(umappp::Float16(std::ldexp(1.f, -26)).bits(), 0);
+    EXPECT_EQ(umappp::Float16(-std::ldexp(1.f, -26)).bits(), 0x8000);
+}
+
+TEST(Float16, Rounding) {
+    // Ties go to the nearest even mantissa.
+    const float ulp = std::ldexp(1.f, -10);
+    EXPECT_EQ(umappp::Float16(1.f + ulp / 2).bits(), 0x3c00);
+    EXPECT_EQ(umappp::Float16(1.f + ulp * 1.5f).bits(), 0x3c02);
+    EXPECT_EQ(umappp::Float16(1.f + ulp * 0.51f).bits(), 0x3c01);
+    EXPECT_EQ(umappp::Float16(1.f + ulp * 0.49f).bits(), 0x3c00);
+
+    // Same for subnormals.
+    const float sub = std::ldexp(1.f, -24);
+    EXPECT_EQ(umappp::Float16(sub / 2).bits(), 0);
+    EXPECT_EQ(umappp::Float16(sub * 1.5f).bits(), 2);
+    EXPECT_EQ(umappp::Float16(sub * 2.5f).bits(), 2);
+
+    // Rounding into the next exponent.
+    EXPECT_EQ(umappp::Float16(2.f - ulp / 4).bits(), 0x4000);
+}
+
+TEST(Float16, Arithmetic) {
+    umappp::Float16 x(1.f);
+    x += 0.5f;
+    EXPECT_EQ(static_cast<float>(x), 1.5f);
+    x -= 2.f;
+    EXPECT_EQ(static_cast<float>(x), -0.5f);
+
+    // Small updates are lost to rounding.
+    umappp::Float16 y(1000.f);
+    y += 0.1f;
+    EXPECT_EQ(static_cast<float>(y), 1000.f);
+
+    const umappp::Float16 a(3.f), b(1.25f);
+    EXPECT_EQ(a - b, 1.75f);
+}
@@ -0,0 +1,194 @@
+#include <gtest/gtest.h>
+
+#include "umappp/neighbor_similarities.hpp"
+#include "umappp/combine_neighbor_sets.hpp"
+#include "umappp/landmark.hpp"
+#include "umappp/spectral_init.hpp"
+#include "knncolle/knncolle.hpp"
+
+#include <vector>
+#include <random>
+#include <memory>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+class LandmarkTest : public ::testing::TestWithParam<std::tuple<int, int> > {
+protected:
+    void SetUp() {
+        auto p = GetParam();
+        nobs = std::get<0>(p);
+        k = std::get<1>(p);
+
+        std::mt19937_64 rng(nobs * k); // for some variety
+        std::normal_distribution<> dist(0, 1);
+
+        std::vector<double> data(nobs * ndim);
+        for (size_t r = 0; r < data.size(); ++r) {
+            data[r] = dist(rng);
+        }
+
+        auto builder = knncolle::VptreeBuilder<int, double, double>(std::make_shared<knncolle::EuclideanDistance<double, double> >());
+        auto index = builder.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+        stored = knncolle::find_nearest_neighbors(*index, k);
+
+        umappp::neighbor_similarities(stored, umappp::NeighborSimilaritiesOptions<double>());
+        umappp::combine_neighbor_sets(stored, 1.0);
+        return;
+    }
+
+    int nobs, k;
+    int ndim = 5;
+    umappp::NeighborList<int, double> stored;
+};
+
+TEST_P(LandmarkTest, Select) {
+    const int nland = nobs / 5;
+
+    auto uniform = umappp::select_landmarks(stored, nland, umappp::LandmarkMethod::UNIFORM, 42);
+    ASSERT_EQ(uniform.size(), nland);
+    for (int l = 1; l < nland; ++l) {
+        EXPECT_LT(uniform[l - 1], uniform[l]);
+    }
+    EXPECT_EQ(uniform, umappp::select_landmarks(stored, nland, umappp::LandmarkMethod::UNIFORM, 42));
+    EXPECT_NE(uniform, umappp::select_landmarks(stored, nland, umappp::LandmarkMethod::UNIFORM, 69));
+
+    auto degree = umappp::select_landmarks(stored, nland, umappp::LandmarkMethod::DEGREE, 42);
+    ASSERT_EQ(degree.size(), nland);
+    std::vector<double> degrees(nobs);
+    for (int i = 0; i < nobs; ++i) {
+        for (const auto& edge : stored[i]) {
+            degrees[i] += edge.second;
+        }
+    }
+    double min_selected = std::numeric_limits<double>::infinity();
+    std::vector<unsigned char> selected(nobs);
+    for (auto l : degree) {
+        min_selected = std::min(min_selected, degrees[l]);
+        selected[l] = 1;
+    }
+    for (int i = 0; i < nobs; ++i) {
+        if (!selected[i]) {
+            EXPECT_LE(degrees[i], min_selected);
+        }
+    }
+}
+
+TEST_P(LandmarkTest, Assign) {
+    const int nland = nobs / 5;
+    auto landmarks = umappp::select_landmarks(stored, nland, umappp::LandmarkMethod::UNIFORM, 42);
+    auto assignment = umappp::assign_to_landmarks(stored, landmarks);
+    ASSERT_EQ(assignment.size(), nobs);
+    const int total_landmarks = landmarks.size();
+    EXPECT_GE(total_landmarks, nland);
+
+    for (int l = 0; l < total_landmarks; ++l) {
+        EXPECT_EQ(assignment[landmarks[l]], l);
+    }
+    for (int i = 0; i < nobs; ++i) {
+        ASSERT_LT(assignment[i], total_landmarks);
+    }
+
+    // Each non-landmark observation has a neighbor that is assigned to the same landmark,
+    // which is the next step on its path to the landmark.
+    std::vector<unsigned char> is_landmark(nobs);
+    for (auto l : landmarks) {
+        is_landmark[l] = 1;
+    }
+    for (int i = 0; i < nobs; ++i) {
+        if (is_landmark[i]) {
+            continue;
+        }
+        bool found = false;
+        for (const auto& edge : stored[i]) {
+            found = found || assignment[edge.first] == assignment[i];
+        }
+        EXPECT_TRUE(found);
+    }
+}
+
+TEST(Landmark, AssignDisconnected) {
+    // Two separate chains, with the only landmark on the first.
+    umappp::NeighborList<int, double> graph(6);
+    graph[0] = { { 1, 1.0 } };
+    graph[1] = { { 0, 1.0 }, { 2, 1.0 } };
+    graph[2] = { { 1, 1.0 } };
+    graph[3] = { { 4, 1.0 } };
+    graph[4] = { { 3, 1.0 }, { 5, 1.0 } };
+    graph[5] = { { 4, 1.0 } };
+
+    std::vector<int> landmarks{ 1 };
+    auto assignment = umappp::assign_to_landmarks(graph, landmarks);
+    std::vector<int> expected_landmarks{ 1, 3 };
+    EXPECT_EQ(landmarks, expected_landmarks);
+    std::vector<int> expected_assignment{ 0, 0, 0, 1, 1, 1 };
+    EXPECT_EQ(assignment, expected_assignment);
+}
+
+TEST_P(LandmarkTest, Initialize) {
+    umappp::Options opt;
+    opt.a = 2;
+    opt.b = 1;
+    opt.initialize_landmark_number = nobs / 5;
+
+    int outdim = 2;
+    std::vector<int> sizes;
+    auto init = [&](const umappp::NeighborList<int, double>& landmark_graph, double* embedding) -> void {
+        sizes.push_back(landmark_graph.size());
+        umappp::random_init<int>(landmark_graph.size(), outdim, embedding, 42, 10);
+    };
+
+    std::vector<double> embedding(nobs * outdim);
+    umappp::landmark_initialize(stored, outdim, embedding.data(), opt, init);
+    ASSERT_EQ(sizes.size(), 1);
+    EXPECT_GE(sizes.front(), nobs / 5);
+    EXPECT_LT(sizes.front(), nobs);
+    for (auto e : embedding) {
+        EXPECT_TRUE(std::isfinite(e));
+    }
+
+    // Same results when repeated.
+    std::vector<double> embedding2(nobs * outdim);
+    umappp::landmark_initialize(stored, outdim, embedding2.data(), opt, init);
+    EXPECT_EQ(embedding, embedding2);
+
+    // Refinement only moves the non-landmarks.
+    {
+        auto landmarks = umappp::select_landmarks(stored, nobs / 5, umappp::LandmarkMethod::UNIFORM, opt.initialize_seed);
+        umappp::assign_to_landmarks(stored, landmarks);
+        std::vector<unsigned char> is_landmark(nobs);
+        for (auto l : landmarks) {
+            is_landmark[l] = 1;
+        }
+
+        opt.initialize_landmark_refine_epochs = 20;
+        std::vector<double> refined(nobs * outdim);
+        umappp::landmark_initialize(stored, outdim, refined.data(), opt, init);
+        EXPECT_NE(refined, embedding);
+
+        for (int i = 0; i < nobs; ++i) {
+            for (int d = 0; d < outdim; ++d) {
+                const auto o = refined[i * outdim + d];
+                EXPECT_TRUE(std::isfinite(o));
+                if (is_landmark[i]) {
+                    EXPECT_EQ(o, embedding[i * outdim + d]);
+                }
+            }
+        }
+    }
+
+    // No landmarks if there are more landmarks than observations.
+    opt.initialize_landmark_number = nobs;
+    std::vector<double> embedding3(nobs * outdim);
+    umappp::landmark_initialize(stored, outdim, embedding3.data(), opt, init);
+    EXPECT_EQ(sizes.back(), nobs);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Landmark,
+    LandmarkTest,
+    ::testing::Combine(
+        ::testing::Values(50, 100, 200), // number of observations
+        ::testing::Values(5, 10, 15) // number of neighbors
+    )
+);
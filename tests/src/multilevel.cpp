@@ -0,0 +1,168 @@
+#include <gtest/gtest.h>
+
+#include "umappp/neighbor_similarities.hpp"
+#include "umappp/combine_neighbor_sets.hpp"
+#include "umappp/multilevel.hpp"
+#include "umappp/spectral_init.hpp"
+#include "knncolle/knncolle.hpp"
+
+#include <vector>
+#include <random>
+#include <map>
+#include <memory>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+class MultilevelTest : public ::testing::TestWithParam<std::tuple<int, int> > {
+protected:
+    void SetUp() {
+        auto p = GetParam();
+        nobs = std::get<0>(p);
+        k = std::get<1>(p);
+
+        std::mt19937_64 rng(nobs * k); // for some variety
+        std::normal_distribution<> dist(0, 1);
+
+        std::vector<double> data(nobs * ndim);
+        for (size_t r = 0; r < data.size(); ++r) {
+            data[r] = dist(rng);
+        }
+
+        auto builder = knncolle::VptreeBuilder<int, double, double>(std::make_shared<knncolle::EuclideanDistance<double, double> >());
+        auto index = builder.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+        stored = knncolle::find_nearest_neighbors(*index, k);
+
+        umappp::neighbor_similarities(stored, umappp::NeighborSimilaritiesOptions<double>());
+        umappp::combine_neighbor_sets(stored, 1.0);
+        return;
+    }
+
+    int nobs, k;
+    int ndim = 5;
+    umappp::NeighborList<int, double> stored;
+};
+
+TEST_P(MultilevelTest, Coarsen) {
+    std::vector<int> assignment;
+    auto coarse = umappp::coarsen_graph(stored, assignment, static_cast<std::size_t>(-1));
+    ASSERT_EQ(assignment.size(), nobs);
+    const int ncoarse = coarse.size();
+    EXPECT_LT(ncoarse, nobs);
+    EXPECT_GE(ncoarse * 2, nobs);
+
+    // Each coarse observation has one or two members, and pairs are always neighbors.
+    std::vector<std::vector<int> > members(ncoarse);
+    for (int i = 0; i < nobs; ++i) {
+        ASSERT_LT(assignment[i], ncoarse);
+        members[assignment[i]].push_back(i);
+    }
+    for (const auto& m : members) {
+        ASSERT_GE(m.size(), 1);
+        ASSERT_LE(m.size(), 2);
+        if (m.size() == 2) {
+            bool found = false;
+            for (const auto& edge : stored[m[0]]) {
+                found = found || edge.first == m[1];
+            }
+            EXPECT_TRUE(found);
+        }
+    }
+
+    // Edge weights are summed across members, ignoring edges within each coarse observation.
+    for (int c = 0; c < ncoarse; ++c) {
+        std::map<int, double> expected;
+        for (auto m : members[c]) {
+            for (const auto& edge : stored[m]) {
+                if (assignment[edge.first] != c) {
+                    expected[assignment[edge.first]] += edge.second;
+                }
+            }
+        }
+
+        std::map<int, double> observed;
+        for (const auto& edge : coarse[c]) {
+            EXPECT_EQ(observed.count(edge.first), 0);
+            observed[edge.first] = edge.second;
+        }
+        EXPECT_EQ(expected, observed);
+    }
+
+    // Capping the number of edges keeps the largest weights, and only keeps
+    // an edge if it is among the largest for both endpoints.
+    auto capped = umappp::coarsen_graph(stored, assignment, 3);
+    ASSERT_EQ(capped.size(), coarse.size());
+    std::size_t num_capped = 0;
+    for (int c = 0; c < ncoarse; ++c) {
+        EXPECT_LE(capped[c].size(), std::min<std::size_t>(3, coarse[c].size()));
+        if (coarse[c].size() <= 3) {
+            for (const auto& edge : coarse[c]) {
+                if (coarse[edge.first].size() <= 3) {
+                    EXPECT_NE(std::find(capped[c].begin(), capped[c].end(), edge), capped[c].end());
+                }
+            }
+        } else {
+            ++num_capped;
+        }
+
+        for (const auto& edge : capped[c]) {
+            const auto& reverse = capped[edge.first];
+            auto found = std::find_if(reverse.begin(), reverse.end(), [&](const std::pair<int, double>& other) -> bool { return other.first == c; });
+            ASSERT_NE(found, reverse.end());
+            EXPECT_FLOAT_EQ(found->second, edge.second); // not exact as the summation order differs.
+        }
+
+        double min_kept = std::numeric_limits<double>::infinity();
+        for (const auto& edge : capped[c]) {
+            min_kept = std::min(min_kept, edge.second);
+        }
+        int num_larger = 0;
+        for (const auto& edge : coarse[c]) {
+            num_larger += (edge.second > min_kept);
+        }
+        EXPECT_LE(num_larger, 3);
+    }
+    EXPECT_GT(num_capped, 0);
+}
+
+TEST_P(MultilevelTest, Initialize) {
+    umappp::Options opt;
+    opt.a = 2;
+    opt.b = 1;
+    opt.initialize_multilevel_size = 10;
+
+    int outdim = 2;
+    std::vector<int> sizes;
+    auto init = [&](const umappp::NeighborList<int, double>& coarsest, double* embedding) -> void {
+        sizes.push_back(coarsest.size());
+        umappp::random_init<int>(coarsest.size(), outdim, embedding, 42, 10);
+    };
+
+    std::vector<double> embedding(nobs * outdim);
+    umappp::multilevel_initialize(stored, outdim, embedding.data(), opt, init);
+    ASSERT_EQ(sizes.size(), 1);
+    EXPECT_LT(sizes.front(), nobs);
+    for (auto e : embedding) {
+        EXPECT_TRUE(std::isfinite(e));
+    }
+
+    // Same results when repeated.
+    std::vector<double> embedding2(nobs * outdim);
+    umappp::multilevel_initialize(stored, outdim, embedding2.data(), opt, init);
+    EXPECT_EQ(embedding, embedding2);
+
+    // No coarsening if the graph is already small enough.
+    opt.initialize_multilevel_size = nobs;
+    std::vector<double> embedding3(nobs * outdim);
+    umappp::multilevel_initialize(stored, outdim, embedding3.data(), opt, init);
+    EXPECT_EQ(sizes.back(), nobs);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Multilevel,
+    MultilevelTest,
+    ::testing::Combine(
+        ::testing::Values(50, 100, 200), // number of observations
+        ::testing::Values(5, 10, 15) // number of neighbors
+    )
+);
@@ -59,21 +59,28 @@ TEST_P(OptimizeTest, Epochs) {
     stored[0][0].second = 1e-8; // check for correct removal.
 
     auto epoch = umappp::similarities_to_epochs(stored, 500, 5.0);
-    EXPECT_EQ(epoch.cumulative_num_edges.size(), nobs + 1);
-    EXPECT_EQ(epoch.edge_targets.size(), epoch.epochs_per_sample.size());
-    EXPECT_EQ(epoch.edge_targets.size(), epoch.cumulative_num_edges.back());
+    const auto& graph = *(epoch.graph);
+    EXPECT_EQ(graph.cumulative_num_edges.size(), nobs + 1);
+    EXPECT_EQ(graph.edge_targets.size(), graph.epochs_per_sample.size());
+    EXPECT_EQ(graph.edge_targets.size(), graph.cumulative_num_edges.back());
 
     // Make sure that we lost something.
     size_t total_n = 0;
     for (auto x : stored) {
         total_n += x.size();        
     }
-    EXPECT_TRUE(total_n > epoch.epochs_per_sample.size());
+    EXPECT_TRUE(total_n > graph.epochs_per_sample.size());
 
     // All survivors should be no less than 1.
-    for (auto x : epoch.epochs_per_sample) {
+    for (auto x : graph.epochs_per_sample) {
         EXPECT_TRUE(x >= 1);
     }
+
+    // Schedule is initialized from the graph.
+    EXPECT_EQ(epoch.epoch_of_next_sample, graph.epochs_per_sample);
+    EXPECT_EQ(epoch.epoch_of_next_negative_sample.size(), graph.epochs_per_sample.size());
+    EXPECT_EQ(epoch.total_epochs, 500);
+    EXPECT_EQ(epoch.current_epoch, 0);
 }
 
 TEST_P(OptimizeTest, BasicRun) {
@@ -103,6 +110,80 @@ TEST_P(OptimizeTest, RestartedRun) {
     EXPECT_EQ(embedding, embedding2);
 }
 
+TEST_P(OptimizeTest, BufferedRun) {
+    auto epoch = umappp::similarities_to_epochs(stored, 200, 5.0);
+    auto epoch2 = epoch;
+
+    std::vector<double> embedding(data);
+    std::mt19937_64 rng(10);
+    umappp::optimize_layout<>(5, embedding.data(), epoch, 2.0, 1.0, 1.0, 1.0, rng, epoch.total_epochs);
+
+    // Same results as the usual serial run, even if we restart.
+    std::vector<double> embedding2(data);
+    rng.seed(10);
+    umappp::optimize_layout_buffered<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, rng, 50);
+    EXPECT_EQ(epoch2.current_epoch, 50);
+    int counter = 0;
+    umappp::optimize_layout_buffered<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, rng, epoch2.total_epochs, 4, [&]() -> bool { return ++counter > 20; });
+    EXPECT_EQ(epoch2.current_epoch, 70);
+    umappp::optimize_layout_buffered<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, rng, epoch2.total_epochs);
+
+    EXPECT_NE(embedding2, data);
+    EXPECT_EQ(embedding, embedding2);
+}
+
+TEST_P(OptimizeTest, PrefetchedRun) {
+    auto epoch = umappp::similarities_to_epochs(stored, 200, 5.0);
+    auto epoch2 = epoch;
+    auto epoch3 = epoch;
+
+    std::vector<double> embedding(data);
+    std::mt19937_64 rng(10);
+    umappp::optimize_layout<>(5, embedding.data(), epoch, 2.0, 1.0, 1.0, 1.0, rng, epoch.total_epochs);
+
+    // Prefetching has no effect on the results, even with a large distance.
+    std::vector<double> embedding2(data);
+    rng.seed(10);
+    umappp::optimize_layout<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, rng, epoch2.total_epochs, 1000);
+    EXPECT_EQ(embedding, embedding2);
+
+    std::vector<double> embedding3(data);
+    rng.seed(10);
+    umappp::optimize_layout_buffered<>(5, embedding3.data(), epoch3, 2.0, 1.0, 1.0, 1.0, rng, epoch3.total_epochs, 8);
+    EXPECT_EQ(embedding, embedding3);
+}
+
+TEST_P(OptimizeTest, StoppedRun) {
+    auto epoch = umappp::similarities_to_epochs(stored, 200, 5.0);
+    auto epoch2 = epoch;
+
+    std::vector<double> embedding(data);
+    std::mt19937_64 rng(10);
+    umappp::optimize_layout<>(5, embedding.data(), epoch, 2.0, 1.0, 1.0, 1.0, rng, epoch.total_epochs);
+
+    // Stopping and then continuing gives the same results as an uninterrupted run.
+    std::vector<double> embedding2(data);
+    rng.seed(10);
+    int counter = 0;
+    umappp::optimize_layout<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, rng, epoch2.total_epochs, 0, [&]() -> bool { return ++counter > 37; });
+    EXPECT_EQ(epoch2.current_epoch, 37);
+    EXPECT_NE(embedding, embedding2);
+    umappp::optimize_layout<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, rng, epoch2.total_epochs);
+    EXPECT_EQ(embedding, embedding2);
+
+    // Same for the parallel run, where the pool should shut down cleanly.
+    auto epoch3 = umappp::similarities_to_epochs(stored, 200, 5.0);
+    std::vector<double> embedding3(data);
+    rng.seed(10);
+    counter = 0;
+    umappp::ParallelStatistics stats;
+    umappp::optimize_layout_parallel<>(5, embedding3.data(), epoch3, 2.0, 1.0, 1.0, 1.0, rng, epoch3.total_epochs, 3, 0, 10000, stats, false, [&]() -> bool { return ++counter > 50; });
+    EXPECT_EQ(epoch3.current_epoch, 50);
+    EXPECT_EQ(stats.num_dispatched, static_cast<std::size_t>(nobs) * 50);
+    umappp::optimize_layout_parallel<>(5, embedding3.data(), epoch3, 2.0, 1.0, 1.0, 1.0, rng, epoch3.total_epochs, 3, 0, 10000, stats, false);
+    EXPECT_EQ(embedding, embedding3);
+}
+
 TEST_P(OptimizeTest, ParallelRun) {
     auto epoch = umappp::similarities_to_epochs(stored, 500, 5.0);
     auto epoch2 = epoch;
@@ -117,13 +198,56 @@ TEST_P(OptimizeTest, ParallelRun) {
     std::vector<double> embedding2(data);
     {
         std::mt19937_64 rng(100);
-        umappp::optimize_layout_parallel<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, rng, epoch2.total_epochs, 3);
+        umappp::ParallelStatistics stats;
+        umappp::optimize_layout_parallel<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, rng, epoch2.total_epochs, 3, 0, 10000, stats, false);
+
+        EXPECT_EQ(stats.num_dispatched, static_cast<std::size_t>(nobs) * epoch2.total_epochs);
+        EXPECT_GE(stats.num_rounds, stats.num_conflicts);
+        EXPECT_EQ(stats.num_deferred, 0);
+        EXPECT_GE(stats.average_width(), 1);
+        EXPECT_LE(stats.average_width(), 3);
     }
 
     EXPECT_NE(data, embedding); // some kind of change happened!
     EXPECT_EQ(embedding, embedding2); 
 }
 
+TEST_P(OptimizeTest, ParallelLookahead) {
+    auto epoch = umappp::similarities_to_epochs(stored, 100, 5.0);
+    auto epoch2 = epoch;
+    auto epoch3 = epoch;
+
+    std::vector<double> embedding(data);
+    {
+        std::mt19937_64 rng(200);
+        umappp::optimize_layout<>(5, embedding.data(), epoch, 2.0, 1.0, 1.0, 1.0, rng, epoch.total_epochs);
+    }
+
+    // Deferring conflicting observations still gives the same results.
+    std::vector<double> embedding2(data);
+    {
+        std::mt19937_64 rng(200);
+        umappp::ParallelStatistics stats;
+        umappp::optimize_layout_parallel<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, rng, epoch2.total_epochs, 4, 3, 10000, stats, false);
+        EXPECT_EQ(stats.num_dispatched, static_cast<std::size_t>(nobs) * epoch2.total_epochs);
+        EXPECT_GT(stats.num_deferred, 0);
+        EXPECT_LE(stats.average_width(), 4);
+        EXPECT_EQ(stats.planning_time, 0);
+    }
+    EXPECT_EQ(embedding, embedding2); 
+
+    // Same results when threads yield at every iteration of the spin-lock,
+    // or when the planning section is timed.
+    std::vector<double> embedding3(data);
+    {
+        std::mt19937_64 rng(200);
+        umappp::ParallelStatistics stats;
+        umappp::optimize_layout_parallel<>(5, embedding3.data(), epoch3, 2.0, 1.0, 1.0, 1.0, rng, epoch3.total_epochs, 2, 1, 1, stats, true);
+        EXPECT_GT(stats.planning_time, 0);
+    }
+    EXPECT_EQ(embedding, embedding3); 
+}
+
 INSTANTIATE_TEST_SUITE_P(
     OptimizeLayout,
     OptimizeTest,
@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+
+#include "umappp/neighbor_similarities.hpp"
+#include "umappp/combine_neighbor_sets.hpp"
+#include "umappp/optimize_layout_accumulated.hpp"
+#include "knncolle/knncolle.hpp"
+
+#include <vector>
+#include <random>
+#include <cmath>
+#include <memory>
+
+TEST(AccumulatedUpdate, Momentum) {
+    umappp::MomentumUpdate<double> update(0.5);
+    double state = 0;
+    EXPECT_EQ(update(2, &state, 0.1), 0.2);
+    EXPECT_EQ(state, 2);
+    EXPECT_DOUBLE_EQ(update(1, &state, 0.1), 0.2);
+    EXPECT_EQ(state, 2);
+    EXPECT_DOUBLE_EQ(update(-4, &state, 1), -3);
+}
+
+TEST(AccumulatedUpdate, Adam) {
+    double state[2] = { 0, 0 };
+
+    // On the first epoch, the bias-corrected step is just the sign of the gradient.
+    umappp::AdamUpdate<double> first(0.5, 0.9, 0, 0);
+    EXPECT_DOUBLE_EQ(first(3, state, 0.1), 0.1);
+    EXPECT_DOUBLE_EQ(state[0], 1.5);
+    EXPECT_DOUBLE_EQ(state[1], 0.9);
+
+    umappp::AdamUpdate<double> second(0.5, 0.9, 0, 1);
+    const double expected_first = (0.5 * 1.5 + 0.5 * -1) / (1 - 0.25);
+    const double expected_second = (0.9 * 0.9 + 0.1 * 1) / (1 - 0.81);
+    EXPECT_DOUBLE_EQ(second(-1, state, 0.1), 0.1 * expected_first / std::sqrt(expected_second));
+}
+
+class OptimizeAccumulatedTest : public ::testing::TestWithParam<std::tuple<int, int> > {
+protected:
+    void SetUp() {
+        auto p = GetParam();
+        nobs = std::get<0>(p);
+        k = std::get<1>(p);
+
+        std::mt19937_64 rng(nobs * k); // for some variety
+        std::normal_distribution<> dist(0, 1);
+
+        data.resize(nobs * ndim);
+        for (size_t r = 0; r < data.size(); ++r) {
+            data[r] = dist(rng);
+        }
+
+        auto builder = knncolle::VptreeBuilder<int, double, double>(std::make_shared<knncolle::EuclideanDistance<double, double> >());
+        auto index = builder.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+        stored = knncolle::find_nearest_neighbors(*index, k);
+
+        umappp::neighbor_similarities(stored, umappp::NeighborSimilaritiesOptions<double>());
+        umappp::combine_neighbor_sets(stored, 1.0);
+        return;
+    }
+
+    int nobs, k;
+    int ndim = 5;
+    std::vector<double> data;
+    umappp::NeighborList<int, double> stored;
+
+    static umappp::AdamUpdate<double> create_adam(const int epoch) {
+        return umappp::AdamUpdate<double>(0.5, 0.9, 1e-7, epoch);
+    }
+};
+
+TEST_P(OptimizeAccumulatedTest, BasicRun) {
+    auto epoch = umappp::similarities_to_epochs<int, double>(stored, 200, 5.0);
+    auto epoch2 = epoch;
+
+    std::vector<double> embedding(data);
+    umappp::optimize_layout_accumulated<>(5, embedding.data(), epoch, 2.0, 1.0, 1.0, 1.0, create_adam, 42, epoch.total_epochs, 1);
+    EXPECT_EQ(epoch.current_epoch, 200);
+    EXPECT_EQ(epoch.optimizer_state.size(), data.size() * 2);
+
+    EXPECT_NE(embedding, data); // some kind of change happened!
+    for (auto e : embedding) {
+        EXPECT_FALSE(std::isnan(e));
+    }
+
+    // Same results regardless of the number of threads.
+    std::vector<double> embedding2(data);
+    umappp::optimize_layout_accumulated<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, create_adam, 42, epoch2.total_epochs, 3);
+    EXPECT_EQ(embedding, embedding2);
+
+    // Different results with a different policy.
+    auto epoch3 = umappp::similarities_to_epochs<int, double>(stored, 200, 5.0);
+    std::vector<double> embedding3(data);
+    umappp::optimize_layout_accumulated<>(5, embedding3.data(), epoch3, 2.0, 1.0, 1.0, 0.25, [](int) -> umappp::MomentumUpdate<double> {
+        return umappp::MomentumUpdate<double>(0.5);
+    }, 42, epoch3.total_epochs, 1);
+    EXPECT_EQ(epoch3.optimizer_state.size(), data.size());
+    EXPECT_NE(embedding, embedding3);
+    for (auto e : embedding3) {
+        EXPECT_FALSE(std::isnan(e));
+    }
+}
+
+TEST_P(OptimizeAccumulatedTest, StoppedRun) {
+    auto epoch = umappp::similarities_to_epochs<int, double>(stored, 200, 5.0);
+    auto epoch2 = epoch;
+
+    std::vector<double> embedding(data);
+    umappp::optimize_layout_accumulated<>(5, embedding.data(), epoch, 2.0, 1.0, 1.0, 1.0, create_adam, 42, epoch.total_epochs, 1);
+
+    // Stopping and then continuing gives the same results as an uninterrupted run,
+    // as the optimizer state is preserved in the epoch data.
+    std::vector<double> embedding2(data);
+    int counter = 0;
+    umappp::optimize_layout_accumulated<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, create_adam, 42, epoch2.total_epochs, 1, [&]() -> bool { return ++counter > 66; });
+    EXPECT_EQ(epoch2.current_epoch, 66);
+    umappp::optimize_layout_accumulated<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, create_adam, 42, epoch2.total_epochs, 1);
+    EXPECT_EQ(epoch2.current_epoch, 200);
+    EXPECT_EQ(embedding, embedding2);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    OptimizeLayoutAccumulated,
+    OptimizeAccumulatedTest,
+    ::testing::Combine(
+        ::testing::Values(50, 100, 200), // number of observations
+        ::testing::Values(5, 10, 15) // number of neighbors
+    )
+);
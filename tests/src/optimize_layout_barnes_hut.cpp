@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+
+#include "umappp/neighbor_similarities.hpp"
+#include "umappp/combine_neighbor_sets.hpp"
+#include "umappp/optimize_layout_barnes_hut.hpp"
+#include "knncolle/knncolle.hpp"
+
+#include <vector>
+#include <random>
+#include <cmath>
+#include <memory>
+#include <algorithm>
+
+class OptimizeBarnesHutTest : public ::testing::TestWithParam<std::tuple<int, int> > {
+protected:
+    void SetUp() {
+        auto p = GetParam();
+        nobs = std::get<0>(p);
+        k = std::get<1>(p);
+
+        std::mt19937_64 rng(nobs * k); // for some variety
+        std::normal_distribution<> dist(0, 1);
+
+        data.resize(nobs * ndim);
+        for (size_t r = 0; r < data.size(); ++r) {
+            data[r] = dist(rng);
+        }
+
+        auto builder = knncolle::VptreeBuilder<int, double, double>(std::make_shared<knncolle::EuclideanDistance<double, double> >());
+        auto index = builder.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+        stored = knncolle::find_nearest_neighbors(*index, k);
+
+        umappp::neighbor_similarities(stored, umappp::NeighborSimilaritiesOptions<double>());
+        umappp::combine_neighbor_sets(stored, 1.0);
+        return;
+    }
+
+    int nobs, k;
+    int ndim = 5;
+    std::vector<double> data;
+    umappp::NeighborList<int, double> stored;
+};
+
+TEST_P(OptimizeBarnesHutTest, Repulsion) {
+    const double a = 2, b = 1, gamma = 1;
+
+    // Computing the exact forces for comparison.
+    std::vector<double> exact(data.size());
+    for (int i = 0; i < nobs; ++i) {
+        auto self = data.data() + i * ndim;
+        auto output = exact.data() + i * ndim;
+        for (int j = 0; j < nobs; ++j) {
+            if (j == i) {
+                continue;
+            }
+            auto other = data.data() + j * ndim;
+            const double dist2 = umappp::quick_squared_distance<double>(self, other, ndim);
+            const double grad_coef = 2 * gamma * b / ((0.001 + dist2) * (a * std::pow(dist2, b) + 1.0));
+            for (int d = 0; d < ndim; ++d) {
+                output[d] += umappp::clamp(grad_coef * (self[d] - other[d]));
+            }
+        }
+    }
+
+    umappp::BarnesHutTree<int, double> tree(ndim);
+    tree.build(nobs, data.data());
+    std::vector<double> buffer(ndim);
+
+    // A theta of zero gives the exact forces, up to round-off.
+    for (int i = 0; i < nobs; ++i) {
+        tree.compute_repulsion(i, a, b, gamma, 0, buffer.data());
+        for (int d = 0; d < ndim; ++d) {
+            EXPECT_NEAR(buffer[d], exact[i * ndim + d], 1e-8);
+        }
+    }
+
+    // Larger thetas give an approximation.
+    double total_error = 0, total_norm = 0;
+    for (int i = 0; i < nobs; ++i) {
+        tree.compute_repulsion(i, a, b, gamma, 0.5 * 0.5, buffer.data());
+        for (int d = 0; d < ndim; ++d) {
+            const double expected = exact[i * ndim + d];
+            const double delta = buffer[d] - expected;
+            total_error += delta * delta;
+            total_norm += expected * expected;
+        }
+    }
+    EXPECT_LT(total_error, total_norm * 0.01);
+
+    // Still a reasonable approximation at a large theta.
+    total_error = 0;
+    for (int i = 0; i < nobs; ++i) {
+        tree.compute_repulsion(i, a, b, gamma, 0.8 * 0.8, buffer.data());
+        for (int d = 0; d < ndim; ++d) {
+            const double delta = buffer[d] - exact[i * ndim + d];
+            total_error += delta * delta;
+        }
+    }
+    EXPECT_LT(total_error, total_norm * 0.05);
+
+    // Building the tree again gives the same results.
+    tree.build(nobs, data.data());
+    std::vector<double> buffer2(ndim);
+    for (int i = 0; i < nobs; ++i) {
+        tree.compute_repulsion(i, a, b, gamma, 0.5 * 0.5, buffer.data());
+        tree.compute_repulsion(i, a, b, gamma, 0.5 * 0.5, buffer2.data());
+        EXPECT_EQ(buffer, buffer2);
+    }
+}
+
+TEST(OptimizeBarnesHut, SelfExclusion) {
+    // One observation at the origin and a tight cluster at (1, 1). The root
+    // node contains everything, and its center of mass is far enough from the
+    // origin for the root to be approximated at large theta; this checks that
+    // the observation does not contribute to its own repulsion.
+    const int nobs = 20, ndim = 2;
+    const double a = 2, b = 1, gamma = 1;
+    std::vector<double> data(nobs * ndim);
+    std::mt19937_64 rng(99);
+    std::uniform_real_distribution<> jitter(-0.005, 0.005);
+    for (int i = 1; i < nobs; ++i) {
+        data[i * ndim] = 1 + jitter(rng);
+        data[i * ndim + 1] = 1 + jitter(rng);
+    }
+
+    // Only checking the observation at the origin, as the approximation
+    // within the cluster is less accurate at large theta.
+    std::vector<double> exact(ndim);
+    for (int j = 1; j < nobs; ++j) {
+        auto other = data.data() + j * ndim;
+        const double dist2 = umappp::quick_squared_distance<double>(data.data(), other, ndim);
+        const double grad_coef = 2 * gamma * b / ((0.001 + dist2) * (a * std::pow(dist2, b) + 1.0));
+        for (int d = 0; d < ndim; ++d) {
+            exact[d] += umappp::clamp(grad_coef * (data[d] - other[d]));
+        }
+    }
+
+    umappp::BarnesHutTree<int, double> tree(ndim);
+    tree.build(nobs, data.data());
+    std::vector<double> buffer(ndim);
+    for (double theta : { 0.8, 1.0, 2.0 }) {
+        tree.compute_repulsion(0, a, b, gamma, theta * theta, buffer.data());
+        for (int d = 0; d < ndim; ++d) {
+            EXPECT_NEAR(buffer[d], exact[d], std::abs(exact[d]) * 0.01);
+        }
+    }
+}
+
+TEST_P(OptimizeBarnesHutTest, BasicRun) {
+    auto epoch = umappp::similarities_to_epochs<int, double>(stored, 200, 5.0);
+    auto epoch2 = epoch;
+
+    std::vector<double> embedding(data);
+    umappp::optimize_layout_barnes_hut<>(5, embedding.data(), epoch, 2.0, 1.0, 1.0, 1.0, 0.5, epoch.total_epochs, 1);
+    EXPECT_EQ(epoch.current_epoch, 200);
+
+    EXPECT_NE(embedding, data); // some kind of change happened!
+    for (auto e : embedding) {
+        EXPECT_FALSE(std::isnan(e));
+    }
+
+    // Same results regardless of the number of threads.
+    std::vector<double> embedding2(data);
+    umappp::optimize_layout_barnes_hut<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, 0.5, epoch2.total_epochs, 3);
+    EXPECT_EQ(embedding, embedding2);
+}
+
+TEST_P(OptimizeBarnesHutTest, StoppedRun) {
+    auto epoch = umappp::similarities_to_epochs<int, double>(stored, 200, 5.0);
+    auto epoch2 = epoch;
+
+    std::vector<double> embedding(data);
+    umappp::optimize_layout_barnes_hut<>(5, embedding.data(), epoch, 2.0, 1.0, 1.0, 1.0, 0.5, epoch.total_epochs, 1);
+
+    // Stopping and then continuing gives the same results as an uninterrupted run.
+    std::vector<double> embedding2(data);
+    int counter = 0;
+    umappp::optimize_layout_barnes_hut<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, 0.5, epoch2.total_epochs, 1, [&]() -> bool { return ++counter > 66; });
+    EXPECT_EQ(epoch2.current_epoch, 66);
+    umappp::optimize_layout_barnes_hut<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, 0.5, epoch2.total_epochs, 1);
+    EXPECT_EQ(epoch2.current_epoch, 200);
+    EXPECT_EQ(embedding, embedding2);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    OptimizeLayoutBarnesHut,
+    OptimizeBarnesHutTest,
+    ::testing::Combine(
+        ::testing::Values(50, 100, 200), // number of observations
+        ::testing::Values(5, 10, 15) // number of neighbors
+    )
+);
@@ -0,0 +1,207 @@
+#include <gtest/gtest.h>
+
+#include "umappp/neighbor_similarities.hpp"
+#include "umappp/combine_neighbor_sets.hpp"
+#include "umappp/optimize_layout_batched.hpp"
+#include "knncolle/knncolle.hpp"
+
+#include <vector>
+#include <stdexcept>
+#include <random>
+#include <cmath>
+#include <memory>
+
+class OptimizeBatchedTest : public ::testing::TestWithParam<std::tuple<int, int> > {
+protected:
+    void SetUp() {
+        auto p = GetParam();
+        nobs = std::get<0>(p);
+        k = std::get<1>(p);
+
+        std::mt19937_64 rng(nobs * k); // for some variety
+        std::normal_distribution<> dist(0, 1);
+
+        data.resize(nobs * ndim);
+        for (size_t r = 0; r < data.size(); ++r) {
+            data[r] = dist(rng);
+        }
+
+        auto builder = knncolle::VptreeBuilder<int, double, double>(std::make_shared<knncolle::EuclideanDistance<double, double> >());
+        auto index = builder.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+        stored = knncolle::find_nearest_neighbors(*index, k);
+
+        umappp::neighbor_similarities(stored, umappp::NeighborSimilaritiesOptions<double>());
+        umappp::combine_neighbor_sets(stored, 1.0);
+        return;
+    }
+
+    umappp::EpochData<int, double> create_epochs(const int num_epochs) const {
+        auto graph = umappp::similarities_to_graph(stored, num_epochs);
+        umappp::color_observations(graph);
+        return umappp::create_epoch_data(std::make_shared<const umappp::EpochGraph<int, double> >(std::move(graph)), num_epochs, 5.0);
+    }
+
+    int nobs, k;
+    int ndim = 5;
+    std::vector<double> data;
+    umappp::NeighborList<int, double> stored;
+};
+
+TEST_P(OptimizeBatchedTest, Coloring) {
+    auto graph = umappp::similarities_to_graph(stored, 500);
+    umappp::color_observations(graph);
+
+    ASSERT_FALSE(graph.batch_pointers.empty());
+    EXPECT_EQ(graph.batch_pointers.front(), 0);
+    EXPECT_EQ(graph.batch_pointers.back(), nobs);
+    EXPECT_EQ(graph.batch_observations.size(), nobs);
+
+    // Each observation should be present exactly once.
+    std::vector<int> batch_of(nobs, -1);
+    const int num_batches = graph.batch_pointers.size() - 1;
+    for (int b = 0; b < num_batches; ++b) {
+        EXPECT_LT(graph.batch_pointers[b], graph.batch_pointers[b + 1]); // no empty batches.
+        for (auto o = graph.batch_pointers[b]; o < graph.batch_pointers[b + 1]; ++o) {
+            const auto obs = graph.batch_observations[o];
+            EXPECT_EQ(batch_of[obs], -1);
+            batch_of[obs] = b;
+        }
+    }
+
+    // No observation should share a batch with a neighbor or a neighbor's neighbor.
+    for (int i = 0; i < nobs; ++i) {
+        for (auto j = graph.cumulative_num_edges[i]; j < graph.cumulative_num_edges[i + 1]; ++j) {
+            const auto neighbor = graph.edge_targets[j];
+            EXPECT_NE(batch_of[i], batch_of[neighbor]);
+            for (auto j2 = graph.cumulative_num_edges[neighbor]; j2 < graph.cumulative_num_edges[neighbor + 1]; ++j2) {
+                const auto neighbor2 = graph.edge_targets[j2];
+                if (neighbor2 != i) {
+                    EXPECT_NE(batch_of[i], batch_of[neighbor2]);
+                }
+            }
+        }
+    }
+}
+
+TEST_P(OptimizeBatchedTest, BasicRun) {
+    auto epoch = create_epochs(500);
+
+    std::vector<double> embedding(data);
+    umappp::ParallelStatistics stats;
+    umappp::optimize_layout_batched<>(5, embedding.data(), epoch, 2.0, 1.0, 1.0, 1.0, 42, epoch.total_epochs, 1, 10000, stats);
+    EXPECT_EQ(epoch.current_epoch, 500);
+
+    EXPECT_NE(embedding, data); // some kind of change happened!
+    for (auto e : embedding) {
+        EXPECT_FALSE(std::isnan(e));
+    }
+
+    EXPECT_EQ(stats.num_dispatched, static_cast<std::size_t>(nobs) * 500);
+    EXPECT_EQ(stats.num_rounds, (epoch.graph->batch_pointers.size() - 1) * 500);
+
+    // Different seeds give different results.
+    auto epoch2 = create_epochs(500);
+    std::vector<double> embedding2(data);
+    umappp::optimize_layout_batched<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, 43, epoch2.total_epochs, 1, 10000, stats);
+    EXPECT_NE(embedding, embedding2);
+}
+
+TEST_P(OptimizeBatchedTest, RestartedRun) {
+    auto epoch = create_epochs(500);
+    umappp::ParallelStatistics stats;
+
+    std::vector<double> embedding(data);
+    umappp::optimize_layout_batched<>(5, embedding.data(), epoch, 2.0, 1.0, 1.0, 1.0, 42, 123, 1, 10000, stats);
+    EXPECT_EQ(epoch.current_epoch, 123);
+    umappp::optimize_layout_batched<>(5, embedding.data(), epoch, 2.0, 1.0, 1.0, 1.0, 42, epoch.total_epochs, 1, 10000, stats);
+
+    // Same results from a full single run.
+    std::vector<double> embedding2(data);
+    epoch = create_epochs(500);
+    umappp::optimize_layout_batched<>(5, embedding2.data(), epoch, 2.0, 1.0, 1.0, 1.0, 42, epoch.total_epochs, 1, 10000, stats);
+
+    EXPECT_EQ(embedding, embedding2);
+}
+
+TEST_P(OptimizeBatchedTest, StoppedRun) {
+    auto epoch = create_epochs(200);
+    umappp::ParallelStatistics stats;
+
+    std::vector<double> embedding(data);
+    umappp::optimize_layout_batched<>(5, embedding.data(), epoch, 2.0, 1.0, 1.0, 1.0, 42, epoch.total_epochs, 1, 10000, stats);
+
+    // Stopping and then continuing gives the same results as an uninterrupted run.
+    for (int nthreads = 1; nthreads <= 3; nthreads += 2) {
+        auto epoch2 = create_epochs(200);
+        std::vector<double> embedding2(data);
+        umappp::ParallelStatistics stats2;
+        int counter = 0;
+        umappp::optimize_layout_batched<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, 42, epoch2.total_epochs, nthreads, 10000, stats2, [&]() -> bool { return ++counter > 77; });
+        EXPECT_EQ(epoch2.current_epoch, 77);
+        EXPECT_EQ(stats2.num_dispatched, static_cast<std::size_t>(nobs) * 77);
+
+        umappp::optimize_layout_batched<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, 42, epoch2.total_epochs, nthreads, 10000, stats2);
+        EXPECT_EQ(epoch2.current_epoch, 200);
+        EXPECT_EQ(embedding, embedding2);
+    }
+}
+
+TEST_P(OptimizeBatchedTest, ParallelRun) {
+    auto epoch = create_epochs(200);
+    auto epoch2 = epoch;
+    auto epoch3 = epoch;
+    umappp::ParallelStatistics stats;
+
+    std::vector<double> embedding(data);
+    umappp::optimize_layout_batched<>(5, embedding.data(), epoch, 2.0, 1.0, 1.0, 1.0, 42, epoch.total_epochs, 1, 10000, stats);
+
+    // Same results regardless of the number of threads.
+    std::vector<double> embedding2(data);
+    umappp::optimize_layout_batched<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, 42, epoch2.total_epochs, 2, 10000, stats);
+    EXPECT_EQ(embedding, embedding2);
+
+    std::vector<double> embedding3(data);
+    umappp::optimize_layout_batched<>(5, embedding3.data(), epoch3, 2.0, 1.0, 1.0, 1.0, 42, epoch3.total_epochs, 3, 10000, stats);
+    EXPECT_EQ(embedding, embedding3);
+}
+
+TEST_P(OptimizeBatchedTest, Workspace) {
+    auto epoch = create_epochs(200);
+    umappp::ParallelStatistics stats;
+    std::vector<double> embedding(data);
+    umappp::optimize_layout_batched<>(5, embedding.data(), epoch, 2.0, 1.0, 1.0, 1.0, 42, epoch.total_epochs, 1, 10000, stats);
+
+    // Worker threads are retained in the workspace across calls.
+    auto epoch2 = create_epochs(200);
+    std::vector<double> embedding2(data);
+    umappp::OptimizeWorkspace<int, double, double> workspace;
+    for (int limit = 50; limit <= 200; limit += 50) {
+        umappp::optimize_layout_batched<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, 42, limit, 3, 10000, stats, umappp::NeverStop(), false, &workspace);
+        EXPECT_EQ(workspace.pool.num_workers(), 2);
+    }
+    EXPECT_EQ(embedding, embedding2);
+
+    // Exceptions in the stopping condition are propagated after the workers have finished.
+    auto epoch3 = create_epochs(200);
+    std::vector<double> embedding3(data);
+    int counter = 0;
+    EXPECT_ANY_THROW(umappp::optimize_layout_batched<>(5, embedding3.data(), epoch3, 2.0, 1.0, 1.0, 1.0, 42, epoch3.total_epochs, 3, 10000, stats, [&]() -> bool {
+        if (++counter > 20) {
+            throw std::runtime_error("stop!");
+        }
+        return false;
+    }, false, &workspace));
+    EXPECT_EQ(epoch3.current_epoch, 20);
+
+    umappp::optimize_layout_batched<>(5, embedding3.data(), epoch3, 2.0, 1.0, 1.0, 1.0, 42, epoch3.total_epochs, 3, 10000, stats, umappp::NeverStop(), false, &workspace);
+    EXPECT_EQ(embedding, embedding3);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    OptimizeLayoutBatched,
+    OptimizeBatchedTest,
+    ::testing::Combine(
+        ::testing::Values(50, 100, 200), // number of observations
+        ::testing::Values(5, 10, 15) // number of neighbors
+    )
+);
@@ -0,0 +1,213 @@
+#include <gtest/gtest.h>
+
+#include "umappp/neighbor_similarities.hpp"
+#include "umappp/combine_neighbor_sets.hpp"
+#include "umappp/optimize_layout_minibatch.hpp"
+#include "knncolle/knncolle.hpp"
+
+#include <vector>
+#include <random>
+#include <cmath>
+#include <memory>
+
+class OptimizeMinibatchTest : public ::testing::TestWithParam<std::tuple<int, int> > {
+protected:
+    void SetUp() {
+        auto p = GetParam();
+        nobs = std::get<0>(p);
+        k = std::get<1>(p);
+
+        std::mt19937_64 rng(nobs * k); // for some variety
+        std::normal_distribution<> dist(0, 1);
+
+        data.resize(nobs * ndim);
+        for (size_t r = 0; r < data.size(); ++r) {
+            data[r] = dist(rng);
+        }
+
+        auto builder = knncolle::VptreeBuilder<int, double, double>(std::make_shared<knncolle::EuclideanDistance<double, double> >());
+        auto index = builder.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+        stored = knncolle::find_nearest_neighbors(*index, k);
+
+        umappp::neighbor_similarities(stored, umappp::NeighborSimilaritiesOptions<double>());
+        umappp::combine_neighbor_sets(stored, 1.0);
+        return;
+    }
+
+    int nobs, k;
+    int ndim = 5;
+    std::vector<double> data;
+    umappp::NeighborList<int, double> stored;
+};
+
+TEST_P(OptimizeMinibatchTest, AliasTable) {
+    auto graph = umappp::similarities_to_graph(stored, 500);
+    auto table = umappp::build_edge_alias_table(graph);
+    const auto num_edges = graph.edge_targets.size();
+    ASSERT_EQ(table.probability.size(), num_edges);
+    ASSERT_EQ(table.alias.size(), num_edges);
+    ASSERT_EQ(table.sources.size(), num_edges);
+
+    for (int i = 0; i < nobs; ++i) {
+        for (auto j = graph.cumulative_num_edges[i]; j < graph.cumulative_num_edges[i + 1]; ++j) {
+            EXPECT_EQ(table.sources[j], i);
+        }
+    }
+
+    // Reconstructing the sampling probability of each edge from the table.
+    std::vector<double> mass(num_edges);
+    double total = 0;
+    for (std::size_t j = 0; j < num_edges; ++j) {
+        EXPECT_GE(table.probability[j], 0);
+        EXPECT_LE(table.probability[j], 1);
+        mass[j] += table.probability[j];
+        mass[table.alias[j]] += 1 - table.probability[j];
+        total += 1 / graph.epochs_per_sample[j];
+    }
+    for (std::size_t j = 0; j < num_edges; ++j) {
+        EXPECT_NEAR(mass[j] / num_edges, 1 / graph.epochs_per_sample[j] / total, 1e-8);
+    }
+    EXPECT_TRUE(table.edges.empty());
+}
+
+TEST_P(OptimizeMinibatchTest, PrunedAliasTable) {
+    // Pruning a graph for a smaller number of epochs gives the same table as
+    // a graph that was created with that number of epochs.
+    auto graph = umappp::similarities_to_graph(stored, 500);
+    auto ref_graph = umappp::similarities_to_graph(stored, 5);
+    auto ref = umappp::build_edge_alias_table(ref_graph);
+    auto table = umappp::build_edge_alias_table(graph, 5);
+    EXPECT_LT(ref_graph.edge_targets.size(), graph.edge_targets.size());
+
+    EXPECT_EQ(table.probability, ref.probability);
+    EXPECT_EQ(table.alias, ref.alias);
+    EXPECT_EQ(table.sources, ref.sources);
+    ASSERT_EQ(table.edges.size(), ref_graph.edge_targets.size());
+    for (std::size_t j = 0; j < table.edges.size(); ++j) {
+        EXPECT_EQ(graph.edge_targets[table.edges[j]], ref_graph.edge_targets[j]);
+    }
+
+    // No indices are stored if nothing was pruned.
+    auto full = umappp::build_edge_alias_table(graph, 500);
+    EXPECT_TRUE(full.edges.empty());
+    EXPECT_EQ(full.probability, umappp::build_edge_alias_table(graph).probability);
+
+    // Only one table is cached for each number of epochs.
+    umappp::fill_edge_alias_table(graph, 500);
+    umappp::fill_edge_alias_table(graph, 5, true);
+    umappp::fill_edge_alias_table(graph, 500);
+    ASSERT_EQ(graph.edge_alias.size(), 2);
+    EXPECT_EQ(graph.edge_alias[1].num_epochs, 5);
+    EXPECT_EQ(graph.edge_alias[1].edges, table.edges);
+}
+
+TEST_P(OptimizeMinibatchTest, BasicRun) {
+    auto epoch = umappp::similarities_to_epochs<int, double>(stored, 200, 5.0);
+    const auto budget = umappp::default_minibatch_updates(*(epoch.graph), 200);
+    EXPECT_GT(budget, 0);
+    auto epoch2 = epoch;
+
+    std::vector<double> embedding(data);
+    umappp::ParallelStatistics stats;
+    umappp::optimize_layout_minibatch<>(5, embedding.data(), epoch, 2.0, 1.0, 1.0, 1.0, 42, budget, 100, epoch.total_epochs, 1, 0, stats);
+    EXPECT_EQ(epoch.current_epoch, 200);
+    EXPECT_EQ(stats.num_dispatched, budget);
+    EXPECT_GE(stats.num_rounds, (budget + 99) / 100);
+
+    EXPECT_NE(embedding, data); // some kind of change happened!
+    for (auto e : embedding) {
+        EXPECT_FALSE(std::isnan(e));
+    }
+
+    // Same results regardless of the number of threads.
+    std::vector<double> embedding2(data);
+    umappp::ParallelStatistics stats2;
+    umappp::optimize_layout_minibatch<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, 42, budget, 100, epoch2.total_epochs, 3, 0, stats2);
+    EXPECT_EQ(embedding, embedding2);
+    EXPECT_EQ(stats.num_rounds, stats2.num_rounds);
+}
+
+TEST_P(OptimizeMinibatchTest, StoppedRun) {
+    auto epoch = umappp::similarities_to_epochs<int, double>(stored, 200, 5.0);
+    const auto budget = umappp::default_minibatch_updates(*(epoch.graph), 200);
+    auto epoch2 = epoch;
+    umappp::ParallelStatistics stats;
+
+    std::vector<double> embedding(data);
+    umappp::optimize_layout_minibatch<>(5, embedding.data(), epoch, 2.0, 1.0, 1.0, 1.0, 42, budget, 100, epoch.total_epochs, 1, 0, stats);
+
+    // Stopping and then continuing gives the same results as an uninterrupted run.
+    std::vector<double> embedding2(data);
+    int counter = 0;
+    umappp::optimize_layout_minibatch<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, 42, budget, 100, epoch2.total_epochs, 1, 0, stats, [&]() -> bool { return ++counter > 66; });
+    EXPECT_EQ(epoch2.current_epoch, 66);
+    umappp::optimize_layout_minibatch<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, 42, budget, 100, epoch2.total_epochs, 2, 0, stats);
+    EXPECT_EQ(epoch2.current_epoch, 200);
+    EXPECT_EQ(embedding, embedding2);
+}
+
+TEST_P(OptimizeMinibatchTest, CachedAliasTable) {
+    auto epoch = umappp::similarities_to_epochs<int, double>(stored, 200, 5.0);
+    const auto budget = umappp::default_minibatch_updates(*(epoch.graph), 200);
+    auto epoch2 = epoch;
+    umappp::ParallelStatistics stats;
+
+    std::vector<double> embedding(data);
+    umappp::optimize_layout_minibatch<>(5, embedding.data(), epoch, 2.0, 1.0, 1.0, 1.0, 42, budget, 100, epoch.total_epochs, 1, 0, stats);
+
+    // Using the table that was cached with the graph gives the same results as building it on the fly.
+    auto graph = std::make_shared<umappp::EpochGraph<int, double> >(*(epoch2.graph));
+    umappp::fill_edge_alias_table(*graph, 200);
+    ASSERT_EQ(graph->edge_alias.size(), 1);
+    EXPECT_EQ(graph->edge_alias.front().sources.size(), graph->edge_targets.size());
+    epoch2.graph = graph;
+
+    std::vector<double> embedding2(data);
+    umappp::optimize_layout_minibatch<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, 42, budget, 100, epoch2.total_epochs, 1, 0, stats);
+    EXPECT_EQ(embedding, embedding2);
+}
+
+TEST_P(OptimizeMinibatchTest, Workspace) {
+    auto epoch = umappp::similarities_to_epochs<int, double>(stored, 200, 5.0);
+    const auto budget = umappp::default_minibatch_updates(*(epoch.graph), 200);
+    auto epoch2 = epoch;
+    umappp::ParallelStatistics stats;
+
+    std::vector<double> embedding(data);
+    umappp::optimize_layout_minibatch<>(5, embedding.data(), epoch, 2.0, 1.0, 1.0, 1.0, 42, budget, 100, epoch.total_epochs, 1, 0, stats);
+
+    // Worker threads are retained in the workspace across calls.
+    std::vector<double> embedding2(data);
+    umappp::OptimizeWorkspace<int, double, double> workspace;
+    for (int limit = 50; limit <= 200; limit += 50) {
+        umappp::optimize_layout_minibatch<>(5, embedding2.data(), epoch2, 2.0, 1.0, 1.0, 1.0, 42, budget, 100, limit, 2, 10000, stats, umappp::NeverStop(), false, &workspace);
+        EXPECT_EQ(workspace.pool.num_workers(), 1);
+    }
+    EXPECT_EQ(embedding, embedding2);
+}
+
+TEST_P(OptimizeMinibatchTest, Budget) {
+    auto epoch = umappp::similarities_to_epochs<int, double>(stored, 200, 5.0);
+    umappp::ParallelStatistics stats;
+
+    // No updates means no change.
+    std::vector<double> embedding(data);
+    umappp::optimize_layout_minibatch<>(5, embedding.data(), epoch, 2.0, 1.0, 1.0, 1.0, 42, 0, 100, epoch.total_epochs, 1, 0, stats);
+    EXPECT_EQ(embedding, data);
+    EXPECT_EQ(stats.num_dispatched, 0);
+
+    // Number of updates is exactly as requested, even if it doesn't divide evenly into epochs or batches.
+    auto epoch2 = umappp::similarities_to_epochs<int, double>(stored, 200, 5.0);
+    umappp::optimize_layout_minibatch<>(5, embedding.data(), epoch2, 2.0, 1.0, 1.0, 1.0, 42, 1234, 7, epoch2.total_epochs, 1, 0, stats);
+    EXPECT_EQ(stats.num_dispatched, 1234);
+    EXPECT_NE(embedding, data);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    OptimizeLayoutMinibatch,
+    OptimizeMinibatchTest,
+    ::testing::Combine(
+        ::testing::Values(50, 100, 200), // number of observations
+        ::testing::Values(5, 10, 15) // number of neighbors
+    )
+);
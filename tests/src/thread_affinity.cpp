@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+
+#include "umappp/thread_affinity.hpp"
+
+#include <vector>
+#include <thread>
+
+TEST(ThreadAffinity, Disabled) {
+    EXPECT_TRUE(umappp::available_cpus(false).empty());
+
+    std::vector<int> empty;
+    umappp::ThreadPin pin(empty, 0);
+    EXPECT_FALSE(pin.pinned());
+}
+
+TEST(ThreadAffinity, Pinned) {
+    const auto cpus = umappp::available_cpus(true);
+#ifdef UMAPPP_THREAD_AFFINITY_SUPPORTED
+    EXPECT_FALSE(cpus.empty());
+
+    {
+        umappp::ThreadPin pin(cpus, 1);
+        EXPECT_TRUE(pin.pinned());
+        const auto pinned_cpus = umappp::available_cpus(true);
+        ASSERT_EQ(pinned_cpus.size(), 1u);
+        EXPECT_EQ(pinned_cpus[0], cpus[1 % cpus.size()]);
+    }
+
+    // Affinity is restored after the pin goes out of scope.
+    EXPECT_EQ(umappp::available_cpus(true), cpus);
+
+    // Works in other threads, cycling through the CPUs.
+    std::vector<int> observed(3);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 3; ++t) {
+        workers.emplace_back([&](const int thread) -> void {
+            umappp::ThreadPin pin(cpus, thread);
+            observed[thread] = umappp::available_cpus(true).front();
+        }, t);
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    for (int t = 0; t < 3; ++t) {
+        EXPECT_EQ(observed[t], cpus[t % cpus.size()]);
+    }
+#else
+    EXPECT_TRUE(cpus.empty());
+#endif
+}
+
+TEST(ThreadAffinity, UninitializedVector) {
+    umappp::UninitializedVector<double> x(10);
+    EXPECT_EQ(x.size(), 10u);
+    std::fill(x.begin(), x.end(), 2);
+    x.push_back(5);
+    EXPECT_EQ(x.back(), 5);
+    x.resize(20);
+    EXPECT_EQ(x.size(), 20u);
+    EXPECT_EQ(x[0], 2);
+
+    umappp::UninitializedVector<double> y(5, 1.5);
+    EXPECT_EQ(y, umappp::UninitializedVector<double>({ 1.5, 1.5, 1.5, 1.5, 1.5 }));
+}
@@ -6,6 +6,8 @@
 #endif
 
 #include "umappp/initialize.hpp"
+#include "umappp/streaming.hpp"
+#include "umappp/Xoshiro256StarStar.hpp"
 #include "knncolle/knncolle.hpp"
 #include "aarand/aarand.hpp"
 
@@ -13,7 +15,17 @@
 #include <cmath>
 #include <limits>
 #include <numeric>
+#include <algorithm>
 #include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <future>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <stdexcept>
 
 class UmapTest : public ::testing::TestWithParam<std::tuple<int, int> > {
 protected:
@@ -129,6 +141,19 @@ TEST_P(UmapTest, Basic) {
 
         // Same results with multiple threads and parallel optimization enabled.
         opt.num_threads_optimize = 3;
+        // Yielding so that the tests don't crawl on machines with fewer CPUs than threads.
+        opt.optimize_spin_limit = 100;
+        {
+            std::vector<double> copy(nobs * outdim);
+            auto status = umappp::initialize(neighbors, outdim, copy.data(), opt);
+            EXPECT_EQ(status.parallel_statistics().num_dispatched, 0);
+            status.run(copy.data());
+            EXPECT_EQ(copy, output);
+            EXPECT_EQ(status.parallel_statistics().num_dispatched, static_cast<std::size_t>(nobs) * status.num_epochs());
+        }
+
+        // Same results with deferral of conflicting observations.
+        opt.optimize_lookahead = 2;
         {
             std::vector<double> copy(nobs * outdim);
             auto status = umappp::initialize(neighbors, outdim, copy.data(), opt);
@@ -147,6 +172,1264 @@ INSTANTIATE_TEST_SUITE_P(
     )
 );
 
+TEST_P(UmapTest, ColoringScheduler) {
+    int outdim = 2;
+    umappp::Options opt;
+    opt.optimize_scheduler = umappp::OptimizeScheduler::COLORING;
+
+    std::vector<double> output(nobs * outdim);
+    auto status = umappp::initialize(neighbors, outdim, output.data(), opt);
+    status.run(output.data());
+    EXPECT_EQ(status.epoch(), 500);
+    for (auto o : output){ 
+        EXPECT_FALSE(std::isnan(o));
+    }
+    EXPECT_EQ(status.parallel_statistics().num_dispatched, static_cast<std::size_t>(nobs) * status.num_epochs());
+
+    // Differs from the default scheduler.
+    {
+        std::vector<double> ref(nobs * outdim);
+        auto status = umappp::initialize(neighbors, outdim, ref.data(), umappp::Options());
+        status.run(ref.data());
+        EXPECT_NE(ref, output);
+    }
+
+    // Same results if we started a little, and then ran the rest.
+    {
+        std::vector<double> copy(nobs * outdim);
+        auto status_partial = umappp::initialize(neighbors, outdim, copy.data(), opt);
+        status_partial.run(copy.data(), 200);
+        status_partial.run(copy.data());
+        EXPECT_EQ(copy, output);
+    }
+
+    // Same results with parallel optimization.
+    {
+        opt.num_threads_optimize = 3;
+        opt.optimize_spin_limit = 100;
+        std::vector<double> copy(nobs * outdim);
+        auto status = umappp::initialize(neighbors, outdim, copy.data(), opt);
+        status.run(copy.data());
+        EXPECT_EQ(copy, output);
+    }
+}
+
+TEST_P(UmapTest, MinibatchScheduler) {
+    int outdim = 2;
+    umappp::Options opt;
+    opt.optimize_scheduler = umappp::OptimizeScheduler::MINIBATCH;
+    opt.optimize_minibatch_size = 64;
+
+    std::vector<double> output(nobs * outdim);
+    auto status = umappp::initialize(neighbors, outdim, output.data(), opt);
+    status.run(output.data());
+    EXPECT_EQ(status.epoch(), 500);
+    for (auto o : output){
+        EXPECT_FALSE(std::isnan(o));
+    }
+    const auto default_updates = status.parallel_statistics().num_dispatched;
+    EXPECT_GT(default_updates, 0);
+
+    // Differs from the default scheduler.
+    {
+        std::vector<double> ref(nobs * outdim);
+        auto status = umappp::initialize(neighbors, outdim, ref.data(), umappp::Options());
+        status.run(ref.data());
+        EXPECT_NE(ref, output);
+    }
+
+    // Same results if we started a little, and then ran the rest.
+    {
+        std::vector<double> copy(nobs * outdim);
+        auto status_partial = umappp::initialize(neighbors, outdim, copy.data(), opt);
+        status_partial.run(copy.data(), 200);
+        status_partial.run(copy.data());
+        EXPECT_EQ(copy, output);
+    }
+
+    // Same results with parallel optimization.
+    {
+        auto opt2 = opt;
+        opt2.num_threads_optimize = 3;
+        opt2.optimize_spin_limit = 100;
+        std::vector<double> copy(nobs * outdim);
+        auto status = umappp::initialize(neighbors, outdim, copy.data(), opt2);
+        status.run(copy.data());
+        EXPECT_EQ(copy, output);
+    }
+
+    // Respects the update budget.
+    {
+        auto opt2 = opt;
+        opt2.optimize_minibatch_updates = default_updates / 4;
+        std::vector<double> copy(nobs * outdim);
+        auto status = umappp::initialize(neighbors, outdim, copy.data(), opt2);
+        status.run(copy.data());
+        EXPECT_EQ(status.parallel_statistics().num_dispatched, default_updates / 4);
+        EXPECT_NE(copy, output);
+    }
+}
+
+TEST_P(UmapTest, AdaptiveMethods) {
+    int outdim = 2;
+    umappp::Options opt;
+    opt.optimize_method = umappp::OptimizeMethod::ADAM;
+    opt.num_epochs = 100;
+
+    std::vector<double> output(nobs * outdim);
+    auto status = umappp::initialize(neighbors, outdim, output.data(), opt);
+    status.run(output.data());
+    EXPECT_EQ(status.epoch(), 100);
+    for (auto o : output){
+        EXPECT_FALSE(std::isnan(o));
+    }
+
+    // Differs from SGD.
+    {
+        auto opt2 = opt;
+        opt2.optimize_method = umappp::OptimizeMethod::SGD;
+        std::vector<double> ref(nobs * outdim);
+        auto status = umappp::initialize(neighbors, outdim, ref.data(), opt2);
+        status.run(ref.data());
+        EXPECT_NE(ref, output);
+    }
+
+    // Same results if we started a little, and then ran the rest.
+    {
+        std::vector<double> copy(nobs * outdim);
+        auto status_partial = umappp::initialize(neighbors, outdim, copy.data(), opt);
+        status_partial.run(copy.data(), 40);
+        status_partial.run(copy.data());
+        EXPECT_EQ(copy, output);
+    }
+
+    // Same results with parallel optimization.
+    {
+        auto opt2 = opt;
+        opt2.num_threads_optimize = 3;
+        opt2.optimize_spin_limit = 100;
+        std::vector<double> copy(nobs * outdim);
+        auto status = umappp::initialize(neighbors, outdim, copy.data(), opt2);
+        status.run(copy.data());
+        EXPECT_EQ(copy, output);
+    }
+
+    // Works with momentum and in single precision.
+    {
+        auto opt2 = opt;
+        opt2.optimize_method = umappp::OptimizeMethod::MOMENTUM;
+        opt2.learning_rate = 0.25;
+        opt2.optimize_precision = umappp::OptimizePrecision::SINGLE;
+        std::vector<double> copy(nobs * outdim);
+        auto status = umappp::initialize(neighbors, outdim, copy.data(), opt2);
+        status.run(copy.data(), 30);
+        status.run(copy.data());
+        EXPECT_NE(copy, output);
+        for (auto o : copy){
+            EXPECT_FALSE(std::isnan(o));
+        }
+
+        std::vector<double> again(nobs * outdim);
+        auto status2 = umappp::initialize(neighbors, outdim, again.data(), opt2);
+        status2.run(again.data());
+        EXPECT_EQ(copy, again);
+    }
+}
+
+TEST_P(UmapTest, ChooseThreads) {
+    int outdim = 2;
+    umappp::Options opt;
+    opt.num_epochs = 50;
+
+    std::vector<double> ref(nobs * outdim);
+    {
+        auto status = umappp::initialize(neighbors, outdim, ref.data(), opt);
+        status.run(ref.data());
+        EXPECT_EQ(status.thread_selection().num_threads, 0);
+        EXPECT_TRUE(status.thread_selection().predicted_time.empty());
+    }
+
+    for (auto sched : { umappp::OptimizeScheduler::GREEDY, umappp::OptimizeScheduler::COLORING }) {
+        auto opt2 = opt;
+        opt2.optimize_scheduler = sched;
+        std::vector<double> expected(nobs * outdim);
+        auto status = umappp::initialize(neighbors, outdim, expected.data(), opt2);
+        status.run(expected.data());
+
+        for (auto calibrate : { false, true }) {
+            for (auto objective : { umappp::ThreadObjective::WALL_TIME, umappp::ThreadObjective::CPU_TIME }) {
+                auto opt3 = opt2;
+                opt3.optimize_choose_threads = true;
+                opt3.optimize_calibrate_threads = calibrate;
+                opt3.optimize_thread_objective = objective;
+                opt3.num_threads_optimize = 3;
+                opt3.optimize_spin_limit = 100;
+
+                std::vector<double> copy(nobs * outdim);
+                auto status = umappp::initialize(neighbors, outdim, copy.data(), opt3);
+                status.run(copy.data(), 20);
+                const auto& selected = status.thread_selection();
+                EXPECT_GE(selected.num_threads, 1);
+                EXPECT_LE(selected.num_threads, 3);
+                EXPECT_EQ(selected.predicted_time.size(), 3u);
+                EXPECT_EQ(selected.predicted_time[0], 1);
+                EXPECT_EQ(selected.calibrated, calibrate);
+
+                // Calibration and the choice of the number of threads do not affect the result.
+                status.run(copy.data());
+                EXPECT_EQ(status.thread_selection().num_threads, selected.num_threads);
+                EXPECT_EQ(copy, expected);
+            }
+        }
+    }
+}
+
+TEST_P(UmapTest, PinThreads) {
+    int outdim = 2;
+    umappp::Options opt;
+    opt.num_epochs = 50;
+    opt.num_threads_optimize = 3;
+    opt.optimize_spin_limit = 100;
+
+    const auto check = [&](const umappp::Options& ref_opt) -> void {
+        std::vector<double> expected(nobs * outdim);
+        auto status = umappp::initialize(neighbors, outdim, expected.data(), ref_opt);
+        status.run(expected.data());
+
+        auto opt2 = ref_opt;
+        opt2.optimize_pin_threads = true;
+        std::vector<double> output(nobs * outdim);
+        auto status2 = umappp::initialize(neighbors, outdim, output.data(), opt2);
+        status2.run(output.data(), 20);
+        status2.run(output.data());
+        EXPECT_EQ(output, expected);
+    };
+
+    check(opt);
+
+    for (auto sched : { umappp::OptimizeScheduler::COLORING, umappp::OptimizeScheduler::MINIBATCH }) {
+        auto opt2 = opt;
+        opt2.optimize_scheduler = sched;
+        check(opt2);
+    }
+
+    {
+        auto opt2 = opt;
+        opt2.optimize_method = umappp::OptimizeMethod::ADAM;
+        check(opt2);
+    }
+
+    {
+        auto opt2 = opt;
+        opt2.optimize_repulsion = umappp::OptimizeRepulsion::BARNES_HUT;
+        check(opt2);
+    }
+
+    // Working arrays are placed by the pinned threads.
+    for (auto prec : { umappp::OptimizePrecision::SINGLE, umappp::OptimizePrecision::HALF }) {
+        auto opt2 = opt;
+        opt2.optimize_scheduler = umappp::OptimizeScheduler::COLORING;
+        opt2.optimize_precision = prec;
+        check(opt2);
+    }
+}
+
+TEST_P(UmapTest, BarnesHut) {
+    int outdim = 2;
+    umappp::Options opt;
+    opt.optimize_repulsion = umappp::OptimizeRepulsion::BARNES_HUT;
+
+    std::vector<double> output(nobs * outdim);
+    auto status = umappp::initialize(neighbors, outdim, output.data(), opt);
+    status.run(output.data());
+    EXPECT_EQ(status.epoch(), 500);
+    for (auto o : output){
+        EXPECT_FALSE(std::isnan(o));
+    }
+
+    // Differs from negative sampling.
+    {
+        std::vector<double> ref(nobs * outdim);
+        auto status = umappp::initialize(neighbors, outdim, ref.data(), umappp::Options());
+        status.run(ref.data());
+        EXPECT_NE(ref, output);
+    }
+
+    // Same results if we started a little, and then ran the rest.
+    {
+        std::vector<double> copy(nobs * outdim);
+        auto status_partial = umappp::initialize(neighbors, outdim, copy.data(), opt);
+        status_partial.run(copy.data(), 200);
+        status_partial.run(copy.data());
+        EXPECT_EQ(copy, output);
+    }
+
+    // Same results with parallel optimization.
+    {
+        opt.num_threads_optimize = 3;
+        opt.optimize_spin_limit = 100;
+        std::vector<double> copy(nobs * outdim);
+        auto status = umappp::initialize(neighbors, outdim, copy.data(), opt);
+        status.run(copy.data());
+        EXPECT_EQ(copy, output);
+        EXPECT_EQ(status.parallel_statistics().num_dispatched, 0);
+    }
+}
+
+TEST_P(UmapTest, Multilevel) {
+    int outdim = 2;
+    umappp::Options opt;
+    opt.initialize_multilevel = true;
+    opt.initialize_multilevel_size = 20;
+    opt.num_epochs = 50;
+
+    std::vector<double> output(nobs * outdim);
+    auto status = umappp::initialize(neighbors, outdim, output.data(), opt);
+    EXPECT_EQ(status.num_epochs(), 50);
+
+    // Differs from the usual initialization.
+    {
+        auto opt2 = opt;
+        opt2.initialize_multilevel = false;
+        std::vector<double> ref(nobs * outdim);
+        umappp::initialize(neighbors, outdim, ref.data(), opt2);
+        EXPECT_NE(ref, output);
+    }
+
+    status.run(output.data());
+    for (auto o : output){
+        EXPECT_TRUE(std::isfinite(o));
+    }
+
+    // Same results if we ran it from the top.
+    {
+        std::vector<double> copy(nobs * outdim);
+        auto status2 = umappp::initialize(neighbors, outdim, copy.data(), opt);
+        status2.run(copy.data());
+        EXPECT_EQ(copy, output);
+    }
+
+    // No effect if the graph is already small enough.
+    {
+        opt.initialize_multilevel_size = nobs;
+        std::vector<double> copy(nobs * outdim);
+        umappp::initialize(neighbors, outdim, copy.data(), opt);
+
+        opt.initialize_multilevel = false;
+        std::vector<double> ref(nobs * outdim);
+        umappp::initialize(neighbors, outdim, ref.data(), opt);
+        EXPECT_EQ(copy, ref);
+    }
+}
+
+TEST_P(UmapTest, Landmark) {
+    int outdim = 2;
+    umappp::Options opt;
+    opt.initialize_landmark = true;
+    opt.initialize_landmark_number = 20;
+    opt.initialize_landmark_refine_epochs = 10;
+    opt.num_epochs = 0;
+
+    std::vector<double> output(nobs * outdim);
+    auto status = umappp::initialize(neighbors, outdim, output.data(), opt);
+    EXPECT_EQ(status.num_epochs(), 0);
+    for (auto o : output){
+        EXPECT_TRUE(std::isfinite(o));
+    }
+
+    // Differs from the usual initialization.
+    {
+        auto opt2 = opt;
+        opt2.initialize_landmark = false;
+        std::vector<double> ref(nobs * outdim);
+        umappp::initialize(neighbors, outdim, ref.data(), opt2);
+        EXPECT_NE(ref, output);
+    }
+
+    // Nothing left to do in the run.
+    auto copy = output;
+    status.run(output.data());
+    EXPECT_EQ(copy, output);
+
+    // Same results if we ran it from the top.
+    {
+        std::vector<double> again(nobs * outdim);
+        umappp::initialize(neighbors, outdim, again.data(), opt);
+        EXPECT_EQ(again, output);
+    }
+
+    // Works with degree-based selection and multilevel initialization of the landmarks.
+    {
+        auto opt2 = opt;
+        opt2.initialize_landmark_method = umappp::LandmarkMethod::DEGREE;
+        opt2.initialize_multilevel = true;
+        opt2.initialize_multilevel_size = 5;
+        std::vector<double> other(nobs * outdim);
+        umappp::initialize(neighbors, outdim, other.data(), opt2);
+        EXPECT_NE(other, output);
+        for (auto o : other){
+            EXPECT_TRUE(std::isfinite(o));
+        }
+    }
+}
+
+TEST_P(UmapTest, Update) {
+    int outdim = 2;
+    const int nadded = 5;
+    const int nexisting = nobs - nadded;
+    umappp::NeighborList<int, double> existing;
+    for (int i = 0; i < nexisting; ++i) {
+        existing.emplace_back();
+        for (const auto& nn : neighbors[i]) {
+            if (nn.first < nexisting) {
+                existing.back().push_back(nn);
+            }
+        }
+    }
+    umappp::NeighborList<int, double> added(neighbors.begin() + nexisting, neighbors.end());
+
+    umappp::Options opt;
+    std::vector<double> output(nexisting * outdim);
+    {
+        auto status = umappp::initialize(existing, outdim, output.data(), opt);
+        status.run(output.data());
+        std::vector<double> updated(nobs * outdim);
+        EXPECT_ANY_THROW(status.update(output.data(), std::vector<int>(), added, updated.data()));
+    }
+
+    opt.update_enabled = true;
+    auto status = umappp::initialize(existing, outdim, output.data(), opt);
+    status.run(output.data(), 100);
+
+    // Doesn't change the existing results.
+    {
+        std::vector<double> ref(nexisting * outdim);
+        auto ref_status = umappp::initialize(existing, outdim, ref.data(), opt);
+        ref_status.run(ref.data(), 100);
+        EXPECT_EQ(ref, output);
+    }
+
+    std::vector<double> updated(nobs * outdim);
+    status.update(output.data(), std::vector<int>(), added, updated.data());
+    const auto first_updated = updated;
+    EXPECT_EQ(status.num_observations(), nobs);
+    EXPECT_EQ(status.epoch(), 100);
+    for (auto u : updated) {
+        EXPECT_TRUE(std::isfinite(u));
+    }
+
+    // Only the neighbors of the added observations are modified.
+    std::vector<unsigned char> affected(nobs);
+    for (int i = nexisting; i < nobs; ++i) {
+        affected[i] = 1;
+        for (const auto& nn : neighbors[i]) {
+            affected[nn.first] = 1;
+            for (const auto& nn2 : neighbors[nn.first]) { // neighbors of neighbors, via symmetrization.
+                affected[nn2.first] = 1;
+            }
+        }
+    }
+    for (int i = 0; i < nexisting; ++i) {
+        if (!affected[i]) {
+            EXPECT_TRUE(std::equal(updated.begin() + i * outdim, updated.begin() + (i + 1) * outdim, output.begin() + i * outdim));
+        }
+    }
+
+    // Works in-place with removals, and optimization can be continued afterwards.
+    std::vector<int> removed{ 0, 3, nobs - 1 };
+    status.update(updated.data(), removed, umappp::NeighborList<int, double>(), updated.data());
+    EXPECT_EQ(status.num_observations(), nobs - 3);
+    updated.resize((nobs - 3) * outdim);
+    status.run(updated.data());
+    EXPECT_EQ(status.epoch(), status.num_epochs());
+    for (auto u : updated) {
+        EXPECT_TRUE(std::isfinite(u));
+    }
+
+    // Same results when repeated.
+    {
+        std::vector<double> again(nexisting * outdim);
+        auto again_status = umappp::initialize(existing, outdim, again.data(), opt);
+        again_status.run(again.data(), 100);
+        std::vector<double> again_updated(nobs * outdim);
+        again_status.update(again.data(), std::vector<int>(), added, again_updated.data());
+        again_status.update(again_updated.data(), removed, umappp::NeighborList<int, double>(), again_updated.data());
+        again_updated.resize((nobs - 3) * outdim);
+        again_status.run(again_updated.data());
+        EXPECT_EQ(again_updated, updated);
+    }
+
+    // Successive updates use different random streams.
+    {
+        std::vector<double> shifted(nexisting * outdim);
+        auto shifted_status = umappp::initialize(existing, outdim, shifted.data(), opt);
+        shifted_status.run(shifted.data(), 100);
+        shifted_status.update(shifted.data(), std::vector<int>(), umappp::NeighborList<int, double>(), shifted.data()); // no-op, apart from the update count.
+        EXPECT_EQ(shifted, output);
+        std::vector<double> shifted_updated(nobs * outdim);
+        shifted_status.update(shifted.data(), std::vector<int>(), added, shifted_updated.data());
+        EXPECT_NE(shifted_updated, first_updated);
+    }
+
+    // Uses the supplied engine.
+    {
+        std::vector<double> xoshiro(nexisting * outdim);
+        auto xoshiro_status = umappp::initialize<int, double, umappp::Xoshiro256StarStar>(existing, outdim, xoshiro.data(), opt);
+        xoshiro_status.run(xoshiro.data(), 100);
+        std::vector<double> xoshiro_updated(nobs * outdim);
+        xoshiro_status.update(xoshiro.data(), std::vector<int>(), added, xoshiro_updated.data());
+        for (auto u : xoshiro_updated) {
+            EXPECT_TRUE(std::isfinite(u));
+        }
+        EXPECT_NE(xoshiro_updated, first_updated);
+    }
+
+    // Works with other methods that carry per-observation state.
+    {
+        auto opt2 = opt;
+        opt2.optimize_method = umappp::OptimizeMethod::ADAM;
+        std::vector<double> adam(nexisting * outdim);
+        auto adam_status = umappp::initialize(existing, outdim, adam.data(), opt2);
+        adam_status.run(adam.data(), 100);
+        std::vector<double> adam_updated(nobs * outdim);
+        adam_status.update(adam.data(), std::vector<int>(), added, adam_updated.data());
+        adam_status.update(adam_updated.data(), std::vector<int>{ 1 }, umappp::NeighborList<int, double>(), adam_updated.data());
+        adam_updated.resize((nobs - 1) * outdim);
+        adam_status.run(adam_updated.data());
+        for (auto u : adam_updated) {
+            EXPECT_TRUE(std::isfinite(u));
+        }
+    }
+}
+
+TEST_P(UmapTest, Streaming) {
+    int outdim = 2;
+    umappp::Options opt;
+    std::vector<double> ref(nobs * outdim);
+    auto ref_status = umappp::initialize(neighbors, outdim, ref.data(), opt);
+
+    std::vector<double> output(nobs * outdim);
+    int counter = 0;
+    auto status = umappp::initialize_streaming(
+        nobs,
+        [&](int i, std::vector<int>& indices, std::vector<double>& distances) -> void {
+            EXPECT_EQ(i, counter);
+            ++counter;
+            indices.clear();
+            distances.clear();
+            for (const auto& nn : neighbors[i]) {
+                indices.push_back(nn.first);
+                distances.push_back(nn.second);
+            }
+        },
+        outdim,
+        output.data(),
+        opt
+    );
+    EXPECT_EQ(counter, nobs);
+    EXPECT_EQ(output, ref);
+
+    const auto& graph = *(status.get_epoch_data().graph);
+    const auto& ref_graph = *(ref_status.get_epoch_data().graph);
+    EXPECT_EQ(graph.cumulative_num_edges, ref_graph.cumulative_num_edges);
+    EXPECT_EQ(graph.edge_targets, ref_graph.edge_targets);
+    EXPECT_EQ(graph.epochs_per_sample, ref_graph.epochs_per_sample);
+
+    ref_status.run(ref.data());
+    status.run(output.data());
+    EXPECT_EQ(output, ref);
+
+    // Same for the knncolle overload.
+    {
+        auto index = builder->build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+        auto opt2 = opt;
+        opt2.num_neighbors = k;
+        opt2.num_threads = 3;
+        std::vector<double> searched(nobs * outdim);
+        auto sstatus = umappp::initialize_streaming(*index, outdim, searched.data(), opt2);
+        sstatus.run(searched.data());
+        EXPECT_EQ(searched, ref);
+    }
+
+    // Same with initializations that need the full list.
+    {
+        auto opt2 = opt;
+        opt2.initialize_multilevel = true;
+        opt2.initialize_multilevel_size = 10;
+        std::vector<double> mref(nobs * outdim);
+        umappp::initialize(neighbors, outdim, mref.data(), opt2);
+
+        auto index = builder->build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+        opt2.num_neighbors = k;
+        std::vector<double> multilevel(nobs * outdim);
+        umappp::initialize_streaming(*index, outdim, multilevel.data(), opt2);
+        EXPECT_EQ(multilevel, mref);
+    }
+
+    // Same with external symmetrization, using a budget small enough to force multiple runs.
+    {
+        auto index = builder->build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+        auto opt2 = opt;
+        opt2.num_neighbors = k;
+        opt2.symmetrize_memory_budget = 1000;
+        std::vector<double> external(nobs * outdim);
+        auto estatus = umappp::initialize_streaming(*index, outdim, external.data(), opt2);
+        estatus.run(external.data());
+        EXPECT_EQ(external, ref);
+    }
+}
+
+TEST_P(UmapTest, FastEngine) {
+    int outdim = 2;
+    umappp::Options opt;
+
+    std::vector<double> output(nobs * outdim);
+    auto status = umappp::initialize<int, double, umappp::Xoshiro256StarStar>(neighbors, outdim, output.data(), opt);
+    status.run(output.data());
+    EXPECT_EQ(status.epoch(), 500);
+    for (auto o : output){ 
+        EXPECT_FALSE(std::isnan(o));
+    }
+
+    // Differs from the default engine.
+    {
+        std::vector<double> ref(nobs * outdim);
+        auto ref_status = umappp::initialize(neighbors, outdim, ref.data(), opt);
+        ref_status.run(ref.data());
+        EXPECT_NE(ref, output);
+    }
+
+    // Same results after restarting.
+    {
+        std::vector<double> copy(nobs * outdim);
+        auto partial = umappp::initialize<int, double, umappp::Xoshiro256StarStar>(neighbors, outdim, copy.data(), opt);
+        partial.run(copy.data(), 123);
+        partial.run(copy.data());
+        EXPECT_EQ(copy, output);
+    }
+
+    // Same results with parallelization.
+    {
+        opt.num_threads_optimize = 2;
+        opt.optimize_spin_limit = 100;
+        std::vector<double> copy(nobs * outdim);
+        auto par = umappp::initialize<int, double, umappp::Xoshiro256StarStar>(neighbors, outdim, copy.data(), opt);
+        par.run(copy.data());
+        EXPECT_EQ(copy, output);
+    }
+}
+
+TEST_P(UmapTest, BufferedNegativeSamples) {
+    int outdim = 2;
+    std::vector<double> ref(nobs * outdim);
+    auto ref_status = umappp::initialize(neighbors, outdim, ref.data(), umappp::Options());
+    ref_status.run(ref.data());
+
+    umappp::Options opt;
+    opt.optimize_buffer_negative_samples = true;
+    std::vector<double> output(nobs * outdim);
+    auto status = umappp::initialize(neighbors, outdim, output.data(), opt);
+    status.run(output.data());
+    EXPECT_EQ(output, ref);
+
+    // Prefetching the neighbors doesn't change anything either.
+    opt.optimize_prefetch_distance = 16;
+    for (int buffered = 0; buffered < 2; ++buffered) {
+        opt.optimize_buffer_negative_samples = buffered;
+        std::vector<double> prefetched(nobs * outdim);
+        auto pstatus = umappp::initialize(neighbors, outdim, prefetched.data(), opt);
+        pstatus.run(prefetched.data());
+        EXPECT_EQ(prefetched, ref);
+    }
+}
+
+TEST_P(UmapTest, SinglePrecision) {
+    int outdim = 2;
+    umappp::Options opt;
+    opt.optimize_precision = umappp::OptimizePrecision::SINGLE;
+
+    std::vector<double> ref(nobs * outdim);
+    auto ref_status = umappp::initialize(neighbors, outdim, ref.data(), opt);
+    ref_status.run(ref.data());
+    for (auto r : ref) {
+        EXPECT_TRUE(std::isfinite(r));
+        EXPECT_EQ(r, static_cast<double>(static_cast<float>(r))); // all values are representable as floats.
+    }
+
+    // Interruptions don't change the result.
+    std::vector<double> output(nobs * outdim);
+    auto status = umappp::initialize(neighbors, outdim, output.data(), opt);
+    status.run(output.data(), 123);
+    EXPECT_EQ(status.epoch(), 123);
+    status.run(output.data());
+    EXPECT_EQ(output, ref);
+
+    // Same for parallelization.
+    opt.num_threads_optimize = 3;
+    opt.optimize_spin_limit = 100;
+    std::vector<double> par(nobs * outdim);
+    auto pstatus = umappp::initialize(neighbors, outdim, par.data(), opt);
+    pstatus.run(par.data());
+    EXPECT_EQ(par, ref);
+}
+
+TEST_P(UmapTest, HalfPrecision) {
+    int outdim = 2;
+    umappp::Options opt;
+    opt.optimize_precision = umappp::OptimizePrecision::SINGLE;
+    std::vector<double> single(nobs * outdim);
+    auto sstatus = umappp::initialize(neighbors, outdim, single.data(), opt);
+    sstatus.run(single.data());
+
+    opt.optimize_precision = umappp::OptimizePrecision::HALF;
+    std::vector<double> ref(nobs * outdim);
+    auto ref_status = umappp::initialize(neighbors, outdim, ref.data(), opt);
+    ref_status.run(ref.data());
+    for (auto r : ref) {
+        EXPECT_TRUE(std::isfinite(r));
+    }
+
+    // Error analysis: the neighborhoods in the half-precision embedding
+    // should be about as well preserved as those in single precision.
+    auto preservation = [&](const std::vector<double>& embedding) -> double {
+        std::size_t total = 0, found = 0;
+        std::vector<std::pair<double, int> > dist(nobs);
+        for (int i = 0; i < nobs; ++i) {
+            for (int j = 0; j < nobs; ++j) {
+                double d2 = 0;
+                for (int d = 0; d < outdim; ++d) {
+                    double delta = embedding[i * outdim + d] - embedding[j * outdim + d];
+                    d2 += delta * delta;
+                }
+                dist[j].first = d2;
+                dist[j].second = j;
+            }
+            dist[i].first = std::numeric_limits<double>::infinity();
+
+            const auto& expected = neighbors[i];
+            std::partial_sort(dist.begin(), dist.begin() + expected.size(), dist.end());
+            for (const auto& x : expected) {
+                for (std::size_t e = 0; e < expected.size(); ++e) {
+                    if (dist[e].second == x.first) {
+                        ++found;
+                        break;
+                    }
+                }
+            }
+            total += expected.size();
+        }
+        return static_cast<double>(found) / total;
+    };
+    EXPECT_GT(preservation(ref), preservation(single) * 0.9);
+
+    // Interruptions don't change the result.
+    std::vector<double> output(nobs * outdim);
+    auto status = umappp::initialize(neighbors, outdim, output.data(), opt);
+    status.run(output.data(), 234);
+    EXPECT_EQ(status.epoch(), 234);
+    status.run(output.data());
+    EXPECT_EQ(output, ref);
+
+    // Same for parallelization.
+    opt.num_threads_optimize = 3;
+    opt.optimize_spin_limit = 100;
+    std::vector<double> par(nobs * outdim);
+    auto pstatus = umappp::initialize(neighbors, outdim, par.data(), opt);
+    pstatus.run(par.data());
+    EXPECT_EQ(par, ref);
+}
+
+TEST_P(UmapTest, StopCondition) {
+    int outdim = 2;
+    std::vector<double> ref(nobs * outdim);
+    auto ref_status = umappp::initialize(neighbors, outdim, ref.data(), umappp::Options());
+    ref_status.run(ref.data());
+
+    std::vector<double> output(nobs * outdim);
+    auto status = umappp::initialize(neighbors, outdim, output.data(), umappp::Options());
+
+    // Cancellation stops the run immediately.
+    std::atomic<bool> cancel(true);
+    umappp::StopCondition stop;
+    stop.cancel = &cancel;
+    EXPECT_EQ(status.run(output.data(), stop), 0);
+    EXPECT_EQ(status.epoch(), 0);
+
+    // Same for an expired deadline.
+    umappp::StopCondition expired;
+    expired.deadline = std::chrono::steady_clock::now();
+    EXPECT_EQ(status.run(output.data(), 100, expired), 0);
+
+    // Otherwise, we run to the requested epoch and can continue afterwards.
+    cancel = false;
+    stop.deadline = std::chrono::steady_clock::now() + std::chrono::hours(1);
+    EXPECT_EQ(status.run(output.data(), 100, stop), 100);
+    EXPECT_EQ(status.run(output.data(), stop), 500);
+    EXPECT_EQ(output, ref);
+}
+
+TEST_P(UmapTest, Snapshot) {
+    int outdim = 2;
+    const int interval = 10;
+
+    const auto check = [&](const umappp::Options& opt) -> void {
+        // Collecting the reference embedding at each multiple of the interval.
+        std::vector<std::vector<double> > ref;
+        {
+            std::vector<double> current(nobs * outdim);
+            auto ref_status = umappp::initialize(neighbors, outdim, current.data(), opt);
+            ref.push_back(current);
+            for (int e = interval; e <= ref_status.num_epochs(); e += interval) {
+                ref_status.run(current.data(), e);
+                ref.push_back(current);
+            }
+        }
+
+        std::vector<double> output(nobs * outdim);
+        auto status = umappp::initialize(neighbors, outdim, output.data(), opt);
+        umappp::EmbeddingSnapshot<double> snapshot(nobs, outdim, interval);
+        std::vector<double> buffer(nobs * outdim, -1);
+        EXPECT_FALSE(snapshot.has_new());
+        EXPECT_EQ(snapshot.read(buffer.data()), -1);
+        EXPECT_EQ(buffer, std::vector<double>(nobs * outdim, -1));
+
+        // Reading snapshots while the optimization runs in another thread.
+        // Each snapshot should be identical to the reference at its epoch.
+        std::atomic<bool> finished(false);
+        int reached = 0;
+        std::thread worker([&]() -> void {
+            reached = status.run(output.data(), status.num_epochs(), umappp::StopCondition(), snapshot);
+            finished = true;
+        });
+
+        int last_epoch = -1;
+        while (!finished) {
+            const int epoch = snapshot.read(buffer.data());
+            if (epoch >= 0) {
+                EXPECT_EQ(epoch % interval, 0);
+                EXPECT_GE(epoch, last_epoch);
+                EXPECT_EQ(buffer, ref[epoch / interval]);
+                last_epoch = epoch;
+            }
+            std::this_thread::yield();
+        }
+        worker.join();
+
+        EXPECT_EQ(reached, 500);
+        EXPECT_EQ(output, ref.back());
+        EXPECT_EQ(snapshot.read(buffer.data()), 500);
+        EXPECT_EQ(buffer, output);
+        EXPECT_FALSE(snapshot.has_new());
+    };
+
+    umappp::Options opt;
+    check(opt);
+
+    {
+        auto opt2 = opt;
+        opt2.optimize_precision = umappp::OptimizePrecision::SINGLE;
+        check(opt2);
+    }
+
+    {
+        auto opt2 = opt;
+        opt2.num_threads_optimize = 3;
+        opt2.optimize_spin_limit = 100;
+        check(opt2);
+        opt2.optimize_scheduler = umappp::OptimizeScheduler::COLORING;
+        check(opt2);
+    }
+
+    // Cancellation publishes the embedding at the epoch that was reached.
+    {
+        std::vector<double> output(nobs * outdim);
+        auto status = umappp::initialize(neighbors, outdim, output.data(), opt);
+        umappp::EmbeddingSnapshot<double> snapshot(nobs, outdim, 7);
+        std::atomic<bool> cancel(false);
+        umappp::StopCondition stop;
+        stop.cancel = &cancel;
+
+        EXPECT_EQ(status.run(output.data(), 100, stop, snapshot), 100);
+        std::vector<double> buffer(nobs * outdim);
+        EXPECT_EQ(snapshot.read(buffer.data()), 100);
+        EXPECT_EQ(buffer, output);
+
+        cancel = true;
+        EXPECT_EQ(status.run(output.data(), 200, stop, snapshot), 100);
+        EXPECT_TRUE(snapshot.has_new());
+        EXPECT_EQ(snapshot.read(buffer.data()), 100);
+        EXPECT_EQ(buffer, output);
+    }
+}
+
+TEST_P(UmapTest, Observer) {
+    int outdim = 2;
+    const int interval = 50;
+
+    const auto check = [&](const umappp::Options& opt) -> void {
+        std::vector<std::vector<double> > ref;
+        {
+            std::vector<double> current(nobs * outdim);
+            auto ref_status = umappp::initialize(neighbors, outdim, current.data(), opt);
+            for (int e = interval; e <= ref_status.num_epochs(); e += interval) {
+                ref_status.run(current.data(), e);
+                ref.push_back(current);
+            }
+        }
+
+        std::vector<double> output(nobs * outdim);
+        auto status = umappp::initialize(neighbors, outdim, output.data(), opt);
+        std::vector<int> epochs;
+        std::vector<double> alphas;
+        std::vector<int> matched;
+
+        // Stopping halfway to check that the observer is called correctly after a restart.
+        for (int limit : { 250, 500 }) {
+            const int reached = status.run(output.data(), limit, umappp::StopCondition(), [&](const int epoch, const double alpha, const double* const embedding) -> void {
+                epochs.push_back(epoch);
+                alphas.push_back(alpha);
+                if (epoch > 0 && epoch % interval == 0) {
+                    EXPECT_EQ(std::vector<double>(embedding, embedding + nobs * outdim), ref[epoch / interval - 1]);
+                    matched.push_back(epoch);
+                }
+            });
+            EXPECT_EQ(reached, limit);
+            EXPECT_EQ(epochs.back(), limit); // final embedding is always observed.
+        }
+
+        EXPECT_EQ(output, ref.back());
+
+        // Epoch 250 is observed at the end of the first run and at the start of the second.
+        std::vector<int> expected_epochs;
+        for (int e = 0; e <= 250; ++e) {
+            expected_epochs.push_back(e);
+        }
+        for (int e = 250; e <= 500; ++e) {
+            expected_epochs.push_back(e);
+        }
+        EXPECT_EQ(epochs, expected_epochs);
+        EXPECT_EQ(matched, std::vector<int>({ 50, 100, 150, 200, 250, 250, 300, 350, 400, 450, 500 }));
+
+        ASSERT_EQ(alphas.size(), epochs.size());
+        for (std::size_t i = 0; i < epochs.size(); ++i) {
+            EXPECT_NEAR(alphas[i], opt.learning_rate * (1.0 - epochs[i] / 500.0), 1e-6); // not exact for single precision.
+        }
+
+        // When stopped early, the final epoch was already observed at its start, so it is not observed again.
+        std::vector<double> stopped(nobs * outdim);
+        auto stopped_status = umappp::initialize(neighbors, outdim, stopped.data(), opt);
+        std::atomic<bool> cancel(false);
+        umappp::StopCondition stop;
+        stop.cancel = &cancel;
+        epochs.clear();
+        const int reached = stopped_status.run(stopped.data(), 500, stop, [&](const int epoch, double, const double*) -> void {
+            epochs.push_back(epoch);
+            if (epoch == 100) {
+                cancel = true;
+            }
+        });
+        EXPECT_EQ(reached, 100);
+        ASSERT_EQ(epochs.size(), 101u);
+        EXPECT_EQ(epochs.back(), 100);
+        EXPECT_EQ(stopped, ref[1]);
+    };
+
+    umappp::Options opt;
+    check(opt);
+
+    {
+        auto opt2 = opt;
+        opt2.learning_rate = 0.5;
+        opt2.optimize_precision = umappp::OptimizePrecision::SINGLE;
+        check(opt2);
+    }
+
+    {
+        auto opt2 = opt;
+        opt2.optimize_method = umappp::OptimizeMethod::ADAM;
+        check(opt2);
+        opt2.optimize_method = umappp::OptimizeMethod::SGD;
+        opt2.optimize_repulsion = umappp::OptimizeRepulsion::BARNES_HUT;
+        check(opt2);
+    }
+
+    {
+        auto opt2 = opt;
+        opt2.num_threads_optimize = 3;
+        opt2.optimize_spin_limit = 100;
+        check(opt2);
+        opt2.optimize_scheduler = umappp::OptimizeScheduler::COLORING;
+        check(opt2);
+        opt2.optimize_scheduler = umappp::OptimizeScheduler::MINIBATCH;
+        check(opt2);
+    }
+}
+
+TEST_P(UmapTest, Stepwise) {
+    int outdim = 2;
+    std::vector<double> ref(nobs * outdim);
+    auto ref_status = umappp::initialize(neighbors, outdim, ref.data(), umappp::Options());
+    ref_status.run(ref.data());
+
+    std::vector<double> output(nobs * outdim);
+    auto status = umappp::initialize(neighbors, outdim, output.data(), umappp::Options());
+    const auto num_edges = status.get_epoch_data().graph->edge_targets.size();
+
+    // At least one epoch is always performed.
+    EXPECT_EQ(status.step(output.data(), 0), 1);
+    EXPECT_EQ(status.step(output.data(), num_edges - 1), 2);
+    EXPECT_EQ(status.step(output.data(), num_edges * 7 + 1), 9);
+
+    std::atomic<bool> cancel(true);
+    umappp::StopCondition stop;
+    stop.cancel = &cancel;
+    EXPECT_EQ(status.step(output.data(), num_edges * 10, stop), 9);
+
+    while (status.epoch() < status.num_epochs()) {
+        EXPECT_EQ(status.step(output.data(), num_edges * 13), std::min(status.epoch() + 13, status.num_epochs()));
+    }
+    EXPECT_EQ(status.step(output.data(), num_edges), status.num_epochs());
+    EXPECT_EQ(output, ref);
+}
+
+// Minimal thread pool to test the asynchronous interface.
+class TaskPool {
+public:
+    TaskPool(int num_threads) {
+        for (int t = 0; t < num_threads; ++t) {
+            my_threads.emplace_back([&]() -> void {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock lck(my_mut);
+                        my_cv.wait(lck, [&]() -> bool { return my_done || !my_tasks.empty(); });
+                        if (my_tasks.empty()) {
+                            return;
+                        }
+                        task = std::move(my_tasks.front());
+                        my_tasks.pop_front();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    ~TaskPool() {
+        {
+            std::lock_guard lck(my_mut);
+            my_done = true;
+        }
+        my_cv.notify_all();
+        for (auto& t : my_threads) {
+            t.join();
+        }
+    }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard lck(my_mut);
+            my_tasks.push_back(std::move(task));
+            ++my_submitted;
+        }
+        my_cv.notify_one();
+    }
+
+    int num_submitted() {
+        std::lock_guard lck(my_mut);
+        return my_submitted;
+    }
+
+private:
+    std::vector<std::thread> my_threads;
+    std::mutex my_mut;
+    std::condition_variable my_cv;
+    std::deque<std::function<void()> > my_tasks;
+    bool my_done = false;
+    int my_submitted = 0;
+};
+
+TEST_P(UmapTest, Async) {
+    int outdim = 2;
+    std::vector<double> ref(nobs * outdim);
+    auto ref_status = umappp::initialize(neighbors, outdim, ref.data(), umappp::Options());
+    ref_status.run(ref.data());
+    const auto num_edges = ref_status.get_epoch_data().graph->edge_targets.size();
+
+    // Multiplexing multiple jobs on a smaller number of threads.
+    TaskPool pool(2);
+    const int num_jobs = 4;
+    std::vector<std::vector<double> > outputs(num_jobs, std::vector<double>(nobs * outdim));
+    std::vector<umappp::Status<int, double> > statuses;
+    for (int j = 0; j < num_jobs; ++j) {
+        statuses.push_back(umappp::initialize(neighbors, outdim, outputs[j].data(), umappp::Options()));
+    }
+
+    std::vector<std::future<int> > futures;
+    for (int j = 0; j < num_jobs; ++j) {
+        futures.push_back(statuses[j].run_async(outputs[j].data(), num_edges * 50, [&](std::function<void()> task) -> void { pool.submit(std::move(task)); }));
+    }
+    for (int j = 0; j < num_jobs; ++j) {
+        EXPECT_EQ(futures[j].get(), 500);
+        EXPECT_EQ(outputs[j], ref);
+    }
+    EXPECT_EQ(pool.num_submitted(), num_jobs * 10);
+
+    // Cancellation stops the job at the next epoch.
+    {
+        std::vector<double> output(nobs * outdim);
+        auto status = umappp::initialize(neighbors, outdim, output.data(), umappp::Options());
+        std::atomic<bool> cancel(true);
+        umappp::StopCondition stop;
+        stop.cancel = &cancel;
+        auto submit = [&](std::function<void()> task) -> void { pool.submit(std::move(task)); };
+        EXPECT_EQ(status.run_async(output.data(), num_edges * 20, submit, stop).get(), 0);
+
+        cancel = false;
+        EXPECT_EQ(status.run_async(output.data(), num_edges * 20, submit, stop).get(), 500);
+        EXPECT_EQ(output, ref);
+    }
+
+    // Exceptions are propagated to the future.
+    {
+        std::vector<double> output(nobs * outdim);
+        auto status = umappp::initialize(neighbors, outdim, output.data(), umappp::Options());
+        int count = 0;
+        auto future = status.run_async(output.data(), num_edges * 100, [&](std::function<void()> task) -> void {
+            if (count++ > 0) {
+                throw std::runtime_error("no more tasks");
+            }
+            pool.submit(std::move(task));
+        });
+        EXPECT_ANY_THROW(future.get());
+        EXPECT_EQ(status.epoch(), 100);
+    }
+}
+
+TEST_P(UmapTest, AsyncSetup) {
+    int outdim = 2;
+    TaskPool pool(2);
+    auto submit = [&](std::function<void()> task) -> void { pool.submit(std::move(task)); };
+
+    const auto check = [&](const umappp::Options& opt) -> void {
+        std::vector<double> ref(nobs * outdim);
+        auto ref_status = umappp::initialize(neighbors, outdim, ref.data(), opt);
+        ref_status.run(ref.data());
+        const auto num_edges = ref_status.get_epoch_data().graph->edge_targets.size();
+
+        // Setup is retained across tasks, e.g., the working array for reduced precision and the worker threads.
+        std::vector<double> output(nobs * outdim);
+        auto status = umappp::initialize(neighbors, outdim, output.data(), opt);
+        EXPECT_EQ(status.run_async(output.data(), num_edges * 7, submit).get(), 500);
+        EXPECT_EQ(output, ref);
+
+        // Same for the individual steps, which always copy the working array back to the embedding.
+        std::vector<double> stepped(nobs * outdim);
+        auto step_status = umappp::initialize(neighbors, outdim, stepped.data(), opt);
+        std::vector<double> partial(nobs * outdim);
+        auto partial_status = umappp::initialize(neighbors, outdim, partial.data(), opt);
+        while (step_status.epoch() < step_status.num_epochs()) {
+            const int reached = step_status.step(stepped.data(), num_edges * 37);
+            partial_status.run(partial.data(), reached);
+            EXPECT_EQ(stepped, partial);
+        }
+        EXPECT_EQ(stepped, ref);
+
+        // The embedding is synchronized with the current epoch if a task fails.
+        std::vector<double> failed(nobs * outdim);
+        auto failed_status = umappp::initialize(neighbors, outdim, failed.data(), opt);
+        int count = 0;
+        auto future = failed_status.run_async(failed.data(), num_edges * 100, [&](std::function<void()> task) -> void {
+            if (count++ > 0) {
+                throw std::runtime_error("no more tasks");
+            }
+            pool.submit(std::move(task));
+        });
+        EXPECT_ANY_THROW(future.get());
+        EXPECT_EQ(failed_status.epoch(), 100);
+
+        std::vector<double> expected(nobs * outdim);
+        auto expected_status = umappp::initialize(neighbors, outdim, expected.data(), opt);
+        expected_status.run(expected.data(), 100);
+        EXPECT_EQ(failed, expected);
+    };
+
+    for (auto precision : { umappp::OptimizePrecision::SINGLE, umappp::OptimizePrecision::HALF }) {
+        umappp::Options opt;
+        opt.optimize_precision = precision;
+        check(opt);
+
+#ifndef UMAPPP_NO_PARALLEL_OPTIMIZATION
+        for (auto scheduler : { umappp::OptimizeScheduler::COLORING, umappp::OptimizeScheduler::MINIBATCH }) {
+            auto opt2 = opt;
+            opt2.optimize_scheduler = scheduler;
+            opt2.num_threads_optimize = 2;
+            opt2.optimize_spin_limit = 100;
+            check(opt2);
+        }
+#endif
+    }
+}
+
+TEST_P(UmapTest, EarlyStopping) {
+    int outdim = 2;
+    umappp::Options opt;
+    opt.early_stop_tolerance = 0.01;
+
+    std::vector<double> output(nobs * outdim);
+    auto status = umappp::initialize(neighbors, outdim, output.data(), opt);
+    EXPECT_FALSE(status.converged());
+    status.run(output.data());
+    EXPECT_TRUE(status.converged());
+    const int stopped = status.epoch();
+    EXPECT_GT(stopped, opt.early_stop_patience);
+    EXPECT_LT(stopped, status.num_epochs());
+
+    // Further calls have no effect.
+    auto copy = output;
+    status.run(output.data());
+    EXPECT_EQ(status.epoch(), stopped);
+    EXPECT_EQ(copy, output);
+
+    // Same as running to the stopping epoch without early stopping.
+    {
+        std::vector<double> ref(nobs * outdim);
+        auto ref_status = umappp::initialize(neighbors, outdim, ref.data(), umappp::Options());
+        ref_status.run(ref.data(), stopped);
+        EXPECT_EQ(ref, output);
+        EXPECT_FALSE(ref_status.converged());
+    }
+
+    // Same stopping epoch if the run is interrupted.
+    {
+        std::vector<double> partial(nobs * outdim);
+        auto partial_status = umappp::initialize(neighbors, outdim, partial.data(), opt);
+        partial_status.run(partial.data(), stopped / 2);
+        EXPECT_FALSE(partial_status.converged());
+
+        std::atomic<bool> cancel(true);
+        umappp::StopCondition stop;
+        stop.cancel = &cancel;
+        partial_status.run(partial.data(), stop);
+        EXPECT_EQ(partial_status.epoch(), stopped / 2);
+
+        partial_status.run(partial.data());
+        EXPECT_EQ(partial_status.epoch(), stopped);
+        EXPECT_EQ(partial, output);
+    }
+
+    // Same stopping epoch with parallelization.
+    {
+        opt.num_threads_optimize = 2;
+        opt.optimize_spin_limit = 100;
+        std::vector<double> par(nobs * outdim);
+        auto par_status = umappp::initialize(neighbors, outdim, par.data(), opt);
+        par_status.run(par.data());
+        EXPECT_EQ(par_status.epoch(), stopped);
+        EXPECT_EQ(par, output);
+    }
+}
+
 TEST(Umap, SinglePrecision) {
     int nobs = 87;
     int k = 5;
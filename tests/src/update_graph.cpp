@@ -0,0 +1,295 @@
+#include <gtest/gtest.h>
+
+#include "umappp/neighbor_similarities.hpp"
+#include "umappp/combine_neighbor_sets.hpp"
+#include "umappp/update_graph.hpp"
+#include "knncolle/knncolle.hpp"
+
+#include <vector>
+#include <random>
+#include <memory>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+class UpdateGraphTest : public ::testing::TestWithParam<std::tuple<int, int> > {
+protected:
+    void SetUp() {
+        auto p = GetParam();
+        nobs = std::get<0>(p);
+        k = std::get<1>(p);
+
+        std::mt19937_64 rng(nobs * k); // for some variety
+        std::normal_distribution<> dist(0, 1);
+
+        std::vector<double> data(nobs * ndim);
+        for (size_t r = 0; r < data.size(); ++r) {
+            data[r] = dist(rng);
+        }
+
+        // The existing observations only have neighbors among themselves,
+        // while the added observations can have any neighbor.
+        auto builder = knncolle::VptreeBuilder<int, double, double>(std::make_shared<knncolle::EuclideanDistance<double, double> >());
+        auto old_index = builder.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs - nadded, data.data()));
+        existing = knncolle::find_nearest_neighbors(*old_index, k);
+
+        auto full_index = builder.build_unique(knncolle::SimpleMatrix<int, double>(ndim, nobs, data.data()));
+        auto searcher = full_index->initialize();
+        std::vector<int> indices;
+        std::vector<double> distances;
+        added.resize(nadded);
+        for (int a = 0; a < nadded; ++a) {
+            searcher->search(nobs - nadded + a, k, &indices, &distances);
+            for (size_t x = 0; x < indices.size(); ++x) {
+                added[a].emplace_back(indices[x], distances[x]);
+            }
+        }
+    }
+
+    int nobs, k;
+    int ndim = 5;
+    int nadded = 10;
+    int num_epochs = 500;
+    umappp::NeighborList<int, double> existing, added;
+
+    // Accounting for the renumbering of the existing observations after removal.
+    umappp::NeighborList<int, double> renumber_added(const std::vector<int>& removed) const {
+        auto output = added;
+        for (auto& current : output) {
+            std::vector<std::pair<int, double> > kept;
+            for (const auto& nn : current) {
+                if (std::find(removed.begin(), removed.end(), nn.first) == removed.end()) {
+                    const int shift = std::count_if(removed.begin(), removed.end(), [&](int r) -> bool { return r < nn.first; });
+                    kept.emplace_back(nn.first - shift, nn.second);
+                }
+            }
+            current.swap(kept);
+        }
+        return output;
+    }
+
+    umappp::UpdatableGraph<int, double> create_store(const umappp::NeighborList<int, double>& neighbors) const {
+        umappp::UpdatableGraph<int, double> store;
+        store.neighbors = neighbors;
+        store.similarities.resize(neighbors.size());
+        std::vector<int> rows(neighbors.size());
+        std::iota(rows.begin(), rows.end(), 0);
+        umappp::fill_directed_similarities(store, rows, umappp::NeighborSimilaritiesOptions<double>());
+        umappp::fill_reverse_neighbors(store);
+
+        auto combined = create_combined(neighbors);
+        for (const auto& current : combined) {
+            for (const auto& nn : current) {
+                store.max_weight = std::max(store.max_weight, nn.second);
+            }
+        }
+        store.num_epochs = num_epochs;
+        return store;
+    }
+
+    static umappp::NeighborList<int, double> create_combined(umappp::NeighborList<int, double> neighbors) {
+        umappp::neighbor_similarities(neighbors, umappp::NeighborSimilaritiesOptions<double>());
+        umappp::combine_neighbor_sets(neighbors, 1.0);
+        return neighbors;
+    }
+
+    umappp::EpochData<int, double> create_epochs(const umappp::NeighborList<int, double>& neighbors) const {
+        auto graph = umappp::similarities_to_graph(create_combined(neighbors), num_epochs);
+        return umappp::create_epoch_data<int, double>(std::make_shared<const umappp::EpochGraph<int, double> >(std::move(graph)), num_epochs, 5.0);
+    }
+
+    static void compare_graphs(const umappp::EpochGraph<int, double>& observed, const umappp::EpochGraph<int, double>& expected) {
+        ASSERT_EQ(observed.cumulative_num_edges, expected.cumulative_num_edges);
+        EXPECT_EQ(observed.edge_targets, expected.edge_targets);
+        ASSERT_EQ(observed.epochs_per_sample.size(), expected.epochs_per_sample.size());
+        for (size_t j = 0; j < observed.epochs_per_sample.size(); ++j) {
+            EXPECT_DOUBLE_EQ(observed.epochs_per_sample[j], expected.epochs_per_sample[j]);
+        }
+    }
+};
+
+TEST_P(UpdateGraphTest, NoChange) {
+    auto store = create_store(existing);
+    auto epochs = create_epochs(existing);
+    const auto original = epochs.graph;
+    epochs.current_epoch = 100;
+
+    auto res = umappp::update_graph(store, epochs, std::vector<int>(), umappp::NeighborList<int, double>(), umappp::Options());
+    EXPECT_TRUE(res.touched.empty());
+    EXPECT_EQ(res.retained.size(), existing.size());
+    EXPECT_EQ(store.neighbors, existing);
+    compare_graphs(*(epochs.graph), *original);
+
+    auto ref = create_epochs(existing);
+    EXPECT_EQ(epochs.epoch_of_next_sample, ref.epoch_of_next_sample);
+    EXPECT_EQ(epochs.epoch_of_next_negative_sample, ref.epoch_of_next_negative_sample);
+}
+
+TEST_P(UpdateGraphTest, Added) {
+    auto store = create_store(existing);
+    auto epochs = create_epochs(existing);
+    auto res = umappp::update_graph(store, epochs, std::vector<int>(), added, umappp::Options());
+
+    auto expected = existing;
+    expected.insert(expected.end(), added.begin(), added.end());
+    auto ref = create_epochs(expected);
+    compare_graphs(*(epochs.graph), *(ref.graph));
+    EXPECT_EQ(epochs.epoch_of_next_sample, ref.epoch_of_next_sample);
+    EXPECT_EQ(epochs.epoch_of_next_negative_sample, ref.epoch_of_next_negative_sample);
+
+    // Only a small subset of observations is affected.
+    EXPECT_LT(res.touched.size(), static_cast<size_t>(nobs));
+    for (int a = 0; a < nadded; ++a) {
+        EXPECT_TRUE(std::binary_search(res.touched.begin(), res.touched.end(), nobs - nadded + a));
+    }
+
+    // Store is consistent with a fresh one.
+    auto ref_store = create_store(expected);
+    EXPECT_EQ(store.neighbors, ref_store.neighbors);
+    EXPECT_EQ(store.similarities, ref_store.similarities);
+    EXPECT_EQ(store.reverse, ref_store.reverse);
+}
+
+TEST_P(UpdateGraphTest, Removed) {
+    const int nexisting = existing.size();
+    std::vector<int> removed;
+    for (int r = 3; r < nexisting; r += 7) {
+        removed.push_back(r);
+    }
+
+    auto store = create_store(existing);
+    auto epochs = create_epochs(existing);
+    auto res = umappp::update_graph(store, epochs, removed, umappp::NeighborList<int, double>(), umappp::Options());
+    EXPECT_EQ(res.retained.size(), existing.size() - removed.size());
+
+    std::vector<int> new_index(nexisting, -1);
+    for (size_t n = 0; n < res.retained.size(); ++n) {
+        new_index[res.retained[n]] = n;
+    }
+    umappp::NeighborList<int, double> expected;
+    for (auto o : res.retained) {
+        expected.emplace_back();
+        for (const auto& nn : existing[o]) {
+            if (new_index[nn.first] >= 0) {
+                expected.back().emplace_back(new_index[nn.first], nn.second);
+            }
+        }
+    }
+
+    auto ref = create_epochs(expected);
+    compare_graphs(*(epochs.graph), *(ref.graph));
+    EXPECT_EQ(epochs.epoch_of_next_sample, ref.epoch_of_next_sample);
+
+    auto ref_store = create_store(expected);
+    EXPECT_EQ(store.neighbors, ref_store.neighbors);
+    EXPECT_EQ(store.similarities, ref_store.similarities);
+    EXPECT_EQ(store.reverse, ref_store.reverse);
+}
+
+TEST_P(UpdateGraphTest, Schedule) {
+    auto store = create_store(existing);
+    auto epochs = create_epochs(existing);
+    const auto& old_graph = *(epochs.graph);
+
+    // Mimicking some progress in the optimization.
+    const int current = 123;
+    epochs.current_epoch = current;
+    for (size_t j = 0; j < epochs.epoch_of_next_sample.size(); ++j) {
+        epochs.epoch_of_next_sample[j] += 1000 + j;
+    }
+    auto old_schedule = epochs.epoch_of_next_sample;
+    auto old_starts = old_graph.cumulative_num_edges;
+
+    std::vector<int> removed{ 0, 10 };
+    auto res = umappp::update_graph(store, epochs, removed, renumber_added(removed), umappp::Options());
+    const auto& graph = *(epochs.graph);
+
+    const int nretained = res.retained.size();
+    std::vector<unsigned char> touched(graph.cumulative_num_edges.size() - 1);
+    for (auto t : res.touched) {
+        touched[t] = 1;
+    }
+
+    for (int i = 0; i < nretained; ++i) {
+        if (touched[i]) {
+            continue;
+        }
+        const auto o = res.retained[i];
+        ASSERT_EQ(graph.cumulative_num_edges[i + 1] - graph.cumulative_num_edges[i], old_starts[o + 1] - old_starts[o]);
+        for (size_t j = graph.cumulative_num_edges[i], oj = old_starts[o]; j < graph.cumulative_num_edges[i + 1]; ++j, ++oj) {
+            EXPECT_EQ(epochs.epoch_of_next_sample[j], old_schedule[oj]);
+        }
+    }
+
+    // New edges are scheduled after the current epoch.
+    for (int i = nretained; i < static_cast<int>(graph.cumulative_num_edges.size()) - 1; ++i) {
+        for (size_t j = graph.cumulative_num_edges[i]; j < graph.cumulative_num_edges[i + 1]; ++j) {
+            EXPECT_GE(epochs.epoch_of_next_sample[j], current);
+            EXPECT_LT(epochs.epoch_of_next_sample[j], current + graph.epochs_per_sample[j] + 1);
+        }
+    }
+}
+
+TEST_P(UpdateGraphTest, Coloring) {
+    auto store = create_store(existing);
+    auto epochs = create_epochs(existing);
+    umappp::Options opt;
+    opt.optimize_scheduler = umappp::OptimizeScheduler::COLORING;
+    std::vector<int> removed{ 5 };
+    umappp::update_graph(store, epochs, removed, renumber_added(removed), opt);
+    const auto& graph = *(epochs.graph);
+    EXPECT_EQ(graph.batch_observations.size(), graph.cumulative_num_edges.size() - 1);
+}
+
+TEST_P(UpdateGraphTest, Errors) {
+    auto store = create_store(existing);
+    auto epochs = create_epochs(existing);
+
+    auto expect_error = [&](const std::vector<int>& removed, const umappp::NeighborList<int, double>& extra, const std::string& msg) -> void {
+        auto store_copy = store;
+        auto epochs_copy = epochs;
+        try {
+            umappp::update_graph(store_copy, epochs_copy, removed, extra, umappp::Options());
+            FAIL() << "expected an error";
+        } catch (std::exception& e) {
+            EXPECT_TRUE(std::string(e.what()).find(msg) != std::string::npos);
+        }
+    };
+
+    expect_error(std::vector<int>{ nobs }, umappp::NeighborList<int, double>(), "less than");
+    expect_error(std::vector<int>{ -1 }, umappp::NeighborList<int, double>(), "less than");
+    expect_error(std::vector<int>{ 1, 1 }, umappp::NeighborList<int, double>(), "unique");
+
+    umappp::NeighborList<int, double> bad(1);
+    bad[0].emplace_back(nobs, 1.0);
+    expect_error(std::vector<int>(), bad, "updated number");
+}
+
+TEST(UpdateGraph, Place) {
+    umappp::UpdatableGraph<int, double> store;
+    store.neighbors.resize(5);
+    store.similarities.resize(5);
+    store.neighbors[3] = std::vector<std::pair<int, double> >{ { 0, 0 }, { 2, 0 } };
+    store.similarities[3] = std::vector<double>{ 1, 0.5 };
+    store.neighbors[4] = std::vector<std::pair<int, double> >{ { 4, 0 } }; // no placed neighbors.
+    store.similarities[4] = std::vector<double>{ 1 };
+
+    std::vector<double> embedding{ 0, 0, 3, 0, 0, 6, -1, -1, -1, -1 };
+    umappp::RngEngine rng(42);
+    umappp::place_added_observations(store, 2, embedding.data(), 3, rng);
+    EXPECT_NEAR(embedding[6], 0, 0.1);
+    EXPECT_NEAR(embedding[7], 2, 0.1);
+    EXPECT_NEAR(embedding[8], 1, 0.1);
+    EXPECT_NEAR(embedding[9], 2, 0.1);
+    EXPECT_NE(embedding[8], 1); // jittered.
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    UpdateGraph,
+    UpdateGraphTest,
+    ::testing::Combine(
+        ::testing::Values(200, 500), // number of observations
+        ::testing::Values(5, 10, 15) // number of neighbors
+    )
+);
@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include "umappp/worker_pool.hpp"
+
+#include <vector>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+TEST(WorkerPool, Basic) {
+    umappp::WorkerPool pool;
+    EXPECT_EQ(pool.num_workers(), 0u);
+
+    // Serial runs don't create any workers.
+    std::vector<int> called(4);
+    pool.run(1, [&](const int t) -> void { ++called[t]; });
+    EXPECT_EQ(pool.num_workers(), 0u);
+    EXPECT_EQ(pool.memory_usage(), 0u);
+    EXPECT_EQ(called, std::vector<int>({ 1, 0, 0, 0 }));
+
+    pool.run(3, [&](const int t) -> void { ++called[t]; });
+    EXPECT_EQ(pool.num_workers(), 2u);
+    EXPECT_GT(pool.memory_usage(), 0u);
+    EXPECT_EQ(called, std::vector<int>({ 2, 1, 1, 0 }));
+
+    // Workers are re-used, and only the missing ones are created.
+    std::vector<std::thread::id> ids(4);
+    pool.run(2, [&](const int t) -> void { ids[t] = std::this_thread::get_id(); });
+    EXPECT_EQ(pool.num_workers(), 2u);
+    pool.run(4, [&](const int t) -> void { ++called[t]; });
+    EXPECT_EQ(pool.num_workers(), 3u);
+    EXPECT_EQ(called, std::vector<int>({ 3, 2, 2, 1 }));
+
+    std::vector<std::thread::id> ids2(4);
+    pool.run(2, [&](const int t) -> void { ids2[t] = std::this_thread::get_id(); });
+    EXPECT_EQ(ids[0], std::this_thread::get_id());
+    EXPECT_NE(ids[1], std::this_thread::get_id());
+    EXPECT_EQ(ids[1], ids2[1]);
+}
+
+TEST(WorkerPool, Exception) {
+    umappp::WorkerPool pool;
+    std::atomic<int> finished = 0;
+    EXPECT_ANY_THROW({
+        pool.run(3, [&](const int t) -> void {
+            if (t == 0) {
+                throw std::runtime_error("oops");
+            }
+            ++finished;
+        });
+    });
+
+    // All workers have finished by the time the exception propagates.
+    EXPECT_EQ(finished, 2);
+
+    // Pool is still usable afterwards.
+    pool.run(3, [&](const int) -> void { ++finished; });
+    EXPECT_EQ(finished, 5);
+}
+
+TEST(WorkerPool, Copy) {
+    umappp::WorkerPool pool;
+    pool.run(2, [&](const int) -> void {});
+    EXPECT_EQ(pool.num_workers(), 1u);
+
+    umappp::WorkerPool copy(pool);
+    EXPECT_EQ(copy.num_workers(), 0u);
+
+    umappp::WorkerPool moved(std::move(pool));
+    EXPECT_EQ(moved.num_workers(), 1u);
+    int total = 0;
+    moved.run(2, [&](const int t) -> void {
+        if (t == 1) {
+            total = 1;
+        }
+    });
+    EXPECT_EQ(total, 1);
+}